@@ -32,12 +32,37 @@ SOURCES += \
     src/skybox.cpp \
     src/object.cpp \
     src/material.cpp \
+    src/materialtable.cpp \
     src/texture.cpp \
+    src/texturearrays.cpp \
+    src/textureatlas.cpp \
+    src/compressedtextureloader.cpp \
+    src/texturebaker.cpp \
     src/vehicle.cpp \
     src/line.cpp \
     src/frame.cpp \ 
+    src/linebatch.cpp \
+    src/meshcache.cpp \
+    src/geometryheap.cpp \
+    src/gltfloader.cpp \
+    src/objloader.cpp \
+    src/meshoptimizer.cpp \
+    src/meshsimplifier.cpp \
+    src/passuniforms.cpp \
+    src/shaderregistry.cpp \
+    src/impostor.cpp \
+    src/indirectrenderer.cpp \
+    src/renderqueue.cpp \
+    src/openglfunctions.cpp \
+    src/tangentgenerator.cpp \
+    src/vertexformat.cpp \
     src/videorecorder.cpp
 
+# Bake the images of the assets with "make bake" (see TextureBaker)
+bake.commands = cd $$PWD && $$OUT_PWD/$$TARGET --bake-textures --compress
+bake.depends = $(TARGET)
+QMAKE_EXTRA_TARGETS += bake
+
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
@@ -62,10 +87,30 @@ HEADERS += \
     include/skybox.h \
     include/object.h \
     include/material.h \
+    include/materialtable.h \
     include/texture.h \
+    include/texturearrays.h \
+    include/textureatlas.h \
+    include/compressedtextureloader.h \
+    include/texturebaker.h \
     include/vehicle.h \
     include/line.h \
     include/frame.h \
+    include/linebatch.h \
+    include/meshcache.h \
+    include/geometryheap.h \
+    include/gltfloader.h \
+    include/objloader.h \
+    include/meshoptimizer.h \
+    include/meshsimplifier.h \
+    include/passuniforms.h \
+    include/shaderregistry.h \
+    include/impostor.h \
+    include/indirectrenderer.h \
+    include/renderqueue.h \
+    include/openglfunctions.h \
+    include/tangentgenerator.h \
+    include/vertexformat.h \
     include/constants.h \
     include/videorecorder.h
 
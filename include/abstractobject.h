@@ -38,10 +38,12 @@ public:
     
     /**
      * @brief Draw the object when computing the framebuffer for shadow mapping.
-     * @param lightSpace The view and projection matrix of the light (used for 
-     * shadow mapping).
+     * @param lightSpace The view and projection matrices of the light (used 
+     * for shadow mapping), one per cascade.
      */
-    virtual void renderShadow(const QMatrix4x4 & lightSpace) = 0;
+    virtual void renderShadow(
+        const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace
+    ) = 0;
     
     /**
      * @brief Clean up the object.
@@ -89,6 +91,15 @@ public:
      */
     static ABCObject * getObject(QString name);
     
+    /**
+     * @brief Remove an object from the manager and delete it.
+     * @remark The object must not be used anymore after calling this function.
+     * Its OpenGL resources are released, which requires a current context if
+     * the object has been initialized.
+     * @param object The object to delete.
+     */
+    static void unloadObject(const ABCObject * object);
+    
     /**
      * @brief Initialize all the objects.
      */
@@ -0,0 +1,121 @@
+#ifndef COMPRESSEDTEXTURELOADER_H
+#define COMPRESSEDTEXTURELOADER_H
+
+#include <QByteArray>
+#include <QOpenGLFunctions_4_5_Core>
+#include <QString>
+#include <vector>
+
+/// Compressed texture loader
+/**
+ * @brief Load the block-compressed images of DDS (.dds) and KTX2 (.ktx2)
+ * files with their mipmaps, so they are uploaded to OpenGL without being
+ * decoded.
+ * @author Louis Filipozzi
+ * @details The supported formats are BC1 (DXT1), BC2 (DXT3), BC3 (DXT5), BC4
+ * (single channel), BC5 (two channels) and BC7. The DDS files are read with
+ * their FourCC or their DX10 header, the KTX2 files with their Vulkan format.
+ * The KTX2 files can also store uncompressed RGBA8 and R8 images, like the
+ * files written by TextureBaker.
+ * The mipmaps stored in the file are used as they are, so the chain may stop
+ * before the 1x1 level.
+ *
+ * Both formats store the top row first while OpenGL expects the bottom row
+ * first. The BC1 to BC5 images are flipped by swapping the rows of blocks and
+ * the rows of pixels inside each block, which does not change the compressed
+ * data. The BC7 images cannot be flipped without being decoded: they are
+ * returned as they are stored and marked as top-down, the textures flip
+ * their texture coordinates instead (see MaterialTable). The KTX2 files
+ * whose KTXorientation is "ru" (e.g. written by
+ * toktx --lower_left_maps_to_s0t0 or by TextureBaker) already store the
+ * bottom row first and are not flipped.
+ * @remark The sRGB formats are loaded as their linear counterpart, like the
+ * decoded images. The cube maps, volumes, arrays and the supercompressed KTX2
+ * files are not supported.
+ */
+class CompressedTextureLoader {
+public:
+    /**
+     * @brief Image and its mipmaps as stored in the file.
+     */
+    struct Image {
+        GLenum format = 0; ///< Internal format, compressed or not.
+        GLsizei width = 0;
+        GLsizei height = 0;
+        std::vector<QByteArray> levels; ///< Mipmaps, from the largest.
+        bool isTopDown = false; ///< Stored top row first (not flippable).
+
+        bool isNull() const {return levels.empty();};
+    };
+
+    /**
+     * @brief Check if the file of a texture is a DDS or a KTX2 file.
+     */
+    static bool isCompressedFile(const QString & path);
+
+    /**
+     * @brief Load a DDS or a KTX2 file.
+     * @param[in] path The path to the file.
+     * @param[out] image The image, null if the file is not valid or uses an
+     * unsupported format.
+     * @return True if the image has been loaded successfully.
+     */
+    static bool load(const QString & path, Image & image);
+
+    /**
+     * @brief Return the size of a level of an image, without padding between
+     * the rows.
+     * @param format The internal format.
+     * @param width The width of the level.
+     * @param height The height of the level.
+     * @return The size in bytes, 0 if the format is not supported.
+     */
+    static GLsizei levelSize(GLenum format, GLsizei width, GLsizei height);
+
+private:
+    CompressedTextureLoader() {};
+
+    /**
+     * @brief Read the header of a DDS file and copy its levels.
+     */
+    static bool loadDds(const QByteArray & data, Image & image);
+
+    /**
+     * @brief Read the header of a KTX2 file and copy its levels.
+     * @param[in] data The content of the file.
+     * @param[out] image The image.
+     * @param[out] isBottomUp True if the bottom row is stored first.
+     */
+    static bool loadKtx2(const QByteArray & data, Image & image,
+                         bool & isBottomUp);
+
+    /**
+     * @brief Return the internal format of a DXGI format, 0 if not supported.
+     */
+    static GLenum dxgiFormat(quint32 format);
+
+    /**
+     * @brief Return the internal format of a Vulkan format, 0 if not
+     * supported.
+     */
+    static GLenum vulkanFormat(quint32 format);
+
+    /**
+     * @brief Flip a level vertically.
+     * @return False if the format cannot be flipped.
+     */
+    static bool flipLevel(GLenum format, GLsizei width, GLsizei height,
+                          QByteArray & level);
+
+    /**
+     * @brief Reverse the first rows of pixels of a part of a block, the rows
+     * being consecutive little-endian bit fields.
+     * @param data The first byte of the part.
+     * @param size The size of the part in bytes (at most 8).
+     * @param rowBits The number of bits of a row.
+     * @param rows The number of rows to reverse.
+     */
+    static void flipRows(uchar * data, int size, int rowBits, int rows);
+};
+
+#endif // COMPRESSEDTEXTURELOADER_H
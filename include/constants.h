@@ -12,8 +12,16 @@ static constexpr unsigned int COLOR_TEXTURE_UNIT  = 0;
 static constexpr unsigned int NORMAL_TEXTURE_UNIT = 1;
 static constexpr unsigned int BUMP_TEXTURE_UNIT   = 2;
 static constexpr unsigned int SKYBOX_TEXTURE_UNIT = 3;
-static constexpr unsigned int SHADOW_TEXTURE_UNITS[] = {4, 5, 6};
+static constexpr unsigned int SHADOW_TEXTURE_UNIT = 4;
+static constexpr unsigned int IMPOSTOR_TEXTURE_UNIT = 7;
 
-static constexpr unsigned int NUM_CASCADES = (sizeof(SHADOW_TEXTURE_UNITS)/sizeof(*SHADOW_TEXTURE_UNITS));
+// Cascades of the shadow map, stored as the layers of a texture array
+static constexpr unsigned int NUM_CASCADES = 3;
+
+// Levels of detail (LOD) generated for each mesh, including the full mesh
+static constexpr unsigned int NUM_LODS = 4;
+// Projected radius of the bounding sphere (normalized device coordinates) 
+// below which the next LOD is used
+static constexpr float LOD_SCREEN_SIZE[NUM_LODS-1] = {0.25f, 0.1f, 0.04f};
 
 #endif // CONSTANTS_H
@@ -2,14 +2,15 @@
 #define DEPTHMAP_H
 
 #include <QOpenGLFunctions_4_5_Core>
-#include <array>
 #include "constants.h"
 
 /// Depth map
 /**
  * @brief Create a framebuffer object (FBO) for cascades shadow mapping.
- * @details Only one FBO is created and NUM_CASCADES textures are generated from
- * this unique FBO.
+ * @details The depth of the cascades is stored in the NUM_CASCADES layers of a
+ * GL_TEXTURE_2D_ARRAY texture, attached as a whole to the FBO. The cascades
+ * are therefore rendered in a single pass, each primitive being sent to the
+ * layer of its cascade by the shadow shaders (see ObjectShadowShader).
  * @author Louis Filipozzi
  */
 class DepthMap {
@@ -30,11 +31,10 @@ public:
     
     /**
      * @brief Switches rendering from the default, windowing system provided 
-     * framebuffer to this framebuffer object. Returns true upon success, 
-     * false otherwise.
-     * @param cascadeIdx The cascade index.
+     * framebuffer to this framebuffer object and clear the depth of all the 
+     * cascades.
      */
-    void bind(const unsigned int cacadeIdx);
+    void bind();
     
     /**
      * @brief Switches rendering back to the default windowing system. This also
@@ -43,10 +43,11 @@ public:
     void release();
     
     /**
-     * @brief Bind the shadow map to supplied texture unit.
-     * @param unit Array texture unit to bind each shadow map texture.
+     * @brief Bind the texture array of the shadow map to supplied texture 
+     * unit.
+     * @param unit The texture unit.
      */
-    void bindTexture(const unsigned int unit[NUM_CASCADES]);
+    void bindTexture(const unsigned int unit);
     
     /**
      * @brief Returns the id of the underlying OpenGL framebuffer objects.
@@ -54,14 +55,10 @@ public:
     unsigned int objectId() const {return m_FBOId;};
     
     /**
-     * @brief Returns the texture ID of the attached texture of each cascade.
+     * @brief Returns the texture ID of the attached texture array, one layer
+     * per cascade.
      */
-    std::array<unsigned int,NUM_CASCADES> texture() const {
-        std::array<unsigned int,NUM_CASCADES> id;
-        for (unsigned int i = 0; i < NUM_CASCADES; i++)
-            id[i] = m_textureId[i];
-        return id;
-    };
+    unsigned int texture() const {return m_textureId;};
     
     /**
      * @brief Returns the size of the underlying framebuffer object in a pair
@@ -92,9 +89,9 @@ private:
     unsigned int m_FBOId;
     
     /**
-     * Texture ID storing the framebuffer depth buffer.
+     * Texture array ID storing the framebuffer depth buffer of each cascade.
      */
-    unsigned int m_textureId[NUM_CASCADES];
+    unsigned int m_textureId;
 };
 
 
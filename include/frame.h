@@ -1,7 +1,7 @@
 #ifndef FRAME_H
 #define FRAME_H
 
-#include "line.h"
+#include "linebatch.h"
 
 // 3D frame
 /**
@@ -10,49 +10,30 @@
  */
 class Frame {
 public:
-    Frame(QVector3D origin);
+    Frame(QVector3D origin) : m_origin(origin) {};
     ~Frame() {};
-    
-    /**
-     * @brief Initialize the object.
-     */
-    void initialize();
 
     /**
-     * @brief Update the animation.
+     * @brief Add the three axes of the frame to the batch of lines.
+     * @param lines The batch of lines rendered at the end of the frame.
      */
-    void render(
-        const CasterLight & light, const QMatrix4x4 & view,
-        const QMatrix4x4 & projection, 
-        const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace,
-        const std::array<float,NUM_CASCADES+1> & cascades
-    );
-
-    /**
-     * @brief Cleanup the animation.
-     */
-    void cleanup();
+    void render(LineBatch & lines) const;
     
     /**
      * @brief Set the model matrix.
      */
-    void setModelMatrix(QMatrix4x4 const model);
+    void setModelMatrix(QMatrix4x4 const model) {m_model = model;};
     
 private:
     /**
-     * The x axis.
-     */
-    Line X_AXIS;
-    
-    /**
-     * The y axis.
+     * The origin of the frame.
      */
-    Line Y_AXIS;
+    QVector3D m_origin;
     
     /**
-     * The z axis.
+     * The model matrix of the frame.
      */
-    Line Z_AXIS;
+    QMatrix4x4 m_model;
 };
 
 #endif // FRAME_H
@@ -0,0 +1,156 @@
+#ifndef GEOMETRYHEAP_H
+#define GEOMETRYHEAP_H
+
+#include <QByteArray>
+#include <QOpenGLFunctions_4_5_Core>
+#include <array>
+#include <list>
+#include <map>
+#include <memory>
+
+/// Geometry heap
+/**
+ * @brief Store the vertex and index data of all the objects in a few large
+ * buffers shared by the objects.
+ * @author Louis Filipozzi
+ * @details There is one heap per vertex format (see VertexFormat): a vertex
+ * buffer, an index buffer and the Vertex Array Object (VAO) reading them.
+ * Each object allocates a range of both buffers and draws its meshes with
+ * glDrawElementsBaseVertex(), the base vertex and the index offset being
+ * given by its allocation. Drawing the objects of a vertex format therefore
+ * does not require any VAO or buffer switch.
+ *
+ * The free ranges of each buffer are kept in a free-list, sorted by offset
+ * and merged with their neighbors when released. When no free range is large
+ * enough, the buffer is reallocated with a larger capacity and its content is
+ * copied on the GPU. defragment() packs the allocations at the beginning of
+ * the buffers and releases the free ranges, it is called once the objects of
+ * the scene are initialized.
+ * @remark The allocations are updated in place when the data is moved, so
+ * the pointers returned by allocate() stay valid until the range is
+ * released.
+ */
+class GeometryHeap {
+public:
+    /**
+     * @brief Range of the heap allocated to an object.
+     */
+    struct Allocation {
+        bool halfTextureUV;    ///< Vertex format of the data.
+        GLint firstVertex;     ///< Index of the first vertex of the range.
+        GLsizeiptr vertexSize; ///< Size of the vertex data (bytes).
+        GLintptr indexOffset;  ///< Offset of the index data (bytes).
+        GLsizeiptr indexSize;  ///< Size of the index data (bytes).
+    };
+
+    /**
+     * @brief Allocate a range of the heap and copy data to it.
+     * @param halfTextureUV The vertex format of the data.
+     * @param vertexData The interleaved vertex data.
+     * @param indexData The index data, relative to the first vertex of the
+     * range.
+     * @return The allocation, or nullptr if there is no current OpenGL
+     * context.
+     */
+    static const Allocation * allocate(bool halfTextureUV,
+                                       const QByteArray & vertexData,
+                                       const QByteArray & indexData);
+
+    /**
+     * @brief Release a range of the heap.
+     * @remark The allocation must not be used anymore after calling this
+     * function.
+     */
+    static void release(const Allocation * allocation);
+
+    /**
+     * @brief Bind the VAO of a vertex format.
+     * @param gl The OpenGL functions of the current context.
+     * @param halfTextureUV The vertex format.
+     */
+    static void bind(QOpenGLFunctions_4_5_Core * gl, bool halfTextureUV);
+
+    /**
+     * @brief Unbind the VAO.
+     * @param gl The OpenGL functions of the current context.
+     */
+    static void unbind(QOpenGLFunctions_4_5_Core * gl);
+
+    /**
+     * @brief Move the allocations to the beginning of the buffers and shrink
+     * the buffers to the allocated size.
+     * @remark The heaps without free range are left untouched. The objects
+     * read their allocation when drawing, so they follow the move.
+     */
+    static void defragment();
+
+    /**
+     * @brief Properly deallocate all buffers and allocations.
+     */
+    static void cleanUp();
+
+private:
+    GeometryHeap() {};
+
+    /**
+     * @brief Buffer sub-allocated with a free-list.
+     */
+    struct Arena {
+        GLuint buffer = 0;
+        GLsizeiptr capacity = 0;
+        std::map<GLintptr, GLsizeiptr> freeRanges; ///< Offset and size.
+    };
+
+    /**
+     * @brief Buffers and VAO of a vertex format.
+     */
+    struct Heap {
+        GLuint vao = 0;
+        Arena vertices;
+        Arena indices;
+        std::list<std::unique_ptr<Allocation>> allocations;
+    };
+
+    /**
+     * @brief Create the VAO of a heap and set its attributes.
+     */
+    static void createVao(QOpenGLFunctions_4_5_Core * gl, Heap & heap,
+                          bool halfTextureUV);
+
+    /**
+     * @brief Allocate a range of an arena, the arena grows if needed.
+     * @param size The size of the range (bytes).
+     * @param alignment The alignment of the offset of the range (bytes).
+     * @return The offset of the range.
+     */
+    static GLintptr allocateRange(QOpenGLFunctions_4_5_Core * gl,
+                                  Arena & arena, GLsizeiptr size,
+                                  GLsizeiptr alignment);
+
+    /**
+     * @brief Return a range to the free-list of an arena.
+     */
+    static void releaseRange(Arena & arena, GLintptr offset, GLsizeiptr size);
+
+    /**
+     * @brief Reallocate the buffer of an arena and copy its content.
+     * @param capacity The new capacity, at least the size of the content.
+     * @param size The size of the content, copied at the beginning.
+     */
+    static void resize(QOpenGLFunctions_4_5_Core * gl, Arena & arena,
+                       GLsizeiptr capacity, GLsizeiptr size);
+
+    /**
+     * @brief Attach the buffers of a heap to its VAO.
+     */
+    static void attachBuffers(QOpenGLFunctions_4_5_Core * gl, Heap & heap,
+                              bool halfTextureUV);
+
+    /**
+     * Heaps of the vertex formats, indexed by the half float texture
+     * coordinates flag.
+     */
+    static std::array<Heap,2> m_heaps;
+};
+
+#endif // GEOMETRYHEAP_H
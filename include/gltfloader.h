@@ -0,0 +1,171 @@
+#ifndef GLTFLOADER_H
+#define GLTFLOADER_H
+
+#include "meshcache.h"
+#include <QByteArray>
+#include <QImage>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+#include <vector>
+
+/// glTF 2.0 loader
+/**
+ * @brief Load glTF 2.0 models, binary (.glb) or JSON (.gltf), directly into
+ * the processed model used by the object loader.
+ * @author Louis Filipozzi
+ * @details The binary chunk of a GLB file is memory-mapped and used in place.
+ * The accessors are copied into the vertex streams in bulk: a tightly packed
+ * float accessor is a single memcpy, the other layouts (interleaved,
+ * normalized integers) are converted while copying. Each primitive becomes a
+ * mesh and the node tree is kept, the root node holding the nodes of the
+ * scene.
+ *
+ * The metallic-roughness materials are mapped onto the Phong model of
+ * Material: the base color gives the diffuse and ambient colors, the metallic
+ * factor the specular color and the roughness the shininess. The textures
+ * embedded in the file are referenced as "<file>#<image index>" and decoded
+ * with loadEmbeddedImage().
+ * @remark The texture coordinates are flipped vertically (glTF uses a top-left
+ * origin) and the missing tangents are computed with TangentGenerator. Sparse
+ * accessors, morph targets and skins are not supported.
+ */
+class GltfLoader {
+public:
+    /**
+     * @brief Load a glTF model.
+     * @param[in] filePath The path to the .glb or .gltf file.
+     * @param[out] entry The processed model, without levels of detail.
+     * @return True if the file has been loaded successfully.
+     */
+    static bool load(const QString & filePath, MeshCache::Entry & entry);
+
+    /**
+     * @brief Check if a texture path references an image embedded in a glTF
+     * file.
+     */
+    static bool isEmbeddedImage(const QString & path);
+
+    /**
+     * @brief Decode an image embedded in a glTF file.
+     * @param path The reference "<file>#<image index>".
+     * @return The image, null if it cannot be decoded.
+     */
+    static QImage loadEmbeddedImage(const QString & path);
+
+private:
+    GltfLoader() {};
+
+    /**
+     * @brief The JSON document and the content of its buffers.
+     */
+    struct Document {
+        QString filePath;
+        QJsonObject json;
+        std::vector<QByteArray> buffers;
+    };
+
+    /**
+     * @brief Read the JSON document and the buffers of a file.
+     * @param[in] filePath The path to the file.
+     * @param[in] data The content of the file.
+     * @param[out] document The document.
+     * @return True if the document is valid.
+     */
+    static bool parse(const QString & filePath, const QByteArray & data,
+                      Document & document);
+
+    /**
+     * @brief Split the content of a file into its JSON document and, for a
+     * GLB file, its binary chunk.
+     * @param[in] filePath The path to the file.
+     * @param[in] data The content of the file.
+     * @param[out] json The JSON document, pointing into the data.
+     * @param[out] binary The binary chunk, pointing into the data, or null.
+     * @return False if the GLB version is not supported.
+     */
+    static bool split(const QString & filePath, const QByteArray & data,
+                      QByteArray & json, QByteArray & binary);
+
+    /**
+     * @brief Parse the JSON document of a file, without its buffers.
+     * @return True if the document is valid.
+     */
+    static bool parseJson(const QString & filePath, const QByteArray & json,
+                          Document & document);
+
+    /**
+     * @brief Load the content of a buffer of a document.
+     * @param document The document.
+     * @param index The index of the buffer.
+     * @param binary The binary chunk of the file.
+     */
+    static QByteArray loadBuffer(const Document & document, int index,
+                                 const QByteArray & binary);
+
+    /**
+     * @brief Return the data of a buffer view, or an empty array if it is not
+     * valid.
+     * @param[out] stride The stride of the view, 0 if not specified.
+     */
+    static QByteArray bufferView(const Document & document, int index,
+                                 int & stride);
+
+    /**
+     * @brief Append the elements of an accessor to a float stream.
+     * @param document The document.
+     * @param index The index of the accessor.
+     * @param components The number of components of the elements.
+     * @param[out] stream The stream.
+     * @return The number of elements, -1 if the accessor is not valid.
+     */
+    static int readAccessor(const Document & document, int index,
+                            int components, QVector<float> & stream);
+
+    /**
+     * @brief Read the elements of an index accessor.
+     * @return False if the accessor is not valid.
+     */
+    static bool readIndices(const Document & document, int index,
+                            std::vector<unsigned int> & indices);
+
+    /**
+     * @brief Convert a glTF material.
+     */
+    static MeshCache::MaterialRecord processMaterial(
+        const Document & document, const QJsonObject & material
+    );
+
+    /**
+     * @brief Return the path of a texture of a material, or an empty string.
+     */
+    static QString texturePath(const Document & document,
+                               const QJsonObject & textureInfo);
+
+    /**
+     * @brief Append a mesh record per primitive of a mesh.
+     * @return False if the mesh is not valid.
+     */
+    static bool processMesh(const Document & document,
+                            const QJsonObject & mesh, unsigned int material,
+                            MeshCache::Entry & entry,
+                            std::vector<bool> & hasTangents);
+
+    /**
+     * @brief Append the record of a node and its children in depth-first
+     * order.
+     * @param depth The depth of the node, used to detect cycles.
+     */
+    static void processNode(const Document & document, int index,
+                            const std::vector<std::vector<unsigned int>> &
+                                meshes,
+                            MeshCache::Entry & entry, int depth);
+
+    /**
+     * JSON document of the file of the last embedded image, without its
+     * buffers. The textures of the models are loaded from the main thread.
+     */
+    static Document m_imageDocument;
+};
+
+#endif // GLTFLOADER_H
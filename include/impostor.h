@@ -0,0 +1,185 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include "object.h"
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLBuffer>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <map>
+#include <memory>
+#include <vector>
+
+/// Impostor renderer
+/**
+ * @brief Render the distant instances of static models as camera-facing
+ * quads textured with pre-rendered views of the models.
+ * @author Louis Filipozzi
+ * @details When baking, every registered model is rendered offscreen from
+ * NUM_AZIMUTHS x NUM_ELEVATIONS directions around its bounding sphere. Each
+ * view is stored in a tile of a shared atlas, one row of tiles per model.
+ * While rendering the scene graph, the instances farther than the impostor
+ * distance of their model are queued instead of being drawn. All the queued
+ * instances are then drawn with a single instanced draw call: the vertex
+ * shader orients the quad toward the camera and selects the tile baked from
+ * the closest direction.
+ */
+class ImpostorRenderer {
+public:
+    ImpostorRenderer() :
+    m_isInitialized(false),
+    m_isBaked(false),
+    m_numRows(0),
+    m_capacity(0),
+    m_instanceBuffer(QOpenGLBuffer::VertexBuffer) {};
+    ~ImpostorRenderer() {};
+
+    /**
+     * @brief Initialize the renderer, i.e. create the shader, buffer,
+     * attributes.
+     */
+    void initialize();
+
+    /**
+     * @brief Register a model to render as an impostor when far enough.
+     * @remark The model is baked when calling bake().
+     * @param object The model.
+     * @param distance Distance from the camera beyond which the instances are
+     * rendered as impostors.
+     */
+    void addModel(Object * object, float distance);
+
+    /**
+     * @brief Check if a model is registered to be rendered as an impostor.
+     * @param object The model.
+     */
+    bool hasModel(const ABCObject * object) const {
+        return m_models.find(object) != m_models.end();
+    };
+
+    /**
+     * @brief Render all the registered models in the impostor atlas.
+     * @remark The models must have been initialized before.
+     * @param light The light of the scene used to shade the models.
+     */
+    void bake(const CasterLight & light);
+
+    /**
+     * @brief Remove the instances queued during the last frame and set the
+     * camera used to select the instances rendered as impostors.
+     * @param view The view matrix.
+     */
+    void clear(const QMatrix4x4 & view);
+
+    /**
+     * @brief Queue an instance of an object if it must be rendered as an
+     * impostor.
+     * @param object The object.
+     * @param model The model matrix of the instance.
+     * @return True if the instance is queued, i.e. the object must not be
+     * rendered.
+     */
+    bool addInstance(const ABCObject * object, const QMatrix4x4 & model);
+
+    /**
+     * @brief Upload the queued instances and draw all of them.
+     * @param view The view matrix.
+     * @param projection The projection matrix.
+     */
+    void render(const QMatrix4x4 & view, const QMatrix4x4 & projection);
+
+    /**
+     * @brief Clean up the renderer.
+     */
+    void cleanUp();
+
+private:
+    /**
+     * @brief Set attributes of the shaders program.
+     */
+    void createAttributes();
+
+    /**
+     * Impostor settings and bounding sphere of a registered model.
+     */
+    struct Model {
+        Object * object;
+        float distance;
+        unsigned int row;
+        QVector3D center;
+        float radius;
+    };
+
+    /**
+     * Data of one impostor as read by the vertex shader (2 x vec4).
+     */
+    struct Instance {
+        float centerRadius[4];
+        float yawRow[4];
+    };
+
+private:
+    /**
+     * Check if the renderer has been initialized.
+     */
+    bool m_isInitialized;
+
+    /**
+     * Check if the atlas has been baked.
+     */
+    bool m_isBaked;
+
+    /**
+     * Pointer to OpenGL ES 3.0 API functions (instancing).
+     */
+    QOpenGLExtraFunctions * p_glFunctions;
+
+    /**
+     * The registered models.
+     */
+    std::map<const ABCObject *, Model> m_models;
+
+    /**
+     * Number of rows of tiles in the atlas.
+     */
+    unsigned int m_numRows;
+
+    /**
+     * Position of the camera (world coordinates).
+     */
+    QVector3D m_cameraPosition;
+
+    /**
+     * The impostors to draw during the current frame.
+     */
+    std::vector<Instance> m_instances;
+
+    /**
+     * Number of instances the buffer can hold.
+     */
+    int m_capacity;
+
+    /**
+     * Framebuffer object whose color texture is the impostor atlas.
+     */
+    std::unique_ptr<QOpenGLFramebufferObject> p_atlas;
+
+    /**
+     * The shader used to render the impostors.
+     */
+    std::shared_ptr<Shader> p_shader;
+
+    /**
+     * Vertex Array Object containing the instance attributes.
+     */
+    QOpenGLVertexArrayObject m_vao;
+
+    /**
+     * Streaming buffer of instances.
+     */
+    QOpenGLBuffer m_instanceBuffer;
+};
+
+#endif // IMPOSTOR_H
@@ -0,0 +1,347 @@
+#ifndef INDIRECTRENDERER_H
+#define INDIRECTRENDERER_H
+
+#include "object.h"
+#include <QMatrix4x4>
+#include <QOpenGLFunctions_4_5_Core>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+
+/// Multi-draw indirect renderer
+/**
+ * @brief Draw the opaque meshes of all the objects of a pass with one
+ * glMultiDrawElementsIndirect() call per pipeline state, the instances being
+ * culled on the GPU.
+ * @author Louis Filipozzi
+ * @details While rendering the scene graph, the instances of Object are queued
+ * instead of being drawn. Each opaque mesh becomes an instance in the batch of
+ * its pipeline state. A pipeline state is the vertex format (VAO of the
+ * GeometryHeap), the type of the indices and the texture arrays storing the
+ * textures of the material (see TextureArrays), the textures being ignored by
+ * the shadow passes. The materials whose textures share arrays are therefore
+ * drawn by the same call.
+ *
+ * The instances are culled by a compute shader (":/shaders/object_cull.comp")
+ * which tests the bounding sphere of each instance against the frustum of the
+ * pass, selects its level of detail, and appends the visible instances to the
+ * draw commands and draw data of the pass. The shadow pass renders all the
+ * cascades at once: the sphere is tested against the frustum of each cascade
+ * and the command is instanced over the cascades containing the instance, its
+ * base instance being the first one (see ObjectShadowShader). The scene is
+ * therefore traversed and submitted once for all the cascades.
+ * The number of commands of each batch is written by the compute shader and
+ * read with glMultiDrawElementsIndirectCount() (GL_ARB_indirect_parameters).
+ * Without this extension, the commands of the culled instances are left empty
+ * and the whole range of each batch is submitted.
+ *
+ * The data of each draw (model matrix, normal matrix, material index) is read
+ * by the vertex shader with the draw ID (GL_ARB_shader_draw_parameters), and
+ * the materials in the MaterialTable. The instances are uploaded
+ * only when they differ from the previous pass of the same kind, so a static
+ * scene is not uploaded again.
+ *
+ * The transparent meshes are culled on the CPU and queued in the
+ * Object::RenderQueue, which draws them from the farthest to the closest.
+ * @remark If the driver does not support GL_ARB_shader_draw_parameters, no
+ * instance is queued and the objects are drawn by Object::render().
+ */
+class Object::IndirectRenderer {
+public:
+    IndirectRenderer() :
+    m_isInitialized(false),
+    m_isSupported(false),
+    m_isShadowPass(false),
+    p_glFunctions(nullptr),
+    p_multiDrawCount(nullptr) {};
+    ~IndirectRenderer() {};
+
+    /**
+     * @brief Initialize the renderer, i.e. create the shaders and buffers.
+     */
+    void initialize();
+
+    /**
+     * @brief Remove the instances queued during the last pass and start a
+     * pass rendering the scene.
+     * @param view The view matrix.
+     * @param projection The projection matrix.
+     */
+    void clear(const QMatrix4x4 & view, const QMatrix4x4 & projection);
+
+    /**
+     * @brief Remove the instances queued during the last pass and start a
+     * pass rendering the shadow map of all the cascades.
+     * @param lightSpace The view and projection matrices of the light, one 
+     * per cascade.
+     */
+    void clearShadow(const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace);
+
+    /**
+     * @brief Queue the meshes of an instance of an object.
+     * @param object The object.
+     * @param model The model matrix of the instance.
+     * @return True if the instance is handled by the renderer, i.e. the 
+     * object must not be rendered.
+     */
+    bool addInstance(const ABCObject * object, const QMatrix4x4 & model);
+
+    /**
+     * @brief Draw the instances queued since clear().
+     * @remark The light and the cascades are read from the uniform buffer set
+     * with PassUniforms::update().
+     */
+    void render();
+
+    /**
+     * @brief Draw the instances queued since clearShadow() in the shadow map.
+     */
+    void renderShadow();
+
+    /**
+     * @brief Clean up the renderer.
+     */
+    void cleanUp();
+
+private:
+    /**
+     * Indirect draw command (layout of DrawElementsIndirectCommand).
+     */
+    struct Command {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    /**
+     * Data of a draw as written by the culling shader (std430 layout).
+     */
+    struct Draw {
+        GLfloat model[16];
+        GLfloat normal[12]; ///< Columns of the normal matrix, padded to vec4.
+        GLuint material;
+        GLuint padding[3];
+    };
+
+    /**
+     * Mesh of an instance as read by the culling shader (std430 layout).
+     */
+    struct Instance {
+        GLfloat model[16];
+        GLfloat sphere[4];              ///< Center (world), radius.
+        GLuint counts[NUM_LODS];        ///< Number of indices of each LOD.
+        GLuint firstIndices[NUM_LODS];  ///< First index of each LOD.
+        GLint baseVertex;
+        GLuint batch;
+        GLuint material;
+        GLuint lodBias;
+    };
+
+    /**
+     * Pipeline state of a batch: half float texture coordinates, type of the
+     * indices, texture arrays of the diffuse, normal and bump textures.
+     */
+    typedef std::tuple<bool, GLenum, const TextureArrays::Array *, 
+                       const TextureArrays::Array *, 
+                       const TextureArrays::Array *> State;
+
+    /**
+     * Instances sharing a pipeline state.
+     */
+    struct Batch {
+        std::vector<Instance> instances;
+        const Material * material; ///< A material binding the arrays.
+    };
+
+    /**
+     * Transparent mesh drawn after the opaque ones.
+     */
+    struct Transparent {
+        const Mesh * mesh;
+        QMatrix4x4 model;
+        bool halfTextureUV;
+        unsigned int lod;
+    };
+
+    /**
+     * Mesh of an object with the parts of its instances that do not depend
+     * on the model matrix.
+     */
+    struct MeshDraw {
+        const Mesh * mesh;
+        QMatrix4x4 transform; ///< Model matrix relative to the object.
+        State state;
+        Instance instance;
+    };
+
+    /**
+     * Meshes of an object. The layout of the object in the geometry heap is
+     * stored to detect objects whose data has been moved, the generation of
+     * the textures to detect textures moved to another array.
+     */
+    struct Meshes {
+        const Node * root;
+        GLint firstVertex;
+        GLintptr indexOffset;
+        unsigned int textures; ///< See TextureManager::getGeneration().
+        std::vector<MeshDraw> draws;
+    };
+
+    /**
+     * Buffers written by the culling shader for a pass.
+     */
+    struct Pass {
+        GLuint commands = 0;
+        GLuint draws = 0;
+        GLuint counts = 0;
+        GLsizeiptr capacity = 0;      ///< Number of commands and draws.
+        GLsizeiptr countCapacity = 0; ///< Number of batches.
+    };
+
+    /**
+     * Instances uploaded for the culling shader. The main pass and the shadow
+     * passes use different sets since they do not batch the meshes the same
+     * way.
+     */
+    struct InstanceSet {
+        GLuint instanceBuffer = 0;
+        GLuint batchBuffer = 0;
+        std::vector<Instance> instances; ///< Content of instanceBuffer.
+        std::vector<GLuint> firsts;      ///< Content of batchBuffer.
+    };
+
+    /**
+     * Signature of glMultiDrawElementsIndirectCount().
+     */
+    typedef void (QOPENGLF_APIENTRYP MultiDrawElementsIndirectCount)(
+        GLenum mode, GLenum type, const void * indirect, GLintptr drawcount,
+        GLsizei maxdrawcount, GLsizei stride
+    );
+
+    /**
+     * @brief Return the meshes of an object.
+     * @details The meshes are collected from the node tree the first time the
+     * object is queued.
+     */
+    const std::vector<MeshDraw> & getMeshes(const Object * object);
+
+    /**
+     * @brief Upload the instances of the batches, cull them and draw the
+     * visible ones.
+     * @param shader The shader.
+     * @param useMaterials Compute the normal matrices, bind the textures of
+     * the batches and the material table.
+     */
+    void submit(ObjectShader * shader, bool useMaterials);
+
+    /**
+     * @brief Cull the uploaded instances against the frustum of the pass.
+     * @param numInstances The number of instances.
+     * @param computeNormals Compute the normal matrices of the draws.
+     */
+    void cull(GLuint numInstances, bool computeNormals);
+
+    /**
+     * @brief Copy data to a buffer, the previous content is orphaned.
+     * @remark The storage is only allocated if data is nullptr.
+     */
+    void upload(GLuint buffer, const void * data, size_t size);
+
+private:
+    /**
+     * Check if the renderer has been initialized.
+     */
+    bool m_isInitialized;
+
+    /**
+     * Check if the driver supports the shaders of the renderer.
+     */
+    bool m_isSupported;
+
+    /**
+     * Check if the current pass renders a shadow map.
+     */
+    bool m_isShadowPass;
+
+    /**
+     * View matrix of the current pass.
+     */
+    QMatrix4x4 m_view;
+
+    /**
+     * Projection matrix of the current pass.
+     */
+    QMatrix4x4 m_projection;
+    
+    /**
+     * Light space matrices of the cascades of the shadow pass.
+     */
+    std::array<QMatrix4x4,NUM_CASCADES> m_lightSpace;
+
+    /**
+     * Position of the camera (world coordinates).
+     */
+    QVector3D m_cameraPosition;
+
+    /**
+     * Pointer to OpenGL 4.5 functions.
+     */
+    QOpenGLFunctions_4_5_Core * p_glFunctions;
+
+    /**
+     * glMultiDrawElementsIndirectCount(), nullptr if not supported.
+     */
+    MultiDrawElementsIndirectCount p_multiDrawCount;
+
+    /**
+     * The batches of the current pass.
+     */
+    std::map<State, Batch> m_batches;
+
+    /**
+     * The transparent meshes of the current pass, sorted by distance to the
+     * camera.
+     */
+    std::multimap<float, Transparent> m_transparent;
+
+    /**
+     * The meshes of the queued objects.
+     */
+    std::map<const Object *, Meshes> m_meshes;
+
+    /**
+     * The shader culling the instances.
+     */
+    std::shared_ptr<ComputeShader> p_cullShader;
+
+    /**
+     * The shader drawing the batches.
+     */
+    std::shared_ptr<ObjectShader> p_shader;
+
+    /**
+     * The shader drawing the batches in the shadow maps.
+     */
+    std::shared_ptr<ObjectShadowShader> p_shadowShader;
+
+    /**
+     * The shader drawing the transparent meshes.
+     */
+    std::shared_ptr<ObjectShader> p_transparentShader;
+
+    /**
+     * Buffers of the scene pass and of the shadow pass.
+     */
+    std::array<Pass,2> m_passes;
+
+    /**
+     * Instances of the scene pass and of the shadow passes.
+     */
+    std::array<InstanceSet,2> m_sets;
+};
+
+#endif // INDIRECTRENDERER_H
@@ -54,10 +54,12 @@ public:
     
     /**
      * @brief Draw the object when computing the framebuffer for shadow mapping.
-     * @param lightSpace The view and projection matrix of the light (used for 
-     * shadow mapping).
+     * @param lightSpace The view and projection matrices of the light (used 
+     * for shadow mapping), one per cascade.
      */
-    virtual void renderShadow(const QMatrix4x4 & lightSpace);
+    virtual void renderShadow(
+        const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace
+    );
     
     /**
      * @brief Clean up the object.
@@ -113,7 +115,7 @@ private:
     /**
      * The shader used to render the line.
      */
-    std::unique_ptr<Shader> p_shader;
+    std::shared_ptr<Shader> p_shader;
     
     /**
      * Vertex Array Object containing all the buffer needed to render the 
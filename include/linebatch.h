@@ -0,0 +1,136 @@
+#ifndef LINEBATCH_H
+#define LINEBATCH_H
+
+#include "shaderprogram.h"
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLBuffer>
+#include <QOpenGLExtraFunctions>
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <memory>
+#include <vector>
+
+/// Batch of debug lines
+/**
+ * @brief Gather all the lines drawn during a frame (tire forces, frames, debug
+ * primitives) and render them with a single instanced draw call.
+ * @author Louis Filipozzi
+ * @details Each primitive is stored as one instance in a streaming vertex
+ * buffer which is orphaned every frame. The vertex shader expands every
+ * instance into up to three segments, so that the arrows are scaled and
+ * positioned on the GPU from the raw force data.
+ */
+class LineBatch {
+public:
+    LineBatch() :
+    m_isInitialized(false),
+    p_glFunctions(nullptr),
+    m_capacity(0),
+    m_instanceBuffer(QOpenGLBuffer::VertexBuffer) {};
+    ~LineBatch() {};
+
+    /**
+     * @brief Initialize the batch, i.e. create the shader, buffer, attributes.
+     */
+    void initialize();
+
+    /**
+     * @brief Remove all the primitives added since the last frame.
+     */
+    void clear() {m_instances.clear();};
+
+    /**
+     * @brief Add a vector drawn as its three components (one line per axis).
+     * @param origin The origin of the frame in which the vector is expressed.
+     * @param yaw The yaw angle of the frame (rad).
+     * @param offset The origin of the vector relatively to the frame.
+     * @param vector The raw vector (e.g. the tire force).
+     * @param scale Scale applied to the vector.
+     * @param color The color of the lines.
+     */
+    void addVector(
+        const QVector3D & origin, float yaw, const QVector3D & offset,
+        const QVector3D & vector, float scale, const QVector3D & color
+    );
+
+    /**
+     * @brief Add a single line segment.
+     * @param from The first end of the segment.
+     * @param to The second end of the segment.
+     * @param color The color of the segment.
+     */
+    void addSegment(
+        const QVector3D & from, const QVector3D & to, const QVector3D & color
+    );
+
+    /**
+     * @brief Upload the primitives and draw all of them.
+     * @param view The view matrix.
+     * @param projection The projection matrix.
+     */
+    void render(const QMatrix4x4 & view, const QMatrix4x4 & projection);
+
+    /**
+     * @brief Clean up the batch.
+     */
+    void cleanUp();
+
+private:
+    /**
+     * @brief Set attributes of the shaders program.
+     */
+    void createAttributes();
+
+    /**
+     * Type of primitive stored in an instance.
+     */
+    enum Mode {Vector = 0, Segment = 1};
+
+    /**
+     * Data of one primitive as read by the vertex shader (4 x vec4).
+     */
+    struct Instance {
+        float originYaw[4];
+        float offsetScale[4];
+        float vectorMode[4];
+        float color[4];
+    };
+
+private:
+    /**
+     * Check if the batch has been initialized.
+     */
+    bool m_isInitialized;
+
+    /**
+     * Pointer to OpenGL ES 3.0 API functions (instancing).
+     */
+    QOpenGLExtraFunctions * p_glFunctions;
+
+    /**
+     * The primitives to draw during the current frame.
+     */
+    std::vector<Instance> m_instances;
+
+    /**
+     * Number of instances the buffer can hold.
+     */
+    int m_capacity;
+
+    /**
+     * The shader used to render the lines.
+     */
+    std::shared_ptr<Shader> p_shader;
+
+    /**
+     * Vertex Array Object containing the instance attributes.
+     */
+    QOpenGLVertexArrayObject m_vao;
+
+    /**
+     * Streaming buffer of instances.
+     */
+    QOpenGLBuffer m_instanceBuffer;
+};
+
+#endif // LINEBATCH_H
@@ -54,6 +54,14 @@ public:
     Texture * getNormalTexture() const {return m_normalTexture;};
     Texture * getBumpTexture() const {return m_bumpTexture;};
     
+    /**
+     * @brief Check if two materials render identically, i.e. all their 
+     * properties and textures but the name are the same.
+     * @param material The material to compare with.
+     * @return Return true for identical materials.
+     */
+    bool isEquivalent(const Material & material) const;
+    
 private:
     /**
      * @brief set the default texture of the material.
@@ -0,0 +1,136 @@
+#ifndef MATERIALTABLE_H
+#define MATERIALTABLE_H
+
+#include "material.h"
+#include <QOpenGLFunctions_4_5_Core>
+#include <map>
+#include <vector>
+
+/// Material table
+/**
+ * @brief Store the parameters of all the loaded materials in a shader storage
+ * buffer, indexed by the draws.
+ * @author Louis Filipozzi
+ * @details The materials of the meshes are added to the table when their
+ * object is initialized, and each mesh keeps the index of its material. The
+ * table is uploaded once after new materials have been added and bound to the
+ * binding point MaterialTable::BINDING, where the object shaders read it as
+ * the std430 buffer "Materials":
+ * @code
+ * struct Material {
+ *     vec4 ambient;   // Ka, shininess
+ *     vec4 diffuse;   // Kd, alpha
+ *     vec4 specular;  // Ks, heightScale
+ *     uvec4 layers;   // Diffuse, normal and bump layers, flags
+ *     vec4 rects[3];  // Offset and scale of the diffuse, normal and bump
+ *                     // texture coordinates in their layer
+ * };
+ * layout (std430, binding = 1) readonly buffer Materials {
+ *     Material materials[];
+ * };
+ * @endcode
+ * A draw therefore only sets the index of its material (a uniform, or the
+ * draw data of a multi-draw indirect call) instead of the six uniforms of its
+ * parameters. The layers give the textures of the material in the arrays of
+ * TextureArrays, the flags how to read them (NORMAL_XY: the normal map only
+ * stores x and y, e.g. BC5). The rectangles locate the textures packed in a
+ * TextureAtlas, the other textures cover their whole layer. The rectangle of
+ * a texture stored top row first (BC7, see Texture::isTopDown()) is flipped
+ * vertically.
+ * @remark The parameters of a material are copied when it is added, later
+ * changes are not reflected in the table. Only the layers are read again, by
+ * updateTextures(), when the textures loaded in the background replace their
+ * placeholder (see TextureManager::loadTextureAsync()).
+ */
+class MaterialTable {
+public:
+    /**
+     * Binding point of the shader storage buffer.
+     */
+    static constexpr GLuint BINDING = 1;
+    
+    /**
+     * Flag of a material whose normal map only stores x and y, z being
+     * reconstructed by the shaders.
+     */
+    static constexpr GLuint NORMAL_XY = 1;
+
+    /**
+     * @brief Add a material to the table.
+     * @param material The material, added once whatever the number of calls.
+     * @return The index of the material in the table.
+     */
+    static GLuint add(const Material & material);
+
+    /**
+     * @brief Read again the layers of the textures of all the materials, the
+     * table being uploaded by the next call to bind().
+     */
+    static void updateTextures();
+
+    /**
+     * @brief Upload the table if materials have been added or updated, then
+     * bind it.
+     */
+    static void bind();
+
+    /**
+     * @brief Properly deallocate the buffer and remove the materials.
+     */
+    static void cleanUp();
+
+private:
+    MaterialTable() {};
+    
+    /**
+     * @brief Parameters of a material (std430 layout).
+     */
+    struct Data {
+        GLfloat ambient[4];  ///< Ambient color, shininess.
+        GLfloat diffuse[4];  ///< Diffuse color, alpha.
+        GLfloat specular[4]; ///< Specular color, height scale.
+        GLuint layers[4];    ///< Diffuse, normal and bump layers, flags.
+        GLfloat rects[3][4]; ///< Rectangles of the textures in their layer.
+    };
+    static_assert(sizeof(Data) == 112,
+                  "Data must match the std430 layout of Materials.");
+
+    /**
+     * @brief Copy the layers, the rectangles and the flags of the textures of
+     * a material.
+     */
+    static void setLayers(Data & data, const Material & material);
+
+    /**
+     * @brief Return the layer of a texture in its array, 0 if there is no
+     * texture.
+     */
+    static GLuint getLayer(const Texture * texture);
+
+    /**
+     * Index of the materials in the table.
+     */
+    static std::map<const Material *, GLuint> m_indices;
+
+    /**
+     * Content of the buffer.
+     */
+    static std::vector<Data> m_data;
+
+    /**
+     * The materials, in the order of the table.
+     */
+    static std::vector<const Material *> m_materials;
+
+    /**
+     * Check if materials have been added or updated since the last upload.
+     */
+    static bool m_changed;
+
+    /**
+     * The shader storage buffer.
+     */
+    static GLuint m_buffer;
+};
+
+#endif // MATERIALTABLE_H
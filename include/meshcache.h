@@ -0,0 +1,140 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <QVector3D>
+#include <QMatrix4x4>
+#include <memory>
+#include <vector>
+
+/// Mesh cache
+/**
+ * @brief Persistent on-disk cache of the models processed by the object
+ * loader.
+ * @author Louis Filipozzi
+ * @details An entry contains everything the loader needs to build an object
+ * without running the importer nor processing the meshes: the interleaved
+ * vertex data and the packed index data as they are copied to the
+ * GeometryHeap (optimized, with the generated levels of detail), the
+ * positions and the indices used on the CPU (bounding sphere, batching), the
+ * material table, the meshes and the node tree.
+ *
+ * The entries are content-addressed: the key is the hash of the model file,
+ * of the files it references (the material libraries of an OBJ file, the
+ * external buffers of a glTF file), of the texture directory, of the
+ * importer flags and of the format version. A modified model thus never
+ * reads a stale entry. The entries are stored in the cache location of the
+ * application and memory-mapped when loaded: the vertex and index data
+ * point into the mapped file, which stays open until the object has copied
+ * them to the GeometryHeap.
+ * @remark FORMAT_VERSION (see meshcache.cpp) must be increased whenever the
+ * processing of the loader changes its output (e.g. the LOD generation).
+ */
+class MeshCache {
+public:
+    /**
+     * @brief Material as read from the model file.
+     */
+    struct MaterialRecord {
+        QString name;           ///< Name of the material.
+        bool isShaded;          ///< False for an unsupported shading model.
+        QVector3D ambient;      ///< Ambient color.
+        QVector3D diffuse;      ///< Diffuse color.
+        QVector3D specular;     ///< Specular color.
+        float shininess;        ///< Specular exponent.
+        float alpha;            ///< Opacity.
+        QString diffuseTexture; ///< Path to the diffuse texture, or empty.
+        QString normalTexture;  ///< Path to the normal texture, or empty.
+    };
+
+    /**
+     * @brief Mesh: its levels of detail, the layout of its indices in the
+     * index data and the index of its material.
+     */
+    struct MeshRecord {
+        QString name;             ///< Name of the mesh.
+        unsigned int material;    ///< Index in the material table.
+        std::vector<unsigned int> lods; ///< Pairs of (count, offset).
+        // Layout in the index data, set when the model is prepared
+        unsigned int indexType = 0;  ///< GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+        unsigned int baseVertex = 0; ///< Vertex the indices are relative to.
+        std::vector<unsigned int> byteOffsets = {}; ///< Offset of each LOD.
+    };
+
+    /**
+     * @brief Node of the tree, the nodes are stored in depth-first order.
+     */
+    struct NodeRecord {
+        QString name;                     ///< Name of the node.
+        QMatrix4x4 transformation;        ///< Transformation of the node.
+        std::vector<unsigned int> meshes; ///< Indices in the mesh table.
+        unsigned int numChildren;         ///< Number of children.
+    };
+
+    /**
+     * @brief The processed model.
+     * @details The normals, texture coordinates, tangents and bitangents are
+     * only filled while the model is processed, until they are interleaved
+     * in the vertex data. They are not stored in the cache.
+     */
+    struct Entry {
+        QVector<float> vertices;
+        QVector<float> normals;
+        QVector<QVector<float>> textureUV;
+        QVector<unsigned int> indices;
+        QVector<float> tangents;
+        QVector<float> bitangents;
+        bool halfTextureUV = true;   ///< Vertex format of the vertex data.
+        float textureRepeat = 1.0f;  ///< Range of the texture coordinates.
+        float acmrBefore = 0.0f;     ///< ACMR before the optimization.
+        float acmrAfter = 0.0f;      ///< ACMR after the optimization.
+        unsigned int numTriangles = 0; ///< Triangles of the full detail.
+        QByteArray vertexData;       ///< Interleaved data (see VertexFormat).
+        QByteArray indexData;        ///< Packed indices (see MeshRecord).
+        std::shared_ptr<QFile> file; ///< File mapped by the data, if loaded.
+        std::vector<MaterialRecord> materials;
+        std::vector<MeshRecord> meshes;
+        std::vector<NodeRecord> nodes;
+    };
+
+    /**
+     * @brief Compute the key of a model.
+     * @param filePath The path to the model file.
+     * @param textureDir The directory containing the textures of the model.
+     * @param flags The importer flags.
+     * @return The key, or an empty string if the file cannot be read.
+     */
+    static QString computeKey(const QString & filePath,
+                              const QString & textureDir,
+                              unsigned int flags);
+
+    /**
+     * @brief Load an entry from the cache.
+     * @param[in] key The key of the model.
+     * @param[out] entry The processed model, whose vertex and index data
+     * point into the mapped file.
+     * @return True if the entry exists and is valid.
+     */
+    static bool load(const QString & key, Entry & entry);
+
+    /**
+     * @brief Store an entry in the cache.
+     * @param key The key of the model.
+     * @param entry The processed model.
+     * @return True if the entry has been written.
+     */
+    static bool save(const QString & key, const Entry & entry);
+
+private:
+    MeshCache() {};
+
+    /**
+     * @brief Return the path of the entry file of a key.
+     */
+    static QString entryPath(const QString & key);
+};
+
+#endif // MESHCACHE_H
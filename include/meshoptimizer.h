@@ -0,0 +1,87 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <QVector>
+#include <vector>
+
+/// Mesh optimizer
+/**
+ * @brief Reorder the triangles and the vertices of a mesh to render it
+ * faster, without modifying its geometry.
+ * @author Louis Filipozzi
+ * @details Three passes are provided:
+ * - the vertex cache optimization reorders the triangles so that the vertices
+ *   transformed by the vertex shader are reused as much as possible (Forsyth's
+ *   linear-speed algorithm);
+ * - the overdraw optimization splits the previous order into clusters and
+ *   sorts the clusters so that the triangles facing outward are drawn first
+ *   (Sander et al., Tipsify);
+ * - the vertex fetch optimization renumbers the vertices in the order they
+ *   are used by the index buffer so that the vertex fetches are sequential.
+ *
+ * The efficiency of the vertex cache is measured by the average cache miss
+ * ratio (ACMR): the number of transformed vertices per triangle, from 0.5 for
+ * a perfect regular grid to 3 for a random order.
+ */
+class MeshOptimizer {
+public:
+    /**
+     * @brief Reorder the triangles for the post-transform vertex cache.
+     * @param[in,out] indices Pointer to the first index of the mesh.
+     * @param[in] count The number of indices of the mesh (3 per triangle).
+     */
+    static void optimizeVertexCache(unsigned int * indices, unsigned int count);
+
+    /**
+     * @brief Reorder clusters of triangles to reduce the overdraw while
+     * keeping most of the vertex cache efficiency.
+     * @param[in,out] indices Pointer to the first index of the mesh, ordered by
+     * optimizeVertexCache().
+     * @param[in] count The number of indices of the mesh (3 per triangle).
+     * @param[in] vertices The vertex positions (3 floats per vertex).
+     * @param[in] threshold The ACMR of a cluster may be up to threshold times
+     * the ACMR of the mesh. The larger the threshold, the smaller the clusters.
+     */
+    static void optimizeOverdraw(
+        unsigned int * indices, unsigned int count,
+        const QVector<float> & vertices, float threshold = 1.05f
+    );
+
+    /**
+     * @brief Compute the renumbering of the vertices in their order of first
+     * use and apply it to the index buffer.
+     * @param[in,out] indices The index buffer.
+     * @param[in] numVertices The number of vertices.
+     * @return The new index of each vertex. The vertices which are not used
+     * are moved after the used ones.
+     */
+    static std::vector<unsigned int> optimizeVertexFetch(
+        QVector<unsigned int> & indices, unsigned int numVertices
+    );
+
+    /**
+     * @brief Apply a renumbering of the vertices to a vertex attribute.
+     * @param[in,out] stream The attribute data.
+     * @param[in] remap The new index of each vertex.
+     */
+    static void remapVertexStream(
+        QVector<float> & stream, const std::vector<unsigned int> & remap
+    );
+
+    /**
+     * @brief Compute the average cache miss ratio of a mesh.
+     * @param indices Pointer to the first index of the mesh.
+     * @param count The number of indices of the mesh (3 per triangle).
+     * @param cacheSize The size of the simulated FIFO vertex cache.
+     * @return The number of cache misses per triangle.
+     */
+    static float computeAcmr(
+        const unsigned int * indices, unsigned int count,
+        unsigned int cacheSize = 16
+    );
+
+private:
+    MeshOptimizer() {};
+};
+
+#endif // MESHOPTIMIZER_H
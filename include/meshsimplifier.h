@@ -0,0 +1,39 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <QVector>
+
+/// Mesh simplifier
+/**
+ * @brief Simplify triangle meshes by quadric edge collapse.
+ * @author Louis Filipozzi
+ * @details The simplification only collapses an edge onto one of its existing
+ * vertices (half-edge collapse). The simplified mesh therefore reuses the
+ * vertex buffer of the original mesh and only a new list of indices is
+ * produced. The vertices lying on an open border or on an attribute seam
+ * (several vertices sharing the same position) are locked so that the
+ * silhouette and the texture mapping of the mesh are preserved.
+ */
+class MeshSimplifier {
+public:
+    /**
+     * @brief Simplify a triangle mesh.
+     * @param vertices The vertex positions (3 floats per vertex).
+     * @param indices Pointer to the first index of the mesh.
+     * @param count The number of indices of the mesh (3 per triangle).
+     * @param ratio The targeted ratio between the number of triangles of the
+     * simplified mesh and of the original mesh.
+     * @param maxError The maximum error allowed for a collapse, relatively to
+     * the size of the mesh.
+     * @return The indices of the simplified mesh.
+     */
+    static QVector<unsigned int> simplify(
+        const QVector<float> & vertices, const unsigned int * indices,
+        unsigned int count, float ratio, float maxError = 0.05f
+    );
+
+private:
+    MeshSimplifier() {};
+};
+
+#endif // MESHSIMPLIFIER_H
@@ -2,12 +2,14 @@
 #define OBJECT_H
 
 #include "abstractobject.h"
+#include "geometryheap.h"
 #include "material.h"
+#include "meshcache.h"
 #include "shaderprogram.h"
 #include <QString>
 #include <memory>
-#include <QOpenGLVertexArrayObject>
-#include <QOpenGLBuffer>
+#include <vector>
+#include <QOpenGLFunctions_4_5_Core>
 
 
 /// Object
@@ -17,17 +19,25 @@
  * ":/shaders/line.frag".
  * @author Louis Filipozzi
  * @details This class uses an architecture similar to the one used by Assimp.
- * The vertex data (vertices, normals, indices) are stored in a unique Vertex 
- * Array Object (VAO). The object is decomposed of several nodes organized in a 
- * tree. A node is decomposed of a mesh. Each mesh has a unique material.
- * When rendering the object, the VAO is bound. Then each node is draw 
- * recursively.
+ * The vertex data (vertices, normals, indices) are stored in a range of the 
+ * GeometryHeap, whose Vertex Array Object (VAO) is shared by all the objects 
+ * using the same vertex format. The object is decomposed of several nodes 
+ * organized in a tree. A node is decomposed of a mesh. Each mesh has a unique 
+ * material.
+ * When rendering the object, the meshes of the nodes are queued in the
+ * Object::RenderQueue, which sorts them by state before drawing them.
+ * Each mesh owns several levels of detail (LOD) stored in the index buffer. 
+ * The LOD used to draw the object is selected from the projected size of its
+ * bounding sphere.
  */
 class Object : public ABCObject {
 public:
     class IBuilder;
     class Loader;
     class XmlLoader;
+    class Batcher;
+    class IndirectRenderer;
+    class RenderQueue;
     
 private:
     class Node;
@@ -48,13 +58,14 @@ public:
         !tangents || !bitangents
     ),
     m_isInitialized(false),
+    m_boundingRadius(0.0f),
+    m_textureRepeat(1.0f),
+    m_shadowLodBias(1),
     p_rootNode(std::move(rootNode)), 
-    m_vertexBuffer(QOpenGLBuffer::VertexBuffer), 
-    m_normalBuffer(QOpenGLBuffer::VertexBuffer), 
-    m_textureUVBuffer(QOpenGLBuffer::VertexBuffer), 
-    m_indexBuffer(QOpenGLBuffer::IndexBuffer), 
-    m_tangentBuffer(QOpenGLBuffer::VertexBuffer), 
-    m_bitangentBuffer(QOpenGLBuffer::VertexBuffer), 
+    p_glFunctions(nullptr), 
+    p_allocation(nullptr), 
+    m_halfTextureUV(true), 
+    m_isPrepared(false), 
     p_objectShader(nullptr), 
     p_shadowShader(nullptr), 
     p_vertices(std::move(vertices)), p_normals(std::move(normals)),
@@ -74,6 +85,9 @@ public:
      * @param lightSpace The view and projection matrix of the light (used for 
      * shadow mapping).
      * @param cascades Array containing the distance for cascade shadow mapping.
+     * @remark The shaders read the light, camera and cascades from the uniform
+     * buffer set with PassUniforms::update(), the matrices given here are
+     * only used for culling and selecting the level of detail.
      */
     virtual void render(
         const CasterLight & light, const QMatrix4x4 & view, 
@@ -84,77 +98,206 @@ public:
     
     /**
      * @brief Draw the object when computing the framebuffer for shadow mapping.
-     * @param lightSpace The view and projection matrix of the light (used for 
-     * shadow mapping).
+     * @param lightSpace The view and projection matrices of the light (used 
+     * for shadow mapping), one per cascade.
+     * @remark The meshes are drawn once per cascade by instancing, in a 
+     * single pass. The shaders read the light space matrices from the uniform
+     * buffer set with PassUniforms::updateShadow().
      */
-    virtual void renderShadow(const QMatrix4x4 & lightSpace);
+    virtual void renderShadow(
+        const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace
+    );
     
     /**
      * @brief Clean up the object.
      */
     virtual void cleanUp();
     
+    /**
+     * @brief Set the number of levels of detail added to the selected LOD 
+     * when computing the shadow map.
+     * @param bias The LOD bias.
+     */
+    void setShadowLodBias(unsigned int bias) {m_shadowLodBias = bias;};
+    
+    /**
+     * @brief Get the bounding sphere of the object.
+     * @remark The sphere is computed when initializing the object.
+     * @param[out] center The center of the sphere (model coordinates).
+     * @param[out] radius The radius of the sphere (model coordinates).
+     */
+    void getBoundingSphere(QVector3D & center, float & radius) const {
+        center = m_boundingCenter;
+        radius = m_boundingRadius;
+    };
+    
+    /**
+     * @brief Print the average cache miss ratio (ACMR) of the full detail of
+     * the meshes of the models loaded by Object::Loader since the last 
+     * report, before and after their optimization, then reset it.
+     * @remark The objects merged by Object::Batcher are not counted twice.
+     */
+    static void reportOptimization();
+    
 private:
+    /**
+     * @brief Average cache miss ratio (ACMR) of the full detail of meshes, 
+     * before and after their optimization for the vertex cache.
+     */
+    struct OptimizationStatistics {
+        double acmrBefore = 0.0;       ///< Weighted by the triangles.
+        double acmrAfter = 0.0;        ///< Weighted by the triangles.
+        unsigned int numTriangles = 0; ///< Triangles of the full detail.
+        unsigned int numModels = 0;    ///< Number of optimized models.
+    };
+    
+    /**
+     * @brief Layout of the indices of a mesh in the index data.
+     */
+    struct IndexLayout {
+        const Mesh * mesh;
+        GLenum type;                     ///< Type of the indices.
+        GLint baseVertex;                ///< Vertex they are relative to.
+        std::vector<size_t> byteOffsets; ///< Offset of each LOD (bytes).
+    };
+    
     /**
      * @brief Draw the object using a given shader.
      * @details This function is used as the implementation of both the 
      * Object::render() and Object::renderShadow() functions since these two 
      * functions perform the same task but using different shader program.
-     * @param view The view matrix.
-     * @param projection The projection matrix.
-     * @param lightSpace The view and projection matrix of the light (used for 
-     * shadow mapping). An array must be given, the size of the array is one 
-     * during shadow mapping and it size is NUM_CASCADES when rendering the 
-     * object.
-     * @param cascades Array containing the distance for cascade shadow mapping.
+     * The uniforms of the pass (camera, light, cascades) must have been set 
+     * with PassUniforms.
+     * The meshes are queued in the render queue if it is open, otherwise
+     * they are drawn immediately.
+     * @param view The view matrix, used to sort the meshes.
      * @param shader The shader program used to draw the scene.
+     * @param lod The level of detail used to draw the meshes.
      */
-    void render(const CasterLight & light, const QMatrix4x4 & view, 
-                const QMatrix4x4 & projection, 
-                const QMatrix4x4 lightSpace[], 
-                const std::array<float,NUM_CASCADES+1> * cascades, 
-                ObjectShader * shader);
+    void render(const QMatrix4x4 & view, ObjectShader * shader, 
+                unsigned int lod);
     
     /**
-     * @brief Create and link the shader program.
+     * @brief Return the radius of the bounding sphere of the object projected
+     * in normalized device coordinates.
+     * @param viewProjection The product of the projection and view matrices.
+     * @param model The model matrix of the object.
      */
-    void createShaderPrograms();
+    float getScreenSize(const QMatrix4x4 & viewProjection, 
+                        const QMatrix4x4 & model) const;
     
     /**
-     * @brief Set attributes of the shaders program.
+     * @brief Request the resolution at which the textures of the object are
+     * seen, for the streaming of their mipmaps (see TextureManager).
+     * @param viewProjection The product of the projection and view matrices.
+     * @param model The model matrix of the object.
      */
-    void createAttributes();
-
+    void requestTextures(const QMatrix4x4 & viewProjection, 
+                         const QMatrix4x4 & model) const;
+    
     /**
-     * @brief Create the vertex, normal, texture, and index buffers.
+     * @brief Select the level of detail from the projected size of the 
+     * bounding sphere of the object.
+     * @param viewProjection The product of the projection and view matrices.
+     * @param model The model matrix of the object.
+     * @return The level of detail, 0 being the most detailed.
      */
-    void createBuffers();
+    unsigned int selectLod(const QMatrix4x4 & viewProjection, 
+                           const QMatrix4x4 & model) const;
+    
+    /**
+     * @brief Check if the bounding sphere of the object intersects the view
+     * frustum.
+     * @param viewProjection The product of the projection and view matrices.
+     * @param model The model matrix of the object.
+     * @return Return false if the object is entirely outside of the frustum.
+     */
+    bool isVisible(const QMatrix4x4 & viewProjection, 
+                   const QMatrix4x4 & model) const;
+    
+    /**
+     * @brief Compute the bounding sphere of the object from the vertex data.
+     */
+    void computeBoundingSphere();
+    
+    /**
+     * @brief Compute the number of repetitions of the texture coordinates
+     * across the object and collect the materials of its meshes.
+     */
+    void computeTextureRepeat();
+    
+    /**
+     * @brief Return the largest range of texture coordinates, at least 1.
+     * @param textureUV The texture coordinates (2 floats per vertex).
+     */
+    static float computeTextureRepeat(const QVector<float> & textureUV);
+    
+    /**
+     * @brief Reorder the triangles of each level of detail for the vertex 
+     * cache and the overdraw, then renumber the vertices in their order of
+     * use.
+     */
+    void optimizeMeshes();
     
-private:
     /**
-     * @brief Compute the tangents and bitangents from the vertices and texture
-     * coordinates.
-     * @param[in] vertices The vertex data.
-     * @param[in] textureUV The texture coordinate data.
-     * @param[in] indices The index data.
-     * @param[out] tangents The tangent data.
-     * @param[out] bitangents The bitangent data.
-     */
-    static void getTangentsAndBitangents(
-        const QVector<float> & vertices, 
-        const QVector<QVector<float>> & textureUV,
-        const QVector<unsigned int> & indices, 
-        QVector<float> & tangents,
+     * @brief Reorder the triangles of levels of detail for the vertex cache
+     * and the overdraw, then renumber the vertices in their order of use and
+     * reorder the vertex streams accordingly.
+     * @param lods The levels of detail of each mesh, as pairs of (count, 
+     * offset) in the indices, the full detail first.
+     * @return The ACMR of the full detail of the meshes, for a single model.
+     */
+    static OptimizationStatistics optimizeMeshes(
+        const std::vector<std::vector<unsigned int>> & lods, 
+        QVector<float> & vertices, 
+        QVector<float> & normals, QVector<QVector<float>> & textureUV,
+        QVector<unsigned int> & indices, QVector<float> & tangents,
         QVector<float> & bitangents
     );
     
-private:
     /**
-     * @typedef Container used to store meshes to draw later.
+     * @brief Append the indices of the levels of detail of a mesh to the
+     * index data: on 16 bits, relative to the first vertex of the mesh, when
+     * the mesh uses less than 65536 vertices, on 32 bits otherwise.
+     * @param[in] indices The indices of all the meshes.
+     * @param[in] lods The levels of detail of the mesh, as pairs of (count,
+     * offset) in the indices.
+     * @param[in,out] indexData The index data.
+     * @param[out] layout The layout of the indices of the mesh, but the mesh.
      */
-    typedef std::multimap<float, std::pair<QMatrix4x4, const Mesh *>> 
-        MeshesToDrawLater;
+    static void packIndices(const QVector<unsigned int> & indices,
+                            const std::vector<unsigned int> & lods,
+                            QByteArray & indexData, IndexLayout & layout);
     
+    /**
+     * @brief Use the vertex and index data prepared by the loader, which
+     * initialize() copies as they are to the geometry heap.
+     * @param entry The processed model, its data is moved to the object.
+     * @param layouts The layout of the indices of each mesh.
+     */
+    void setPreparedData(MeshCache::Entry & entry, 
+                         std::vector<IndexLayout> layouts);
+    
+    /**
+     * @brief Add the statistics of the optimization of a loaded model to 
+     * the ones printed by reportOptimization().
+     */
+    static void addStatistics(const OptimizationStatistics & statistics);
+    
+    /**
+     * @brief Create and link the shader program.
+     */
+    void createShaderPrograms();
+    
+    /**
+     * @brief Copy the interleaved vertex data and the index data to the 
+     * geometry heap.
+     * @details The data is interleaved and packed (see packIndices()) unless
+     * it has been prepared by the loader.
+     */
+    void createBuffers();
+    
+private:
     /**
      * Set to true if the model is not valid.
      */
@@ -165,56 +308,93 @@ private:
      */
     bool m_isInitialized;
     
+    /**
+     * Center of the bounding sphere of the object (model coordinates).
+     */
+    QVector3D m_boundingCenter;
+    
+    /**
+     * Radius of the bounding sphere of the object (model coordinates).
+     */
+    float m_boundingRadius;
+    
+    /**
+     * Largest range of the texture coordinates of the object, at least 1.
+     */
+    float m_textureRepeat;
+    
+    /**
+     * Number of levels of detail added to the selected LOD for shadow mapping.
+     */
+    unsigned int m_shadowLodBias;
+    
     /**
      * The root node of the model.
      */
     std::unique_ptr<const Node> p_rootNode;
     
     /**
-     * Vertex Array Object containing all the buffer needed to render the 
-     * object.
+     * Pointer to OpenGL 4.5 functions (immutable buffer storage).
      */
-    QOpenGLVertexArrayObject m_vao;
+    QOpenGLFunctions_4_5_Core * p_glFunctions;
     
     /**
-     * Buffer of vertices.
+     * Range of the geometry heap containing the interleaved vertex data (see 
+     * VertexFormat) and the indices of the object.
      */
-    QOpenGLBuffer m_vertexBuffer;
-
+    const GeometryHeap::Allocation * p_allocation;
+    
     /**
-     * Buffer of normal vectors.
+     * Texture coordinates stored as half floats in the vertex buffer.
      */
-    QOpenGLBuffer m_normalBuffer;
-
+    bool m_halfTextureUV;
+    
     /**
-     * Buffer of textures coordinates.
+     * Check if the vertex and index data have been prepared by the loader,
+     * the other vertex streams are empty then.
      */
-    QOpenGLBuffer m_textureUVBuffer;
-
+    bool m_isPrepared;
+    
+    /**
+     * Interleaved vertex data copied to the geometry heap at initialization.
+     */
+    QByteArray m_vertexData;
+    
+    /**
+     * Packed index data copied to the geometry heap at initialization.
+     */
+    QByteArray m_indexData;
+    
     /**
-     * Buffer of indices.
+     * Layout of the indices of each mesh in the index data.
      */
-    QOpenGLBuffer m_indexBuffer;
+    std::vector<IndexLayout> m_layouts;
     
     /**
-     * Buffer of tangents.
+     * The cache entry mapped by the prepared data, if any. This pointer is
+     * reset after initialization.
      */
-    QOpenGLBuffer m_tangentBuffer;
+    std::shared_ptr<QFile> p_entryFile;
     
     /**
-     * Buffer of bitangents.
+     * Statistics of the models optimized since the last report.
      */
-    QOpenGLBuffer m_bitangentBuffer;
+    static OptimizationStatistics m_statistics;
+    
+    /**
+     * The materials of the meshes of the object.
+     */
+    std::vector<const Material *> m_materials;
 
     /**
      * The shader used to render the scene.
      */
-    std::unique_ptr<ObjectShader> p_objectShader;
+    std::shared_ptr<ObjectShader> p_objectShader;
     
     /**
      * The shader used to render the object when computing the shadow map.
      */
-    std::unique_ptr<ObjectShadowShader> p_shadowShader;
+    std::shared_ptr<ObjectShadowShader> p_shadowShader;
     
     /**
      * Pointer to the vertices data used to fill the vertex buffer at 
@@ -289,21 +469,43 @@ public:
     const QString getName() const {return m_name;};
     
     /**
-     * @brief Draw the node and its children.
+     * @brief Queue the meshes of the node and of its children in the render
+     * queue.
      * @param model The model matrix use to position the node. Note that the 
      * transformation stored in the node is applied for positioning the node.
-     * @param view The view matrix.
-     * @param projection The projection matrix.
-     * @param lightSpace The view and projection matrix of the light (used for 
-     * shadow mapping).
-     * @param drawLaterMeshes Container of meshes to draw later (transparent
-     * meshes).
+     * @param cameraPosition The position of the camera, used to sort the 
+     * meshes.
      * @param objectShader The shader used to render the object.
+     * @param halfTextureUV The vertex format of the object.
+     * @param lod The level of detail used to draw the meshes.
+     */
+    void queueNode(const QMatrix4x4 & model, const QVector3D & cameraPosition,
+                   ObjectShader * objectShader, bool halfTextureUV, 
+                   unsigned int lod) const;
+    
+    /**
+     * @brief Expand a bounding box with the meshes of the node and of its
+     * children.
+     * @param[in] model The model matrix use to position the node.
+     * @param[in] vertices The vertex data of the object.
+     * @param[in] indices The index data of the object.
+     * @param[in,out] lower The lower corner of the bounding box.
+     * @param[in,out] upper The upper corner of the bounding box.
+     */
+    void expandBoundingBox(const QMatrix4x4 & model, 
+                           const QVector<float> & vertices,
+                           const QVector<unsigned int> & indices,
+                           QVector3D & lower, QVector3D & upper) const;
+    
+    /**
+     * @brief Collect the meshes of the node and of its children.
+     * @param[in] model The model matrix use to position the node.
+     * @param[out] meshes The meshes with the model matrix of their node.
      */
-    void drawNode(const QMatrix4x4 & model, const QMatrix4x4 & view, 
-                  const QMatrix4x4 & projection, const QMatrix4x4 lightSpace[], 
-                  MeshesToDrawLater & drawLaterMeshes, 
-                  ObjectShader * objectShader) const;
+    void collectMeshes(
+        const QMatrix4x4 & model, 
+        std::vector<std::pair<QMatrix4x4, const Mesh *>> & meshes
+    ) const;
     
 private:
     /**
@@ -335,12 +537,22 @@ private:
  * @author Louis Filipozzi
  * @remark The mesh does not contains any vertices, normals, and indices data. 
  * It only has information about the number of vertices in the mesh, and the 
- * offset of the first index in the index buffer. The data must be stored in the
- * Vertex Array Object (VAO) of the class containing the mesh. This is done to 
- * reduce number of VAO that have to be bind for rendering.
+ * offset of the first index in the index buffer. The data is stored in the 
+ * range of the geometry heap allocated to the object containing the mesh. This
+ * is done to reduce number of VAO that have to be bind for rendering.
+ * The levels of detail of the mesh are stored the same way: each LOD is a 
+ * range of the index buffer referencing the vertices of the full mesh.
  */
 class Object::Mesh {
 public:
+    /**
+     * @brief Range of the index buffer defining a level of detail.
+     */
+    struct Lod {
+        unsigned int count;  ///< Number of indices.
+        unsigned int offset; ///< Offset of the first index in the buffer.
+    };
+    
     /**
      * @brief Constructor of the mesh.
      * @param name The name of the mesh.
@@ -351,17 +563,61 @@ public:
     Mesh(const QString name, const unsigned int count, 
          const unsigned int offset, 
          const std::shared_ptr<const Material> material
-    ) : m_name(name), m_indexCount(count), m_indexOffset(offset), 
-    m_material(material) {};
+    ) : m_name(name), m_lods({{count, offset}}), m_material(material),
+    m_indexType(GL_UNSIGNED_INT), m_baseVertex(0), p_allocation(nullptr),
+    m_materialIndex(0) {};
+    
+    /**
+     * @brief Constructor of a mesh with several levels of detail.
+     * @param name The name of the mesh.
+     * @param lods The levels of detail, from the most to the least detailed.
+     * @param material The material used by the mesh.
+     */
+    Mesh(const QString name, const std::vector<Lod> lods,
+         const std::shared_ptr<const Material> material
+    ) : m_name(name), m_lods(lods), m_material(material),
+    m_indexType(GL_UNSIGNED_INT), m_baseVertex(0), p_allocation(nullptr),
+    m_materialIndex(0) {};
     ~Mesh() {};
     
     /**
-     * @brief Set material uniform and draw the mesh.
-     * @param objectShader The shader used to render the object.
-     * @remark This function does not set the uniform for the model, view, and
-     * projection matrices. It only set the uniforms related to the material.
+     * @brief Get the range of the geometry heap drawing a level of detail.
+     * @param[in] lod The level of detail. The least detailed LOD of the mesh 
+     * is used if the mesh does not have this level of detail.
+     * @param[out] type The type of the indices.
+     * @param[out] count The number of indices.
+     * @param[out] byteOffset The offset of the first index in the index 
+     * buffer of the heap (bytes).
+     * @param[out] baseVertex The value added to the indices.
+     * @return False if the data of the mesh is not in the heap.
+     */
+    bool getDrawRange(unsigned int lod, GLenum & type, GLsizei & count,
+                      size_t & byteOffset, GLint & baseVertex) const;
+    
+    /**
+     * @brief Return the range of the index buffer of the most detailed LOD.
+     */
+    const Lod & getFullDetail() const {return m_lods.front();};
+    
+    /**
+     * @brief Return the levels of detail, from the most to the least detailed.
+     */
+    const std::vector<Lod> & getLods() const {return m_lods;};
+    
+    /**
+     * @brief Return the material used by the mesh.
+     */
+    std::shared_ptr<const Material> getMaterial() const {return m_material;};
+    
+    /**
+     * @brief Return the index of the material in the MaterialTable.
+     */
+    GLuint getMaterialIndex() const {return m_materialIndex;};
+    
+    /**
+     * @brief Set the index of the material in the MaterialTable.
      */
-    void drawMesh(ObjectShader * objectShader) const;
+    void setMaterialIndex(GLuint index) const {m_materialIndex = index;};
     
     /**
      * @brief Check if the material applied to the node is opaque.
@@ -369,6 +625,21 @@ public:
      */
     bool isOpaque() const {return (m_material->getAlpha() == 1.0f);};
     
+    /**
+     * @brief Set the layout of the mesh in the index data of the object.
+     * @param allocation The range of the geometry heap containing the data of
+     * the object, or nullptr if the data has been released.
+     * @param type The type of the indices (GL_UNSIGNED_SHORT or 
+     * GL_UNSIGNED_INT).
+     * @param baseVertex The value added to the indices when drawing, relative
+     * to the first vertex of the object.
+     * @param byteOffsets The offset (in bytes) of each level of detail, 
+     * relative to the index data of the object.
+     */
+    void setIndexLayout(const GeometryHeap::Allocation * allocation,
+                        GLenum type, GLint baseVertex, 
+                        std::vector<size_t> byteOffsets) const;
+    
 private:
     /**
      * The name of the mesh.
@@ -376,19 +647,41 @@ private:
     const QString m_name;
     
     /**
-     * Number of indices used by the vertices of the mesh.
+     * Levels of detail of the mesh, the first one is the full mesh.
      */
-    const unsigned int m_indexCount;
+    const std::vector<Lod> m_lods;
     
     /**
-     * Offset in the index buffer of the first mesh index.
+     * Pointer to the material of the mesh.
      */
-    const unsigned int m_indexOffset;
+    const std::shared_ptr<const Material> m_material;
     
     /**
-     * Pointer to the material of the mesh.
+     * Type of the indices in the index buffer. The layout is mutable since it
+     * is only known when the object creates its buffers.
      */
-    const std::shared_ptr<const Material> m_material;
+    mutable GLenum m_indexType;
+    
+    /**
+     * Value added to the indices when drawing.
+     */
+    mutable GLint m_baseVertex;
+    
+    /**
+     * Offset (in bytes) of each level of detail in the index data.
+     */
+    mutable std::vector<size_t> m_byteOffsets;
+    
+    /**
+     * Range of the geometry heap containing the data of the object.
+     */
+    mutable const GeometryHeap::Allocation * p_allocation;
+    
+    /**
+     * Index of the material in the MaterialTable, set when the object is
+     * initialized.
+     */
+    mutable GLuint m_materialIndex;
 };
 
 
@@ -442,66 +735,107 @@ public:
     
 private:
     /**
-     * @brief Process Assimp material into a Material. 
+     * @brief Import the model with Assimp.
+     * @param[in] flags The Assimp post-processing flags.
+     * @param[out] entry The processed model.
+     * @return True if the model has been imported successfully.
+     */
+    bool import(unsigned int flags, MeshCache::Entry & entry);
+    
+    /**
+     * @brief Generate the simplified levels of detail of each mesh and append
+     * them to the index buffer.
+     * @param entry The processed model.
+     */
+    static void generateLods(MeshCache::Entry & entry);
+    
+    /**
+     * @brief Optimize the meshes, interleave the vertex data and pack the
+     * indices of each mesh, as Object::initialize() does for the objects
+     * which are not loaded from a file. Only the positions and the indices
+     * are kept as streams.
+     * @param entry The processed model.
+     */
+    static void prepareBuffers(MeshCache::Entry & entry);
+    
+    /**
+     * @brief Create the object from the processed model.
+     * @param entry The processed model, its data is moved to the object.
+     * @return True if the object has been created successfully.
+     */
+    bool buildObject(MeshCache::Entry & entry);
+    
+    /**
+     * @brief Process Assimp material into a material record. 
      * @details Check if the lighting model is supported and retrieve material
-     * information (color, shininess, ...).
+     * information (color, shininess, textures, ...).
      * @param mater The Assimp material.
      * @param textureDir The directory containing the textures to load.
      * @return The processed material.
      */
-    std::shared_ptr<const Material> processMaterial(const aiMaterial * material,
+    MeshCache::MaterialRecord processMaterial(const aiMaterial * material,
                                               const QString textureDir);
     
     /**
-     * @brief Loads the textures of the material 'material' and of type
-     * 'type'.
+     * @brief Get the paths of the textures of the material 'material' and of
+     * type 'type'.
      * @param material The Assimp material.
      * @param type The type of texture.
      * @param textureDir The folder containing the texture files.
-     * @return Vector of pointer to the material textures.
-     */
-    std::vector<Texture *> loadMaterialTextures(const aiMaterial * material,
-                                   const Texture::Type type,
-                                   const QString textureDir);
-    
-    /**
-     * @brief Process the Assimp mesh into a Mesh.
-     * @details Retrieve the data to fill the vertices, normals, indices, and 
-     * texture coordinate buffer of the object, and create the meshes.
-     * @param[in] aiMesh The Assimp mesh.
-     * @param[in] materials The vector of the processed materials of the object.
-     * @param[out] vertices The data used to fill the vertex buffer.
-     * @param[out] normals The data used to fill the normal buffer.
-     * @param[out] textureUV The data used to fill the texture coordinates 
-     * buffer.
-     * @param[out] indices The data used to fill the index buffer.
-     * @param[out] tangents The data used to fill the tangent buffer.
-     * @param[out] bitangents The data used to fill the bitangent buffer.
-     * @remark The std::unique_ptr vertices, normals, textureUV, and indices are
-     * passed by reference as we don't want to give ownership of the pointer to 
-     * the function, but only perform some action to change its content
-     * @return The processed mesh.
+     * @return Vector of paths to the material textures.
+     */
+    std::vector<QString> getTexturePaths(const aiMaterial * material,
+                                         const Texture::Type type,
+                                         const QString textureDir);
+    
+    /**
+     * @brief Create a material and load its textures.
+     * @param material The material record.
+     * @return The material.
      */
-    std::shared_ptr<const Mesh> processMesh(const aiMesh * mesh,
-            const std::vector<std::shared_ptr<const Material>> & materials,
-            std::unique_ptr<QVector<float>> & vertices,
-            std::unique_ptr<QVector<float>> & normals,
-            std::unique_ptr<QVector<QVector<float>>> & textureUV,
-            std::unique_ptr<QVector<unsigned int>> & indices,
-            std::unique_ptr<QVector<float>> & tangents,
-            std::unique_ptr<QVector<float>> & bitangents
+    static std::shared_ptr<const Material> createMaterial(
+        const MeshCache::MaterialRecord & material
     );
     
     /**
-     * @brief Process the Assimp node into a Node.
+     * @brief Load a texture with the texture manager.
+     * @param path The path to the texture file.
+     * @param type The type of texture.
+     * @return The texture or nullptr if the path is empty.
+     */
+    static Texture * loadTexture(const QString & path, 
+                                 const Texture::Type type);
+    
+    /**
+     * @brief Process the Assimp mesh into a mesh record.
+     * @details Retrieve the data to fill the vertices, normals, indices, 
+     * tangents and texture coordinate buffers of the object.
+     * @param[in] mesh The Assimp mesh.
+     * @param[in,out] entry The processed model the mesh is appended to.
+     */
+    void processMesh(const aiMesh * mesh, MeshCache::Entry & entry);
+    
+    /**
+     * @brief Process the Assimp node and its children into node records, in
+     * depth-first order.
      * @param[in] node The Assimp node.
-     * @param[in] scene The Assimp scene.
-     * @param[in] meshes The processed meshes of the scene.
-     * @return The processed node.
+     * @param[in,out] entry The processed model the nodes are appended to.
+     */
+    void processNode(const aiNode * node, MeshCache::Entry & entry);
+    
+    /**
+     * @brief Create a node and its children from the node records.
+     * @param[in] entry The processed model.
+     * @param[in] meshes The meshes of the model.
+     * @param[in,out] index The index of the node record, incremented past the
+     * records of the node and its children.
+     * @return The node.
      */
-    std::unique_ptr<const Node> processNode(const aiNode * node, 
-            const aiScene * scene, 
-            const std::vector<std::shared_ptr<const Mesh>> & sceneMeshes);
+    static std::unique_ptr<const Node> createNode(
+        const MeshCache::Entry & entry,
+        const std::vector<std::shared_ptr<const Mesh>> & meshes, 
+        size_t & index
+    );
     
 private:
     /**
@@ -622,4 +956,92 @@ private:
 };
 
 
+
+#include <array>
+#include <map>
+
+/// Static geometry batcher
+/**
+ * @brief Merge static objects into a few objects sharing their buffers.
+ * @author Louis Filipozzi
+ * @details The instances added to the batcher are grouped by spatial cell, 
+ * from the center of their bounding box. In each cell, the meshes using 
+ * equivalent materials are merged into a single mesh whose vertices are 
+ * transformed in world coordinates. A cell is therefore drawn with one VAO 
+ * bind and one draw call per material, and its bounding sphere is still small
+ * enough to cull it.
+ * The levels of detail of the merged meshes are concatenated: the i-th LOD of 
+ * a merged mesh contains the i-th LOD of all its meshes.
+ */
+class Object::Batcher {
+public:
+    /**
+     * @brief Constructor of the batcher.
+     * @param cellSize The size of the spatial cells.
+     */
+    Batcher(float cellSize) : m_cellSize(cellSize) {};
+    
+    /**
+     * @brief Add an instance of an object to merge.
+     * @remark Only opaque objects which have not been initialized yet can be 
+     * merged, since the vertex data is freed at initialization.
+     * @param object The object.
+     * @param model The model matrix of the instance.
+     * @return Return true if the instance is added, false if the object cannot
+     * be merged.
+     */
+    bool addInstance(const Object * object, const QMatrix4x4 & model);
+    
+    /**
+     * @brief Merge the instances.
+     * @return One object per spatial cell, positioned in world coordinates.
+     */
+    std::vector<std::unique_ptr<Object>> build();
+    
+private:
+    /**
+     * Instance of an object added to the batcher.
+     */
+    struct Instance {
+        const Object * object;
+        QMatrix4x4 model;
+    };
+    
+    /**
+     * Vertex data of a merged object.
+     */
+    struct Buffers {
+        QVector<float> vertices;
+        QVector<float> normals;
+        QVector<float> textureUV;
+        QVector<float> tangents;
+        QVector<float> bitangents;
+    };
+    
+    /**
+     * @brief Append a mesh of an object to the merged vertex data.
+     * @param[in] object The object owning the mesh.
+     * @param[in] model The model matrix of the mesh.
+     * @param[in] mesh The mesh.
+     * @param[in,out] buffers The merged vertex data.
+     * @param[in,out] lodIndices The merged indices of each level of detail.
+     */
+    static void appendMesh(
+        const Object & object, const QMatrix4x4 & model, const Mesh & mesh, 
+        Buffers & buffers, std::vector<QVector<unsigned int>> & lodIndices
+    );
+    
+private:
+    /**
+     * The size of the spatial cells.
+     */
+    float m_cellSize;
+    
+    /**
+     * The instances added to the batcher, sorted by spatial cell.
+     */
+    std::map<std::array<int,3>, std::vector<Instance>> m_cells;
+};
+
+
 #endif // OBJECT_H
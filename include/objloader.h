@@ -0,0 +1,170 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include "meshcache.h"
+#include <QByteArray>
+#include <QString>
+#include <map>
+#include <vector>
+
+/// Wavefront OBJ loader
+/**
+ * @brief Parse Wavefront OBJ and MTL files directly into the processed model
+ * used by the object loader.
+ * @author Louis Filipozzi
+ * @details The file is memory-mapped and split into line-aligned chunks which
+ * are parsed in parallel: each chunk stores its positions, texture
+ * coordinates, normals and faces. The chunks are then merged in parallel as
+ * well: each chunk triangulates its faces (fan) and merges its identical
+ * (position, texture coordinates, normal) triplets into a single vertex,
+ * which gives the number of vertices and indices of each chunk, hence their
+ * offsets in the final vertex streams. Each chunk then writes its vertices
+ * and indices there directly. Only the statements changing the mesh (object,
+ * material) and the sums of the smooth normals are processed serially.
+ * @remark The vertices are only merged within a chunk: a vertex used by the
+ * faces of several chunks is duplicated in each of them.
+ *
+ * The output matches the Assimp import of the object loader: a new mesh is
+ * started at each change of object or material, the missing normals are
+ * smoothed over the faces sharing a position, and the tangent space is
+ * computed with TangentGenerator. The root node has one child per object.
+ * @remark Only the material properties used by the renderer are read: the
+ * colors, the shininess, the opacity, the illumination model, and the diffuse
+ * (map_Kd) and normal (norm, map_Kn) textures.
+ */
+class ObjLoader {
+public:
+    /**
+     * @brief Load an OBJ file.
+     * @param[in] filePath The path to the OBJ file.
+     * @param[in] textureDir The directory containing the textures.
+     * @param[out] entry The processed model, without levels of detail.
+     * @return True if the file has been parsed successfully.
+     */
+    static bool load(const QString & filePath, const QString & textureDir,
+                     MeshCache::Entry & entry);
+
+private:
+    ObjLoader() {};
+
+    /**
+     * @brief Reference of a face corner to the attributes, as written in the
+     * file. The references relative to the end of the attributes (negative
+     * in the file) are stored relative to the beginning of the chunk.
+     */
+    struct Corner {
+        int position;
+        int textureUV;
+        int normal;
+        unsigned char relative; ///< Bit i set if reference i is relative.
+    };
+
+    /**
+     * @brief Attributes of a vertex: the indices of its position, texture
+     * coordinates and normal (-1 if missing).
+     */
+    struct VertexKey {
+        int position;
+        int textureUV;
+        int normal;
+
+        bool operator==(const VertexKey & other) const {
+            return position == other.position &&
+                textureUV == other.textureUV && normal == other.normal;
+        };
+    };
+
+    /**
+     * @brief Statement changing the state of the faces that follow it.
+     */
+    struct Event {
+        enum Type {Object, Material, Library};
+        Type type;
+        size_t face;     ///< Index of the first face of the chunk following it.
+        QByteArray name; ///< Name of the object, material, or library.
+    };
+
+    /**
+     * @brief Data of a chunk of the file.
+     */
+    struct Chunk {
+        std::vector<float> positions;
+        std::vector<float> textureUV;
+        std::vector<float> normals;
+        std::vector<Corner> corners;
+        std::vector<unsigned int> faceSizes;
+        std::vector<Event> events;
+        // Merged faces, the vertices are numbered from the chunk
+        std::vector<VertexKey> vertices;  ///< Unique vertices of the chunk.
+        std::vector<unsigned int> indices; ///< Triangles of the chunk.
+        std::vector<unsigned int> eventIndices; ///< Indices before an event.
+        std::vector<float> faceNormals;   ///< Normal of the unsmoothed faces.
+        /// Pairs of (position, face normal) to sum into the smooth normals.
+        std::vector<std::pair<int, unsigned int>> smoothCorners;
+    };
+
+    /**
+     * @brief Attributes of all the chunks.
+     */
+    struct Attributes {
+        std::vector<float> positions;
+        std::vector<float> textureUV;
+        std::vector<float> normals;
+        std::vector<float> smoothNormals; ///< Sum of the normals per position.
+        int counts[3];                    ///< Number of each attribute.
+    };
+
+    /**
+     * @brief Parse the lines in [begin, end).
+     */
+    static void parseChunk(const char * begin, const char * end,
+                           Chunk & chunk);
+
+    /**
+     * @brief Resolve the references of the faces of a chunk, merge its
+     * identical vertices and triangulate its faces.
+     * @param[in,out] chunk The chunk.
+     * @param[in] bases The number of each attribute in the previous chunks,
+     * to which the relative references of the chunk are added.
+     * @param[in] attributes The attributes of all the chunks.
+     */
+    static void mergeChunk(Chunk & chunk, const int * bases,
+                           const Attributes & attributes);
+
+    /**
+     * @brief Write the vertices and the indices of a merged chunk in the
+     * final vertex streams, at the position of the chunk.
+     * @param[in] chunk The merged chunk.
+     * @param[in] attributes The attributes with the sums of smooth normals.
+     * @param[in] firstVertex The number of vertices of the previous chunks.
+     * @param[out] vertices The positions of the first vertex of the chunk.
+     * @param[out] normals The normals of the first vertex of the chunk.
+     * @param[out] textureUV The texture coordinates of the first vertex of
+     * the chunk, or nullptr.
+     * @param[out] indices The first index of the chunk.
+     */
+    static void writeChunk(const Chunk & chunk, const Attributes & attributes,
+                           unsigned int firstVertex, float * vertices,
+                           float * normals, float * textureUV,
+                           unsigned int * indices);
+
+    /**
+     * @brief Parse a MTL file and append its materials.
+     * @param[in] path The path to the MTL file.
+     * @param[in] textureDir The directory containing the textures.
+     * @param[in,out] materials The material table.
+     * @param[in,out] names The index of each material name in the table.
+     */
+    static void loadMaterials(
+        const QString & path, const QString & textureDir,
+        std::vector<MeshCache::MaterialRecord> & materials,
+        std::map<QByteArray, unsigned int> & names
+    );
+
+    /**
+     * @brief Return the material used when none is defined.
+     */
+    static MeshCache::MaterialRecord defaultMaterial(const QString & name);
+};
+
+#endif // OBJLOADER_H
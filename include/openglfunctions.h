@@ -0,0 +1,28 @@
+#ifndef OPENGLFUNCTIONS_H
+#define OPENGLFUNCTIONS_H
+
+#include <QOpenGLFunctions_4_5_Core>
+
+/// OpenGL functions
+/**
+ * @brief Access the OpenGL 4.5 functions of the current context.
+ * @author Louis Filipozzi
+ * @details The singletons owning OpenGL resources shared by all the objects
+ * (GeometryHeap, ShaderRegistry, TextureManager, TextureArrays, TextureAtlas)
+ * do not keep a context: they get the functions of the current context each
+ * time they need them.
+ */
+class OpenGLFunctions {
+public:
+    /**
+     * @brief Return the OpenGL 4.5 functions of the current context.
+     * @return The functions, or nullptr with a warning if there is no current
+     * context or if it does not support OpenGL 4.5.
+     */
+    static QOpenGLFunctions_4_5_Core * get();
+
+private:
+    OpenGLFunctions() {};
+};
+
+#endif // OPENGLFUNCTIONS_H
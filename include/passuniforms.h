@@ -0,0 +1,110 @@
+#ifndef PASSUNIFORMS_H
+#define PASSUNIFORMS_H
+
+#include "light.h"
+#include "constants.h"
+#include <QMatrix4x4>
+#include <QOpenGLFunctions_4_5_Core>
+#include <array>
+#include <cstddef>
+
+/// Uniforms of a render pass
+/**
+ * @brief Store the uniforms shared by all the draws of a render pass (camera,
+ * light, shadow cascades) in a uniform buffer object.
+ * @author Louis Filipozzi
+ * @details The buffer is updated once per pass and bound to the binding point
+ * PassUniforms::BINDING, where the object shaders read it as the std140 block
+ * "PassUniforms":
+ * @code
+ * layout (std140, binding = 0) uniform PassUniforms {
+ *     mat4 V;
+ *     mat4 P;
+ *     mat4 lVP[NUM_CASCADES];
+ *     vec4 lightDirection;    // View coordinates
+ *     vec4 lightIntensity;
+ *     vec4 endCascade;        // Far plane of each cascade
+ * };
+ * @endcode
+ * The shadow pass renders all the cascades at once: it sets the view and
+ * projection matrices to the identity and the light space matrices of the
+ * cascades, which are selected by the instance of the draw.
+ * @remark The buffer is created by the first update and orphaned by the
+ * following ones, so a pass never waits for the draws of the previous pass.
+ */
+class PassUniforms {
+public:
+    /**
+     * Binding point of the uniform buffer.
+     */
+    static constexpr GLuint BINDING = 0;
+
+    /**
+     * @brief Set the uniforms of a pass rendering the scene.
+     * @param light The light of the scene.
+     * @param view The view matrix.
+     * @param projection The projection matrix.
+     * @param lightSpace The view and projection matrices of the light.
+     * @param cascades Array containing the distance for cascade shadow mapping.
+     */
+    static void update(const CasterLight & light, const QMatrix4x4 & view,
+                       const QMatrix4x4 & projection,
+                       const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace,
+                       const std::array<float,NUM_CASCADES+1> & cascades);
+
+    /**
+     * @brief Set the uniforms of a pass rendering the shadow map of all the
+     * cascades.
+     * @param lightSpace The view and projection matrices of the light.
+     */
+    static void updateShadow(
+        const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace
+    );
+
+    /**
+     * @brief Return the size of the uniform block (bytes), used to check the
+     * layout of the block declared by the shaders.
+     */
+    static GLint getDataSize() {return static_cast<GLint>(sizeof(Data));};
+
+    /**
+     * @brief Properly deallocate the buffer.
+     */
+    static void cleanUp();
+
+private:
+    PassUniforms() {};
+
+    /**
+     * @brief Content of the buffer (std140 layout).
+     */
+    struct Data {
+        GLfloat view[16];
+        GLfloat projection[16];
+        GLfloat lightSpace[NUM_CASCADES][16];
+        GLfloat lightDirection[4];
+        GLfloat lightIntensity[4];
+        GLfloat endCascade[4];
+    };
+    static_assert(NUM_CASCADES <= 4, 
+                  "The cascades must fit in the vec4 endCascade.");
+    static_assert(offsetof(Data, projection) == 64 &&
+                  offsetof(Data, lightSpace) == 128 &&
+                  offsetof(Data, lightDirection) == 128 + 64 * NUM_CASCADES &&
+                  offsetof(Data, lightIntensity) == 144 + 64 * NUM_CASCADES &&
+                  offsetof(Data, endCascade) == 160 + 64 * NUM_CASCADES &&
+                  sizeof(Data) == 176 + 64 * NUM_CASCADES,
+                  "Data must match the std140 layout of PassUniforms.");
+
+    /**
+     * @brief Copy the data to the buffer and bind it.
+     */
+    static void upload(const Data & data);
+
+    /**
+     * The uniform buffer.
+     */
+    static GLuint m_buffer;
+};
+
+#endif // PASSUNIFORMS_H
@@ -0,0 +1,177 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include "object.h"
+#include <QMatrix4x4>
+#include <QOpenGLFunctions_4_5_Core>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+
+
+/// Render queue
+/**
+ * @brief Collect the meshes drawn by the objects of a pass, sort them by
+ * pipeline state and draw them applying only the state that changes between
+ * two consecutive draws.
+ * @author Louis Filipozzi
+ * @details The meshes are queued between open() and flush(). Each draw item
+ * gets a 64-bit key packing, from the most to the least significant bits:
+ * - the pass (opaque or transparent, 4 bits),
+ * - the shader program (12 bits),
+ * - the vertex format (1 bit),
+ * - the texture set of the material (15 bits),
+ * - the index of the material in the MaterialTable (16 bits),
+ * - the distance to the camera (16 bits).
+ *
+ * The opaque meshes are therefore grouped by state and drawn from the closest
+ * to the farthest within a state. For the transparent meshes, the inverted
+ * distance is moved right after the pass, so they are drawn from the farthest
+ * to the closest whatever their state. The texture set is made of the texture
+ * arrays storing the textures of the material (see TextureArrays), so it is
+ * sorted before the material since many materials share the same arrays.
+ *
+ * When drawing the sorted items, the program, the VAO of the GeometryHeap,
+ * the index of the material and each texture unit are only set when they
+ * differ from the previous item. The state changes that were avoided are
+ * counted in getStatistics().
+ * @remark Object::render() queues its meshes if the queue is open and draws
+ * them through a queue of its own otherwise.
+ */
+class Object::RenderQueue {
+public:
+    /**
+     * @brief Number of state changes applied and avoided by the queue.
+     */
+    struct Statistics {
+        unsigned long draws = 0;
+        unsigned long programBinds = 0;
+        unsigned long programBindsAvoided = 0;
+        unsigned long vaoBinds = 0;
+        unsigned long vaoBindsAvoided = 0;
+        unsigned long materialUpdates = 0;
+        unsigned long materialUpdatesAvoided = 0;
+        unsigned long textureBinds = 0;
+        unsigned long textureBindsAvoided = 0;
+    };
+
+    /**
+     * @brief Start collecting the meshes of a pass.
+     */
+    static void open();
+
+    /**
+     * @brief Check if the meshes are collected.
+     */
+    static bool isOpen() {return m_isOpen;};
+
+    /**
+     * @brief Queue a mesh.
+     * @param shader The shader used to draw the mesh.
+     * @param mesh The mesh.
+     * @param model The model matrix of the mesh.
+     * @param halfTextureUV The vertex format of the object of the mesh.
+     * @param lod The level of detail to draw.
+     * @param distance The distance between the mesh and the camera.
+     */
+    static void add(ObjectShader * shader, const Mesh * mesh,
+                    const QMatrix4x4 & model, bool halfTextureUV,
+                    unsigned int lod, float distance);
+
+    /**
+     * @brief Sort and draw the queued meshes, then stop collecting.
+     * @remark The uniforms of the pass must have been set with PassUniforms.
+     */
+    static void flush();
+
+    /**
+     * @brief Return the counters accumulated since the last call to
+     * resetStatistics().
+     */
+    static const Statistics & getStatistics() {return m_statistics;};
+
+    /**
+     * @brief Reset the counters.
+     */
+    static void resetStatistics() {m_statistics = Statistics();};
+
+    /**
+     * @brief Remove the queued meshes and the identifiers of the states.
+     */
+    static void cleanUp();
+
+private:
+    RenderQueue() {};
+
+    /**
+     * @brief Mesh to draw with its state.
+     */
+    struct Item {
+        std::uint64_t key;
+        ObjectShader * shader;
+        const Mesh * mesh;
+        QMatrix4x4 model;
+        bool halfTextureUV;
+        unsigned int lod;
+    };
+
+    /**
+     * Texture arrays of a material: diffuse, normal and bump.
+     */
+    typedef std::tuple<const TextureArrays::Array *, 
+                       const TextureArrays::Array *, 
+                       const TextureArrays::Array *> TextureSet;
+    
+    /**
+     * @brief Return the array storing a texture, nullptr if there is no
+     * texture.
+     */
+    static const TextureArrays::Array * getArray(const Texture * texture) {
+        return texture != nullptr ? texture->getArray() : nullptr;
+    };
+
+    /**
+     * @brief Return the identifier of a state, a new state gets the next
+     * identifier.
+     * @remark The identifiers are only used to sort the items, the states
+     * themselves are compared when drawing.
+     */
+    template <class T>
+    static unsigned int getId(std::map<T, unsigned int> & ids, const T & state) {
+        return ids.emplace(state, static_cast<unsigned int>(ids.size()))
+                  .first->second;
+    };
+
+    /**
+     * @brief Draw the items in the order of their keys.
+     */
+    static void draw(QOpenGLFunctions_4_5_Core * gl);
+
+    /**
+     * Check if the meshes are collected.
+     */
+    static bool m_isOpen;
+
+    /**
+     * The queued meshes.
+     */
+    static std::vector<Item> m_items;
+
+    /**
+     * Identifiers of the programs.
+     */
+    static std::map<const ObjectShader *, unsigned int> m_programIds;
+
+    /**
+     * Identifiers of the texture sets.
+     */
+    static std::map<TextureSet, unsigned int> m_textureIds;
+
+    /**
+     * The counters of the state changes.
+     */
+    static Statistics m_statistics;
+};
+
+#endif // RENDERQUEUE_H
@@ -5,6 +5,13 @@
 #include <QOpenGLFramebufferObject>
 #include "vehicle.h"
 #include "frame.h"
+#include "linebatch.h"
+#include "impostor.h"
+#include "indirectrenderer.h"
+#include "materialtable.h"
+#include "renderqueue.h"
+#include "passuniforms.h"
+#include "shaderregistry.h"
 #include "skybox.h"
 #include <memory>
 #include "camera.h"
@@ -52,11 +59,10 @@ public:
     void render();
     
     /**
-     * @brief Render the scene to generate the shadow map associated to the 
-     * cascadeIdx-th cascade.
-     * @param cascadeIdx The cascade index.
+     * @brief Render the scene to generate the shadow map of all the cascades
+     * at once, the scene being traversed a single time.
      */
-    void renderShadow(unsigned int cascadeIdx);
+    void renderShadow();
 
     /**
      * @brief Cleanup the animation.
@@ -181,6 +187,28 @@ private:
      * The XYZ frame of the scene.
      */
     Frame m_frame;
+    
+    /**
+     * Batch gathering the lines (tire forces, frame) drawn in the frame.
+     */
+    LineBatch m_lines;
+    
+    /**
+     * Renderer of the distant static models drawn as impostors.
+     */
+    ImpostorRenderer m_impostors;
+    
+    /**
+     * Check if the impostors have been baked while textures were still
+     * loading (see TextureManager::isLoading()).
+     */
+    bool m_impostorPlaceholders;
+    
+    /**
+     * Renderer submitting the objects of the scene graph with multi-draw 
+     * indirect calls.
+     */
+    Object::IndirectRenderer m_indirect;
 
     /**
      * The current timestep at which the frame is drawn.
@@ -263,7 +291,12 @@ private:
  */
 class Scene::Loader {
 public:
-    Loader();
+    /**
+     * @brief Constructor of the scene loader.
+     * @param impostors The renderer in which the models drawn as impostors 
+     * are registered.
+     */
+    Loader(ImpostorRenderer & impostors);
     ~Loader();
     
     /**
@@ -337,8 +370,15 @@ private:
      */
     ABCObject * processReference(const QDomElement & elmt);
     
+    /**
+     * @brief Merge the static objects drawn only once in the scene graph into
+     * a few objects grouped by material and spatial cell.
+     */
+    void batchStaticObjects();
+    
 private:
     std::unique_ptr<Node> p_rootNode;
+    ImpostorRenderer & m_impostors;
 };
 
 
@@ -388,20 +428,49 @@ public:
      * @param lightSpace The view and projection matrix of the light (used for 
      * shadow mapping).
      * @param cascades Array containing the distance for cascade shadow mapping.
+     * @param impostors The renderer queuing the objects drawn as impostors.
+     * @param indirect The renderer queuing the objects drawn with multi-draw
+     * indirect calls.
      */
     void render(
         const CasterLight & light, const QMatrix4x4 & view, 
         const QMatrix4x4 & projection, 
         const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace,
-        const std::array<float,NUM_CASCADES+1> & cascades
+        const std::array<float,NUM_CASCADES+1> & cascades,
+        ImpostorRenderer & impostors, Object::IndirectRenderer & indirect
     );
     
     /**
      * @brief Render the shadow of the node and of all its descendants.
-     * @param lightSpace The view and projection matrix of the light (used for 
-     * shadow mapping).
+     * @param lightSpace The view and projection matrices of the light (used 
+     * for shadow mapping), one per cascade.
+     * @param indirect The renderer queuing the objects drawn with multi-draw
+     * indirect calls.
      */
-    void renderShadow(const QMatrix4x4 & lightSpace);
+    void renderShadow(const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace,
+                      Object::IndirectRenderer & indirect);
+    
+    /**
+     * @brief Count the number of times each object is drawn by the node and 
+     * its descendants.
+     * @param[in,out] counts The number of times each object is drawn.
+     */
+    void countObjects(std::map<const ABCObject *, unsigned int> & counts) const;
+    
+    /**
+     * @brief Move the static objects of the node and of its descendants to a 
+     * batcher.
+     * @param[in] counts The number of times each object is drawn in the scene 
+     * graph. Only the objects drawn once are moved.
+     * @param[in] impostors The objects rendered as impostors are not moved.
+     * @param[in,out] batcher The batcher.
+     * @param[out] batched The objects moved to the batcher.
+     */
+    void batchObjects(
+        const std::map<const ABCObject *, unsigned int> & counts,
+        const ImpostorRenderer & impostors, Object::Batcher & batcher,
+        std::vector<const ABCObject *> & batched
+    );
     
 private:
     QMatrix4x4 m_worldMatrix;
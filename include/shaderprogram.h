@@ -3,7 +3,10 @@
 
 #include <QOpenGLShaderProgram>
 #include <QString>
+#include <QStringList>
 #include <array>
+#include <utility>
+#include <vector>
 #include "material.h"
 #include "light.h"
 
@@ -14,16 +17,54 @@
  * @brief This class defines a shader program from the source files of the 
  * vertex and fragment shaders.
  * @author Louis Filipozzi
+ * @details Variants of a shader are selected with preprocessor definitions,
+ * inserted in both sources after the version directive. The binary of the
+ * linked program is cached by ShaderRegistry, which is also the place to
+ * obtain a program shared with the other users of the same sources.
  */
 class Shader : public QOpenGLShaderProgram {
 public:
+    /**
+     * @brief Type and path to the source file of the shaders of a program.
+     */
+    typedef std::vector<std::pair<QOpenGLShader::ShaderType, QString>> Stages;
+
     /**
      * @brief Constructor of the shader program.
      * @param vShader The path to the source file of the vertex shader.
      * @param fShader The path to the source file of the fragment shader.
+     * @param defines The names of the macros defined in both shaders.
      */
-    Shader(QString vShader, QString fShader);
+    Shader(QString vShader, QString fShader, 
+           const QStringList & defines = QStringList());
     virtual ~Shader() {};
+    
+protected:
+    /**
+     * @brief Constructor of a program whose shaders are added by the derived
+     * class.
+     */
+    Shader() {};
+    
+    /**
+     * @brief Load the program from its cached binary, or compile and link
+     * its shaders and cache the binary.
+     * @param stages The shaders of the program.
+     * @param defines The names of the macros defined in the shaders.
+     */
+    void build(const Stages & stages, const QStringList & defines);
+    
+    /**
+     * @brief Read the source of a shader and insert the definitions after its
+     * version directive.
+     * @param path The path to the source file.
+     * @param defines The names of the macros to define.
+     * @return The source code, empty if the file cannot be read.
+     */
+    static QByteArray readSource(const QString & path, 
+                                 const QStringList & defines);
+    
+    friend class ShaderRegistry;
 };
 
 
@@ -32,6 +73,12 @@ public:
 /**
  * @brief Defines a shader to render a 3D object in the scene.
  * @author Louis Filipozzi
+ * @details The uniforms shared by the draws of a pass (camera, light, 
+ * cascades) are read from the uniform block of PassUniforms, so the model 
+ * matrix is the only matrix set per draw. The parameters of the materials are
+ * read from the MaterialTable, a draw only sets the index of its material. 
+ * The locations of the uniforms set per draw are cached when the program is 
+ * created, and the samplers, which never change, are set once.
  */
 class ObjectShader : public Shader {
 public:
@@ -39,45 +86,76 @@ public:
      * @brief Constructor of the shader program.
      * @param vShader The path to the source file of the vertex shader.
      * @param fShader The path to the source file of the fragment shader.
+     * @param defines The names of the macros defined in both shaders.
      */
-    ObjectShader(QString vShader, QString fShader)
-    : Shader(vShader, fShader) {};
+    ObjectShader(QString vShader, QString fShader, 
+                 const QStringList & defines = QStringList());
     virtual ~ObjectShader() {};
     
     /**
-     * @brief Set the uniforms in OpenGL defining the material.
+     * @brief Set the index of the material in the MaterialTable.
+     * @param index The index of the material.
+     */
+    void setMaterialIndex(GLuint index) {
+        setUniformValue(m_locations.material, index);
+    };
+    
+    /**
+     * @brief Bind the texture arrays of a material to their texture units.
+     * @param gl The OpenGL functions of the current context.
      * @param material The material to apply.
      */
-    virtual void setMaterialUniforms(const Material & material);
+    void bindTextures(QOpenGLFunctions_4_5_Core * gl, 
+                      const Material & material);
+    
+    /**
+     * @brief Check if the shader reads the material of the meshes.
+     */
+    virtual bool usesMaterials() const {return true;};
+    
+    /**
+     * @brief Return the number of instances of each draw.
+     */
+    virtual GLsizei getInstanceCount() const {return 1;};
     
     /**
-     * @brief Set the matrix uniforms in OpenGL.
+     * @brief Set the model matrix uniform in OpenGL.
      * @param M The model matrix.
-     * @param V The view matrix.
-     * @param P The projection matrix.
-     * @param lVP The light transform matrix. This correspond to the product of 
-     * the light projection matrix by the light view matrix.
      */
-    virtual void setMatrixUniforms(const QMatrix4x4 & M, 
-                                   const QMatrix4x4 & V, 
-                                   const QMatrix4x4 & P, 
-                                   const QMatrix4x4 lVP[]);
+    void setModelMatrix(const QMatrix4x4 & M) {
+        setUniformValue(m_locations.model, M);
+    };
+    
+    /**
+     * @brief Set the offset of the draw data of a multi-draw indirect call.
+     * @param offset The index of the data of the first draw of the call.
+     */
+    void setDrawOffset(GLuint offset) {
+        setUniformValue(m_locations.drawOffset, offset);
+    };
     
+protected:
     /**
-     * @brief Set the light uniforms in OpenGL.
-     * @param light The light.
-     * @param V The view matrix.
+     * @brief Constructor of a program made of any shaders.
+     * @param stages The shaders of the program.
+     * @param defines The names of the macros defined in all the shaders.
      */
-    virtual void setLightUniforms(const CasterLight & light, 
-                                  const QMatrix4x4 & V);
+    ObjectShader(const Stages & stages, const QStringList & defines);
     
     /**
-     * @brief Set uniforms about cascade shadow.
-     * @param cascades The end distance of each cascade shadow.
+     * @brief Locations of the uniforms set per draw, -1 if the uniform is not
+     * used by the program.
      */
-    virtual void setCascadeUniforms(
-        const std::array<float,NUM_CASCADES+1> & cascades
-    );
+    struct Locations {
+        int model;
+        int drawOffset;
+        int material;
+    };
+    
+    /**
+     * The locations of the uniforms.
+     */
+    Locations m_locations;
 };
 
 
@@ -87,6 +165,13 @@ public:
  * @brief Defines a shader to render a 3D object in the scene for shadow
  * mapping.
  * @author Louis Filipozzi
+ * @details All the cascades are rendered in a single pass to the layers of
+ * the shadow map (see DepthMap): each draw is instanced once per cascade and
+ * the instance selects the light space matrix and the layer of its cascade.
+ * The layer is written by the vertex shader if the driver supports
+ * GL_ARB_shader_viewport_layer_array (macro VERTEX_LAYER), otherwise by the
+ * geometry shader ":/shaders/object_shadow.geom" (macro GEOMETRY_LAYER), see
+ * getLayerDefine().
  */
 class ObjectShadowShader : public ObjectShader {
 public:
@@ -94,49 +179,59 @@ public:
      * @brief Constructor of the shader program.
      * @param vShader The path to the source file of the vertex shader.
      * @param fShader The path to the source file of the fragment shader.
+     * @param defines The names of the macros defined in the shaders, the
+     * geometry shader is added if GEOMETRY_LAYER is defined.
      */
-    ObjectShadowShader(QString vShader, QString fShader)
-    : ObjectShader(vShader, fShader) {};
+    ObjectShadowShader(QString vShader, QString fShader, 
+                       const QStringList & defines = QStringList())
+    : ObjectShader(getStages(vShader, fShader, defines), defines) {};
     virtual ~ObjectShadowShader() {};
     
     /**
      * @overload
-     * @brief Set the uniforms in OpenGL defining the material.
-     * @param material The material to apply.
-     * @remark This function does not set any uniform as the material is not 
-     * used when computing the shadow map.
+     * @brief Check if the shader reads the material of the meshes.
+     * @remark The material is not used when computing the shadow map.
      */
-    virtual void setMaterialUniforms(const Material & material);
+    virtual bool usesMaterials() const {return false;};
     
     /**
      * @overload
-     * @brief Set the matrix uniforms in OpenGL.
-     * @param M The model matrix.
-     * @param V The view matrix.
-     * @param P The projection matrix.
-     * @param lVP The light transform matrix. This correspond to the product of 
-     * the light projection matrix by the light view matrix.
+     * @brief Return the number of instances of each draw, one per cascade.
      */
-    virtual void setMatrixUniforms(const QMatrix4x4 & M, 
-                                   const QMatrix4x4 & V, 
-                                   const QMatrix4x4 & P, 
-                                   const QMatrix4x4 lVP[]);
+    virtual GLsizei getInstanceCount() const {return NUM_CASCADES;};
     
     /**
-     * @brief Set the light uniforms in OpenGL.
-     * @param light The light.
-     * @param V The view matrix.
+     * @brief Return the macro selecting the shader writing the layer of the
+     * shadow map with the driver of the current context: VERTEX_LAYER or 
+     * GEOMETRY_LAYER.
      */
-    virtual void setLightUniforms(const CasterLight & light, 
-                                  const QMatrix4x4 & V);
+    static QString getLayerDefine();
     
     /**
-     * @brief Set uniforms about cascade shadow.
-     * @param cascades The end distance of each cascade shadow.
+     * @brief Return the shaders of a program: the vertex and fragment shaders,
+     * and the geometry shader if GEOMETRY_LAYER is defined.
+     */
+    static Stages getStages(const QString & vShader, const QString & fShader,
+                            const QStringList & defines);
+};
+
+
+/// Compute shader
+/**
+ * @brief Defines a shader program made of a single compute shader.
+ * @author Louis Filipozzi
+ */
+class ComputeShader : public Shader {
+public:
+    /**
+     * @brief Constructor of the shader program.
+     * @param cShader The path to the source file of the compute shader.
+     * @param defines The macros defined in the shader, a value can follow the
+     * name of the macro (e.g. "NUM_LODS 4").
      */
-    virtual void setCascadeUniforms(
-        const std::array<float,NUM_CASCADES+1> & cascades
-    );
+    ComputeShader(QString cShader, 
+                  const QStringList & defines = QStringList());
+    virtual ~ComputeShader() {};
 };
 
 #endif // SHADERPROGRAM_H
@@ -0,0 +1,154 @@
+#ifndef SHADERREGISTRY_H
+#define SHADERREGISTRY_H
+
+#include "shaderprogram.h"
+#include <QByteArray>
+#include <QOpenGLFunctions_4_5_Core>
+#include <QString>
+#include <QStringList>
+#include <map>
+#include <memory>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+/// Shader registry
+/**
+ * @brief Share the shader programs between their users and cache the
+ * binaries of the linked programs on disk.
+ * @author Louis Filipozzi
+ * @details A program is identified by its class, the paths to its sources and
+ * its definitions. It is compiled the first time it is requested and the
+ * following requests return the same program, so the objects of the scene
+ * share a single ObjectShader instead of compiling one each.
+ *
+ * When a program is linked, its binary is read with glGetProgramBinary() and
+ * saved in the cache location of the application, under a key computed from
+ * the driver (vendor, renderer, version) and the processed sources. The next
+ * runs load the binary with glProgramBinary() instead of compiling the
+ * sources. A binary rejected by the driver, e.g. after a driver update, is
+ * ignored and the sources are compiled again.
+ *
+ * precompile() compiles a list of programs before they are requested. The
+ * compilation of all the programs is started before the result of any of
+ * them is read, so the driver can compile them concurrently when it supports
+ * GL_KHR_parallel_shader_compile (or GL_ARB_parallel_shader_compile).
+ * @remark The registry keeps every program alive until cleanUp(), even when
+ * none of the objects uses it anymore.
+ */
+class ShaderRegistry {
+public:
+    /**
+     * @brief Sources and definitions of a program to precompile.
+     */
+    struct Program {
+        Shader::Stages stages;
+        QStringList defines;
+    };
+
+    /**
+     * @brief Return the program made of a vertex and a fragment shader,
+     * compiled on the first request.
+     * @tparam T The class of the program, Shader or a derived class whose
+     * constructor takes the same arguments.
+     * @param vShader The path to the source file of the vertex shader.
+     * @param fShader The path to the source file of the fragment shader.
+     * @param defines The names of the macros defined in both shaders.
+     */
+    template <class T>
+    static std::shared_ptr<T> getShader(const QString & vShader,
+                                        const QString & fShader,
+                                        const QStringList & defines =
+                                            QStringList()) {
+        const QString key = QString(typeid(T).name()) + "|" + vShader + "|" +
+                            fShader + "|" + defines.join("|");
+        auto it = m_shaders.find(key);
+        if (it == m_shaders.end()) {
+            it = m_shaders.emplace(
+                key, std::make_shared<T>(vShader, fShader, defines)
+            ).first;
+        }
+        return std::static_pointer_cast<T>(it->second);
+    };
+
+    /**
+     * @brief Return the program made of a compute shader, compiled on the
+     * first request.
+     * @param cShader The path to the source file of the compute shader.
+     * @param defines The macros defined in the shader.
+     */
+    static std::shared_ptr<ComputeShader> getComputeShader(
+        const QString & cShader, const QStringList & defines = QStringList()
+    );
+
+    /**
+     * @brief Compile the programs whose binary is not cached yet and cache
+     * their binary.
+     * @details The programs are compiled concurrently if the driver supports
+     * it. The programs are not created: getShader() and getComputeShader()
+     * load their binary from the cache.
+     * @param programs The programs.
+     */
+    static void precompile(const std::vector<Program> & programs);
+
+    /**
+     * @brief Release the programs held by the registry.
+     * @remark The programs are destroyed once their users release them.
+     */
+    static void cleanUp();
+
+private:
+    ShaderRegistry() {};
+
+    friend class Shader;
+
+    /**
+     * @brief Return the OpenGL type of a shader stage.
+     */
+    static GLenum shaderType(QOpenGLShader::ShaderType type);
+
+    /**
+     * @brief Return the key of the binary of a program.
+     * @param stages The stages of the program.
+     * @param sources The processed sources of the stages.
+     */
+    static QByteArray programKey(const Shader::Stages & stages,
+                                 const std::vector<QByteArray> & sources);
+
+    /**
+     * @brief Load the cached binary of a program.
+     * @param program The program, created if needed.
+     * @param key The key of the binary.
+     * @return True if the program has been linked from the binary.
+     */
+    static bool loadProgram(QOpenGLShaderProgram & program,
+                            const QByteArray & key);
+
+    /**
+     * @brief Allow the binary of a program to be retrieved, must be called
+     * before linking the program.
+     */
+    static void setRetrievable(QOpenGLShaderProgram & program);
+
+    /**
+     * @brief Cache the binary of a linked program.
+     */
+    static void saveProgram(GLuint program, const QByteArray & key);
+
+    /**
+     * @brief Return the path to the cache file of a binary.
+     */
+    static QString binaryPath(const QByteArray & key);
+
+    /**
+     * The programs, indexed by class, sources and definitions.
+     */
+    static std::map<QString, std::shared_ptr<Shader>> m_shaders;
+
+    /**
+     * The binaries cached during this run (format, binary), indexed by key.
+     */
+    static std::map<QByteArray, std::pair<GLenum, QByteArray>> m_binaries;
+};
+
+#endif // SHADERREGISTRY_H
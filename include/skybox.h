@@ -7,6 +7,7 @@
 #include <QOpenGLVertexArrayObject>
 #include <QMatrix4x4>
 #include <memory>
+#include <vector>
 #include <QOpenGLFunctions>
 
 /// Class for the skybox
@@ -36,6 +37,14 @@ public:
      */
     void cleanUp();
     
+    /**
+     * @brief Return the images of the faces of the cube map with the
+     * transformation applied when they are loaded, in the order of the
+     * faces (+X, +Y, +Z, -X, -Y, -Z).
+     * @remark The faces are baked with TextureBaker.
+     */
+    static std::vector<TextureBaker::Job> getFaces();
+    
 private:
     /**
      * @brief Create and link the shader program.
@@ -43,7 +52,8 @@ private:
     void createShaderProgram();
     
     /**
-     * @brief Load the cubemap textures.
+     * @brief Load the cubemap textures, from the baked files of the faces if
+     * they are up to date.
      */
     void loadCubeMapTextures();
     
@@ -81,7 +91,7 @@ private:
     /**
      * Shader program used to render the skybox.
      */
-    std::unique_ptr<Shader> m_shader;
+    std::shared_ptr<Shader> m_shader;
     
     /**
      * Pointer to OpenGL ES 2.0 API functions.
@@ -0,0 +1,77 @@
+#ifndef TANGENTGENERATOR_H
+#define TANGENTGENERATOR_H
+
+#include <QVector>
+
+/// Tangent generator
+/**
+ * @brief Compute the tangent space of each vertex of an indexed triangle mesh
+ * from its positions, normals and texture coordinates.
+ * @author Louis Filipozzi
+ * @details The tangent and bitangent of each triangle are accumulated to its
+ * vertices, weighted by the area of the triangle, so the result does not
+ * depend on the order of the triangles. The tangent of each vertex is then
+ * orthonormalized against its normal (Gram-Schmidt) and the bitangent is
+ * rebuilt from the normal and the tangent with the handedness of the
+ * accumulated bitangent.
+ *
+ * The output buffers are used as accumulators: no memory is allocated apart
+ * from resizing them. The per-vertex pass processes 4 vertices at a time
+ * with SSE2 on x86 (part of the x86-64 baseline), transposing the vectors
+ * of the vertices to one register per component, and is split over several
+ * threads for large meshes.
+ */
+class TangentGenerator {
+public:
+    /**
+     * @brief Compute the tangents and bitangents.
+     * @param[in] vertices The vertex positions (3 floats per vertex).
+     * @param[in] normals The vertex normals (3 floats per vertex). If the
+     * normals are missing, the normal of the accumulated tangent space is used.
+     * @param[in] textureUV The texture coordinates (2 floats per vertex).
+     * @param[in] indices The index data (3 indices per triangle).
+     * @param[out] tangents The tangent data (3 floats per vertex).
+     * @param[out] bitangents The bitangent data (3 floats per vertex).
+     * @param[in] parallel Allow the use of several threads.
+     */
+    static void generate(
+        const QVector<float> & vertices,
+        const QVector<float> & normals,
+        const QVector<float> & textureUV,
+        const QVector<unsigned int> & indices,
+        QVector<float> & tangents,
+        QVector<float> & bitangents,
+        bool parallel = true
+    );
+
+private:
+    TangentGenerator() {};
+
+    /**
+     * @brief Accumulate the tangent space of the triangles to their vertices.
+     */
+    static void accumulate(
+        const float * vertices, const float * textureUV,
+        const unsigned int * indices, unsigned int numTriangles,
+        unsigned int numVertices, float * tangents, float * bitangents
+    );
+
+    /**
+     * @brief Orthonormalize the tangent space of the vertices in [begin, end),
+     * 4 vertices at a time with SSE2.
+     */
+    static void orthonormalize(
+        const float * normals, float * tangents, float * bitangents,
+        unsigned int begin, unsigned int end
+    );
+
+    /**
+     * @brief Orthonormalize the tangent space of a vertex.
+     */
+    static void orthonormalizeVertex(
+        const float * normals, float * tangents, float * bitangents,
+        unsigned int v
+    );
+};
+
+#endif // TANGENTGENERATOR_H
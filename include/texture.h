@@ -4,12 +4,25 @@
 #include <QString>
 #include <QImage>
 #include <QOpenGLTexture>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "texturearrays.h"
+#include "textureatlas.h"
+#include "texturebaker.h"
 
 /// Texture class
 /**
  * @brief Texture class inherited from QOpenGLTexture.
  * @author Louis Filipozzi
+ * @details The textures of the materials are stored in a layer of the
+ * TextureArrays: they allocate no storage of their own and are sampled
+ * through getArray() and getLayer().
  */
 class Texture : public QOpenGLTexture {
 public:
@@ -23,14 +36,59 @@ public:
     
     Texture(Type type, QOpenGLTexture::Target target) 
     : QOpenGLTexture(target), m_type(type) {}
+    
+    Texture(Type type, const TextureArrays::Layer & layer)
+    : QOpenGLTexture(Target2D), m_type(type), m_layer(layer) {}
 
     Type getType() const {return m_type;}
     
+    /**
+     * @brief Return the texture array storing the texture, nullptr if the
+     * texture has its own storage.
+     */
+    const TextureArrays::Array * getArray() const {return m_layer.array;}
+    
+    /**
+     * @brief Return the layer of the texture in its array.
+     */
+    GLint getLayer() const {return m_layer.layer;}
+    
+    /**
+     * @brief Return the offset and the scale of the texture coordinates in
+     * the layer, the identity unless the texture is a tile of a TextureAtlas.
+     */
+    const GLfloat * getRect() const {return m_layer.rect;}
+    
+    /**
+     * @brief Check if the texture is stored top row first, its texture
+     * coordinates must then be flipped vertically (see 
+     * CompressedTextureLoader::Image::isTopDown).
+     */
+    bool isTopDown() const {return m_isTopDown;}
+    
 private:
+    friend class TextureManager;
+
     /**
      * Texture type.
      */
     Type m_type;
+    
+    /**
+     * Layer storing the texture.
+     */
+    TextureArrays::Layer m_layer;
+    
+    /**
+     * Index of the streaming state of the texture in the TextureManager, -1
+     * if the texture is not streamed.
+     */
+    int m_stream = -1;
+    
+    /**
+     * Check if the texture is stored top row first.
+     */
+    bool m_isTopDown = false;
 };
 
 
@@ -44,6 +102,33 @@ private:
  * texture managers.
  * @remark The textures are stored using std::unique_ptr as the manager is 
  * assumed to be the only owner of all textures.
+ * @remark The loaded images are copied to the TextureArrays.
+ * @remark The textures of the objects are loaded in the background (see
+ * loadTextureAsync()): worker threads read and decode the files, and update()
+ * copies a few of them per frame to their array through two persistently
+ * mapped staging buffers used in turn. Each staging buffer is protected by a
+ * fence, so the CPU never writes data that the GPU has not read yet and never
+ * waits for it either.
+ * @remark The mipmaps of these textures are streamed within a memory budget
+ * (see setMemoryBudget()). The objects drawn by a frame request the
+ * resolution at which they see their textures (see requestResolution()), and
+ * a texture only keeps the levels from the finest one requested: its layer
+ * is in the array of the size of this level. The first upload of a texture
+ * stops at MIN_SIZE texels. The next frames load the finer levels that are
+ * requested, the largest gains first, a few at a time. To stay within the
+ * budget, the textures that were not used for the longest time lose their
+ * finest levels first (least recently used policy). Dropping levels copies
+ * the remaining ones to a smaller array on the GPU, without reading the
+ * file again. The budget counts the whole storage of the arrays of the
+ * streamed textures, which shrink as their layers are released (see
+ * TextureArrays::compact()).
+ * @remark The worker threads hash the images they read (format, size,
+ * orientation and levels). Before the upload of a texture, its hash is
+ * compared with the textures already read, so the files with identical
+ * content (e.g. the variants of a road material sharing a map) are uploaded
+ * once and streamed together, whatever their path.
+ * @remark The small uncompressed textures (e.g. the props) are packed in a
+ * TextureAtlas instead of being streamed.
  */
 class TextureManager {
 public:
@@ -57,6 +142,80 @@ public:
     static Texture * loadTexture(QString name, Texture::Type type,
                                  QImage & image);
     
+    /**
+     * @brief Load and return the texture of a file.
+     * @details The DDS and KTX2 files are uploaded without being decoded
+     * (see CompressedTextureLoader), like the baked file of an image if it is
+     * up to date (see TextureBaker). The other files and the compressed
+     * formats not supported by the driver are decoded with QImage.
+     * @param path The path to the texture file, used as name.
+     * @param type The texture type.
+     * @return A pointer to the texture.
+     */
+    static Texture * loadTexture(const QString & path, Texture::Type type);
+    
+    /**
+     * @brief Load and return the texture of a file in the background.
+     * @details The file is read and decoded by a worker thread, then uploaded
+     * by update(). Until then, the texture is sampled at the layer of the
+     * default texture of its type (see getDefaultTexture()).
+     * @param path The path to the texture file, used as name.
+     * @param type The texture type.
+     * @return A pointer to the texture.
+     */
+    static Texture * loadTextureAsync(const QString & path, 
+                                      Texture::Type type);
+    
+    /**
+     * @brief Return the default texture of a type, loaded by the first call.
+     * @details The normal and bump types have a flat default texture, the
+     * other types a white one.
+     */
+    static Texture * getDefaultTexture(Texture::Type type);
+    
+    /**
+     * @brief Upload the textures decoded in the background, as much as fits
+     * in a staging buffer, and replace their placeholder.
+     * @remark Must be called once per frame with the OpenGL context current.
+     */
+    static void update();
+    
+    /**
+     * @brief Request the resolution at which a texture is seen by the frame
+     * being drawn.
+     * @param texture The texture, ignored if it is not streamed.
+     * @param size The size (pixels) on the screen of the whole texture, i.e.
+     * of one repetition of the texture coordinates.
+     */
+    static void requestResolution(const Texture * texture, float size);
+    
+    /**
+     * @brief Set the memory available for the arrays of the streamed
+     * textures, in bytes.
+     */
+    static void setMemoryBudget(GLsizeiptr budget) {m_budget = budget;};
+    
+    /**
+     * @brief Return the memory allocated for the arrays of the streamed
+     * textures, in bytes, including their free layers and the layers of the
+     * levels being loaded.
+     */
+    static GLsizeiptr getMemoryUsage() {
+        return TextureArrays::getStreamedSize() + m_charged;
+    };
+    
+    /**
+     * @brief Check if textures loaded in the background have not replaced
+     * their placeholder yet.
+     */
+    static bool isLoading();
+    
+    /**
+     * @brief Return a counter increased each time textures replace their
+     * placeholder or change resolution, so their layer can be read again.
+     */
+    static unsigned int getGeneration() {return m_generation;};
+    
     /**
      * @brief Get the texture.
      * @remark Return a null pointer if the texture has not been loaded yet.
@@ -74,6 +233,168 @@ public:
 private:
     TextureManager() {};
     
+    /**
+     * Size in bytes of each staging buffer.
+     */
+    static constexpr GLsizeiptr STAGING_SIZE = 16 << 20;
+    
+    /**
+     * Default memory budget of the streamed textures, in bytes.
+     */
+    static constexpr GLsizeiptr DEFAULT_BUDGET = GLsizeiptr(1) << 30;
+    
+    /**
+     * Size (texels) of the coarsest level kept by a streamed texture.
+     */
+    static constexpr GLsizei MIN_SIZE = 64;
+    
+    /**
+     * Maximum number of textures loading finer levels at the same time.
+     */
+    static constexpr unsigned int MAX_LOADS = 4;
+    
+    /**
+     * @brief Texture loaded in the background.
+     */
+    struct Upload {
+        Texture * texture = nullptr;
+        QString path;
+        CompressedTextureLoader::Image image; ///< Set by the worker threads.
+        TextureArrays::Layer layer;           ///< Reserved by update().
+        GLsizei first = 0; ///< Level of the file in the first level.
+        GLsizei level = 0; ///< Next level of the file to upload.
+        bool isFirstLoad = true; ///< The image is hashed by the workers.
+        GLsizeiptr charge = 0;   ///< Memory charged until the reservation.
+        QByteArray hash;         ///< Hash of the content of the image.
+    };
+    
+    /**
+     * @brief Streaming state of a texture loaded in the background.
+     */
+    struct Stream {
+        std::vector<Texture *> textures; ///< Textures of identical content.
+        TextureArrays::Layer layer;      ///< Layer of the textures.
+        QString path;
+        GLenum format = 0;
+        GLsizei width = 0;         ///< Size of the first level of the file.
+        GLsizei height = 0;
+        GLsizei levels = 0;        ///< Levels of the file, 0 if not streamed.
+        GLsizei resident = 0;      ///< Level of the file in the layer.
+        GLsizei target = 0;        ///< Level loaded, resident if none.
+        GLsizei wanted = 0;        ///< Level requested by the last frame.
+        bool isResident = false;   ///< The first upload is done.
+        bool isTopDown = false;    ///< The file is stored top row first.
+        float size = 0.0f;         ///< Size requested by the frame (pixels).
+        unsigned int lastUsed = 0; ///< Last frame requesting the texture.
+    };
+    
+    /**
+     * @brief Persistently mapped buffer from which the levels are uploaded.
+     */
+    struct Staging {
+        GLuint buffer = 0;
+        uchar * data = nullptr;
+        GLsync fence = nullptr; ///< Signaled when the GPU has read the data.
+    };
+    
+    /**
+     * @brief Read a texture file, the block-compressed and the baked files as
+     * they are, the other files decoded with their mipmaps.
+     * @remark This function can be called from any thread.
+     */
+    static bool read(const QString & path, 
+                     CompressedTextureLoader::Image & image);
+    
+    /**
+     * @brief Queue a texture to be read by the worker threads, which are
+     * started by the first call.
+     */
+    static void queue(Upload && upload);
+    
+    /**
+     * @brief Loop of the worker threads.
+     */
+    static void decode();
+    
+    /**
+     * @brief Copy the levels of a texture to the staging buffer and upload
+     * them from there.
+     * @param gl The OpenGL functions.
+     * @param upload The texture.
+     * @param staging The staging buffer, bound to GL_PIXEL_UNPACK_BUFFER.
+     * @param offset The first free byte of the staging buffer.
+     * @return True if all the levels have been uploaded, false if the
+     * staging buffer is full.
+     */
+    static bool uploadLevels(QOpenGLFunctions_4_5_Core * gl, Upload & upload,
+                             Staging & staging, GLsizeiptr & offset);
+    
+    /**
+     * @brief Reserve the layer of a texture read by a worker thread.
+     * @return False if the image cannot be uploaded from the staging buffer.
+     */
+    static bool reserve(Upload & upload);
+    
+    /**
+     * @brief Give the textures of an image read for the first time to the
+     * texture of identical content read before, if any.
+     * @return True if the image is a duplicate and must not be uploaded.
+     */
+    static bool share(const Upload & upload);
+    
+    /**
+     * @brief Set the layer of the textures of a stream.
+     */
+    static void setLayer(Stream & stream, const TextureArrays::Layer & layer);
+    
+    /**
+     * @brief Return the hash of the content of an image.
+     * @remark This function can be called from any thread.
+     */
+    static QByteArray hash(const CompressedTextureLoader::Image & image);
+    
+    /**
+     * @brief Load the finer levels requested by the last frame and drop
+     * levels to stay within the budget.
+     * @param gl The OpenGL functions.
+     * @return True if textures have changed resolution.
+     */
+    static bool stream(QOpenGLFunctions_4_5_Core * gl);
+    
+    /**
+     * @brief Drop the finest levels of the textures least recently used, up
+     * to the levels they need, to free memory.
+     * @param size The memory needed, in bytes.
+     * @param loading The index of the texture the memory is freed for.
+     * @return True if levels have been dropped, false, without dropping any
+     * level, if the levels that can be dropped are not enough.
+     * @remark The memory of the dropped levels is only given back when their
+     * array shrinks, the caller checks the memory again.
+     */
+    static bool evict(GLsizeiptr size, size_t loading);
+    
+    /**
+     * @brief Copy the levels of a texture from a level to a layer of a
+     * smaller array.
+     */
+    static void dropLevels(Stream & stream, GLsizei level);
+    
+    /**
+     * @brief Release the former layer of a texture and shrink its array if
+     * possible, updating the layers moved in the array.
+     */
+    static void releaseLayer(const TextureArrays::Layer & layer);
+    
+    /**
+     * @brief Return the memory used by the levels of a texture from a level.
+     */
+    static GLsizeiptr residentSize(const Stream & stream, GLsizei level);
+    
+    /**
+     * @brief Return the coarsest level kept by a texture.
+     */
+    static GLsizei coarsestLevel(const Stream & stream);
+    
     typedef std::map<QString, std::unique_ptr<Texture>> TexturesMap;
     typedef std::map<Texture::Type, TexturesMap> TexturesMapsContainer;
     /**
@@ -83,6 +404,98 @@ private:
      * can have a same name but a different type.
      */
     static TexturesMapsContainer m_textures;
+    
+    /**
+     * Textures waiting for a worker thread (guarded by m_mutex).
+     */
+    static std::deque<Upload> m_pending;
+    
+    /**
+     * Textures decoded by the worker threads (guarded by m_mutex).
+     */
+    static std::deque<Upload> m_decoded;
+    
+    /**
+     * Textures being uploaded by update(), in order.
+     */
+    static std::deque<Upload> m_uploads;
+    
+    /**
+     * Mutex guarding the queues shared with the worker threads.
+     */
+    static std::mutex m_mutex;
+    
+    /**
+     * Condition notified when textures are queued or the workers stopped.
+     */
+    static std::condition_variable m_condition;
+    
+    /**
+     * The worker threads, started by the first call to loadTextureAsync().
+     */
+    static std::vector<std::thread> m_workers;
+    
+    /**
+     * Check if the worker threads must stop.
+     */
+    static bool m_stop;
+    
+    
+    /**
+     * The staging buffers, used in turn by the frames.
+     */
+    static std::array<Staging, 2> m_staging;
+    
+    /**
+     * Streaming state of the textures loaded in the background.
+     */
+    static std::vector<Stream> m_streams;
+    
+    /**
+     * Memory available for the streamed textures, in bytes.
+     */
+    static GLsizeiptr m_budget;
+    
+    /**
+     * Memory charged for the levels being loaded whose layer is not reserved
+     * yet, in bytes.
+     */
+    static GLsizeiptr m_charged;
+    
+    /**
+     * Number of textures loading finer levels.
+     */
+    static unsigned int m_loads;
+    
+    /**
+     * Index of the stream of each content hash.
+     */
+    static std::map<QByteArray, size_t> m_contents;
+    
+    /**
+     * Number of images sharing the texture of an identical image.
+     */
+    static unsigned int m_duplicates;
+    
+    /**
+     * Size in bytes of the levels of the duplicate images.
+     */
+    static qint64 m_duplicateSize;
+    
+    /**
+     * Check if the duplicates have been reported.
+     */
+    static bool m_isReported;
+    
+    /**
+     * Number of calls to update().
+     */
+    static unsigned int m_frame;
+    
+    /**
+     * Number of times textures have replaced their placeholder.
+     */
+    static unsigned int m_generation;
 };
 
 #endif // TEXTURE_H
@@ -0,0 +1,214 @@
+#ifndef TEXTUREARRAYS_H
+#define TEXTUREARRAYS_H
+
+#include "compressedtextureloader.h"
+#include <QImage>
+#include <QOpenGLFunctions_4_5_Core>
+#include <list>
+#include <memory>
+#include <vector>
+
+/// Texture arrays
+/**
+ * @brief Store the textures of the materials as layers of a few
+ * GL_TEXTURE_2D_ARRAY textures, grouped by size and format.
+ * @author Louis Filipozzi
+ * @details The images of the same size and format share an array: the
+ * grayscale images (e.g. the bump maps) are stored in GL_R8 arrays whose
+ * swizzle repeats the red channel, the other images in GL_RGBA8 arrays. The
+ * mipmaps are computed when the image is added, so adding a layer does not
+ * touch the other layers.
+ *
+ * The block-compressed and baked images (see CompressedTextureLoader and
+ * TextureBaker) are uploaded with their mipmaps as they are stored in the
+ * file, in arrays of their format and number of mipmaps. The BC4 arrays repeat the red
+ * channel like the GL_R8 arrays.
+ *
+ * A material gives the layer of each of its textures to the shaders (see
+ * MaterialTable), which sample the array bound to the texture unit at this
+ * layer. The meshes whose textures are in the same arrays can therefore be
+ * drawn without binding any texture in between, whatever their material.
+ *
+ * When an array is full, it is reallocated with twice its number of layers
+ * and its content is copied on the GPU, up to GL_MAX_ARRAY_TEXTURE_LAYERS.
+ * Another array of the same size and format is then created. The layers
+ * released by the streamed textures (see TextureManager) are reused by the
+ * next textures of their array, and an array whose layers are all released
+ * is deleted.
+ *
+ * The streamed textures are reserved in arrays of their own, which compact()
+ * shrinks once at most a quarter of their layers are used, so the memory of
+ * the levels they drop is given back to the driver. Their allocated layers,
+ * used or not, are what counts against the budget of TextureManager (see
+ * getStreamedSize()).
+ * @remark The arrays are never moved in memory, so the pointers in Layer
+ * stay valid until their array is deleted by release() or cleanUp().
+ */
+class TextureArrays {
+public:
+    /**
+     * @brief Texture array of a size and format.
+     */
+    struct Array {
+        GLuint texture = 0;
+        GLenum format = GL_RGBA8; ///< Internal format.
+        GLsizei width = 0;
+        GLsizei height = 0;
+        GLsizei levels = 0;       ///< Number of mipmap levels.
+        GLsizei capacity = 0;     ///< Number of allocated layers.
+        GLsizei size = 0;         ///< Number of used layers.
+        std::vector<GLint> freeLayers; ///< Released layers below size.
+        GLsizeiptr layerSize = 0; ///< Size in bytes of a layer and its mipmaps.
+        bool isStreamed = false;  ///< Layers of streamed textures only.
+    };
+
+    /**
+     * @brief Layer of an array storing a texture.
+     */
+    struct Layer {
+        const Array * array = nullptr; ///< nullptr if not allocated.
+        GLint layer = 0;
+        /// Offset and scale of the texture coordinates in the layer, the
+        /// whole layer unless the texture is a tile of a TextureAtlas.
+        GLfloat rect[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+    };
+
+    /**
+     * @brief Copy an image and its mipmaps to a layer of the array of its
+     * size and format.
+     * @param image The image, in the orientation of QImage.
+     * @return The layer, whose array is nullptr if the image is null or if
+     * there is no current OpenGL context.
+     */
+    static Layer allocate(const QImage & image);
+
+    /**
+     * @brief Copy an image loaded from a file, block-compressed or baked, and
+     * its mipmaps to a layer of the array of its size, format and number of
+     * mipmaps.
+     * @param image The image, with the bottom row first.
+     * @return The layer, whose array is nullptr if the image is null, if the
+     * format is not supported by the driver or if there is no current OpenGL
+     * context.
+     */
+    static Layer allocate(const CompressedTextureLoader::Image & image);
+
+    /**
+     * @brief Check if the driver supports the arrays of a format.
+     */
+    static bool isSupported(GLenum format);
+
+    /**
+     * @brief Reserve a layer of the array of a size, format and number of
+     * mipmaps, its levels being uploaded later with upload().
+     * @param isStreamed Reserve the layer in the arrays of the streamed
+     * textures, whose layers can be moved by compact().
+     * @return The layer, whose array is nullptr if there is no current
+     * OpenGL context.
+     */
+    static Layer reserve(GLenum format, GLsizei width, GLsizei height,
+                         GLsizei levels, bool isStreamed = false);
+    
+    /**
+     * @brief Return the memory that reserving a layer of a streamed texture
+     * would allocate, in bytes: 0 if its array has a free layer, the layers
+     * added to the array or the layers of a new array otherwise.
+     */
+    static GLsizeiptr getReserveSize(GLenum format, GLsizei width, 
+                                     GLsizei height, GLsizei levels);
+    
+    /**
+     * @brief Return the memory allocated for the arrays of the streamed
+     * textures, in bytes, including their free and unused layers.
+     */
+    static GLsizeiptr getStreamedSize();
+
+    /**
+     * @brief Copy a level of an image to its layer.
+     * @param layer The layer, returned by reserve().
+     * @param level The mipmap level.
+     * @param data The level, as stored in CompressedTextureLoader::Image, or
+     * its offset in the buffer bound to GL_PIXEL_UNPACK_BUFFER.
+     * @param size The size of the level in bytes.
+     */
+    static void upload(const Layer & layer, GLsizei level, const void * data,
+                       GLsizei size);
+
+    /**
+     * @brief Copy the levels of a layer, from a level of another layer whose
+     * array is larger.
+     * @param source The layer to copy.
+     * @param firstLevel The level of the source copied to the first level of
+     * the destination.
+     * @param destination The layer written, all its levels are copied.
+     */
+    static void copy(const Layer & source, GLsizei firstLevel, 
+                     const Layer & destination);
+
+    /**
+     * @brief Release a layer, to be reused by the next texture of its array.
+     * @remark The array is deleted if all its layers are released. The tiles
+     * of a TextureAtlas must not be released.
+     */
+    static void release(const Layer & layer);
+    
+    /**
+     * @brief Shrink an array of streamed textures whose used layers fit in a
+     * quarter of its capacity, moving them to its first layers.
+     * @param array The array, ignored if it has been deleted or if it is not
+     * an array of streamed textures.
+     * @return The new layer of each layer of the array, -1 for the released
+     * layers, or an empty vector if the array has not been shrunk. The owners
+     * of the layers must update them.
+     */
+    static std::vector<GLint> compact(const Array * array);
+
+    /**
+     * @brief Bind an array to a texture unit.
+     * @param gl The OpenGL functions of the current context.
+     * @param array The array, nothing is bound if it is nullptr.
+     * @param unit The texture unit.
+     */
+    static void bind(QOpenGLFunctions_4_5_Core * gl, const Array * array,
+                     GLuint unit);
+
+    /**
+     * @brief Properly deallocate all the arrays.
+     */
+    static void cleanUp();
+
+private:
+    TextureArrays() {};
+
+    /**
+     * @brief Return an array of a size, format and number of mipmaps with a
+     * free layer, the array grows or is created if needed.
+     */
+    static Array * findArray(QOpenGLFunctions_4_5_Core * gl, GLenum format,
+                             GLsizei width, GLsizei height, GLsizei levels,
+                             bool isStreamed);
+
+    /**
+     * @brief Return a released layer of an array, or its first unused one.
+     */
+    static GLint takeLayer(Array & array);
+
+    /**
+     * @brief Reallocate the texture of an array and copy its layers.
+     */
+    static void resize(QOpenGLFunctions_4_5_Core * gl, Array & array,
+                       GLsizei capacity);
+    
+    /**
+     * @brief Create the storage of an array for a number of layers.
+     */
+    static GLuint createStorage(QOpenGLFunctions_4_5_Core * gl, 
+                                const Array & array, GLsizei capacity);
+
+    /**
+     * The arrays of all sizes and formats.
+     */
+    static std::list<std::unique_ptr<Array>> m_arrays;
+};
+
+#endif // TEXTUREARRAYS_H
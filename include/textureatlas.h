@@ -0,0 +1,130 @@
+#ifndef TEXTUREATLAS_H
+#define TEXTUREATLAS_H
+
+#include "compressedtextureloader.h"
+#include "texturearrays.h"
+#include <QOpenGLFunctions_4_5_Core>
+#include <vector>
+
+/// Texture atlas
+/**
+ * @brief Pack the small textures of the props into the layers of a few
+ * texture arrays, so the props whose textures have different sizes share
+ * the same arrays and are drawn by the same call.
+ * @author Louis Filipozzi
+ * @details An atlas is a SIZE x SIZE layer of a GL_RGBA8 or GL_R8 array
+ * (see TextureArrays) with LEVELS mipmaps. The textures are packed in rows
+ * of tiles of the same height (shelves). Each tile holds the texture and a
+ * gutter of GUTTER texels on every side, filled with the opposite side of
+ * the texture so that the filtering wraps like GL_REPEAT.
+ *
+ * The mipmaps of a tile are copied from the mipmaps of the texture, the
+ * gutter being halved at each level: the tiles and their sizes are multiples
+ * of 2^(LEVELS-1) texels, so a tile never bleeds into its neighbors at any
+ * level. The atlas stops at the level where the gutter is one texel, the
+ * distant props being sampled at this level.
+ *
+ * The texture of a tile gets the offset and the scale of its rectangle in
+ * the layer (see TextureArrays::Layer::rect), which the shaders apply to the
+ * fractional part of the texture coordinates (see MaterialTable). The meshes
+ * are therefore not modified.
+ * @remark The tiles are not streamed and never released before cleanUp().
+ */
+class TextureAtlas {
+public:
+    /**
+     * Size of an atlas, in texels.
+     */
+    static constexpr GLsizei SIZE = 2048;
+
+    /**
+     * Number of mipmaps of an atlas.
+     */
+    static constexpr GLsizei LEVELS = 5;
+
+    /**
+     * Width of the gutter around a tile at the first level, in texels.
+     */
+    static constexpr GLsizei GUTTER = 1 << (LEVELS - 1);
+
+    /**
+     * Largest width and height of a texture packed in an atlas, so that the
+     * 512 x 512 textures of the props are packed, nine per layer with their
+     * gutters.
+     */
+    static constexpr GLsizei MAX_TILE_SIZE = 512;
+
+    /**
+     * @brief Check if an image can be packed in an atlas: uncompressed, small,
+     * with sizes multiple of 2^(LEVELS-1) and at least LEVELS mipmaps.
+     */
+    static bool isPackable(const CompressedTextureLoader::Image & image);
+
+    /**
+     * @brief Copy an image and its mipmaps to a tile of an atlas of its
+     * format.
+     * @param image The image, with the bottom row first.
+     * @return The layer of the atlas with the rectangle of the tile, whose
+     * array is nullptr if the image cannot be packed or if there is no
+     * current OpenGL context.
+     * @remark The buffer bound to GL_PIXEL_UNPACK_BUFFER must be 0.
+     */
+    static TextureArrays::Layer allocate(
+        const CompressedTextureLoader::Image & image
+    );
+
+    /**
+     * @brief Forget the atlases, their arrays being deleted by
+     * TextureArrays::cleanUp().
+     */
+    static void cleanUp();
+
+private:
+    TextureAtlas() {};
+
+    /**
+     * @brief Row of tiles of the same height.
+     */
+    struct Shelf {
+        GLsizei y;
+        GLsizei height;
+        GLsizei width; ///< Used width.
+    };
+
+    /**
+     * @brief Atlas of a format.
+     */
+    struct Atlas {
+        TextureArrays::Layer layer;
+        std::vector<Shelf> shelves;
+        GLsizei height; ///< Used height.
+    };
+
+    /**
+     * @brief Find room for a tile in an atlas of a format, a new atlas is
+     * created if needed.
+     * @param[in] format The internal format.
+     * @param[in] width The width of the tile.
+     * @param[in] height The height of the tile.
+     * @param[out] x The position of the tile.
+     * @param[out] y The position of the tile.
+     * @return The atlas, nullptr if it could not be created.
+     */
+    static Atlas * findRoom(GLenum format, GLsizei width, GLsizei height,
+                            GLsizei & x, GLsizei & y);
+
+    /**
+     * @brief Return a level of an image surrounded by a gutter filled with the
+     * opposite sides of the level.
+     */
+    static QByteArray addGutter(const QByteArray & level, GLsizei width,
+                                GLsizei height, GLsizei pixelSize,
+                                GLsizei gutter);
+
+    /**
+     * The atlases of all formats.
+     */
+    static std::vector<Atlas> m_atlases;
+};
+
+#endif // TEXTUREATLAS_H
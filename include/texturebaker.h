@@ -0,0 +1,142 @@
+#ifndef TEXTUREBAKER_H
+#define TEXTUREBAKER_H
+
+#include "compressedtextureloader.h"
+#include <QImage>
+#include <QString>
+#include <vector>
+
+/// Texture baker
+/**
+ * @brief Convert the images of the assets offline into KTX2 files ready to be
+ * uploaded, so they are not decoded, flipped and mipmapped at every launch.
+ * @author Louis Filipozzi
+ * @details A baked file holds the image with the transformation applied by
+ * the renderer when it loads the source (the vertical flip of the material
+ * textures, the mirroring and rotation of the faces of the Skybox) and its
+ * mipmaps down to 1x1, computed with a box filter. Its rows are stored from
+ * the bottom (KTXorientation "ru"), so CompressedTextureLoader does not flip
+ * them.
+ *
+ * The images are stored as RGBA8 (R8 for the grayscale images) or, if
+ * requested, compressed with BC1 (opaque), BC3 (with alpha) or BC4
+ * (grayscale). The encoders fit the endpoints of each block to the bounding
+ * box of its colors: the quality is lower than the offline encoders but the
+ * whole asset directory is baked in seconds. The images are baked in parallel
+ * on all the cores.
+ *
+ * The baked file of an image is "<image>.ktx2". The renderer uses it instead
+ * of the image if it is not older than the image (see isBaked()).
+ * @remark The baker is run with "VirtualModel --bake-textures [--compress]"
+ * from the project folder, or with the "bake" target of the Makefile.
+ */
+class TextureBaker {
+public:
+    /**
+     * @brief Image to bake and the transformation applied when it is loaded.
+     */
+    struct Job {
+        QString source;
+        bool mirrorHorizontally; ///< See QImage::mirrored().
+        bool mirrorVertically;   ///< See QImage::mirrored().
+        qreal rotation;          ///< Rotation in degrees, after mirroring.
+    };
+
+    /**
+     * @brief Return the jobs of the images of a directory and its
+     * subdirectories, flipped vertically like the material textures.
+     * @remark The images already compressed (DDS, KTX2) are ignored.
+     */
+    static std::vector<Job> findImages(const QString & directory);
+
+    /**
+     * @brief Bake images in parallel.
+     * @param jobs The images.
+     * @param compress Compress the images with BC1, BC3 or BC4.
+     * @return True if all the images have been baked.
+     */
+    static bool bake(const std::vector<Job> & jobs, bool compress);
+
+    /**
+     * @brief Return the path to the baked file of an image.
+     */
+    static QString bakedPath(const QString & source);
+
+    /**
+     * @brief Check if an image has a baked file which is not older than the
+     * image.
+     */
+    static bool isBaked(const QString & source);
+
+    /**
+     * @brief Load the image of a job: its baked file if it is up to date,
+     * otherwise the source decoded and transformed.
+     * @param[in] job The image.
+     * @param[out] image The image, with the bottom row first.
+     * @param[in] generateMipmaps Compute the mipmaps of a decoded source.
+     * @return True if the image has been loaded.
+     * @remark This function can be called from any thread.
+     */
+    static bool load(const Job & job, CompressedTextureLoader::Image & image,
+                     bool generateMipmaps = false);
+
+private:
+    TextureBaker() {};
+
+    /**
+     * @brief Decode and transform the source of a job, converted to RGBA8888
+     * or Grayscale8.
+     */
+    static QImage decode(const Job & job);
+
+    /**
+     * @brief Bake an image.
+     */
+    static bool bakeImage(const Job & job, bool compress);
+
+    /**
+     * @brief Return the next mipmap of an image, filtered with a box filter.
+     */
+    static QImage downsample(const QImage & image);
+
+    /**
+     * @brief Check if a RGBA8888 image has pixels which are not opaque.
+     */
+    static bool hasTransparency(const QImage & image);
+
+    /**
+     * @brief Copy the pixels of an image without the padding of its rows.
+     */
+    static QByteArray packPixels(const QImage & image);
+
+    /**
+     * @brief Compress an image.
+     * @param format The compressed format: BC1, BC3 or BC4.
+     * @param image The image, RGBA8888 (BC1, BC3) or Grayscale8 (BC4).
+     */
+    static QByteArray compress(GLenum format, const QImage & image);
+
+    /**
+     * @brief Encode the colors of a block of 4x4 pixels with BC1 (four color
+     * mode).
+     * @param rgba The pixels, row by row.
+     * @param block The 8 bytes of the block.
+     */
+    static void encodeColorBlock(const uchar rgba[64], uchar * block);
+
+    /**
+     * @brief Encode a channel of a block of 4x4 pixels with BC4 (eight value
+     * mode).
+     * @param values The pixels, row by row.
+     * @param block The 8 bytes of the block.
+     */
+    static void encodeChannelBlock(const uchar values[16], uchar * block);
+
+    /**
+     * @brief Write an image in a KTX2 file.
+     */
+    static bool write(const QString & path,
+                      const CompressedTextureLoader::Image & image);
+};
+
+#endif // TEXTUREBAKER_H
@@ -2,6 +2,7 @@
 #define VEHICLE_H
 
 #include "abstractobject.h"
+#include "linebatch.h"
 #include "position.h"
 #include <QFile>
 #include <QMatrix4x4>
@@ -146,14 +147,12 @@ private:
  */
 class VehicleGraphics {
 public:
-    VehicleGraphics(
-        ABCObject * chassisModel, ABCObject * wheelModel, ABCObject * line
-    ) : 
+    VehicleGraphics(ABCObject * chassisModel, ABCObject * wheelModel) : 
     p_chassisModel(chassisModel),
     p_wheelModel(wheelModel), 
-    p_forceLine(line), 
     m_offset(Position(0.0f, 0.0f, 0.05f, 0.0f, 0.0f, 0.0f)),
-    m_showTireForce(true) {};
+    m_showTireForce(true),
+    m_chassisYaw(0.0f) {};
     
     /**
      * @brief Update the model matrices.
@@ -178,10 +177,16 @@ public:
     
     /**
      * @brief Draw the object when computing the framebuffer for shadow mapping.
-     * @param lightSpace The view and projection matrix of the light (used for 
-     * shadow mapping).
+     * @param lightSpace The view and projection matrices of the light (used 
+     * for shadow mapping), one per cascade.
+     */
+    void renderShadow(const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace);
+    
+    /**
+     * @brief Add the tire force arrows to the batch of lines.
+     * @param lines The batch of lines rendered at the end of the frame.
      */
-    void renderShadow(const QMatrix4x4 & lightSpace);
+    void renderTireForces(LineBatch & lines) const;
     
     /**
      * @brief Render/hide tire forces.
@@ -190,17 +195,13 @@ public:
     
 private:
     /**
-     * @brief Compute the model matrix to draw the force.
-     * @param force The force vector.
-     * @param wheelPos The wheel position.
-     * @param chassisPos The chassis Position.
-     * @param offset The offset defining the origin of the force vector 
-     * relatively to the wheel hub.
+     * Raw data defining a tire force arrow.
      */
-    QMatrix4x4 getForceModelMatrix(const QVector3D &force,
-                                   const Position &wheelPos, 
-                                   const Position &chassisPos,
-                                   const QVector3D &offset);
+    struct TireForce {
+        QVector3D wheel;  ///< Position of the wheel hub.
+        QVector3D offset; ///< Origin of the arrow relatively to the wheel hub.
+        QVector3D force;  ///< The tire force.
+    };
     
 private:
     /**
@@ -213,11 +214,6 @@ private:
      */
     ABCObject * p_wheelModel;
     
-    /**
-     * Object to draw 3D lines in the scene.
-     */
-    ABCObject * p_forceLine;
-    
     /**
      * Offset used to better position the vehicle.
      */
@@ -233,10 +229,16 @@ private:
     QMatrix4x4 m_wheelFRMatrix;
     QMatrix4x4 m_wheelRLMatrix;
     QMatrix4x4 m_wheelRRMatrix;
-    QMatrix4x4 m_forceFLMatrix;
-    QMatrix4x4 m_forceFRMatrix;
-    QMatrix4x4 m_forceRLMatrix;
-    QMatrix4x4 m_forceRRMatrix;
+    
+    /**
+     * Yaw angle of the chassis, used to orient the tire force arrows.
+     */
+    float m_chassisYaw;
+    
+    /**
+     * Tire forces of the FL, FR, RL, and RR wheels.
+     */
+    std::array<TireForce,4> m_tireForces;
 };
 
 
@@ -251,10 +253,10 @@ private:
 class Vehicle {
 public:
     Vehicle(
-        ABCObject * chassisModel, ABCObject * wheelModel, ABCObject * line, 
+        ABCObject * chassisModel, ABCObject * wheelModel, 
         const QString trajectory
     ) :
-    m_graphics(chassisModel, wheelModel, line),
+    m_graphics(chassisModel, wheelModel),
     m_controller(trajectory) {};
     
     /**
@@ -311,13 +313,21 @@ public:
     /**
      * @brief Draw the vehicle when computing the framebuffer for shadow 
      * mapping.
-     * @param lightSpace The view and projection matrix of the light (used for 
-     * shadow mapping).
+     * @param lightSpace The view and projection matrices of the light (used 
+     * for shadow mapping), one per cascade.
      */
-    void renderShadow(const QMatrix4x4 & lightSpace) {
+    void renderShadow(const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace) {
         m_graphics.renderShadow(lightSpace);
     };
     
+    /**
+     * @brief Add the tire forces of the vehicle to the batch of lines.
+     * @param lines The batch of lines rendered at the end of the frame.
+     */
+    void renderTireForces(LineBatch & lines) const {
+        m_graphics.renderTireForces(lines);
+    };
+    
     /**
      * @brief Render/hide tire forces.
      */
@@ -0,0 +1,114 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QVector3D>
+
+/// Compact vertex format
+/**
+ * @brief Interleave the vertex data of an object into a single compact buffer.
+ * @author Louis Filipozzi
+ * @details Each vertex is stored as:
+ * - the position: 3 floats;
+ * - the normal: 2 normalized shorts (octahedral encoding);
+ * - the tangent: 4 normalized shorts, the octahedral encoding of the tangent,
+ *   the handedness of the tangent space (sign of the bitangent), and an unused
+ *   component keeping the next attribute aligned;
+ * - the texture coordinates: 2 half floats, or 2 floats when the coordinates 
+ *   are too large to be stored accurately as half floats (e.g. tiled 
+ *   textures).
+ * 
+ * This is 28 bytes per vertex (32 bytes with floats texture coordinates), 
+ * instead of 56 bytes with separate float buffers. The bitangent is not 
+ * stored: it is computed in the vertex shader from the normal, the tangent,
+ * and the handedness.
+ */
+class VertexFormat {
+public:
+    /**
+     * Offset of each attribute in the vertex (bytes).
+     */
+    static constexpr int POSITION_OFFSET = 0;
+    static constexpr int NORMAL_OFFSET = 12;
+    static constexpr int TANGENT_OFFSET = 16;
+    static constexpr int TEXTURE_UV_OFFSET = 24;
+    
+    /**
+     * @brief Return the size of a vertex (bytes).
+     * @param halfTextureUV Texture coordinates stored as half floats.
+     */
+    static int stride(bool halfTextureUV) {return halfTextureUV ? 28 : 32;};
+    
+    /**
+     * @brief Check if texture coordinates can be stored as half floats 
+     * without a visible loss of accuracy.
+     * @param textureUV The texture coordinates (2 floats per vertex).
+     */
+    static bool isHalfTextureUV(const QVector<float> & textureUV);
+    
+    /**
+     * @brief Interleave the vertex data.
+     * @param vertices The vertex positions (3 floats per vertex).
+     * @param normals The normals (3 floats per vertex).
+     * @param textureUV The texture coordinates (2 floats per vertex). Missing
+     * coordinates are set to zero.
+     * @param tangents The tangents (3 floats per vertex).
+     * @param bitangents The bitangents (3 floats per vertex), only used to 
+     * compute the handedness of the tangent space.
+     * @param halfTextureUV Store the texture coordinates as half floats.
+     * @return The interleaved vertex data.
+     */
+    static QByteArray interleave(
+        const QVector<float> & vertices, const QVector<float> & normals,
+        const QVector<float> & textureUV, const QVector<float> & tangents,
+        const QVector<float> & bitangents, bool halfTextureUV
+    );
+    
+    /**
+     * @brief Decode the attributes of an interleaved vertex, as the vertex
+     * shader does.
+     * @param[in] vertex The vertex in the interleaved data.
+     * @param[in] halfTextureUV Texture coordinates stored as half floats.
+     * @param[out] normal The normal.
+     * @param[out] tangent The tangent.
+     * @param[out] bitangent The bitangent, computed from the handedness.
+     * @param[out] textureUV The texture coordinates.
+     */
+    static void decode(const char * vertex, bool halfTextureUV, 
+                       QVector3D & normal, QVector3D & tangent,
+                       QVector3D & bitangent, float textureUV[2]);
+    
+    /**
+     * @brief Encode a unit vector with the octahedral mapping.
+     * @param[in] vector The vector to encode.
+     * @param[out] encoded The two normalized shorts.
+     */
+    static void octEncode(const QVector3D & vector, qint16 encoded[2]);
+    
+    /**
+     * @brief Convert a float to a half float (IEEE 754 binary16).
+     * @param value The float to convert.
+     * @return The bits of the half float.
+     */
+    static quint16 toHalf(float value);
+    
+    /**
+     * @brief Decode a unit vector encoded with the octahedral mapping.
+     * @param encoded The two normalized shorts.
+     * @return The unit vector.
+     */
+    static QVector3D octDecode(const qint16 encoded[2]);
+    
+    /**
+     * @brief Convert a half float (IEEE 754 binary16) to a float.
+     * @param half The bits of the half float.
+     * @return The float.
+     */
+    static float fromHalf(quint16 half);
+    
+private:
+    VertexFormat() {};
+};
+
+#endif // VERTEXFORMAT_H
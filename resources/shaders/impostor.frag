@@ -0,0 +1,16 @@
+#version 330 core
+
+uniform sampler2D atlasSampler;
+
+in vec2 texCoord;
+
+layout (location = 0) out vec4 fragColor;
+
+void main()
+{
+    // Keep the silhouette of the model only
+    vec4 color = texture(atlasSampler, texCoord);
+    if (color.a < 0.5)
+        discard;
+    fragColor = vec4(color.rgb, 1.0);
+}
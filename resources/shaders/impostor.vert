@@ -0,0 +1,47 @@
+#version 330 core
+
+const float PI = 3.14159265358979323846;
+
+// Views baked for each model (see impostor.cpp)
+const int NUM_AZIMUTHS = 8;
+const int NUM_ELEVATIONS = 2;
+// Elevation separating the two rows of views (rad): between 10 and 40 deg
+const float ELEVATION_THRESHOLD = 25.0 * PI / 180.0;
+
+// Per-instance data (see ImpostorRenderer::Instance)
+layout (location = 0) in vec4 centerRadius;   // bounding sphere (world)
+layout (location = 1) in vec4 yawRow;         // yaw of the model, atlas row
+
+uniform mat4 VP;
+uniform vec3 cameraPosition;
+uniform float numRows;
+
+out vec2 texCoord;
+
+void main()
+{
+    // Corner of the quad: gl_VertexID = 0, 1, 2, 3 for a triangle strip
+    vec2 corner = vec2(gl_VertexID % 2, gl_VertexID / 2) * 2.0 - 1.0;
+
+    // Orient the quad toward the camera, keeping the vertical axis upward
+    vec3 forward = normalize(centerRadius.xyz - cameraPosition);
+    vec3 right = cross(forward, vec3(0.0, 0.0, 1.0));
+    right = length(right) > 1e-4 ? normalize(right) : vec3(1.0, 0.0, 0.0);
+    vec3 up = cross(right, forward);
+    vec3 position = centerRadius.xyz +
+        centerRadius.w * (corner.x * right + corner.y * up);
+
+    // Select the view baked from the closest direction in the model frame
+    vec3 toCamera = -forward;
+    float azimuth = atan(toCamera.y, toCamera.x) - yawRow.x;
+    int a = int(floor(azimuth / (2.0 * PI) * NUM_AZIMUTHS + 0.5));
+    a = ((a % NUM_AZIMUTHS) + NUM_AZIMUTHS) % NUM_AZIMUTHS;
+    int e = asin(clamp(toCamera.z, -1.0, 1.0)) > ELEVATION_THRESHOLD ? 1 : 0;
+    float tile = float(e * NUM_AZIMUTHS + a);
+
+    texCoord = vec2(
+        (tile + 0.5 * (corner.x + 1.0)) / float(NUM_AZIMUTHS * NUM_ELEVATIONS),
+        (yawRow.y + 0.5 * (corner.y + 1.0)) / numRows
+    );
+    gl_Position = VP * vec4(position, 1.0);
+}
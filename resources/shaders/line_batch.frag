@@ -0,0 +1,10 @@
+#version 330 core
+
+in vec3 lineColor;
+
+layout (location = 0) out vec4 fragColor;
+
+void main()
+{
+    fragColor = vec4(lineColor, 1.0);
+}
@@ -0,0 +1,36 @@
+#version 330 core
+
+// Per-instance data (see LineBatch::Instance)
+layout (location = 0) in vec4 originYaw;    // frame origin, yaw angle
+layout (location = 1) in vec4 offsetScale;  // offset in the frame, scale
+layout (location = 2) in vec4 vectorMode;   // vector (or segment end), mode
+layout (location = 3) in vec4 color;
+
+uniform mat4 VP;
+
+out vec3 lineColor;
+
+void main()
+{
+    // Each instance is drawn as 3 segments: gl_VertexID = 2 * segment + tip
+    int segment = gl_VertexID / 2;
+    float tip = float(gl_VertexID % 2);
+
+    vec3 position;
+    if (vectorMode.w < 0.5) {
+        // Vector: draw the component along the axis 'segment'
+        vec3 local = offsetScale.xyz;
+        local[segment] += tip * offsetScale.w * vectorMode[segment];
+        float c = cos(originYaw.w);
+        float s = sin(originYaw.w);
+        position = originYaw.xyz +
+            vec3(c * local.x - s * local.y, s * local.x + c * local.y, local.z);
+    }
+    else {
+        // Segment: only the first segment is used, the others are degenerated
+        position = mix(originYaw.xyz, vectorMode.xyz, segment == 0 ? tip : 0.0);
+    }
+
+    lineColor = color.rgb;
+    gl_Position = VP * vec4(position, 1.0);
+}
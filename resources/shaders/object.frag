@@ -1,28 +1,63 @@
-#version 330 core
+#version 450 core
 
 const int NUM_CASCADES = 3;     // Number of cascaded shadows
 
-// Light information
-uniform vec3 lightIntensity;
+// Uniforms shared by the draws of the pass (see PassUniforms)
+layout (std140, binding = 0) uniform PassUniforms {
+    highp mat4 V;
+    highp mat4 P;
+    highp mat4 lVP[NUM_CASCADES];
+    vec4 lightDirection;    // View coordinates
+    vec4 lightIntensity;
+    vec4 endCascade;        // Far plane of each cascade
+};
 
-// Material information
-uniform vec3 Ka;
-uniform vec3 Kd;
-uniform vec3 Ks;
-uniform float shininess;
-uniform float alpha;
+// Material information, read from the table of all the materials (see 
+// MaterialTable)
+struct Material {
+    vec4 ambient;   // Ka, shininess
+    vec4 diffuse;   // Kd, alpha
+    vec4 specular;  // Ks, heightScale
+    uvec4 layers;   // Layers of the diffuse, normal and bump textures, flags
+    vec4 rects[3];  // Offset and scale of the diffuse, normal and bump
+                    // textures in their layer (see TextureAtlas)
+};
 
-// Texture sampler
-uniform sampler2D diffuseSampler;
-uniform sampler2D normalSampler;
-uniform sampler2D depthSampler;
-uniform sampler2D shadowMap[NUM_CASCADES];
+layout (std430, binding = 1) readonly buffer Materials {
+    Material materials[];
+};
 
-// Far plane distance of each shadow cascade
-uniform float endCascade[NUM_CASCADES];
+#ifdef INDIRECT
+// The index of the material is given by the draw of the multi-draw indirect
+// call
+flat in uint materialIndex;
+#else
+uniform uint materialIndex;
+#endif
 
-// Amplitude of parallax effect in bump mapping
-uniform float heightScale;
+#define Ka (materials[materialIndex].ambient.xyz)
+#define Kd (materials[materialIndex].diffuse.xyz)
+#define Ks (materials[materialIndex].specular.xyz)
+#define shininess (materials[materialIndex].ambient.w)
+#define alpha (materials[materialIndex].diffuse.w)
+#define heightScale (materials[materialIndex].specular.w)
+#define diffuseLayer (materials[materialIndex].layers.x)
+#define normalLayer (materials[materialIndex].layers.y)
+#define depthLayer (materials[materialIndex].layers.z)
+#define materialFlags (materials[materialIndex].layers.w)
+#define diffuseRect (materials[materialIndex].rects[0])
+#define normalRect (materials[materialIndex].rects[1])
+#define depthRect (materials[materialIndex].rects[2])
+
+// The normal map only stores x and y (BC5), see MaterialTable::NORMAL_XY
+const uint NORMAL_XY = 1u;
+
+// Texture sampler, the textures of the material are layers of texture arrays
+// (see TextureArrays)
+uniform sampler2DArray diffuseSampler;
+uniform sampler2DArray normalSampler;
+uniform sampler2DArray depthSampler;
+uniform sampler2DArray shadowMap;  // One layer per cascade (see DepthMap)
 
 in vec2 texCoord;
 
@@ -55,40 +90,21 @@ float shadowCalculation(
     // Perform perspective divide and transform to [0,1] range
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5;
-    // Get closest depth value from light's perspective
-//     float closestDepth = texture(shadowMap[cascadeIndex], projCoords.xy).r; 
-    float closestDepth;
-    switch(cascadeIndex) {
-        case 0: closestDepth = texture(shadowMap[0], projCoords.xy).r; break;
-        case 1: closestDepth = texture(shadowMap[1], projCoords.xy).r; break;
-        case 2: closestDepth = texture(shadowMap[2], projCoords.xy).r; break;
-    }
     // Get depth of current fragment from light's perspective
     float currentDepth = projCoords.z;
     // Check if the current fragment is in the shadow
     float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.0005);
     // Use PCF
     float shadow = 0.0;
-//     vec2 texelSize = 1.0 / textureSize(shadowMap[cascadeIndex], 0);
-    vec2 texelSize;
-    switch(cascadeIndex) {
-        case 0: texelSize = 1.0 / textureSize(shadowMap[0], 0); break;
-        case 1: texelSize = 1.0 / textureSize(shadowMap[1], 0); break;
-        case 2: texelSize = 1.0 / textureSize(shadowMap[2], 0); break;
-    }
+    vec2 texelSize = 1.0 / textureSize(shadowMap, 0).xy;
     for(int x = -PCF_TEXELSIZE_FILTER; x <= PCF_TEXELSIZE_FILTER; ++x)
     {
         for(int y = -PCF_TEXELSIZE_FILTER; y <= PCF_TEXELSIZE_FILTER; ++y)
         {
-//             float pcfDepth = texture(
-//                 shadowMap[cascadeIndex], projCoords.xy + vec2(x, y) * texelSize
-//             ).r; 
-            float pcfDepth;
-            switch(cascadeIndex) {
-                case 0: pcfDepth = texture(shadowMap[0], projCoords.xy + vec2(x, y) * texelSize).r; break;
-                case 1: pcfDepth = texture(shadowMap[1], projCoords.xy + vec2(x, y) * texelSize).r; break;
-                case 2: pcfDepth = texture(shadowMap[2], projCoords.xy + vec2(x, y) * texelSize).r; break;
-            }
+            float pcfDepth = texture(
+                shadowMap, 
+                vec3(projCoords.xy + vec2(x, y) * texelSize, cascadeIndex)
+            ).r; 
             shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;        
         }    
     }
@@ -105,10 +121,26 @@ float shadowCalculation(
 
 
 
+/**
+ * Sample a texture of the material. The texture coordinates wrap inside the
+ * rectangle of the texture in its layer, the gradients are given since they
+ * are discontinuous where the coordinates wrap.
+ */
+vec4 sampleTexture(
+    sampler2DArray s, vec2 uv, uint layer, vec4 rect, vec2 dx, vec2 dy
+) {
+    return textureGrad(
+        s, vec3(rect.xy + fract(uv) * rect.zw, layer), 
+        dx * rect.zw, dy * rect.zw
+    );
+}
+
+
+
 /**
  * Compute the displaced texture coordinates for bump mapping.
  */
-vec2 parallaxMapping(vec2 texCoords, vec3 viewDir) { 
+vec2 parallaxMapping(vec2 texCoords, vec3 viewDir, vec2 dx, vec2 dy) { 
     // Number of depth layers
     const float minLayers = 8.0;
     const float maxLayers = 32.0;
@@ -122,14 +154,18 @@ vec2 parallaxMapping(vec2 texCoords, vec3 viewDir) {
     vec2 deltaTexCoords = P / numLayers;
     // Get initial values
     vec2  currentTexCoords     = texCoords;
-    float currentDepthMapValue = texture(depthSampler, currentTexCoords).r;
+    float currentDepthMapValue = sampleTexture(
+        depthSampler, currentTexCoords, depthLayer, depthRect, dx, dy
+    ).r;
     
     while(currentLayerDepth < currentDepthMapValue)
     {
         // Shift texture coordinates along direction of P
         currentTexCoords -= deltaTexCoords;
         // Get depthmap value at current texture coordinates
-        currentDepthMapValue = texture(depthSampler, currentTexCoords).r;  
+        currentDepthMapValue = sampleTexture(
+            depthSampler, currentTexCoords, depthLayer, depthRect, dx, dy
+        ).r;
         // Get depth of next layer
         currentLayerDepth += layerDepth;  
     }
@@ -139,9 +175,9 @@ vec2 parallaxMapping(vec2 texCoords, vec3 viewDir) {
 
     // Get depth after and before collision for linear interpolation
     float afterDepth  = currentDepthMapValue - currentLayerDepth;
-    float beforeDepth = 
-        texture(depthSampler, prevTexCoords).r 
-        - currentLayerDepth + layerDepth;
+    float beforeDepth = sampleTexture(
+        depthSampler, prevTexCoords, depthLayer, depthRect, dx, dy
+    ).r - currentLayerDepth + layerDepth;
     
     // Interpolation of texture coordinates
     float weight = afterDepth / (afterDepth - beforeDepth);
@@ -162,11 +198,21 @@ void main() {
     // Compute the halfway vector for the Blinn-Phong lighting model
     vec3 h = normalize(s + v);
     
+    // Gradients of the texture coordinates, computed before any non-uniform
+    // control flow
+    vec2 dx = dFdx(texCoord);
+    vec2 dy = dFdy(texCoord);
+    
     // Offset texture coordinates with bump mapping
-    vec2 texCoordOffset = parallaxMapping(texCoord, v);
+    vec2 texCoordOffset = parallaxMapping(texCoord, v, dx, dy);
     
-    vec3 normal = texture(normalSampler, texCoordOffset).rgb;
-    normal = normalize(normal * 2.0 - 1.0);
+    vec3 normal = sampleTexture(
+        normalSampler, texCoordOffset, normalLayer, normalRect, dx, dy
+    ).rgb;
+    normal = normal * 2.0 - 1.0;
+    if ((materialFlags & NORMAL_XY) != 0u)
+        normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0));
+    normal = normalize(normal);
     //normal = vec3(0.0, 0.0, 1.0);
     
     // Calculate the diffuse contribution
@@ -176,7 +222,7 @@ void main() {
     vec3 specular = vec3(pow(max(dot(normal, h), 0.0), shininess));
     
     // Compute shadow
-    float shadow;
+    float shadow = 0.0;
 //     #ifdef CSM_DEBUG
 //         int shadowDebug;
 //     #endif
@@ -200,7 +246,9 @@ void main() {
     }
 
     // Calculate final color
-    vec3 color = lightIntensity * texture(diffuseSampler, texCoordOffset).rgb;
+    vec3 color = lightIntensity.rgb * sampleTexture(
+        diffuseSampler, texCoordOffset, diffuseLayer, diffuseRect, dx, dy
+    ).rgb;
 //     #ifdef CSM_DEBUG
 //         color[shadowDebug] = 1.0;
 //     #endif
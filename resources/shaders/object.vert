@@ -1,20 +1,47 @@
-#version 330
+#version 450 core
 
-const int NUM_CASCADES = 3;     // Number of cascaded shadows
+#ifdef INDIRECT
+#extension GL_ARB_shader_draw_parameters : require
+#endif
 
-in highp   vec3 vertexPosition;
-in highp   vec3 vertexNormal;
-in mediump vec2 texCoord2D;
-in highp   vec3 vertexTangent;
-in highp   vec3 vertexBitangent;
+const int NUM_CASCADES = 3;     // Number of cascaded shadows
 
+// Compact vertex format (see VertexFormat): the normal and the tangent are
+// octahedral-encoded, the tangent carries the handedness of the tangent space
+layout (location = 0) in highp   vec3 vertexPosition;
+layout (location = 1) in highp   vec2 vertexNormal;
+layout (location = 2) in mediump vec2 texCoord2D;
+layout (location = 3) in highp   vec3 vertexTangent;
+
+#ifdef INDIRECT
+// Data of the draws submitted with a multi-draw indirect call (see 
+// Object::IndirectRenderer), the draw of the call is given by gl_DrawIDARB
+struct Draw {
+    highp mat4 model;
+    highp mat3 normal;
+    uint material;
+};
+
+layout (std430, binding = 0) readonly buffer Draws {
+    Draw draws[];
+};
+
+uniform uint drawOffset;
+
+flat out uint materialIndex;
+#else
 uniform highp mat4 M;
-uniform highp mat4 MV;
-uniform highp mat4 MVP;
-uniform highp mat4 lMVP[NUM_CASCADES];
-uniform highp mat3 N;
-
-uniform vec4 lightDirection;
+#endif
+
+// Uniforms shared by the draws of the pass (see PassUniforms)
+layout (std140, binding = 0) uniform PassUniforms {
+    highp mat4 V;
+    highp mat4 P;
+    highp mat4 lVP[NUM_CASCADES];
+    vec4 lightDirection;    // View coordinates
+    vec4 lightIntensity;
+    vec4 endCascade;        // Far plane of each cascade
+};
 
 out highp vec2 texCoord;
 
@@ -37,31 +64,53 @@ out Tangent {
 
 
 
+// Decode a unit vector from its octahedral encoding
+vec3 octDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(v.yx)) * 
+            vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
+
+
 void main(void) {    
+#ifdef INDIRECT
+    // Matrices of the draw
+    Draw draw = draws[drawOffset + uint(gl_DrawIDARB)];
+    highp mat4 M = draw.model;
+    highp mat3 N = draw.normal;
+    materialIndex = draw.material;
+#else
+    highp mat3 N = transpose(inverse(mat3(V * M)));
+#endif
+    
     // Pass texture coordinates to the fragment shader
     texCoord = texCoord2D;
     
     // Transform to the vertex position to view space
-    view.position = vec3(MV * highp vec4(vertexPosition, 1.0));
+    highp vec4 worldPosition = M * highp vec4(vertexPosition, 1.0);
+    view.position = vec3(V * worldPosition);
     
     // Transform to light space (for shadow mapping)
 //     for (int i = 0; i < NUM_CASCADES; i++)
-//         lightProj.position[i] = lMVP[i] * highp vec4(vertexPosition, 1.0);
-    lightProj.position[0] = lMVP[0] * highp vec4(vertexPosition, 1.0);
-    lightProj.position[1] = lMVP[1] * highp vec4(vertexPosition, 1.0);
-    lightProj.position[2] = lMVP[2] * highp vec4(vertexPosition, 1.0);
+//         lightProj.position[i] = lVP[i] * worldPosition;
+    lightProj.position[0] = lVP[0] * worldPosition;
+    lightProj.position[1] = lVP[1] * worldPosition;
+    lightProj.position[2] = lVP[2] * worldPosition;
     
     // Transform the vertex position to clip space
-    gl_Position = MVP * highp vec4(vertexPosition, 1.0);
+    gl_Position = P * highp vec4(view.position, 1.0);
     
     // Give the z-coordinate in the clip space for cascaded shadow mapping
     proj.z = gl_Position.z;
     
     // Compute TBN matrix
-    vec3 Tvec = normalize(N * vertexTangent);
-    // vec3 Bvec = normalize(N * vertexBitangent);
-    vec3 Nvec = normalize(N * vertexNormal);
-    vec3 Bvec = cross(Nvec,Tvec);
+    vec3 Tvec = normalize(N * octDecode(vertexTangent.xy));
+    vec3 Nvec = normalize(N * octDecode(vertexNormal));
+    vec3 Bvec = vertexTangent.z * cross(Nvec,Tvec);
     mat3 TBN = transpose(mat3(Tvec, Bvec, Nvec));
     
     // Transform from view space to tangent space
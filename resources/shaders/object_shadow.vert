@@ -1,12 +1,69 @@
-#version 120
+#version 450 core
 
-// Simple vertex shader used to transform to light space for shadow mapping
+#ifdef INDIRECT
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+#ifdef VERTEX_LAYER
+#extension GL_ARB_shader_viewport_layer_array : require
+#endif
 
-attribute highp vec3 vertexPosition;
+// Simple vertex shader used to transform to light space for shadow mapping.
+// All the cascades are rendered in one pass: each draw is instanced once per
+// cascade and the vertex is sent to the layer of the shadow map of its
+// cascade, by this shader (VERTEX_LAYER) or by the geometry shader
+// (GEOMETRY_LAYER).
 
-uniform mat4 lMVP;
+const int NUM_CASCADES = 3;     // Number of cascaded shadows
+
+layout (location = 0) in highp vec3 vertexPosition;
+
+#ifdef INDIRECT
+// Data of the draws submitted with a multi-draw indirect call (see 
+// Object::IndirectRenderer), the draw of the call is given by gl_DrawIDARB
+struct Draw {
+    highp mat4 model;
+    highp mat3 normal;
+    uint material;
+};
+
+layout (std430, binding = 0) readonly buffer Draws {
+    Draw draws[];
+};
+
+uniform uint drawOffset;
+#else
+uniform mat4 M;
+#endif
+
+// Uniforms shared by the draws of the pass (see PassUniforms)
+layout (std140, binding = 0) uniform PassUniforms {
+    mat4 V;
+    mat4 P;
+    mat4 lVP[NUM_CASCADES];
+    vec4 lightDirection;    // View coordinates
+    vec4 lightIntensity;
+    vec4 endCascade;        // Far plane of each cascade
+};
+
+#ifdef GEOMETRY_LAYER
+out Cascade {
+    flat int index;
+} cascade;
+#endif
 
 void main()
 {
-    gl_Position = lMVP * vec4(vertexPosition, 1.0);
+#ifdef INDIRECT
+    mat4 M = draws[drawOffset + uint(gl_DrawIDARB)].model;
+    // The culling shader instances the draw over the cascades containing it
+    int index = gl_BaseInstanceARB + gl_InstanceID;
+#else
+    int index = gl_InstanceID;
+#endif
+    gl_Position = lVP[index] * (M * vec4(vertexPosition, 1.0));
+#ifdef GEOMETRY_LAYER
+    cascade.index = index;
+#else
+    gl_Layer = index;
+#endif
 }  
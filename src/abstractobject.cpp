@@ -44,6 +44,20 @@ ABCObject * ObjectManager::getObject(QString name) {
 }
 
 
+void ObjectManager::unloadObject(const ABCObject * object) {
+    for (
+        ObjectsMap::iterator it = m_objects.begin(); it != m_objects.end(); it++
+    ) {
+        if (it->second.get() == object) {
+            // Release the OpenGL resources of the object
+            it->second->cleanUp();
+            m_objects.erase(it);
+            return;
+        }
+    }
+}
+
+
 void ObjectManager::initialize() {
     // Delete all textures
     for (
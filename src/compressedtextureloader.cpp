@@ -0,0 +1,377 @@
+#include "../include/compressedtextureloader.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+// Identifiers of the DDS files
+static constexpr quint32 DDS_MAGIC = 0x20534444;     // "DDS "
+static constexpr quint32 DDS_HEADER_SIZE = 124;
+static constexpr quint32 DDS_DX10_HEADER_SIZE = 20;
+static constexpr quint32 DDPF_FOURCC = 0x4;
+static constexpr quint32 DDSCAPS2_CUBEMAP = 0x200;
+static constexpr quint32 DDSCAPS2_VOLUME = 0x200000;
+static constexpr quint32 DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+// Identifier of the KTX2 files
+static const char KTX2_IDENTIFIER[12] = {
+    '\xAB', 'K', 'T', 'X', ' ', '2', '0', '\xBB', '\r', '\n', '\x1A', '\n'
+};
+static constexpr int KTX2_LEVEL_INDEX = 80;
+
+/**
+ * @brief Return the FourCC code of four characters.
+ */
+static constexpr quint32 fourCC(char a, char b, char c, char d) {
+    return quint32(quint8(a)) | quint32(quint8(b)) << 8 | 
+           quint32(quint8(c)) << 16 | quint32(quint8(d)) << 24;
+}
+
+/**
+ * @brief Read a little-endian integer of a file, 0 past the end.
+ */
+template <class T>
+static T read(const QByteArray & data, size_t offset) {
+    if (offset + sizeof(T) > static_cast<size_t>(data.size()))
+        return 0;
+    return qFromLittleEndian<T>(data.constData() + offset);
+}
+
+/***
+ *       _____                                                           _ 
+ *      / ____|                                                         | |
+ *     | |       ___   _ __ ___   _ __   _ __   ___  ___  ___   ___   __| |
+ *     | |      / _ \ | '_ ` _ \ | '_ \ | '__| / _ \/ __|/ __| / _ \ / _` |
+ *     | |____ | (_) || | | | | || |_) || |   |  __/\__ \\__ \|  __/| (_| |
+ *      \_____| \___/ |_| |_| |_|| .__/ |_|    \___||___/|___/ \___| \__,_|
+ *                               | |                                       
+ *                               |_|                                       
+ *      _______               _                      
+ *     |__   __|             | |                     
+ *        | |     ___ __  __ | |_  _   _  _ __   ___ 
+ *        | |    / _ \\ \/ / | __|| | | || '__| / _ \
+ *        | |   |  __/ >  <  | |_ | |_| || |   |  __/
+ *        |_|    \___|/_/\_\  \__| \__,_||_|    \___|
+ *                                                   
+ *                                                   
+ *      _                          _             
+ *     | |                        | |            
+ *     | |        ___    __ _   __| |  ___  _ __ 
+ *     | |       / _ \  / _` | / _` | / _ \| '__|
+ *     | |____  | (_) || (_| || (_| ||  __/| |   
+ *     |______|  \___/  \__,_| \__,_| \___||_|   
+ *                                               
+ *                                               
+ */
+
+bool CompressedTextureLoader::isCompressedFile(const QString & path) {
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    return suffix == "dds" || suffix == "ktx2";
+}
+
+
+bool CompressedTextureLoader::load(const QString & path, Image & image) {
+    image = Image();
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const QByteArray data = file.readAll();
+    
+    const bool isKtx2 = data.size() >= 12 && 
+        std::memcmp(data.constData(), KTX2_IDENTIFIER, 12) == 0;
+    bool isBottomUp = false;
+    if (!(isKtx2 ? loadKtx2(data, image, isBottomUp) : loadDds(data, image))) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "The format of the texture" << path << "is not supported.";
+        image = Image();
+        return false;
+    }
+    
+    // OpenGL expects the bottom row first
+    if (isBottomUp)
+        return true;
+    GLsizei width = image.width;
+    GLsizei height = image.height;
+    for (QByteArray & level : image.levels) {
+        // The format of the image is not flippable, the whole image is kept
+        // top-down
+        if (!flipLevel(image.format, width, height, level)) {
+            image.isTopDown = true;
+            break;
+        }
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return true;
+}
+
+
+GLsizei CompressedTextureLoader::levelSize(
+    GLenum format, GLsizei width, GLsizei height
+) {
+    GLsizei blockSize = 0;
+    switch (format) {
+        case GL_RGBA8:
+            return width * height * 4;
+        case GL_R8:
+            return width * height;
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RED_RGTC1:
+            blockSize = 8;
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RG_RGTC2:
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+            blockSize = 16;
+            break;
+        default:
+            return 0;
+    }
+    return std::max(1, (width + 3) / 4) * std::max(1, (height + 3) / 4) * 
+           blockSize;
+}
+
+
+bool CompressedTextureLoader::loadDds(const QByteArray & data, Image & image) {
+    if (read<quint32>(data, 0) != DDS_MAGIC || 
+        read<quint32>(data, 4) != DDS_HEADER_SIZE)
+        return false;
+    const quint32 height = read<quint32>(data, 12);
+    const quint32 width = read<quint32>(data, 16);
+    const quint32 mipMapCount = read<quint32>(data, 28);
+    const quint32 pixelFlags = read<quint32>(data, 80);
+    const quint32 code = read<quint32>(data, 84);
+    const quint32 caps2 = read<quint32>(data, 112);
+    if (!(pixelFlags & DDPF_FOURCC) || 
+        (caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)))
+        return false;
+    
+    // Format, given by the FourCC code or by the DX10 header
+    size_t offset = 4 + DDS_HEADER_SIZE;
+    if (code == fourCC('D', 'X', '1', '0')) {
+        // DXGI format, dimension (3: 2D texture), flags, array size
+        image.format = dxgiFormat(read<quint32>(data, offset));
+        if (read<quint32>(data, offset + 4) != 3 || 
+            (read<quint32>(data, offset + 8) & 
+             DDS_RESOURCE_MISC_TEXTURECUBE) ||
+            read<quint32>(data, offset + 12) > 1)
+            return false;
+        offset += DDS_DX10_HEADER_SIZE;
+    }
+    else if (code == fourCC('D', 'X', 'T', '1'))
+        image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    else if (code == fourCC('D', 'X', 'T', '3'))
+        image.format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+    else if (code == fourCC('D', 'X', 'T', '5'))
+        image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    else if (code == fourCC('A', 'T', 'I', '1') || 
+             code == fourCC('B', 'C', '4', 'U'))
+        image.format = GL_COMPRESSED_RED_RGTC1;
+    else if (code == fourCC('A', 'T', 'I', '2') || 
+             code == fourCC('B', 'C', '5', 'U'))
+        image.format = GL_COMPRESSED_RG_RGTC2;
+    if (image.format == 0 || width == 0 || height == 0)
+        return false;
+    image.width = static_cast<GLsizei>(width);
+    image.height = static_cast<GLsizei>(height);
+    
+    // The levels follow the headers, from the largest
+    const quint32 numLevels = std::max<quint32>(mipMapCount, 1);
+    GLsizei levelWidth = image.width;
+    GLsizei levelHeight = image.height;
+    for (quint32 level = 0; level < numLevels; level++) {
+        const GLsizei size = levelSize(image.format, levelWidth, levelHeight);
+        if (offset + size > static_cast<size_t>(data.size()))
+            return false;
+        image.levels.push_back(data.mid(static_cast<int>(offset), size));
+        offset += size;
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+        levelWidth = std::max(1, levelWidth / 2);
+        levelHeight = std::max(1, levelHeight / 2);
+    }
+    return true;
+}
+
+
+bool CompressedTextureLoader::loadKtx2(const QByteArray & data, 
+                                       Image & image, bool & isBottomUp) {
+    // Vulkan format, type size, width, height, depth, layers, faces, levels,
+    // supercompression scheme
+    image.format = vulkanFormat(read<quint32>(data, 12));
+    const quint32 width = read<quint32>(data, 20);
+    const quint32 height = read<quint32>(data, 24);
+    if (image.format == 0 || width == 0 || height == 0 ||
+        read<quint32>(data, 28) != 0 || read<quint32>(data, 32) > 1 || 
+        read<quint32>(data, 36) != 1 || read<quint32>(data, 44) != 0)
+        return false;
+    image.width = static_cast<GLsizei>(width);
+    image.height = static_cast<GLsizei>(height);
+    
+    // Key/value data: length, key and value ended by '\0', padded to 4 bytes
+    const quint32 kvdOffset = read<quint32>(data, 56);
+    const quint32 kvdEnd = std::min<quint32>(
+        kvdOffset + read<quint32>(data, 60), data.size()
+    );
+    for (quint32 offset = kvdOffset; offset + 4 <= kvdEnd;) {
+        const quint32 length = read<quint32>(data, offset);
+        const QByteArray entry = data.mid(offset + 4, length);
+        if (entry.startsWith(QByteArray("KTXorientation\0", 15)))
+            isBottomUp = entry.mid(15).startsWith("ru");
+        offset += 4 + (length + 3) / 4 * 4;
+    }
+    
+    // Level index: offset, length and uncompressed length of each level, from
+    // the largest
+    const quint32 numLevels = std::max<quint32>(read<quint32>(data, 40), 1);
+    GLsizei levelWidth = image.width;
+    GLsizei levelHeight = image.height;
+    for (quint32 level = 0; level < numLevels; level++) {
+        const size_t index = KTX2_LEVEL_INDEX + 24 * level;
+        const quint64 offset = read<quint64>(data, index);
+        const quint64 length = read<quint64>(data, index + 8);
+        const GLsizei size = levelSize(image.format, levelWidth, levelHeight);
+        if (length != static_cast<quint64>(size) ||
+            offset + length > static_cast<quint64>(data.size()))
+            return false;
+        image.levels.push_back(data.mid(static_cast<int>(offset), size));
+        levelWidth = std::max(1, levelWidth / 2);
+        levelHeight = std::max(1, levelHeight / 2);
+    }
+    return true;
+}
+
+
+GLenum CompressedTextureLoader::dxgiFormat(quint32 format) {
+    switch (format) {
+        case 71: case 72:   // DXGI_FORMAT_BC1_UNORM(_SRGB)
+            return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        case 74: case 75:   // DXGI_FORMAT_BC2_UNORM(_SRGB)
+            return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        case 77: case 78:   // DXGI_FORMAT_BC3_UNORM(_SRGB)
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case 80:            // DXGI_FORMAT_BC4_UNORM
+            return GL_COMPRESSED_RED_RGTC1;
+        case 83:            // DXGI_FORMAT_BC5_UNORM
+            return GL_COMPRESSED_RG_RGTC2;
+        case 98: case 99:   // DXGI_FORMAT_BC7_UNORM(_SRGB)
+            return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default:
+            return 0;
+    }
+}
+
+
+GLenum CompressedTextureLoader::vulkanFormat(quint32 format) {
+    switch (format) {
+        case 9:             // VK_FORMAT_R8_UNORM
+            return GL_R8;
+        case 37:            // VK_FORMAT_R8G8B8A8_UNORM
+            return GL_RGBA8;
+        case 131: case 132: // VK_FORMAT_BC1_RGB_UNORM(SRGB)_BLOCK
+            return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case 133: case 134: // VK_FORMAT_BC1_RGBA_UNORM(SRGB)_BLOCK
+            return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        case 135: case 136: // VK_FORMAT_BC2_UNORM(SRGB)_BLOCK
+            return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        case 137: case 138: // VK_FORMAT_BC3_UNORM(SRGB)_BLOCK
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case 139:           // VK_FORMAT_BC4_UNORM_BLOCK
+            return GL_COMPRESSED_RED_RGTC1;
+        case 141:           // VK_FORMAT_BC5_UNORM_BLOCK
+            return GL_COMPRESSED_RG_RGTC2;
+        case 145: case 146: // VK_FORMAT_BC7_UNORM(SRGB)_BLOCK
+            return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default:
+            return 0;
+    }
+}
+
+
+bool CompressedTextureLoader::flipLevel(
+    GLenum format, GLsizei width, GLsizei height, QByteArray & level
+) {
+    // Parts of a block holding the rows of pixels: offset, size, bits per
+    // row. The indices of a color block follow its two colors, those of an
+    // alpha (BC4) block its two values, BC2 stores 4 bits per alpha.
+    struct Part {int offset; int size; int rowBits;};
+    std::vector<Part> parts;
+    int blockSize = 16;
+    switch (format) {
+        case GL_RGBA8:
+        case GL_R8: {
+            // Swap the rows of pixels
+            const int rowSize = levelSize(format, width, 1);
+            char * bytes = level.data();
+            for (int y = 0; y < height / 2; y++) {
+                std::swap_ranges(bytes + y * rowSize, bytes + (y + 1) * rowSize,
+                                 bytes + (height - 1 - y) * rowSize);
+            }
+            return true;
+        }
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+            parts = {{4, 4, 8}};
+            blockSize = 8;
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+            parts = {{0, 8, 16}, {8 + 4, 4, 8}};
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            parts = {{2, 6, 12}, {8 + 4, 4, 8}};
+            break;
+        case GL_COMPRESSED_RED_RGTC1:
+            parts = {{2, 6, 12}};
+            blockSize = 8;
+            break;
+        case GL_COMPRESSED_RG_RGTC2:
+            parts = {{2, 6, 12}, {8 + 2, 6, 12}};
+            break;
+        default:
+            return false;
+    }
+    
+    // Swap the rows of blocks, then reverse the rows of pixels in each block.
+    // The rows of the last blocks are only valid up to the height.
+    const int blocksX = std::max(1, (width + 3) / 4);
+    const int blocksY = std::max(1, (height + 3) / 4);
+    const int rowSize = blocksX * blockSize;
+    const int rows = std::min(height, 4);
+    uchar * bytes = reinterpret_cast<uchar *>(level.data());
+    for (int y = 0; y < blocksY / 2; y++) {
+        std::swap_ranges(bytes + y * rowSize, bytes + (y + 1) * rowSize,
+                         bytes + (blocksY - 1 - y) * rowSize);
+    }
+    for (int block = 0; block < blocksX * blocksY; block++) {
+        for (const Part & part : parts) {
+            flipRows(bytes + block * blockSize + part.offset, part.size, 
+                     part.rowBits, rows);
+        }
+    }
+    return true;
+}
+
+
+void CompressedTextureLoader::flipRows(
+    uchar * data, int size, int rowBits, int rows
+) {
+    quint64 bits = 0;
+    for (int i = 0; i < size; i++)
+        bits |= quint64(data[i]) << (8 * i);
+    
+    const quint64 mask = (quint64(1) << rowBits) - 1;
+    quint64 flipped = bits;
+    for (int row = 0; row < rows; row++) {
+        const quint64 value = (bits >> (rowBits * (rows - 1 - row))) & mask;
+        flipped &= ~(mask << (rowBits * row));
+        flipped |= value << (rowBits * row);
+    }
+    
+    for (int i = 0; i < size; i++)
+        data[i] = static_cast<uchar>(flipped >> (8 * i));
+}
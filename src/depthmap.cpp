@@ -20,40 +20,45 @@ c_height(height) {
         exit(1);
     }
     
-    // Create the frame buffer and texture for shadow mapping
-    p_glFunctions->glGenTextures(NUM_CASCADES, m_textureId);
-    for (unsigned int i = 0; i < NUM_CASCADES; i++) {
-        p_glFunctions->glBindTexture(GL_TEXTURE_2D, m_textureId[i]);
-        p_glFunctions->glTexImage2D(
-            GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, c_width, c_height, 0, 
-            GL_DEPTH_COMPONENT, GL_FLOAT, NULL
-        );
-        p_glFunctions->glTexParameteri(
-            GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST
-        );
-        p_glFunctions->glTexParameteri(
-            GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST
-        );
-        p_glFunctions->glTexParameteri(
-            GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER
-        );
-        p_glFunctions->glTexParameteri(
-            GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER
-        );
-        float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-        p_glFunctions->glTexParameterfv(
-            GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor
-        ); 
-    }
+    // Create the frame buffer and texture array for shadow mapping
+    p_glFunctions->glGenTextures(1, &m_textureId);
+    p_glFunctions->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureId);
+    p_glFunctions->glTexImage3D(
+        GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, c_width, c_height, 
+        NUM_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL
+    );
+    p_glFunctions->glTexParameteri(
+        GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST
+    );
+    p_glFunctions->glTexParameteri(
+        GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST
+    );
+    p_glFunctions->glTexParameteri(
+        GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER
+    );
+    p_glFunctions->glTexParameteri(
+        GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER
+    );
+    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    p_glFunctions->glTexParameterfv(
+        GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor
+    ); 
+    p_glFunctions->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     
-    // Attach the depth texture to the FBO
+    // Attach all the layers of the depth texture to the FBO, the layer of 
+    // each primitive is selected by the shaders
     p_glFunctions->glGenFramebuffers(1, &m_FBOId); 
     p_glFunctions->glBindFramebuffer(GL_FRAMEBUFFER, m_FBOId);
-    p_glFunctions->glFramebufferTexture2D(
-        GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_textureId[0], 0
+    p_glFunctions->glFramebufferTexture(
+        GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_textureId, 0
     );
     p_glFunctions->glDrawBuffer(GL_NONE);
     p_glFunctions->glReadBuffer(GL_NONE);
+    if (p_glFunctions->glCheckFramebufferStatus(GL_FRAMEBUFFER) != 
+        GL_FRAMEBUFFER_COMPLETE) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "The layered framebuffer of the shadow map is not complete.";
+    }
     p_glFunctions->glBindFramebuffer(GL_FRAMEBUFFER, 0); 
 }
 
@@ -61,14 +66,10 @@ c_height(height) {
 DepthMap::~DepthMap() {}
 
 
-void DepthMap::bind(const unsigned int cacadeIdx) {
+void DepthMap::bind() {
     if (p_glFunctions != nullptr) {
         p_glFunctions->glViewport(0, 0, c_width, c_height);
         p_glFunctions->glBindFramebuffer(GL_FRAMEBUFFER, m_FBOId);
-        p_glFunctions->glFramebufferTexture2D(
-            GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
-            m_textureId[cacadeIdx], 0
-        );
         p_glFunctions->glClear(GL_DEPTH_BUFFER_BIT);
     }
 }
@@ -82,17 +83,9 @@ void DepthMap::release() {
 }
 
 
-void DepthMap::bindTexture(const unsigned int unit[NUM_CASCADES]) {
+void DepthMap::bindTexture(const unsigned int unit) {
     if (p_glFunctions != nullptr) {
-        for (unsigned int i = 0; i < NUM_CASCADES; i++) {
-            p_glFunctions->glActiveTexture(GL_TEXTURE0 + unit[i]);
-            p_glFunctions->glBindTexture(GL_TEXTURE_2D, m_textureId[i]);
-        }
+        p_glFunctions->glActiveTexture(GL_TEXTURE0 + unit);
+        p_glFunctions->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureId);
     }
 }
-
-
-
-
-
-
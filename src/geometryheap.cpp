@@ -0,0 +1,329 @@
+#include "../include/geometryheap.h"
+#include "../include/openglfunctions.h"
+#include "../include/vertexformat.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+// Initial capacity of the vertex and index buffers of a heap (bytes)
+static constexpr GLsizeiptr INITIAL_VERTEX_CAPACITY = 16 << 20;
+static constexpr GLsizeiptr INITIAL_INDEX_CAPACITY = 4 << 20;
+// Alignment of the index data of an allocation (bytes)
+static constexpr GLsizeiptr INDEX_ALIGNMENT = sizeof(GLuint);
+
+/***
+ *       _____                                _                
+ *      / ____|                              | |               
+ *     | |  __   ___   ___   _ __ ___    ___ | |_  _ __  _   _ 
+ *     | | |_ | / _ \ / _ \ | '_ ` _ \  / _ \| __|| '__|| | | |
+ *     | |__| ||  __/| (_) || | | | | ||  __/| |_ | |   | |_| |
+ *      \_____| \___| \___/ |_| |_| |_| \___| \__||_|    \__, |
+ *                                                        __/ |
+ *                                                       |___/ 
+ *      _    _                     
+ *     | |  | |                    
+ *     | |__| |  ___   __ _  _ __  
+ *     |  __  | / _ \ / _` || '_ \ 
+ *     | |  | ||  __/| (_| || |_) |
+ *     |_|  |_| \___| \__,_|| .__/ 
+ *                          | |    
+ *                          |_|    
+ */
+
+// Instantiate static member variables
+std::array<GeometryHeap::Heap,2> GeometryHeap::m_heaps;
+
+
+const GeometryHeap::Allocation * GeometryHeap::allocate(
+    bool halfTextureUV, const QByteArray & vertexData,
+    const QByteArray & indexData
+) {
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (!gl)
+        return nullptr;
+    Heap & heap = m_heaps[halfTextureUV];
+    if (heap.vao == 0) {
+        createVao(gl, heap, halfTextureUV);
+        resize(gl, heap.vertices, INITIAL_VERTEX_CAPACITY, 0);
+        resize(gl, heap.indices, INITIAL_INDEX_CAPACITY, 0);
+        releaseRange(heap.vertices, 0, INITIAL_VERTEX_CAPACITY);
+        releaseRange(heap.indices, 0, INITIAL_INDEX_CAPACITY);
+    }
+
+    // Reserve the ranges, the vertex range is aligned on the size of a vertex
+    // so that its first vertex can be used as base vertex
+    const GLsizeiptr stride = VertexFormat::stride(halfTextureUV);
+    const GLsizeiptr vertexSize = vertexData.size();
+    const GLsizeiptr indexSize =
+        (indexData.size() + INDEX_ALIGNMENT - 1) / INDEX_ALIGNMENT *
+        INDEX_ALIGNMENT;
+    const GLintptr vertexOffset =
+        allocateRange(gl, heap.vertices, vertexSize, stride);
+    const GLintptr indexOffset =
+        allocateRange(gl, heap.indices, indexSize, INDEX_ALIGNMENT);
+
+    // Copy the data, the buffers may have been reallocated
+    if (vertexSize > 0) {
+        gl->glNamedBufferSubData(
+            heap.vertices.buffer, vertexOffset, vertexSize,
+            vertexData.constData()
+        );
+    }
+    if (indexData.size() > 0) {
+        gl->glNamedBufferSubData(
+            heap.indices.buffer, indexOffset, indexData.size(),
+            indexData.constData()
+        );
+    }
+    attachBuffers(gl, heap, halfTextureUV);
+
+    heap.allocations.push_back(std::make_unique<Allocation>(Allocation{
+        halfTextureUV, static_cast<GLint>(vertexOffset / stride), vertexSize,
+        indexOffset, indexSize
+    }));
+    return heap.allocations.back().get();
+}
+
+
+void GeometryHeap::release(const Allocation * allocation) {
+    if (!allocation)
+        return;
+    Heap & heap = m_heaps[allocation->halfTextureUV];
+    for (
+        auto it = heap.allocations.begin(); it != heap.allocations.end(); it++
+    ) {
+        if (it->get() == allocation) {
+            const GLsizeiptr stride =
+                VertexFormat::stride(allocation->halfTextureUV);
+            releaseRange(heap.vertices, allocation->firstVertex * stride,
+                         allocation->vertexSize);
+            releaseRange(heap.indices, allocation->indexOffset,
+                         allocation->indexSize);
+            heap.allocations.erase(it);
+            return;
+        }
+    }
+    qWarning() << __FILE__ << __LINE__ <<
+        "The allocation does not belong to the geometry heap.";
+}
+
+
+void GeometryHeap::bind(QOpenGLFunctions_4_5_Core * gl, bool halfTextureUV) {
+    gl->glBindVertexArray(m_heaps[halfTextureUV].vao);
+}
+
+
+void GeometryHeap::unbind(QOpenGLFunctions_4_5_Core * gl) {
+    gl->glBindVertexArray(0);
+}
+
+
+void GeometryHeap::defragment() {
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (!gl)
+        return;
+
+    for (bool halfTextureUV : {false, true}) {
+        Heap & heap = m_heaps[halfTextureUV];
+        if (heap.vao == 0 || (heap.vertices.freeRanges.empty() &&
+                              heap.indices.freeRanges.empty()))
+            continue;
+        const GLsizeiptr stride = VertexFormat::stride(halfTextureUV);
+
+        // Total size of the allocations
+        GLsizeiptr vertexSize = 0;
+        GLsizeiptr indexSize = 0;
+        for (const std::unique_ptr<Allocation> & allocation : heap.allocations) {
+            vertexSize += allocation->vertexSize;
+            indexSize += allocation->indexSize;
+        }
+
+        // Copy the allocations one after the other in new buffers, the
+        // allocations keep their order
+        Arena vertices;
+        Arena indices;
+        vertices.capacity = vertexSize;
+        indices.capacity = indexSize;
+        for (Arena * arena : {&vertices, &indices}) {
+            if (arena->capacity == 0)
+                continue;
+            gl->glCreateBuffers(1, &arena->buffer);
+            gl->glNamedBufferStorage(
+                arena->buffer, arena->capacity, nullptr,
+                GL_DYNAMIC_STORAGE_BIT
+            );
+        }
+        GLintptr vertexOffset = 0;
+        GLintptr indexOffset = 0;
+        for (const std::unique_ptr<Allocation> & allocation : heap.allocations) {
+            if (allocation->vertexSize > 0) {
+                gl->glCopyNamedBufferSubData(
+                    heap.vertices.buffer, vertices.buffer,
+                    allocation->firstVertex * stride, vertexOffset,
+                    allocation->vertexSize
+                );
+            }
+            if (allocation->indexSize > 0) {
+                gl->glCopyNamedBufferSubData(
+                    heap.indices.buffer, indices.buffer,
+                    allocation->indexOffset, indexOffset,
+                    allocation->indexSize
+                );
+            }
+            allocation->firstVertex = static_cast<GLint>(vertexOffset / stride);
+            allocation->indexOffset = indexOffset;
+            vertexOffset += allocation->vertexSize;
+            indexOffset += allocation->indexSize;
+        }
+
+        // Replace the buffers
+        gl->glDeleteBuffers(1, &heap.vertices.buffer);
+        gl->glDeleteBuffers(1, &heap.indices.buffer);
+        heap.vertices = vertices;
+        heap.indices = indices;
+        attachBuffers(gl, heap, halfTextureUV);
+    }
+}
+
+
+void GeometryHeap::cleanUp() {
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    for (Heap & heap : m_heaps) {
+        if (gl && heap.vao != 0) {
+            gl->glDeleteVertexArrays(1, &heap.vao);
+            gl->glDeleteBuffers(1, &heap.vertices.buffer);
+            gl->glDeleteBuffers(1, &heap.indices.buffer);
+        }
+        heap = Heap();
+    }
+}
+
+
+void GeometryHeap::createVao(
+    QOpenGLFunctions_4_5_Core * gl, Heap & heap, bool halfTextureUV
+) {
+    gl->glCreateVertexArrays(1, &heap.vao);
+
+    // All the attributes are read from the vertex buffer bound to the binding
+    // point '0' (see attachBuffers())
+
+    // Map vertex data to the vertex shader layout location '0'
+    gl->glEnableVertexArrayAttrib(heap.vao, 0);
+    gl->glVertexArrayAttribFormat(
+        heap.vao, 0, 3, GL_FLOAT, GL_FALSE, VertexFormat::POSITION_OFFSET
+    );
+    gl->glVertexArrayAttribBinding(heap.vao, 0, 0);
+
+    // Map normal data (normalized shorts) to the vertex shader layout
+    // location '1'
+    gl->glEnableVertexArrayAttrib(heap.vao, 1);
+    gl->glVertexArrayAttribFormat(
+        heap.vao, 1, 2, GL_SHORT, GL_TRUE, VertexFormat::NORMAL_OFFSET
+    );
+    gl->glVertexArrayAttribBinding(heap.vao, 1, 0);
+
+    // Map texture data to the vertex shader layout location '2'
+    gl->glEnableVertexArrayAttrib(heap.vao, 2);
+    gl->glVertexArrayAttribFormat(
+        heap.vao, 2, 2, halfTextureUV ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE,
+        VertexFormat::TEXTURE_UV_OFFSET
+    );
+    gl->glVertexArrayAttribBinding(heap.vao, 2, 0);
+
+    // Map tangent data (normalized shorts) to the vertex shader layout
+    // location '3'
+    gl->glEnableVertexArrayAttrib(heap.vao, 3);
+    gl->glVertexArrayAttribFormat(
+        heap.vao, 3, 3, GL_SHORT, GL_TRUE, VertexFormat::TANGENT_OFFSET
+    );
+    gl->glVertexArrayAttribBinding(heap.vao, 3, 0);
+}
+
+
+GLintptr GeometryHeap::allocateRange(
+    QOpenGLFunctions_4_5_Core * gl, Arena & arena, GLsizeiptr size,
+    GLsizeiptr alignment
+) {
+    if (size == 0)
+        return 0;
+
+    // First free range large enough, the unused parts of the range are
+    // returned to the free-list
+    for (auto it = arena.freeRanges.begin(); it != arena.freeRanges.end(); it++) {
+        const GLintptr offset = it->first;
+        const GLsizeiptr rangeSize = it->second;
+        const GLintptr aligned =
+            (offset + alignment - 1) / alignment * alignment;
+        if (aligned + size > offset + rangeSize)
+            continue;
+        arena.freeRanges.erase(it);
+        if (aligned > offset)
+            arena.freeRanges[offset] = aligned - offset;
+        if (aligned + size < offset + rangeSize)
+            arena.freeRanges[aligned + size] = offset + rangeSize - aligned - size;
+        return aligned;
+    }
+
+    // Grow the buffer, the new space is added to the free-list
+    const GLsizeiptr previous = arena.capacity;
+    const GLsizeiptr capacity =
+        std::max(2 * previous, previous + size + alignment);
+    resize(gl, arena, capacity, previous);
+    releaseRange(arena, previous, capacity - previous);
+    return allocateRange(gl, arena, size, alignment);
+}
+
+
+void GeometryHeap::releaseRange(
+    Arena & arena, GLintptr offset, GLsizeiptr size
+) {
+    if (size == 0)
+        return;
+
+    // Merge the range with the next and previous free ranges
+    auto next = arena.freeRanges.lower_bound(offset);
+    if (next != arena.freeRanges.end() && offset + size == next->first) {
+        size += next->second;
+        next = arena.freeRanges.erase(next);
+    }
+    if (next != arena.freeRanges.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return;
+        }
+    }
+    arena.freeRanges[offset] = size;
+}
+
+
+void GeometryHeap::resize(
+    QOpenGLFunctions_4_5_Core * gl, Arena & arena, GLsizeiptr capacity,
+    GLsizeiptr size
+) {
+    GLuint buffer = 0;
+    gl->glCreateBuffers(1, &buffer);
+    gl->glNamedBufferStorage(
+        buffer, capacity, nullptr, GL_DYNAMIC_STORAGE_BIT
+    );
+    if (arena.buffer != 0) {
+        if (size > 0)
+            gl->glCopyNamedBufferSubData(arena.buffer, buffer, 0, 0, size);
+        gl->glDeleteBuffers(1, &arena.buffer);
+    }
+    arena.buffer = buffer;
+    arena.capacity = capacity;
+}
+
+
+void GeometryHeap::attachBuffers(
+    QOpenGLFunctions_4_5_Core * gl, Heap & heap, bool halfTextureUV
+) {
+    gl->glVertexArrayVertexBuffer(
+        heap.vao, 0, heap.vertices.buffer, 0,
+        VertexFormat::stride(halfTextureUV)
+    );
+    gl->glVertexArrayElementBuffer(heap.vao, heap.indices.buffer);
+}
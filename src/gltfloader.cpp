@@ -0,0 +1,790 @@
+#include "../include/gltfloader.h"
+#include "../include/tangentgenerator.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QQuaternion>
+#include <QUrl>
+#include <QtEndian>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Identifiers of the GLB container
+static constexpr quint32 GLB_MAGIC = 0x46546C67;      // "glTF"
+static constexpr quint32 GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+static constexpr quint32 GLB_CHUNK_BIN = 0x004E4942;  // "BIN"
+// Component types of the accessors
+static constexpr int GLTF_BYTE = 5120;
+static constexpr int GLTF_UNSIGNED_BYTE = 5121;
+static constexpr int GLTF_SHORT = 5122;
+static constexpr int GLTF_UNSIGNED_SHORT = 5123;
+static constexpr int GLTF_UNSIGNED_INT = 5125;
+static constexpr int GLTF_FLOAT = 5126;
+// Primitive mode of the triangle lists
+static constexpr int GLTF_TRIANGLES = 4;
+// Maximum depth of the node tree, protects against cycles
+static constexpr int MAX_NODE_DEPTH = 64;
+// Ambient color of a material relative to its base color
+static constexpr float AMBIENT_FACTOR = 0.2f;
+
+GltfLoader::Document GltfLoader::m_imageDocument;
+
+namespace {
+
+/**
+ * @brief Return the size (bytes) of a component type, 0 if not valid.
+ */
+int componentSize(int type) {
+    switch (type) {
+        case GLTF_BYTE:
+        case GLTF_UNSIGNED_BYTE:
+            return 1;
+        case GLTF_SHORT:
+        case GLTF_UNSIGNED_SHORT:
+            return 2;
+        case GLTF_UNSIGNED_INT:
+        case GLTF_FLOAT:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Return the number of components of an accessor type, 0 if not
+ * valid.
+ */
+int componentCount(const QString & type) {
+    if (type == "SCALAR")
+        return 1;
+    if (type == "VEC2")
+        return 2;
+    if (type == "VEC3")
+        return 3;
+    if (type == "VEC4" || type == "MAT2")
+        return 4;
+    return 0;
+}
+
+/**
+ * @brief Read a component and convert it to a float.
+ */
+float readComponent(const char * data, int type, bool normalized) {
+    switch (type) {
+        case GLTF_FLOAT: {
+            float value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+        case GLTF_UNSIGNED_BYTE: {
+            const float value = static_cast<unsigned char>(*data);
+            return normalized ? value / 255.0f : value;
+        }
+        case GLTF_BYTE: {
+            const float value = static_cast<signed char>(*data);
+            return normalized ? std::max(value / 127.0f, -1.0f) : value;
+        }
+        case GLTF_UNSIGNED_SHORT: {
+            const float value = qFromLittleEndian<quint16>(
+                reinterpret_cast<const uchar *>(data)
+            );
+            return normalized ? value / 65535.0f : value;
+        }
+        case GLTF_SHORT: {
+            const float value = qFromLittleEndian<qint16>(
+                reinterpret_cast<const uchar *>(data)
+            );
+            return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+        }
+        default:
+            return 0.0f;
+    }
+}
+
+/**
+ * @brief Read an array of numbers, missing values are set to their default.
+ */
+void readNumbers(const QJsonValue & value, float * numbers, int count) {
+    const QJsonArray array = value.toArray();
+    for (int i = 0; i < count && i < array.size(); i++)
+        numbers[i] = static_cast<float>(array.at(i).toDouble(numbers[i]));
+}
+
+}
+
+
+bool GltfLoader::load(const QString & filePath, MeshCache::Entry & entry) {
+    // Map the file, the binary chunk of a GLB file is used in place
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0)
+        return false;
+    uchar * map = file.map(0, file.size());
+    if (map == nullptr)
+        return false;
+    const QByteArray data = QByteArray::fromRawData(
+        reinterpret_cast<const char *>(map), static_cast<int>(file.size())
+    );
+    Document document;
+    if (!parse(filePath, data, document)) {
+        file.unmap(map);
+        return false;
+    }
+    const QJsonObject & json = document.json;
+
+    // Materials, followed by a default material for the primitives without
+    // material
+    const QJsonArray materials = json["materials"].toArray();
+    for (int i = 0; i < materials.size(); i++) {
+        entry.materials.push_back(
+            processMaterial(document, materials.at(i).toObject())
+        );
+    }
+    entry.materials.push_back(
+        processMaterial(document, QJsonObject{{"name", "DefaultMaterial"}})
+    );
+    const unsigned int defaultMaterial =
+        static_cast<unsigned int>(entry.materials.size()) - 1;
+
+    // Meshes: one mesh record per primitive
+    const QJsonArray meshes = json["meshes"].toArray();
+    std::vector<std::vector<unsigned int>> meshRecords(meshes.size());
+    std::vector<bool> hasTangents;
+    for (int i = 0; i < meshes.size(); i++) {
+        const unsigned int first = static_cast<unsigned int>(entry.meshes.size());
+        if (!processMesh(document, meshes.at(i).toObject(), defaultMaterial,
+                         entry, hasTangents)) {
+            qWarning() << __FILE__ << __LINE__ <<
+                "The mesh" << i << "of" << filePath << "is not valid.";
+            file.unmap(map);
+            return false;
+        }
+        for (unsigned int j = first; j < entry.meshes.size(); j++)
+            meshRecords[i].push_back(j);
+    }
+    file.unmap(map);
+    if (entry.meshes.empty()) {
+        qDebug() << __FILE__ << __LINE__ <<
+            "No triangles found in the file" << filePath;
+        return false;
+    }
+
+    // Compute the tangent space of the vertices without tangents
+    if (std::find(hasTangents.begin(), hasTangents.end(), false) !=
+        hasTangents.end()) {
+        QVector<float> tangents;
+        QVector<float> bitangents;
+        TangentGenerator::generate(
+            entry.vertices, entry.normals, entry.textureUV.at(0),
+            entry.indices, tangents, bitangents
+        );
+        for (size_t v = 0; v < hasTangents.size(); v++) {
+            if (hasTangents[v])
+                continue;
+            for (int j = 0; j < 3; j++) {
+                const int i = 3 * static_cast<int>(v) + j;
+                entry.tangents[i] = tangents.at(i);
+                entry.bitangents[i] = bitangents.at(i);
+            }
+        }
+    }
+
+    // Nodes of the scene, or the nodes without parent if there is no scene
+    const QJsonArray nodes = json["nodes"].toArray();
+    std::vector<int> roots;
+    const QJsonArray scenes = json["scenes"].toArray();
+    if (!scenes.isEmpty()) {
+        const QJsonObject scene =
+            scenes.at(json["scene"].toInt(0)).toObject();
+        for (const QJsonValue & node : scene["nodes"].toArray())
+            roots.push_back(node.toInt(-1));
+    }
+    else {
+        std::vector<bool> isChild(nodes.size(), false);
+        for (const QJsonValue & node : nodes) {
+            for (const QJsonValue & child : node.toObject()["children"].toArray()) {
+                if (child.toInt(-1) >= 0 && child.toInt(-1) < nodes.size())
+                    isChild[child.toInt()] = true;
+            }
+        }
+        for (int i = 0; i < nodes.size(); i++) {
+            if (!isChild[i])
+                roots.push_back(i);
+        }
+    }
+    roots.erase(std::remove_if(roots.begin(), roots.end(),
+        [&](int i) {return i < 0 || i >= nodes.size();}), roots.end()
+    );
+    entry.nodes.push_back({
+        QFileInfo(filePath).fileName(), QMatrix4x4(), {},
+        static_cast<unsigned int>(roots.size())
+    });
+    for (int root : roots)
+        processNode(document, root, meshRecords, entry, 1);
+    return true;
+}
+
+
+bool GltfLoader::isEmbeddedImage(const QString & path) {
+    const int separator = path.lastIndexOf('#');
+    if (separator < 0)
+        return false;
+    const QString suffix = QFileInfo(path.left(separator)).suffix().toLower();
+    return suffix == "glb" || suffix == "gltf";
+}
+
+
+QImage GltfLoader::loadEmbeddedImage(const QString & path) {
+    const int separator = path.lastIndexOf('#');
+    const QString filePath = path.left(separator);
+    bool isValid = false;
+    const int index = path.mid(separator + 1).toInt(&isValid);
+    QFile file(filePath);
+    if (!isValid || !file.open(QIODevice::ReadOnly) || file.size() == 0)
+        return QImage();
+    uchar * map = file.map(0, file.size());
+    if (map == nullptr)
+        return QImage();
+    const QByteArray data = QByteArray::fromRawData(
+        reinterpret_cast<const char *>(map), static_cast<int>(file.size())
+    );
+
+    // The images of a file are loaded one after the other: the JSON document
+    // of the last file is kept, and only the buffer of the image is loaded
+    QImage image;
+    QByteArray json;
+    QByteArray binary;
+    Document & document = m_imageDocument;
+    if (split(filePath, data, json, binary)) {
+        if (document.filePath != filePath) {
+            document = Document();
+            document.filePath = filePath;
+            parseJson(filePath, json, document);
+        }
+        const QJsonObject object =
+            document.json["images"].toArray().at(index).toObject();
+        const QString uri = object["uri"].toString();
+        if (object.contains("bufferView")) {
+            const int view = object["bufferView"].toInt(-1);
+            const int buffer = document.json["bufferViews"].toArray()
+                .at(view).toObject()["buffer"].toInt(-1);
+            const int numBuffers = document.json["buffers"].toArray().size();
+            if (buffer >= 0 && buffer < numBuffers) {
+                document.buffers.assign(numBuffers, QByteArray());
+                document.buffers[buffer] = loadBuffer(document, buffer, binary);
+            }
+            int stride = 0;
+            image = QImage::fromData(bufferView(document, view, stride));
+            document.buffers.clear();
+        }
+        else if (uri.startsWith("data:")) {
+            image = QImage::fromData(QByteArray::fromBase64(
+                uri.mid(uri.indexOf(',') + 1).toLatin1()
+            ));
+        }
+    }
+    file.unmap(map);
+    return image;
+}
+
+
+bool GltfLoader::parse(
+    const QString & filePath, const QByteArray & data, Document & document
+) {
+    document.filePath = filePath;
+    QByteArray json;
+    QByteArray binary;
+    if (!split(filePath, data, json, binary) ||
+        !parseJson(filePath, json, document))
+        return false;
+
+    // Load the buffers
+    const int numBuffers = document.json["buffers"].toArray().size();
+    for (int i = 0; i < numBuffers; i++)
+        document.buffers.push_back(loadBuffer(document, i, binary));
+    return true;
+}
+
+
+bool GltfLoader::split(
+    const QString & filePath, const QByteArray & data, QByteArray & json,
+    QByteArray & binary
+) {
+    // Split a GLB file into its JSON and binary chunks
+    json = data;
+    binary = QByteArray();
+    const uchar * bytes = reinterpret_cast<const uchar *>(data.constData());
+    if (data.size() >= 12 && qFromLittleEndian<quint32>(bytes) == GLB_MAGIC) {
+        const quint32 version = qFromLittleEndian<quint32>(bytes + 4);
+        const quint32 length = std::min(
+            qFromLittleEndian<quint32>(bytes + 8),
+            static_cast<quint32>(data.size())
+        );
+        if (version != 2) {
+            qWarning() << __FILE__ << __LINE__ <<
+                "Unsupported GLB version" << version << "in" << filePath;
+            return false;
+        }
+        json.clear();
+        quint32 offset = 12;
+        while (length - offset >= 8) {
+            const quint32 chunkLength = qFromLittleEndian<quint32>(bytes + offset);
+            const quint32 chunkType =
+                qFromLittleEndian<quint32>(bytes + offset + 4);
+            if (chunkLength > length - offset - 8)
+                break;
+            const QByteArray chunk = QByteArray::fromRawData(
+                data.constData() + offset + 8, static_cast<int>(chunkLength)
+            );
+            if (chunkType == GLB_CHUNK_JSON && json.isEmpty())
+                json = chunk;
+            else if (chunkType == GLB_CHUNK_BIN && binary.isNull())
+                binary = chunk;
+            offset += 8 + (chunkLength + 3) / 4 * 4;
+            if (offset > length)
+                break;
+        }
+    }
+    return true;
+}
+
+
+bool GltfLoader::parseJson(
+    const QString & filePath, const QByteArray & json, Document & document
+) {
+    QJsonParseError error;
+    const QJsonDocument jsonDocument = QJsonDocument::fromJson(json, &error);
+    if (!jsonDocument.isObject()) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Unable to parse" << filePath << ":" << error.errorString();
+        return false;
+    }
+    document.json = jsonDocument.object();
+    const QString version =
+        document.json["asset"].toObject()["version"].toString();
+    if (!version.startsWith("2")) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Unsupported glTF version" << version << "in" << filePath;
+        document.json = QJsonObject();
+        return false;
+    }
+    return true;
+}
+
+
+QByteArray GltfLoader::loadBuffer(
+    const Document & document, int index, const QByteArray & binary
+) {
+    // The binary chunk, a data URI or an external file
+    const QJsonObject buffer =
+        document.json["buffers"].toArray().at(index).toObject();
+    const QString uri = buffer["uri"].toString();
+    QByteArray content;
+    if (uri.isEmpty()) {
+        content = binary;
+    }
+    else if (uri.startsWith("data:")) {
+        content = QByteArray::fromBase64(
+            uri.mid(uri.indexOf(',') + 1).toLatin1()
+        );
+    }
+    else {
+        const QDir directory = QFileInfo(document.filePath).absoluteDir();
+        QFile bufferFile(directory.filePath(
+            QUrl::fromPercentEncoding(uri.toUtf8())
+        ));
+        if (bufferFile.open(QIODevice::ReadOnly))
+            content = bufferFile.readAll();
+    }
+    if (content.size() < buffer["byteLength"].toDouble()) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "A buffer of" << document.filePath << "is missing or truncated.";
+    }
+    return content;
+}
+
+
+QByteArray GltfLoader::bufferView(
+    const Document & document, int index, int & stride
+) {
+    const QJsonArray views = document.json["bufferViews"].toArray();
+    if (index < 0 || index >= views.size())
+        return QByteArray();
+    const QJsonObject view = views.at(index).toObject();
+    const int buffer = view["buffer"].toInt(-1);
+    const qint64 offset = static_cast<qint64>(view["byteOffset"].toDouble(0));
+    const qint64 length = static_cast<qint64>(view["byteLength"].toDouble(0));
+    stride = view["byteStride"].toInt(0);
+    if (buffer < 0 || buffer >= static_cast<int>(document.buffers.size()) ||
+        offset < 0 || length < 0 ||
+        offset + length > document.buffers[buffer].size())
+        return QByteArray();
+    return QByteArray::fromRawData(
+        document.buffers[buffer].constData() + offset, static_cast<int>(length)
+    );
+}
+
+
+int GltfLoader::readAccessor(
+    const Document & document, int index, int components,
+    QVector<float> & stream
+) {
+    const QJsonArray accessors = document.json["accessors"].toArray();
+    if (index < 0 || index >= accessors.size())
+        return -1;
+    const QJsonObject accessor = accessors.at(index).toObject();
+    const int count = accessor["count"].toInt(-1);
+    const int type = accessor["componentType"].toInt();
+    const int size = componentSize(type);
+    const int typeComponents = componentCount(accessor["type"].toString());
+    const bool normalized = accessor["normalized"].toBool(false);
+    const qint64 offset = static_cast<qint64>(accessor["byteOffset"].toDouble(0));
+    if (count < 0 || size == 0 || typeComponents == 0 ||
+        accessor.contains("sparse"))
+        return -1;
+
+    // An accessor without buffer view is filled with zeros
+    const int start = stream.size();
+    if (!accessor.contains("bufferView")) {
+        stream.resize(start + count * components);
+        std::fill(stream.begin() + start, stream.end(), 0.0f);
+        return count;
+    }
+    int stride = 0;
+    const QByteArray view = bufferView(
+        document, accessor["bufferView"].toInt(-1), stride
+    );
+    const int elementSize = typeComponents * size;
+    if (stride == 0)
+        stride = elementSize;
+    if (count > 0 && (offset < 0 || offset + static_cast<qint64>(count - 1) *
+        stride + elementSize > view.size()))
+        return -1;
+
+    // Copy the data in bulk when the layout matches the stream
+    stream.resize(start + count * components);
+    float * output = stream.data() + start;
+    const char * input = view.constData() + offset;
+    if (type == GLTF_FLOAT && stride == elementSize &&
+        typeComponents == components) {
+        std::memcpy(output, input, static_cast<size_t>(count) * elementSize);
+        return count;
+    }
+    for (int i = 0; i < count; i++) {
+        const char * element = input + static_cast<qint64>(i) * stride;
+        for (int c = 0; c < components; c++) {
+            output[i * components + c] = c < typeComponents ?
+                readComponent(element + c * size, type, normalized) : 0.0f;
+        }
+    }
+    return count;
+}
+
+
+bool GltfLoader::readIndices(
+    const Document & document, int index, std::vector<unsigned int> & indices
+) {
+    const QJsonArray accessors = document.json["accessors"].toArray();
+    if (index < 0 || index >= accessors.size())
+        return false;
+    const QJsonObject accessor = accessors.at(index).toObject();
+    const int count = accessor["count"].toInt(-1);
+    const int type = accessor["componentType"].toInt();
+    const int size = componentSize(type);
+    const qint64 offset = static_cast<qint64>(accessor["byteOffset"].toDouble(0));
+    if (count < 0 || type == GLTF_FLOAT || type == GLTF_BYTE ||
+        type == GLTF_SHORT || size == 0 || accessor.contains("sparse") ||
+        accessor["type"].toString() != "SCALAR")
+        return false;
+    int stride = 0;
+    const QByteArray view = bufferView(
+        document, accessor["bufferView"].toInt(-1), stride
+    );
+    if (stride == 0)
+        stride = size;
+    if (count > 0 && (offset < 0 || offset + static_cast<qint64>(count - 1) *
+        stride + size > view.size()))
+        return false;
+
+    indices.resize(static_cast<size_t>(count));
+    const uchar * input =
+        reinterpret_cast<const uchar *>(view.constData() + offset);
+    for (int i = 0; i < count; i++) {
+        const uchar * element = input + static_cast<qint64>(i) * stride;
+        if (type == GLTF_UNSIGNED_INT)
+            indices[i] = qFromLittleEndian<quint32>(element);
+        else if (type == GLTF_UNSIGNED_SHORT)
+            indices[i] = qFromLittleEndian<quint16>(element);
+        else
+            indices[i] = *element;
+    }
+    return true;
+}
+
+
+MeshCache::MaterialRecord GltfLoader::processMaterial(
+    const Document & document, const QJsonObject & material
+) {
+    const QJsonObject pbr = material["pbrMetallicRoughness"].toObject();
+    float base[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    readNumbers(pbr["baseColorFactor"], base, 4);
+    const float metallic = static_cast<float>(
+        pbr["metallicFactor"].toDouble(1.0)
+    );
+    const float roughness = std::max(static_cast<float>(
+        pbr["roughnessFactor"].toDouble(1.0)), 0.05f
+    );
+
+    // Map the metallic-roughness model onto the Phong model: the specular
+    // color goes from the dielectric reflectance (4%) to the base color of
+    // metals, and the roughness to the equivalent Phong exponent
+    const QVector3D color(base[0], base[1], base[2]);
+    MeshCache::MaterialRecord record;
+    record.name = material["name"].toString();
+    record.isShaded = !material["extensions"].toObject().contains(
+        "KHR_materials_unlit"
+    );
+    record.ambient = AMBIENT_FACTOR * color;
+    record.diffuse = color;
+    record.specular = (1.0f - metallic) * QVector3D(0.04f, 0.04f, 0.04f) +
+        metallic * color;
+    record.shininess = std::min(std::max(
+        2.0f / std::pow(roughness, 4.0f) - 2.0f, 1.0f), 1000.0f
+    );
+    record.alpha = material["alphaMode"].toString() == "BLEND" ? base[3] : 1.0f;
+    record.diffuseTexture = texturePath(
+        document, pbr["baseColorTexture"].toObject()
+    );
+    record.normalTexture = texturePath(
+        document, material["normalTexture"].toObject()
+    );
+    return record;
+}
+
+
+QString GltfLoader::texturePath(
+    const Document & document, const QJsonObject & textureInfo
+) {
+    if (!textureInfo.contains("index"))
+        return QString();
+    const QJsonObject texture = document.json["textures"].toArray().at(
+        textureInfo["index"].toInt(-1)
+    ).toObject();
+    const int source = texture["source"].toInt(-1);
+    const QJsonArray images = document.json["images"].toArray();
+    if (source < 0 || source >= images.size())
+        return QString();
+
+    // External images are referenced by their path, the embedded ones by the
+    // path of the model and their index
+    const QString uri = images.at(source).toObject()["uri"].toString();
+    if (!uri.isEmpty() && !uri.startsWith("data:")) {
+        return QFileInfo(document.filePath).absoluteDir().filePath(
+            QUrl::fromPercentEncoding(uri.toUtf8())
+        );
+    }
+    return document.filePath + "#" + QString::number(source);
+}
+
+
+bool GltfLoader::processMesh(
+    const Document & document, const QJsonObject & mesh,
+    unsigned int material, MeshCache::Entry & entry,
+    std::vector<bool> & hasTangents
+) {
+    const QString name = mesh["name"].toString();
+    if (entry.textureUV.isEmpty())
+        entry.textureUV.resize(1);
+    QVector<float> & textureUV = entry.textureUV[0];
+
+    for (const QJsonValue & value : mesh["primitives"].toArray()) {
+        const QJsonObject primitive = value.toObject();
+        const QJsonObject attributes = primitive["attributes"].toObject();
+        if (primitive["mode"].toInt(GLTF_TRIANGLES) != GLTF_TRIANGLES) {
+            qDebug() << "Model loading: primitive which is not a triangle "
+                "list, ignore it.";
+            continue;
+        }
+        if (!attributes.contains("POSITION"))
+            continue;
+
+        // Positions
+        const int vertexOffset = entry.vertices.size() / 3;
+        const int count = readAccessor(
+            document, attributes["POSITION"].toInt(-1), 3, entry.vertices
+        );
+        if (count < 0)
+            return false;
+        const int numVertices = vertexOffset + count;
+
+        // Normals, computed from the triangles if missing
+        bool computeNormals = !attributes.contains("NORMAL") || readAccessor(
+            document, attributes["NORMAL"].toInt(-1), 3, entry.normals
+        ) != count;
+        entry.normals.resize(3 * numVertices);
+
+        // Texture coordinates, flipped to the convention of Texture
+        textureUV.resize(2 * vertexOffset);
+        if (attributes.contains("TEXCOORD_0") && readAccessor(
+                document, attributes["TEXCOORD_0"].toInt(-1), 2, textureUV
+            ) == count) {
+            for (int v = vertexOffset; v < numVertices; v++)
+                textureUV[2*v+1] = 1.0f - textureUV[2*v+1];
+        }
+        textureUV.resize(2 * numVertices);
+
+        // Indices
+        std::vector<unsigned int> indices;
+        if (primitive.contains("indices")) {
+            if (!readIndices(document, primitive["indices"].toInt(-1), indices))
+                return false;
+        }
+        else {
+            indices.resize(static_cast<size_t>(count));
+            for (int i = 0; i < count; i++)
+                indices[i] = static_cast<unsigned int>(i);
+        }
+        indices.resize(indices.size() / 3 * 3);
+        const unsigned int offset = static_cast<unsigned int>(
+            entry.indices.size()
+        );
+        entry.indices.resize(entry.indices.size() +
+                             static_cast<int>(indices.size()));
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (indices[i] >= static_cast<unsigned int>(count))
+                return false;
+            entry.indices[static_cast<int>(offset + i)] =
+                indices[i] + static_cast<unsigned int>(vertexOffset);
+        }
+
+        if (computeNormals) {
+            std::fill(entry.normals.begin() + 3 * vertexOffset,
+                      entry.normals.end(), 0.0f);
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                const QVector3D p[3] = {
+                    QVector3D(entry.vertices[3 * (vertexOffset + indices[i])],
+                              entry.vertices[3 * (vertexOffset + indices[i]) + 1],
+                              entry.vertices[3 * (vertexOffset + indices[i]) + 2]),
+                    QVector3D(entry.vertices[3 * (vertexOffset + indices[i+1])],
+                              entry.vertices[3 * (vertexOffset + indices[i+1]) + 1],
+                              entry.vertices[3 * (vertexOffset + indices[i+1]) + 2]),
+                    QVector3D(entry.vertices[3 * (vertexOffset + indices[i+2])],
+                              entry.vertices[3 * (vertexOffset + indices[i+2]) + 1],
+                              entry.vertices[3 * (vertexOffset + indices[i+2]) + 2])
+                };
+                const QVector3D normal =
+                    QVector3D::crossProduct(p[1] - p[0], p[2] - p[0]);
+                for (size_t k = 0; k < 3; k++) {
+                    const int v = 3 * (vertexOffset +
+                                       static_cast<int>(indices[i+k]));
+                    entry.normals[v] += normal.x();
+                    entry.normals[v+1] += normal.y();
+                    entry.normals[v+2] += normal.z();
+                }
+            }
+            for (int v = vertexOffset; v < numVertices; v++) {
+                QVector3D normal(entry.normals[3*v], entry.normals[3*v+1],
+                                 entry.normals[3*v+2]);
+                normal.normalize();
+                entry.normals[3*v] = normal.x();
+                entry.normals[3*v+1] = normal.y();
+                entry.normals[3*v+2] = normal.z();
+            }
+        }
+
+        // Tangents, the bitangent is rebuilt from the handedness (w)
+        QVector<float> tangents;
+        const bool isTangentValid = attributes.contains("TANGENT") &&
+            readAccessor(
+                document, attributes["TANGENT"].toInt(-1), 4, tangents
+            ) == count;
+        entry.tangents.resize(3 * numVertices);
+        entry.bitangents.resize(3 * numVertices);
+        hasTangents.resize(static_cast<size_t>(numVertices), isTangentValid);
+        for (int i = 0; isTangentValid && i < count; i++) {
+            const int v = 3 * (vertexOffset + i);
+            const QVector3D tangent(
+                tangents[4*i], tangents[4*i+1], tangents[4*i+2]
+            );
+            const QVector3D normal(
+                entry.normals[v], entry.normals[v+1], entry.normals[v+2]
+            );
+            const QVector3D bitangent = tangents[4*i+3] *
+                QVector3D::crossProduct(normal, tangent);
+            for (int j = 0; j < 3; j++) {
+                entry.tangents[v+j] = tangent[j];
+                entry.bitangents[v+j] = bitangent[j];
+            }
+        }
+
+        // Create the mesh
+        const int materialIndex = primitive["material"].toInt(-1);
+        entry.meshes.push_back({
+            name,
+            materialIndex >= 0 &&
+                static_cast<unsigned int>(materialIndex) < material ?
+                static_cast<unsigned int>(materialIndex) : material,
+            {static_cast<unsigned int>(indices.size()), offset}
+        });
+    }
+    return true;
+}
+
+
+void GltfLoader::processNode(
+    const Document & document, int index,
+    const std::vector<std::vector<unsigned int>> & meshes,
+    MeshCache::Entry & entry, int depth
+) {
+    const QJsonArray nodes = document.json["nodes"].toArray();
+    const QJsonObject node = nodes.at(index).toObject();
+
+    // Transformation: a matrix (column-major) or translation, rotation and
+    // scale
+    QMatrix4x4 transformation;
+    if (node.contains("matrix")) {
+        float values[16] = {
+            1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f
+        };
+        readNumbers(node["matrix"], values, 16);
+        transformation = QMatrix4x4(values).transposed();
+    }
+    else {
+        float translation[3] = {0.0f, 0.0f, 0.0f};
+        float rotation[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+        float scale[3] = {1.0f, 1.0f, 1.0f};
+        readNumbers(node["translation"], translation, 3);
+        readNumbers(node["rotation"], rotation, 4);
+        readNumbers(node["scale"], scale, 3);
+        transformation.translate(translation[0], translation[1], translation[2]);
+        transformation.rotate(
+            QQuaternion(rotation[3], rotation[0], rotation[1], rotation[2])
+        );
+        transformation.scale(scale[0], scale[1], scale[2]);
+    }
+
+    // Meshes and children
+    std::vector<unsigned int> nodeMeshes;
+    const int mesh = node["mesh"].toInt(-1);
+    if (mesh >= 0 && mesh < static_cast<int>(meshes.size()))
+        nodeMeshes = meshes[mesh];
+    std::vector<int> children;
+    if (depth < MAX_NODE_DEPTH) {
+        for (const QJsonValue & child : node["children"].toArray()) {
+            if (child.toInt(-1) >= 0 && child.toInt(-1) < nodes.size())
+                children.push_back(child.toInt());
+        }
+    }
+
+    entry.nodes.push_back({
+        node["name"].toString(), transformation, nodeMeshes,
+        static_cast<unsigned int>(children.size())
+    });
+    for (int child : children)
+        processNode(document, child, meshes, entry, depth + 1);
+}
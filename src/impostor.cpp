@@ -0,0 +1,296 @@
+#include "../include/impostor.h"
+#include "../include/passuniforms.h"
+#include "../include/shaderregistry.h"
+
+#include <QOpenGLContext>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Number of views baked around the vertical axis (see impostor.vert)
+static constexpr unsigned int NUM_AZIMUTHS = 8;
+// Elevation of the baked views (rad) (see impostor.vert)
+static constexpr unsigned int NUM_ELEVATIONS = 2;
+static constexpr float ELEVATIONS[NUM_ELEVATIONS] = {
+    10.0f * PI / 180.0f, 40.0f * PI / 180.0f
+};
+// Size of a tile of the atlas (pixel)
+static constexpr int TILE_SIZE = 128;
+// Margin kept around the bounding sphere in each tile
+static constexpr float TILE_PADDING = 1.05f;
+
+void ImpostorRenderer::initialize() {
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (!context) {
+        qWarning() << __FILE__ << __LINE__ <<
+                      "Requires a valid current OpenGL context. \n" <<
+                      "Unable to draw the impostors.";
+        return;
+    }
+    p_glFunctions = context->extraFunctions();
+
+    p_shader = ShaderRegistry::getShader<Shader>(
+        ":/shaders/impostor.vert", ":/shaders/impostor.frag"
+    );
+
+    // Create the streaming buffer, it is (re)allocated when rendering
+    m_vao.create();
+    m_vao.bind();
+    m_instanceBuffer.create();
+    m_instanceBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+    createAttributes();
+    m_vao.release();
+
+    m_isInitialized = true;
+}
+
+
+void ImpostorRenderer::addModel(Object * object, float distance) {
+    if (object == nullptr || distance <= 0.0f)
+        return;
+    m_models[object] = {object, distance, 0, QVector3D(), 0.0f};
+}
+
+
+void ImpostorRenderer::bake(const CasterLight & light) {
+    // Check if the renderer has been initialized
+    if (!m_isInitialized) {
+        qCritical() << __FILE__ << __LINE__
+            << "The impostor renderer must be initialized before baking.";
+        exit(1);
+    }
+    m_isBaked = false;
+    p_atlas.reset();
+
+    // Assign a row of the atlas to each model with a valid bounding sphere
+    GLint maxSize = 0;
+    p_glFunctions->glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    const unsigned int maxRows = static_cast<unsigned int>(maxSize / TILE_SIZE);
+    m_numRows = 0;
+    for (auto it = m_models.begin(); it != m_models.end();) {
+        Model & model = it->second;
+        model.object->getBoundingSphere(model.center, model.radius);
+        if (model.radius <= 0.0f || m_numRows >= maxRows) {
+            if (m_numRows >= maxRows) {
+                qWarning() << __FILE__ << __LINE__ <<
+                    "The impostor atlas is full, some models will always be "
+                    "rendered with their meshes.";
+            }
+            it = m_models.erase(it);
+            continue;
+        }
+        model.row = m_numRows++;
+        it++;
+    }
+    if (m_numRows == 0)
+        return;
+
+    // Save the state modified when rendering the atlas
+    GLint previousFramebuffer = 0;
+    GLint viewport[4];
+    GLfloat clearColor[4];
+    p_glFunctions->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    p_glFunctions->glGetIntegerv(GL_VIEWPORT, viewport);
+    p_glFunctions->glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    const bool isBlending = p_glFunctions->glIsEnabled(GL_BLEND);
+
+    // Create the atlas, transparent where no model is drawn
+    QOpenGLFramebufferObjectFormat format;
+    format.setAttachment(QOpenGLFramebufferObject::Depth);
+    format.setInternalTextureFormat(GL_RGBA8);
+    format.setMipmap(true);
+    p_atlas = std::make_unique<QOpenGLFramebufferObject>(
+        static_cast<int>(NUM_AZIMUTHS * NUM_ELEVATIONS) * TILE_SIZE,
+        static_cast<int>(m_numRows) * TILE_SIZE, format
+    );
+    if (!p_atlas->isValid()) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Unable to create the impostor atlas, the models will always be "
+            "rendered with their meshes.";
+        p_atlas.reset();
+        return;
+    }
+    p_atlas->bind();
+    p_glFunctions->glDisable(GL_BLEND);
+    p_glFunctions->glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    p_glFunctions->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // The views are rendered without shadow: every fragment is beyond the
+    // last cascade
+    std::array<QMatrix4x4,NUM_CASCADES> lightSpace;
+    std::array<float,NUM_CASCADES+1> cascades;
+    cascades.fill(std::numeric_limits<float>::max());
+
+    // Render each model from each direction in its own tile
+    for (auto it = m_models.begin(); it != m_models.end(); it++) {
+        Model & model = it->second;
+        const float extent = TILE_PADDING * model.radius;
+        QMatrix4x4 projection;
+        projection.ortho(
+            -extent, extent, -extent, extent, extent, 3.0f * extent
+        );
+        model.object->setModelMatrix(QMatrix4x4());
+        for (unsigned int e = 0; e < NUM_ELEVATIONS; e++) {
+            for (unsigned int a = 0; a < NUM_AZIMUTHS; a++) {
+                const float azimuth = 2.0f * PI * a / NUM_AZIMUTHS;
+                const QVector3D direction(
+                    std::cos(ELEVATIONS[e]) * std::cos(azimuth),
+                    std::cos(ELEVATIONS[e]) * std::sin(azimuth),
+                    std::sin(ELEVATIONS[e])
+                );
+                QMatrix4x4 view;
+                view.lookAt(
+                    model.center + 2.0f * extent * direction, model.center,
+                    QVector3D(0.0f, 0.0f, 1.0f)
+                );
+
+                const GLint tile = static_cast<GLint>(e * NUM_AZIMUTHS + a);
+                p_glFunctions->glViewport(
+                    tile * TILE_SIZE,
+                    static_cast<GLint>(model.row) * TILE_SIZE,
+                    TILE_SIZE, TILE_SIZE
+                );
+                PassUniforms::update(
+                    light, view, projection, lightSpace, cascades
+                );
+                model.object->render(
+                    light, view, projection, lightSpace, cascades
+                );
+            }
+        }
+    }
+
+    // Filter the atlas when the impostors are small on the screen
+    p_glFunctions->glBindTexture(GL_TEXTURE_2D, p_atlas->texture());
+    p_glFunctions->glGenerateMipmap(GL_TEXTURE_2D);
+    p_glFunctions->glTexParameteri(
+        GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR
+    );
+    p_glFunctions->glTexParameteri(
+        GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR
+    );
+    p_glFunctions->glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Restore the state
+    p_glFunctions->glBindFramebuffer(
+        GL_FRAMEBUFFER, static_cast<GLuint>(previousFramebuffer)
+    );
+    p_glFunctions->glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    p_glFunctions->glClearColor(
+        clearColor[0], clearColor[1], clearColor[2], clearColor[3]
+    );
+    if (isBlending)
+        p_glFunctions->glEnable(GL_BLEND);
+
+    m_isBaked = true;
+}
+
+
+void ImpostorRenderer::clear(const QMatrix4x4 & view) {
+    m_instances.clear();
+    m_cameraPosition = QVector3D(view.inverted().column(3));
+}
+
+
+bool ImpostorRenderer::addInstance(
+    const ABCObject * object, const QMatrix4x4 & model
+) {
+    if (!m_isBaked)
+        return false;
+    auto it = m_models.find(object);
+    if (it == m_models.end())
+        return false;
+
+    // Keep the mesh when the instance is close to the camera
+    const Model & impostor = it->second;
+    const QVector3D center = model.map(impostor.center);
+    if ((center - m_cameraPosition).length() < impostor.distance)
+        return false;
+
+    // The tile is selected from the direction of the camera in the model
+    // frame: only the rotation around the vertical axis is considered
+    const float scale = std::max(
+        model.column(0).toVector3D().length(), std::max(
+        model.column(1).toVector3D().length(),
+        model.column(2).toVector3D().length())
+    );
+    const float yaw = std::atan2(model(1,0), model(0,0));
+    m_instances.push_back({
+        {center.x(), center.y(), center.z(),
+         TILE_PADDING * impostor.radius * scale},
+        {yaw, static_cast<float>(impostor.row), 0.0f, 0.0f}
+    });
+    return true;
+}
+
+
+void ImpostorRenderer::render(
+    const QMatrix4x4 & view, const QMatrix4x4 & projection
+) {
+    // Check if the renderer has been initialized
+    if (!m_isInitialized) {
+        qCritical() << __FILE__ << __LINE__
+            << "The impostor renderer must be initialized before being "
+               "rendered.";
+        exit(1);
+    }
+    if (m_instances.empty())
+        return;
+
+    const int count = static_cast<int>(m_instances.size());
+    const int size = count * static_cast<int>(sizeof(Instance));
+
+    // Orphan the previous storage so the upload never waits for the GPU
+    m_instanceBuffer.bind();
+    if (count > m_capacity)
+        m_capacity = std::max(count, 2 * m_capacity);
+    m_instanceBuffer.allocate(
+        m_capacity * static_cast<int>(sizeof(Instance))
+    );
+    m_instanceBuffer.write(0, m_instances.data(), size);
+    m_instanceBuffer.release();
+
+    // Draw all the impostors at once: one quad (4 vertices) per instance
+    p_glFunctions->glActiveTexture(GL_TEXTURE0 + IMPOSTOR_TEXTURE_UNIT);
+    p_glFunctions->glBindTexture(GL_TEXTURE_2D, p_atlas->texture());
+    p_shader->bind();
+    p_shader->setUniformValue("VP", projection * view);
+    p_shader->setUniformValue("cameraPosition", m_cameraPosition);
+    p_shader->setUniformValue("numRows", static_cast<float>(m_numRows));
+    p_shader->setUniformValue("atlasSampler", IMPOSTOR_TEXTURE_UNIT);
+    m_vao.bind();
+    p_glFunctions->glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+    m_vao.release();
+}
+
+
+void ImpostorRenderer::cleanUp() {
+    m_instances.clear();
+    m_models.clear();
+    p_atlas.reset();
+    m_instanceBuffer.destroy();
+    m_vao.destroy();
+    m_capacity = 0;
+    m_isBaked = false;
+}
+
+
+void ImpostorRenderer::createAttributes() {
+    // Set up the vertex array state
+    p_shader->bind();
+    m_instanceBuffer.bind();
+
+    // Each vec4 of the instance is mapped to the layout locations 0 and 1
+    const int stride = static_cast<int>(sizeof(Instance));
+    for (int i = 0; i < 2; i++) {
+        p_shader->enableAttributeArray(i);
+        p_shader->setAttributeBuffer(
+            i,                                            // layout location
+            GL_FLOAT,                                     // data type
+            i * 4 * static_cast<int>(sizeof(float)),      // offset
+            4,                                            // components
+            stride                                        // stride
+        );
+        p_glFunctions->glVertexAttribDivisor(static_cast<GLuint>(i), 1);
+    }
+}
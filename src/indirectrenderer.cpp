@@ -0,0 +1,500 @@
+#include "../include/indirectrenderer.h"
+#include "../include/materialtable.h"
+#include "../include/renderqueue.h"
+#include "../include/shaderregistry.h"
+
+#include <QDebug>
+#include <QOpenGLContext>
+#include <algorithm>
+#include <cstring>
+
+#ifndef GL_PARAMETER_BUFFER_ARB
+#define GL_PARAMETER_BUFFER_ARB 0x80EE
+#endif
+
+// Number of instances culled by a work group of the culling shader
+static constexpr GLuint CULL_GROUP_SIZE = 64;
+
+/***
+ *      _____             _  _                    _   
+ *     |_   _|           | |(_)                  | |  
+ *       | |   _ __    __| | _  _ __   ___   ___ | |_ 
+ *       | |  | '_ \  / _` || || '__| / _ \ / __|| __|
+ *      _| |_ | | | || (_| || || |   |  __/| (__ | |_ 
+ *     |_____||_| |_| \__,_||_||_|    \___| \___| \__|
+ *                                                    
+ *                                                    
+ *      _____                    _                         
+ *     |  __ \                  | |                        
+ *     | |__) |  ___  _ __    __| |  ___  _ __   ___  _ __ 
+ *     |  _  /  / _ \| '_ \  / _` | / _ \| '__| / _ \| '__|
+ *     | | \ \ |  __/| | | || (_| ||  __/| |   |  __/| |   
+ *     |_|  \_\ \___||_| |_| \__,_| \___||_|    \___||_|   
+ *                                                         
+ *                                                         
+ */
+
+void Object::IndirectRenderer::initialize() {
+    if (m_isInitialized)
+        return;
+    m_isInitialized = true;
+    
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (!context) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Requires a valid current OpenGL context.";
+        return;
+    }
+    p_glFunctions = context->versionFunctions<QOpenGLFunctions_4_5_Core>();
+    if (!p_glFunctions || !p_glFunctions->initializeOpenGLFunctions()) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Could not obtain required OpenGL context version";
+        p_glFunctions = nullptr;
+        return;
+    }
+    
+    // The shaders read the draw data with the draw ID of the command
+    if (!context->hasExtension("GL_ARB_shader_draw_parameters")) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "GL_ARB_shader_draw_parameters is not supported. The objects are "
+            "drawn one at a time.";
+        return;
+    }
+    m_isSupported = true;
+    
+    // The number of draws written by the culling shader is read by the GPU
+    if (context->hasExtension("GL_ARB_indirect_parameters")) {
+        p_multiDrawCount = reinterpret_cast<MultiDrawElementsIndirectCount>(
+            context->getProcAddress("glMultiDrawElementsIndirectCountARB")
+        );
+    }
+    
+    // Create the shaders
+    p_cullShader = ShaderRegistry::getComputeShader(
+        ":/shaders/object_cull.comp", 
+        QStringList(QString("NUM_LODS %1").arg(NUM_LODS))
+    );
+    p_shader = ShaderRegistry::getShader<ObjectShader>(
+        ":/shaders/object.vert", ":/shaders/object.frag", 
+        QStringList("INDIRECT")
+    );
+    p_shadowShader = ShaderRegistry::getShader<ObjectShadowShader>(
+        ":/shaders/object_shadow.vert", ":/shaders/object_shadow.frag", 
+        QStringList({"INDIRECT", ObjectShadowShader::getLayerDefine()})
+    );
+    p_transparentShader = ShaderRegistry::getShader<ObjectShader>(
+        ":/shaders/object.vert", ":/shaders/object.frag"
+    );
+    
+    // Create the buffers, their storage is allocated when uploading
+    for (Pass & pass : m_passes) {
+        p_glFunctions->glCreateBuffers(1, &pass.commands);
+        p_glFunctions->glCreateBuffers(1, &pass.draws);
+        p_glFunctions->glCreateBuffers(1, &pass.counts);
+    }
+    for (InstanceSet & set : m_sets) {
+        p_glFunctions->glCreateBuffers(1, &set.instanceBuffer);
+        p_glFunctions->glCreateBuffers(1, &set.batchBuffer);
+    }
+}
+
+
+void Object::IndirectRenderer::clear(
+    const QMatrix4x4 & view, const QMatrix4x4 & projection
+) {
+    m_batches.clear();
+    m_transparent.clear();
+    m_isShadowPass = false;
+    m_view = view;
+    m_projection = projection;
+    m_cameraPosition = QVector3D(view.inverted().column(3));
+}
+
+
+void Object::IndirectRenderer::clearShadow(
+    const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace
+) {
+    m_batches.clear();
+    m_transparent.clear();
+    m_isShadowPass = true;
+    m_view = QMatrix4x4();
+    m_projection = QMatrix4x4();
+    m_lightSpace = lightSpace;
+}
+
+
+bool Object::IndirectRenderer::addInstance(
+    const ABCObject * object, const QMatrix4x4 & model
+) {
+    if (!m_isSupported)
+        return false;
+    
+    // Only the initialized instances of Object are queued
+    const Object * instance = dynamic_cast<const Object *>(object);
+    if (instance == nullptr || instance->m_error || 
+        !instance->m_isInitialized)
+        return false;
+    
+    // Bounding sphere of the instance in world coordinates, the culling and
+    // the selection of the LOD of the opaque meshes are done on the GPU
+    const float scale = std::max(
+        model.column(0).toVector3D().length(), std::max(
+        model.column(1).toVector3D().length(),
+        model.column(2).toVector3D().length())
+    );
+    const QVector3D center = model * instance->m_boundingCenter;
+    const float radius = instance->m_boundingRadius * scale;
+    
+    // The transparent meshes are culled on the CPU, their LOD is computed
+    // with the first one (-1: not computed, -2: culled)
+    const QMatrix4x4 viewProjection = m_projection * m_view;
+    int transparentLod = -1;
+    
+    // The resolution of the textures is requested by the scene pass for the
+    // instances in the frustum
+    if (!m_isShadowPass && instance->isVisible(viewProjection, model))
+        instance->requestTextures(viewProjection, model);
+    
+    for (const MeshDraw & draw : getMeshes(instance)) {
+        const QMatrix4x4 meshModel = model * draw.transform;
+        
+        // Transparent meshes are drawn later, from farthest to closest
+        if (!m_isShadowPass && !draw.mesh->isOpaque()) {
+            if (transparentLod == -1) {
+                transparentLod = 
+                    instance->isVisible(viewProjection, model) ? 
+                    static_cast<int>(instance->selectLod(viewProjection, model)) :
+                    -2;
+            }
+            if (transparentLod < 0)
+                continue;
+            QVector3D position(meshModel * QVector3D(0.0f, 0.0f, 0.0f));
+            m_transparent.insert(std::make_pair(
+                m_cameraPosition.distanceToPoint(position),
+                Transparent{
+                    draw.mesh, meshModel, instance->m_halfTextureUV, 
+                    static_cast<unsigned int>(transparentLod)
+                }
+            ));
+            continue;
+        }
+        
+        // Find the batch of the pipeline state of the mesh
+        const State state = m_isShadowPass ? 
+            State(std::get<0>(draw.state), std::get<1>(draw.state), 
+                  nullptr, nullptr, nullptr) :
+            draw.state;
+        Batch & batch = m_batches[state];
+        if (batch.instances.empty())
+            batch.material = draw.mesh->getMaterial().get();
+        
+        Instance data = draw.instance;
+        std::copy(meshModel.constData(), meshModel.constData() + 16, 
+                  data.model);
+        data.sphere[0] = center.x();
+        data.sphere[1] = center.y();
+        data.sphere[2] = center.z();
+        data.sphere[3] = radius;
+        data.lodBias = m_isShadowPass ? instance->m_shadowLodBias : 0;
+        batch.instances.push_back(data);
+    }
+    return true;
+}
+
+
+void Object::IndirectRenderer::render() {
+    if (!m_isSupported || m_isShadowPass)
+        return;
+    
+    // Draw the opaque meshes
+    if (!m_batches.empty())
+        submit(p_shader.get(), true);
+    
+    // Draw the transparent meshes from farthest to closest, with the meshes
+    // of the render queue if it is open
+    if (!m_transparent.empty()) {
+        const bool drawNow = !RenderQueue::isOpen();
+        if (drawNow)
+            RenderQueue::open();
+        for (const auto & transparent : m_transparent) {
+            RenderQueue::add(
+                p_transparentShader.get(), transparent.second.mesh, 
+                transparent.second.model, transparent.second.halfTextureUV,
+                transparent.second.lod, transparent.first
+            );
+        }
+        if (drawNow)
+            RenderQueue::flush();
+    }
+}
+
+
+void Object::IndirectRenderer::renderShadow() {
+    if (!m_isSupported || !m_isShadowPass || m_batches.empty())
+        return;
+    
+    submit(p_shadowShader.get(), false);
+}
+
+
+void Object::IndirectRenderer::cleanUp() {
+    m_batches.clear();
+    m_transparent.clear();
+    m_meshes.clear();
+    if (p_glFunctions && m_isSupported) {
+        for (Pass & pass : m_passes) {
+            p_glFunctions->glDeleteBuffers(1, &pass.commands);
+            p_glFunctions->glDeleteBuffers(1, &pass.draws);
+            p_glFunctions->glDeleteBuffers(1, &pass.counts);
+        }
+        for (InstanceSet & set : m_sets) {
+            p_glFunctions->glDeleteBuffers(1, &set.instanceBuffer);
+            p_glFunctions->glDeleteBuffers(1, &set.batchBuffer);
+        }
+    }
+    m_passes = std::array<Pass,2>();
+    m_sets = std::array<InstanceSet,2>();
+    p_cullShader.reset();
+    p_shader.reset();
+    p_shadowShader.reset();
+    p_transparentShader.reset();
+    p_glFunctions = nullptr;
+    p_multiDrawCount = nullptr;
+    m_isSupported = false;
+    m_isInitialized = false;
+}
+
+
+const std::vector<Object::IndirectRenderer::MeshDraw> & 
+Object::IndirectRenderer::getMeshes(const Object * object) {
+    // The root node identifies the object if its address is reused, the
+    // batches change when textures loaded in the background are uploaded
+    Meshes & meshes = m_meshes[object];
+    if (meshes.root == object->p_rootNode.get() &&
+        meshes.firstVertex == object->p_allocation->firstVertex &&
+        meshes.indexOffset == object->p_allocation->indexOffset &&
+        meshes.textures == TextureManager::getGeneration())
+        return meshes.draws;
+    
+    meshes.root = object->p_rootNode.get();
+    meshes.firstVertex = object->p_allocation->firstVertex;
+    meshes.indexOffset = object->p_allocation->indexOffset;
+    meshes.textures = TextureManager::getGeneration();
+    meshes.draws.clear();
+    
+    std::vector<std::pair<QMatrix4x4, const Mesh *>> list;
+    object->p_rootNode->collectMeshes(QMatrix4x4(), list);
+    for (const auto & item : list) {
+        MeshDraw draw = {};
+        draw.mesh = item.second;
+        draw.transform = item.first;
+        
+        // Range of the index buffer of each level of detail
+        GLenum type = GL_UNSIGNED_INT;
+        bool isValid = true;
+        for (unsigned int lod = 0; lod < NUM_LODS && isValid; lod++) {
+            GLsizei count;
+            size_t byteOffset;
+            GLint baseVertex;
+            isValid = draw.mesh->getDrawRange(lod, type, count, byteOffset, 
+                                               baseVertex);
+            const size_t indexSize = type == GL_UNSIGNED_SHORT ? 
+                sizeof(GLushort) : sizeof(GLuint);
+            draw.instance.counts[lod] = static_cast<GLuint>(count);
+            draw.instance.firstIndices[lod] = 
+                static_cast<GLuint>(byteOffset / indexSize);
+            draw.instance.baseVertex = baseVertex;
+        }
+        if (!isValid)
+            continue;
+        
+        // Index of the material in the material table
+        const Material * material = draw.mesh->getMaterial().get();
+        draw.instance.material = draw.mesh->getMaterialIndex();
+        
+        draw.state = State(object->m_halfTextureUV, type, 
+                           material->getDiffuseTexture()->getArray(), 
+                           material->getNormalTexture()->getArray(), 
+                           material->getBumpTexture()->getArray());
+        meshes.draws.push_back(draw);
+    }
+    return meshes.draws;
+}
+
+
+void Object::IndirectRenderer::submit(ObjectShader * shader, 
+                                      bool useMaterials) {
+    static_assert(sizeof(Draw) == 128 && sizeof(Instance) % 16 == 0,
+                  "The data must match the std430 layout of the shaders.");
+    
+    // Gather the instances of all the batches
+    std::vector<Instance> instances;
+    std::vector<GLuint> firsts;
+    for (const auto & batch : m_batches) {
+        const GLuint index = static_cast<GLuint>(firsts.size());
+        firsts.push_back(static_cast<GLuint>(instances.size()));
+        for (Instance instance : batch.second.instances) {
+            instance.batch = index;
+            instances.push_back(instance);
+        }
+    }
+    const GLuint numInstances = static_cast<GLuint>(instances.size());
+    const GLsizeiptr numBatches = static_cast<GLsizeiptr>(firsts.size());
+    
+    // Upload the instances only if they changed since the last pass of the 
+    // same kind
+    InstanceSet & set = m_sets[m_isShadowPass];
+    if (instances.size() != set.instances.size() || std::memcmp(
+            instances.data(), set.instances.data(), 
+            instances.size() * sizeof(Instance)) != 0) {
+        upload(set.instanceBuffer, instances.data(), 
+               instances.size() * sizeof(Instance));
+        set.instances.swap(instances);
+    }
+    if (firsts != set.firsts) {
+        upload(set.batchBuffer, firsts.data(), firsts.size() * sizeof(GLuint));
+        set.firsts.swap(firsts);
+    }
+    
+    // Cull the instances on the GPU
+    Pass & pass = m_passes[m_isShadowPass];
+    if (static_cast<GLsizeiptr>(numInstances) > pass.capacity) {
+        pass.capacity = numInstances;
+        upload(pass.commands, nullptr, numInstances * sizeof(Command));
+        upload(pass.draws, nullptr, numInstances * sizeof(Draw));
+    }
+    if (numBatches > pass.countCapacity) {
+        pass.countCapacity = numBatches;
+        upload(pass.counts, nullptr, numBatches * sizeof(GLuint));
+    }
+    cull(numInstances, useMaterials);
+    shader->bind();
+    
+    // One multi-draw call per batch
+    p_glFunctions->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, pass.commands);
+    if (p_multiDrawCount)
+        p_glFunctions->glBindBuffer(GL_PARAMETER_BUFFER_ARB, pass.counts);
+    p_glFunctions->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pass.draws);
+    if (useMaterials)
+        MaterialTable::bind();
+    int halfTextureUV = -1;
+    GLsizeiptr index = 0;
+    for (const auto & batch : m_batches) {
+        const bool half = std::get<0>(batch.first);
+        if (static_cast<int>(half) != halfTextureUV) {
+            GeometryHeap::bind(p_glFunctions, half);
+            halfTextureUV = half;
+        }
+        if (useMaterials)
+            shader->bindTextures(p_glFunctions, *batch.second.material);
+        const GLuint first = set.firsts[index];
+        shader->setDrawOffset(first);
+        
+        const GLsizei maxCount = 
+            static_cast<GLsizei>(batch.second.instances.size());
+        const void * offset = 
+            reinterpret_cast<const void *>(first * sizeof(Command));
+        if (p_multiDrawCount) {
+            p_multiDrawCount(
+                GL_TRIANGLES, std::get<1>(batch.first), offset, 
+                static_cast<GLintptr>(index * sizeof(GLuint)), maxCount, 0
+            );
+        }
+        else {
+            p_glFunctions->glMultiDrawElementsIndirect(
+                GL_TRIANGLES, std::get<1>(batch.first), offset, maxCount, 0
+            );
+        }
+        index++;
+    }
+    
+    GeometryHeap::unbind(p_glFunctions);
+    p_glFunctions->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    if (p_multiDrawCount)
+        p_glFunctions->glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+}
+
+
+void Object::IndirectRenderer::cull(GLuint numInstances, 
+                                    bool computeNormals) {
+    const Pass & pass = m_passes[m_isShadowPass];
+    const InstanceSet & set = m_sets[m_isShadowPass];
+    
+    // Reset the number of draws of each batch. Without the draw count, the
+    // commands of the culled instances must be empty.
+    p_glFunctions->glClearNamedBufferSubData(
+        pass.counts, GL_R32UI, 0, set.firsts.size() * sizeof(GLuint), 
+        GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr
+    );
+    if (!p_multiDrawCount) {
+        p_glFunctions->glClearNamedBufferSubData(
+            pass.commands, GL_R32UI, 0, numInstances * sizeof(Command), 
+            GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr
+        );
+    }
+    
+    // Views of the pass: the camera, or the cascades of the shadow map
+    QMatrix4x4 viewProjections[NUM_CASCADES];
+    GLuint numViews = 1;
+    viewProjections[0] = m_projection * m_view;
+    if (m_isShadowPass) {
+        numViews = NUM_CASCADES;
+        std::copy(m_lightSpace.begin(), m_lightSpace.end(), viewProjections);
+    }
+    
+    // Planes of the frustum of each view in world coordinates, extracted from
+    // the rows of the view-projection matrix
+    QVector4D planes[6 * NUM_CASCADES];
+    GLfloat lodScales[NUM_CASCADES] = {};
+    for (GLuint view = 0; view < numViews; view++) {
+        const QMatrix4x4 & viewProjection = viewProjections[view];
+        QVector4D * frustum = planes + 6 * view;
+        for (int i = 0; i < 3; i++) {
+            frustum[2*i]   = viewProjection.row(3) + viewProjection.row(i);
+            frustum[2*i+1] = viewProjection.row(3) - viewProjection.row(i);
+        }
+        for (int i = 0; i < 6; i++)
+            frustum[i] /= frustum[i].toVector3D().length();
+        lodScales[view] = viewProjection.row(1).toVector3D().length();
+    }
+    
+    p_cullShader->bind();
+    p_cullShader->setUniformValue("numInstances", numInstances);
+    p_cullShader->setUniformValue("numViews", numViews);
+    const int count = static_cast<int>(numViews);
+    p_cullShader->setUniformValueArray("planes", planes, 6 * count);
+    p_cullShader->setUniformValue("V", m_view);
+    p_cullShader->setUniformValueArray("VP", viewProjections, count);
+    p_cullShader->setUniformValueArray("lodScale", lodScales, count, 1);
+    p_cullShader->setUniformValueArray("lodScreenSize", LOD_SCREEN_SIZE, 
+                                       NUM_LODS - 1, 1);
+    p_cullShader->setUniformValue("computeNormals", 
+                                  static_cast<GLint>(computeNormals));
+    
+    p_glFunctions->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pass.draws);
+    p_glFunctions->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, 
+                                    set.instanceBuffer);
+    p_glFunctions->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, 
+                                    pass.commands);
+    p_glFunctions->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, pass.counts);
+    p_glFunctions->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, 
+                                    set.batchBuffer);
+    p_glFunctions->glDispatchCompute(
+        (numInstances + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1
+    );
+    
+    // The commands and draws are read by the following draw calls
+    p_glFunctions->glMemoryBarrier(GL_COMMAND_BARRIER_BIT | 
+                                   GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+
+void Object::IndirectRenderer::upload(
+    GLuint buffer, const void * data, size_t size
+) {
+    if (size == 0)
+        return;
+    p_glFunctions->glNamedBufferData(buffer, static_cast<GLsizeiptr>(size), 
+                                     data, GL_STREAM_DRAW);
+}
+
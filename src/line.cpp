@@ -1,4 +1,5 @@
 #include "../include/line.h"
+#include "../include/shaderregistry.h"
 
 #include <QOpenGLContext>
 
@@ -12,7 +13,7 @@ void Line::initialize() {
     }
     p_glFunctions = context->functions();
     
-    p_shader = std::make_unique<Shader>(
+    p_shader = ShaderRegistry::getShader<Shader>(
         ":/shaders/line.vert", ":/shaders/line.frag"
     );
     createBuffers();
@@ -50,12 +51,12 @@ void Line::render(
         reinterpret_cast<const void*>(0)
     );
     m_vao.release();
-    float width;
-    p_glFunctions->glGetFloatv(GL_LINE_WIDTH, &width);
 }
 
 
-void Line::renderShadow(const QMatrix4x4 & /*lightSpace*/) {
+void Line::renderShadow(
+    const std::array<QMatrix4x4,NUM_CASCADES> & /*lightSpace*/
+) {
     // Nothing to do: Do not render the shadow of the line.
 }
 
@@ -0,0 +1,117 @@
+#include "../include/linebatch.h"
+#include "../include/shaderregistry.h"
+
+#include <QOpenGLContext>
+
+void LineBatch::initialize() {
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (!context) {
+        qWarning() << __FILE__ << __LINE__ <<
+                      "Requires a valid current OpenGL context. \n" <<
+                      "Unable to draw the lines.";
+        return;
+    }
+    p_glFunctions = context->extraFunctions();
+
+    p_shader = ShaderRegistry::getShader<Shader>(
+        ":/shaders/line_batch.vert", ":/shaders/line_batch.frag"
+    );
+
+    // Create the streaming buffer, it is (re)allocated when rendering
+    m_vao.create();
+    m_vao.bind();
+    m_instanceBuffer.create();
+    m_instanceBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+    createAttributes();
+    m_vao.release();
+
+    m_isInitialized = true;
+}
+
+
+void LineBatch::addVector(
+    const QVector3D & origin, float yaw, const QVector3D & offset,
+    const QVector3D & vector, float scale, const QVector3D & color
+) {
+    m_instances.push_back({
+        {origin.x(), origin.y(), origin.z(), yaw},
+        {offset.x(), offset.y(), offset.z(), scale},
+        {vector.x(), vector.y(), vector.z(), static_cast<float>(Vector)},
+        {color.x(), color.y(), color.z(), 1.0f}
+    });
+}
+
+
+void LineBatch::addSegment(
+    const QVector3D & from, const QVector3D & to, const QVector3D & color
+) {
+    m_instances.push_back({
+        {from.x(), from.y(), from.z(), 0.0f},
+        {0.0f, 0.0f, 0.0f, 1.0f},
+        {to.x(), to.y(), to.z(), static_cast<float>(Segment)},
+        {color.x(), color.y(), color.z(), 1.0f}
+    });
+}
+
+
+void LineBatch::render(
+    const QMatrix4x4 & view, const QMatrix4x4 & projection
+) {
+    // Check if the batch has been initialized
+    if (!m_isInitialized) {
+        qCritical() << __FILE__ << __LINE__
+            << "The line batch must be initialized before being rendered.";
+        exit(1);
+    }
+    if (m_instances.empty())
+        return;
+
+    const int count = static_cast<int>(m_instances.size());
+    const int size = count * static_cast<int>(sizeof(Instance));
+
+    // Orphan the previous storage so the upload never waits for the GPU
+    m_instanceBuffer.bind();
+    if (count > m_capacity)
+        m_capacity = std::max(count, 2 * m_capacity);
+    m_instanceBuffer.allocate(
+        m_capacity * static_cast<int>(sizeof(Instance))
+    );
+    m_instanceBuffer.write(0, m_instances.data(), size);
+    m_instanceBuffer.release();
+
+    // Draw all the lines at once: 3 segments (6 vertices) per instance
+    p_shader->bind();
+    p_shader->setUniformValue("VP", projection * view);
+    m_vao.bind();
+    p_glFunctions->glDrawArraysInstanced(GL_LINES, 0, 6, count);
+    m_vao.release();
+}
+
+
+void LineBatch::cleanUp() {
+    m_instances.clear();
+    m_instanceBuffer.destroy();
+    m_vao.destroy();
+    m_capacity = 0;
+}
+
+
+void LineBatch::createAttributes() {
+    // Set up the vertex array state
+    p_shader->bind();
+    m_instanceBuffer.bind();
+
+    // Each vec4 of the instance is mapped to the layout locations 0 to 3
+    const int stride = static_cast<int>(sizeof(Instance));
+    for (int i = 0; i < 4; i++) {
+        p_shader->enableAttributeArray(i);
+        p_shader->setAttributeBuffer(
+            i,                                            // layout location
+            GL_FLOAT,                                     // data type
+            i * 4 * static_cast<int>(sizeof(float)),      // offset
+            4,                                            // components
+            stride                                        // stride
+        );
+        p_glFunctions->glVertexAttribDivisor(static_cast<GLuint>(i), 1);
+    }
+}
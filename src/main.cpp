@@ -1,5 +1,8 @@
 #include <QApplication>
 #include "../include/animationwindow.h"
+#include "../include/skybox.h"
+#include "../include/texture.h"
+#include "../include/texturebaker.h"
 #include <iostream>
 
 
@@ -9,7 +12,12 @@ void helpPrinter() {
     << "Options:\n"
     << "  -h, --help        Displays help on command line options.\n"
     << "  -v <file>         Load vehicle trajectory data file." 
-    << "  -e, --env <file>  Load environment XML file." << std::endl;
+    << "  -e, --env <file>  Load environment XML file.\n"
+    << "  --bake-textures   Bake the images of the assets and exit.\n"
+    << "  --compress        Compress the baked images (BC1, BC3, BC4).\n"
+    << "  --texture-budget <MB>\n"
+    << "                    Memory available for the textures (default 1024)."
+    << std::endl;
 }
 
 
@@ -17,6 +25,8 @@ int main(int argc, char *argv[]) {
     // Parse arguments
     std::vector<QString> vehicle;
     QString environment;
+    bool bakeTextures = false;
+    bool compressTextures = false;
     for (int i = 1; i < argc; i++) {
         if ((strcmp(argv[i],"-h") == 0) || (strcmp(argv[i],"--help") == 0)) {
             helpPrinter();
@@ -38,6 +48,25 @@ int main(int argc, char *argv[]) {
             }
             environment = QString(argv[++i]);
         }
+        else if (strcmp(argv[i],"--bake-textures") == 0) {
+            bakeTextures = true;
+        }
+        else if (strcmp(argv[i],"--compress") == 0) {
+            compressTextures = true;
+        }
+        else if (strcmp(argv[i],"--texture-budget") == 0) {
+            bool isValid = false;
+            const long long budget = 
+                i+1 < argc ? QString(argv[++i]).toLongLong(&isValid) : 0;
+            if (!isValid || budget <= 0) {
+                std::cout << "Argument '--texture-budget' must be followed "
+                    << "by a positive number of megabytes." << std::endl;
+                return -1;
+            }
+            TextureManager::setMemoryBudget(
+                static_cast<GLsizeiptr>(budget) << 20
+            );
+        }
         else {
             std::cout << "Invalid argument: " << argv[i] << "." << std::endl;
             return -1;
@@ -48,6 +77,19 @@ int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
     app.setApplicationName("3D viewer");
     
+    // Bake the images of the assets and the faces of the skybox, which are
+    // loaded with another orientation
+    if (bakeTextures) {
+        const QString skyboxDirectory("asset/Texture/Skybox");
+        std::vector<TextureBaker::Job> jobs = Skybox::getFaces();
+        for (const TextureBaker::Job & job : TextureBaker::findImages("asset")) {
+            if (!job.source.startsWith(skyboxDirectory))
+                jobs.push_back(job);
+        }
+        std::cout << "Baking " << jobs.size() << " images..." << std::endl;
+        return TextureBaker::bake(jobs, compressTextures) ? 0 : -1;
+    }
+    
     AnimationWindow animationWindow(environment, vehicle);
     animationWindow.show();
 
@@ -75,4 +117,10 @@ int main(int argc, char *argv[]) {
  * When running the program, the running directory must be the project folder, 
  * i.e. 'build/..'.
  * 
+ * The images of the assets can be baked into KTX2 files with their mipmaps,
+ * so they are not decoded at every launch:
+ * @code{.sh}
+ * make bake
+ * @endcode
+ * 
  */
@@ -44,37 +44,33 @@ void Material::setBumpTexture(Texture * bump) {
 }
 
 
+bool Material::isEquivalent(const Material & material) const {
+    return m_ambient == material.m_ambient &&
+        m_diffuse == material.m_diffuse &&
+        m_specular == material.m_specular &&
+        m_shininess == material.m_shininess &&
+        m_alpha == material.m_alpha &&
+        m_heightScale == material.m_heightScale &&
+        m_diffuseTexture == material.m_diffuseTexture &&
+        m_normalTexture == material.m_normalTexture &&
+        m_bumpTexture == material.m_bumpTexture;
+}
+
+
 void Material::setDefaultTexture() { 
+    // The default textures are loaded once, from their baked file if it is up
+    // to date
     // Diffuse texture
-    if (m_diffuseTexture == nullptr) {
-        QImage image("asset/Texture/Default/diffuse.png");
-        if (image.isNull())
-            qCritical() << __FILE__ << __LINE__ << 
-                "The image file to the default diffuse texture does not exist.";
-        m_diffuseTexture = TextureManager::loadTexture(
-            QString("DefaultDiffuseTexture"), Texture::Type::Diffuse, image
-        );
-    }
+    if (m_diffuseTexture == nullptr)
+        m_diffuseTexture = 
+            TextureManager::getDefaultTexture(Texture::Type::Diffuse);
     // Normal texture
-    if (m_normalTexture == nullptr) {
-        QImage image("asset/Texture/Default/normal.png");
-        if (image.isNull())
-            qCritical() << __FILE__ << __LINE__ << 
-                "The image file to the default normal texture does not exist.";
-        m_normalTexture = TextureManager::loadTexture(
-            QString("DefaultNormalTexture"), Texture::Type::Normal, image
-        );
-    }
+    if (m_normalTexture == nullptr)
+        m_normalTexture = 
+            TextureManager::getDefaultTexture(Texture::Type::Normal);
     // Bump/displacement texture
-    if (m_bumpTexture == nullptr) {
-        QImage image("asset/Texture/Default/depth.png");
-        if (image.isNull())
-            qCritical() << __FILE__ << __LINE__ <<
-                "The image file to the default normal texture does not exist.";
-        m_bumpTexture = TextureManager::loadTexture(
-            QString("DefaultBumpTexture"), Texture::Type::Bump, image
-        );
-    }
+    if (m_bumpTexture == nullptr)
+        m_bumpTexture = TextureManager::getDefaultTexture(Texture::Type::Bump);
 }
 
 
@@ -0,0 +1,136 @@
+#include "../include/materialtable.h"
+
+#include <QDebug>
+#include <QOpenGLContext>
+#include <algorithm>
+
+std::map<const Material *, GLuint> MaterialTable::m_indices;
+std::vector<MaterialTable::Data> MaterialTable::m_data;
+std::vector<const Material *> MaterialTable::m_materials;
+bool MaterialTable::m_changed = false;
+GLuint MaterialTable::m_buffer = 0;
+
+/***
+ *      __  __         _                _         _ 
+ *     |  \/  |       | |              (_)       | |
+ *     | \  / |  __ _ | |_   ___  _ __  _   __ _ | |
+ *     | |\/| | / _` || __| / _ \| '__|| | / _` || |
+ *     | |  | || (_| || |_ |  __/| |   | || (_| || |
+ *     |_|  |_| \__,_| \__| \___||_|   |_| \__,_||_|
+ *                                                  
+ *                                                  
+ *      _______         _      _       
+ *     |__   __|       | |    | |      
+ *        | |     __ _ | |__  | |  ___ 
+ *        | |    / _` || '_ \ | | / _ \
+ *        | |   | (_| || |_) || ||  __/
+ *        |_|    \__,_||_.__/ |_| \___|
+ *                                     
+ *                                     
+ */
+
+GLuint MaterialTable::add(const Material & material) {
+    auto it = m_indices.find(&material);
+    if (it != m_indices.end())
+        return it->second;
+    
+    const QVector3D Ka = material.getAmbientColor();
+    const QVector3D Kd = material.getDiffuseColor();
+    const QVector3D Ks = material.getSpecularColor();
+    m_data.push_back(Data{
+        {Ka.x(), Ka.y(), Ka.z(), material.getShininess()},
+        {Kd.x(), Kd.y(), Kd.z(), material.getAlpha()},
+        {Ks.x(), Ks.y(), Ks.z(), material.getHeightScale()},
+        {0, 0, 0, 0},
+        {{0.0f, 0.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 1.0f, 1.0f}, 
+         {0.0f, 0.0f, 1.0f, 1.0f}}
+    });
+    setLayers(m_data.back(), material);
+    m_materials.push_back(&material);
+    m_changed = true;
+    
+    const GLuint index = static_cast<GLuint>(m_data.size() - 1);
+    m_indices.insert(std::make_pair(&material, index));
+    return index;
+}
+
+
+void MaterialTable::updateTextures() {
+    for (size_t i = 0; i < m_materials.size(); i++)
+        setLayers(m_data[i], *m_materials[i]);
+    m_changed = !m_data.empty();
+}
+
+
+void MaterialTable::bind() {
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (!context) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Requires a valid current OpenGL context.";
+        return;
+    }
+    QOpenGLFunctions_4_5_Core * gl =
+        context->versionFunctions<QOpenGLFunctions_4_5_Core>();
+    if (!gl || !gl->initializeOpenGLFunctions()) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Could not obtain required OpenGL context version";
+        return;
+    }
+    
+    // The table only grows while the objects are loaded, it is uploaded
+    // again once the new materials have been added or once textures loaded
+    // in the background have replaced their placeholder
+    if (m_buffer == 0)
+        gl->glCreateBuffers(1, &m_buffer);
+    if (m_changed && !m_data.empty()) {
+        gl->glNamedBufferData(m_buffer, m_data.size() * sizeof(Data), 
+                              m_data.data(), GL_STATIC_DRAW);
+        m_changed = false;
+    }
+    gl->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING, m_buffer);
+}
+
+
+void MaterialTable::cleanUp() {
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (m_buffer != 0 && context) {
+        QOpenGLFunctions_4_5_Core * gl = 
+            context->versionFunctions<QOpenGLFunctions_4_5_Core>();
+        if (gl && gl->initializeOpenGLFunctions())
+            gl->glDeleteBuffers(1, &m_buffer);
+    }
+    m_buffer = 0;
+    m_indices.clear();
+    m_data.clear();
+    m_materials.clear();
+    m_changed = false;
+}
+
+
+void MaterialTable::setLayers(Data & data, const Material & material) {
+    const Texture * normal = material.getNormalTexture();
+    const GLuint flags = 
+        normal != nullptr && normal->getArray() != nullptr &&
+        normal->getArray()->format == GL_COMPRESSED_RG_RGTC2 ? NORMAL_XY : 0;
+    const Texture * textures[3] = {
+        material.getDiffuseTexture(), normal, material.getBumpTexture()
+    };
+    for (int i = 0; i < 3; i++) {
+        data.layers[i] = getLayer(textures[i]);
+        if (textures[i] == nullptr)
+            continue;
+        std::copy(textures[i]->getRect(), textures[i]->getRect() + 4, 
+                  data.rects[i]);
+        // Flip the rectangle of a texture stored top row first
+        if (textures[i]->isTopDown()) {
+            data.rects[i][1] += data.rects[i][3];
+            data.rects[i][3] = -data.rects[i][3];
+        }
+    }
+    data.layers[3] = flags;
+}
+
+
+GLuint MaterialTable::getLayer(const Texture * texture) {
+    return texture != nullptr ? static_cast<GLuint>(texture->getLayer()) : 0;
+}
@@ -0,0 +1,437 @@
+#include "../include/meshcache.h"
+#include "../include/vertexformat.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QOpenGLFunctions>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QUrl>
+#include <cstring>
+
+// Identifies the entry files, also detects a change of endianness
+static constexpr quint32 MAGIC = 0x31434d56; // "VMC1"
+// Version of the format and of the processing of the loader
+static constexpr quint32 FORMAT_VERSION = 4;
+
+namespace {
+
+/**
+ * @brief Append the data of an entry to a byte array, every field is aligned
+ * on 4 bytes.
+ */
+class Writer {
+public:
+    Writer(QByteArray & data) : m_data(data) {};
+
+    void write(const void * data, size_t size) {
+        m_data.append(reinterpret_cast<const char *>(data),
+                      static_cast<int>(size));
+        m_data.append(QByteArray((4 - m_data.size() % 4) % 4, '\0'));
+    };
+
+    void write(quint32 value) {write(&value, sizeof(value));};
+
+    void write(float value) {write(&value, sizeof(value));};
+
+    void write(const QString & string) {
+        const QByteArray utf8 = string.toUtf8();
+        write(static_cast<quint32>(utf8.size()));
+        write(utf8.constData(), static_cast<size_t>(utf8.size()));
+    };
+
+    void write(const QVector3D & vector) {
+        write(vector.x());
+        write(vector.y());
+        write(vector.z());
+    };
+
+    template<typename T> void write(const QVector<T> & array) {
+        write(static_cast<quint32>(array.size()));
+        write(array.constData(), array.size() * sizeof(T));
+    };
+
+    void write(const QByteArray & array) {
+        write(static_cast<quint32>(array.size()));
+        write(array.constData(), static_cast<size_t>(array.size()));
+    };
+
+    void write(const std::vector<unsigned int> & array) {
+        write(static_cast<quint32>(array.size()));
+        write(array.data(), array.size() * sizeof(unsigned int));
+    };
+
+private:
+    QByteArray & m_data;
+};
+
+
+/**
+ * @brief Read the data of an entry from memory. Once a read fails, every
+ * following read fails.
+ */
+class Reader {
+public:
+    Reader(const uchar * data, qint64 size) :
+    m_data(data), m_size(size), m_position(0), m_isValid(true) {};
+
+    bool isValid() const {return m_isValid;};
+
+    bool read(void * data, qint64 size) {
+        const qint64 aligned = (size + 3) / 4 * 4;
+        if (!m_isValid || size < 0 || m_size - m_position < aligned) {
+            m_isValid = false;
+            return false;
+        }
+        std::memcpy(data, m_data + m_position, static_cast<size_t>(size));
+        m_position += aligned;
+        return true;
+    };
+
+    quint32 readUInt() {
+        quint32 value = 0;
+        read(&value, sizeof(value));
+        return value;
+    };
+
+    float readFloat() {
+        float value = 0.0f;
+        read(&value, sizeof(value));
+        return value;
+    };
+
+    QString readString() {
+        QByteArray utf8(static_cast<int>(readCount(1)), '\0');
+        read(utf8.data(), utf8.size());
+        return QString::fromUtf8(utf8);
+    };
+
+    QVector3D readVector3D() {
+        const float x = readFloat();
+        const float y = readFloat();
+        return QVector3D(x, y, readFloat());
+    };
+
+    template<typename T> QVector<T> readArray() {
+        QVector<T> array(static_cast<int>(readCount(sizeof(T))));
+        read(array.data(), array.size() * static_cast<qint64>(sizeof(T)));
+        return array;
+    };
+
+    /**
+     * @brief Read a byte array without copying it: the array points into
+     * the data, which must outlive it.
+     */
+    QByteArray readRawData() {
+        const qint64 size = readCount(1);
+        const qint64 aligned = (size + 3) / 4 * 4;
+        if (!m_isValid || m_size - m_position < aligned) {
+            m_isValid = false;
+            return QByteArray();
+        }
+        const QByteArray array = QByteArray::fromRawData(
+            reinterpret_cast<const char *>(m_data + m_position), 
+            static_cast<int>(size)
+        );
+        m_position += aligned;
+        return array;
+    };
+
+    std::vector<unsigned int> readIndices() {
+        std::vector<unsigned int> array(readCount(sizeof(unsigned int)));
+        read(array.data(),
+             static_cast<qint64>(array.size() * sizeof(unsigned int)));
+        return array;
+    };
+
+    /**
+     * @brief Read a number of elements, checking they fit in the remaining
+     * data so that a corrupted entry never allocates a huge array.
+     */
+    quint32 readCount(qint64 elementSize) {
+        const quint32 count = readUInt();
+        if (count * elementSize > m_size - m_position) {
+            m_isValid = false;
+            return 0;
+        }
+        return count;
+    };
+
+private:
+    const uchar * m_data;
+    qint64 m_size;
+    qint64 m_position;
+    bool m_isValid;
+};
+
+/**
+ * @brief Add the content of a file to a hash.
+ * @return False if the file cannot be read.
+ */
+bool addFile(QCryptographicHash & hash, const QString & path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    return hash.addData(&file);
+}
+
+}
+
+
+QString MeshCache::computeKey(
+    const QString & filePath, const QString & textureDir, unsigned int flags
+) {
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return QString();
+    const QByteArray content = file.readAll();
+    hash.addData(content);
+
+    // Add the material libraries referenced by a Wavefront OBJ file
+    if (QFileInfo(filePath).suffix().toLower() == "obj") {
+        const QDir directory = QFileInfo(filePath).absoluteDir();
+        int position = content.indexOf("mtllib");
+        while (position >= 0) {
+            int end = content.indexOf('\n', position);
+            if (end < 0)
+                end = content.size();
+            const QString library = QString::fromUtf8(
+                content.mid(position + 6, end - position - 6)
+            ).trimmed();
+            hash.addData(library.toUtf8());
+            addFile(hash, directory.filePath(library));
+            position = content.indexOf("mtllib", end);
+        }
+    }
+
+    // Add the external buffers referenced by a glTF file, the data URIs are
+    // part of its content
+    if (QFileInfo(filePath).suffix().toLower() == "gltf") {
+        const QDir directory = QFileInfo(filePath).absoluteDir();
+        const QJsonArray buffers = 
+            QJsonDocument::fromJson(content).object()["buffers"].toArray();
+        for (const QJsonValue & value : buffers) {
+            const QString uri = value.toObject()["uri"].toString();
+            if (uri.isEmpty() || uri.startsWith("data:"))
+                continue;
+            hash.addData(uri.toUtf8());
+            addFile(hash, directory.filePath(
+                QUrl::fromPercentEncoding(uri.toUtf8())
+            ));
+        }
+    }
+
+    hash.addData(textureDir.toUtf8());
+    const quint32 settings[2] = {static_cast<quint32>(flags), FORMAT_VERSION};
+    hash.addData(reinterpret_cast<const char *>(settings), sizeof(settings));
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+
+bool MeshCache::load(const QString & key, Entry & entry) {
+    if (key.isEmpty())
+        return false;
+    // The file stays mapped while the entry data is used
+    std::shared_ptr<QFile> file = std::make_shared<QFile>(entryPath(key));
+    if (!file->open(QIODevice::ReadOnly))
+        return false;
+    const qint64 size = file->size();
+    const uchar * data = file->map(0, size);
+    if (data == nullptr)
+        return false;
+
+    Reader reader(data, size);
+    if (reader.readUInt() != MAGIC || reader.readUInt() != FORMAT_VERSION)
+        return false;
+
+    // Vertex and index data, and the streams used on the CPU
+    entry.file = file;
+    entry.halfTextureUV = (reader.readUInt() != 0);
+    entry.textureRepeat = reader.readFloat();
+    entry.acmrBefore = reader.readFloat();
+    entry.acmrAfter = reader.readFloat();
+    entry.numTriangles = reader.readUInt();
+    entry.vertexData = reader.readRawData();
+    entry.indexData = reader.readRawData();
+    entry.vertices = reader.readArray<float>();
+    entry.indices = reader.readArray<unsigned int>();
+
+    // Material table
+    entry.materials.resize(reader.readCount(4));
+    for (MaterialRecord & material : entry.materials) {
+        if (!reader.isValid())
+            break;
+        material.name = reader.readString();
+        material.isShaded = (reader.readUInt() != 0);
+        material.ambient = reader.readVector3D();
+        material.diffuse = reader.readVector3D();
+        material.specular = reader.readVector3D();
+        material.shininess = reader.readFloat();
+        material.alpha = reader.readFloat();
+        material.diffuseTexture = reader.readString();
+        material.normalTexture = reader.readString();
+    }
+
+    // Meshes
+    entry.meshes.resize(reader.readCount(4));
+    for (MeshRecord & mesh : entry.meshes) {
+        if (!reader.isValid())
+            break;
+        mesh.name = reader.readString();
+        mesh.material = reader.readUInt();
+        mesh.lods = reader.readIndices();
+        mesh.indexType = reader.readUInt();
+        mesh.baseVertex = reader.readUInt();
+        mesh.byteOffsets = reader.readIndices();
+    }
+
+    // Nodes
+    entry.nodes.resize(reader.readCount(4));
+    for (NodeRecord & node : entry.nodes) {
+        if (!reader.isValid())
+            break;
+        node.name = reader.readString();
+        // Stored in column-major order, as returned by QMatrix4x4::constData
+        float * values = node.transformation.data();
+        for (int i = 0; i < 16; i++)
+            values[i] = reader.readFloat();
+        node.meshes = reader.readIndices();
+        node.numChildren = reader.readUInt();
+    }
+
+    // Check the references between the tables and the data
+    const int stride = VertexFormat::stride(entry.halfTextureUV);
+    const qint64 numVertices = entry.vertices.size() / 3;
+    bool isValid = reader.isValid() && 
+        entry.vertexData.size() == numVertices * stride;
+    for (unsigned int index : entry.indices)
+        isValid = isValid && index < numVertices;
+    for (const MeshRecord & mesh : entry.meshes) {
+        isValid = isValid && mesh.material < entry.materials.size() &&
+            mesh.lods.size() % 2 == 0 &&
+            mesh.byteOffsets.size() == mesh.lods.size() / 2 &&
+            (mesh.indexType == GL_UNSIGNED_SHORT || 
+             mesh.indexType == GL_UNSIGNED_INT);
+        if (!isValid)
+            break;
+        // The levels of detail must be in the indices, and their packed
+        // indices in the index data and below the number of vertices
+        const qint64 indexSize = (mesh.indexType == GL_UNSIGNED_SHORT) ? 2 : 4;
+        for (size_t i = 0; isValid && i < mesh.byteOffsets.size(); i++) {
+            const qint64 count = mesh.lods[2*i];
+            const qint64 offset = mesh.lods[2*i+1];
+            const qint64 byteOffset = mesh.byteOffsets[i];
+            isValid = offset + count <= entry.indices.size() &&
+                byteOffset % indexSize == 0 &&
+                byteOffset + count * indexSize <= entry.indexData.size();
+            for (qint64 j = 0; isValid && j < count; j++) {
+                const char * data = 
+                    entry.indexData.constData() + byteOffset + j * indexSize;
+                qint64 index = 0;
+                if (indexSize == 2) {
+                    quint16 value;
+                    std::memcpy(&value, data, sizeof(value));
+                    index = value;
+                }
+                else {
+                    quint32 value;
+                    std::memcpy(&value, data, sizeof(value));
+                    index = value;
+                }
+                isValid = mesh.baseVertex + index < numVertices;
+            }
+        }
+    }
+    for (const NodeRecord & node : entry.nodes) {
+        for (unsigned int mesh : node.meshes)
+            isValid = isValid && mesh < entry.meshes.size();
+    }
+    if (!isValid) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "The mesh cache entry" << entryPath(key) << "is corrupted.";
+        entry = Entry();
+    }
+    return isValid;
+}
+
+
+bool MeshCache::save(const QString & key, const Entry & entry) {
+    if (key.isEmpty())
+        return false;
+    QByteArray data;
+    Writer writer(data);
+    writer.write(MAGIC);
+    writer.write(FORMAT_VERSION);
+
+    // Vertex and index data, and the streams used on the CPU
+    writer.write(static_cast<quint32>(entry.halfTextureUV));
+    writer.write(entry.textureRepeat);
+    writer.write(entry.acmrBefore);
+    writer.write(entry.acmrAfter);
+    writer.write(static_cast<quint32>(entry.numTriangles));
+    writer.write(entry.vertexData);
+    writer.write(entry.indexData);
+    writer.write(entry.vertices);
+    writer.write(entry.indices);
+
+    // Material table
+    writer.write(static_cast<quint32>(entry.materials.size()));
+    for (const MaterialRecord & material : entry.materials) {
+        writer.write(material.name);
+        writer.write(static_cast<quint32>(material.isShaded));
+        writer.write(material.ambient);
+        writer.write(material.diffuse);
+        writer.write(material.specular);
+        writer.write(material.shininess);
+        writer.write(material.alpha);
+        writer.write(material.diffuseTexture);
+        writer.write(material.normalTexture);
+    }
+
+    // Meshes
+    writer.write(static_cast<quint32>(entry.meshes.size()));
+    for (const MeshRecord & mesh : entry.meshes) {
+        writer.write(mesh.name);
+        writer.write(static_cast<quint32>(mesh.material));
+        writer.write(mesh.lods);
+        writer.write(static_cast<quint32>(mesh.indexType));
+        writer.write(static_cast<quint32>(mesh.baseVertex));
+        writer.write(mesh.byteOffsets);
+    }
+
+    // Nodes
+    writer.write(static_cast<quint32>(entry.nodes.size()));
+    for (const NodeRecord & node : entry.nodes) {
+        writer.write(node.name);
+        writer.write(node.transformation.constData(), 16 * sizeof(float));
+        writer.write(node.meshes);
+        writer.write(static_cast<quint32>(node.numChildren));
+    }
+
+    // Write the entry atomically so that a concurrent or interrupted run never
+    // reads a partial entry
+    const QString path = entryPath(key);
+    if (!QDir().mkpath(QFileInfo(path).absolutePath()))
+        return false;
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) ||
+        file.write(data) != data.size() || !file.commit()) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Unable to write the mesh cache entry" << path;
+        return false;
+    }
+    return true;
+}
+
+
+QString MeshCache::entryPath(const QString & key) {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+        "/meshes/" + key + ".vmc";
+}
@@ -0,0 +1,366 @@
+#include "../include/meshoptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+
+// Parameters of the vertex score of Forsyth's algorithm
+constexpr int SCORING_CACHE_SIZE = 32;
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+constexpr float VALENCE_BOOST_SCALE = 2.0f;
+constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+// Size of the FIFO cache used to split the mesh into clusters
+constexpr unsigned int FIFO_CACHE_SIZE = 16;
+
+/**
+ * @brief Score of a vertex: the vertices recently used and the vertices with
+ * few remaining triangles are preferred.
+ */
+float vertexScore(int cachePosition, unsigned int liveTriangles) {
+    if (liveTriangles == 0)
+        return -1.0f;
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // The vertices of the last triangle get a fixed score so that the
+            // next triangle does not always reuse the same edge
+            score = LAST_TRIANGLE_SCORE;
+        }
+        else {
+            const float scaler = 1.0f / (SCORING_CACHE_SIZE - 3);
+            score = std::pow(
+                1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER
+            );
+        }
+    }
+    score += VALENCE_BOOST_SCALE *
+        std::pow(static_cast<float>(liveTriangles), -VALENCE_BOOST_POWER);
+    return score;
+}
+
+/**
+ * @brief FIFO vertex cache: a vertex is in the cache if less than 'size'
+ * vertices have been inserted since its own insertion.
+ */
+class FifoCache {
+public:
+    FifoCache(unsigned int size) : m_size(size), m_time(size) {};
+
+    unsigned int access(unsigned int vertex) {
+        auto it = m_insertion.find(vertex);
+        if (it != m_insertion.end() && m_time - it->second < m_size)
+            return 0;
+        m_insertion[vertex] = m_time++;
+        return 1;
+    };
+
+    void reset() {m_time += m_size;};
+
+private:
+    unsigned int m_size;
+    unsigned int m_time;
+    std::unordered_map<unsigned int, unsigned int> m_insertion;
+};
+
+}
+
+
+void MeshOptimizer::optimizeVertexCache(
+    unsigned int * indices, unsigned int count
+) {
+    const unsigned int numTriangles = count / 3;
+    if (numTriangles < 2)
+        return;
+
+    // Renumber the vertices of the mesh from 0
+    std::vector<unsigned int> local(3 * numTriangles);
+    std::unordered_map<unsigned int, unsigned int> ids;
+    for (unsigned int i = 0; i < 3 * numTriangles; i++) {
+        local[i] = ids.emplace(
+            indices[i], static_cast<unsigned int>(ids.size())
+        ).first->second;
+    }
+    const unsigned int numVertices = static_cast<unsigned int>(ids.size());
+
+    // Triangles using each vertex
+    std::vector<unsigned int> liveTriangles(numVertices, 0);
+    for (unsigned int i = 0; i < 3 * numTriangles; i++)
+        liveTriangles[local[i]]++;
+    std::vector<unsigned int> adjacencyOffset(numVertices + 1, 0);
+    for (unsigned int v = 0; v < numVertices; v++)
+        adjacencyOffset[v+1] = adjacencyOffset[v] + liveTriangles[v];
+    std::vector<unsigned int> adjacency(3 * numTriangles);
+    std::vector<unsigned int> fill(
+        adjacencyOffset.begin(), adjacencyOffset.end() - 1
+    );
+    for (unsigned int i = 0; i < 3 * numTriangles; i++)
+        adjacency[fill[local[i]]++] = i / 3;
+
+    // Initial scores
+    std::vector<int> cachePosition(numVertices, -1);
+    std::vector<float> vertexScores(numVertices);
+    for (unsigned int v = 0; v < numVertices; v++)
+        vertexScores[v] = vertexScore(-1, liveTriangles[v]);
+    std::vector<float> triangleScores(numTriangles);
+    int best = 0;
+    for (unsigned int t = 0; t < numTriangles; t++) {
+        triangleScores[t] = vertexScores[local[3*t]] +
+            vertexScores[local[3*t+1]] + vertexScores[local[3*t+2]];
+        if (triangleScores[t] > triangleScores[best])
+            best = static_cast<int>(t);
+    }
+
+    // Emit the triangle with the best score until all are emitted
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<unsigned int> result(3 * numTriangles);
+    std::vector<unsigned int> cache;
+    std::vector<unsigned int> newCache;
+    unsigned int cursor = 0;
+    for (unsigned int n = 0; n < numTriangles; n++) {
+        if (best < 0) {
+            // No candidate around the cache: take the next triangle
+            while (emitted[cursor])
+                cursor++;
+            best = static_cast<int>(cursor);
+        }
+        const unsigned int t = static_cast<unsigned int>(best);
+        emitted[t] = true;
+        for (unsigned int k = 0; k < 3; k++)
+            result[3*n+k] = indices[3*t+k];
+
+        // Remove the triangle from its vertices
+        for (unsigned int k = 0; k < 3; k++) {
+            const unsigned int v = local[3*t+k];
+            const unsigned int begin = adjacencyOffset[v];
+            const unsigned int end = begin + liveTriangles[v];
+            for (unsigned int j = begin; j < end; j++) {
+                if (adjacency[j] == t) {
+                    std::swap(adjacency[j], adjacency[end-1]);
+                    liveTriangles[v]--;
+                    break;
+                }
+            }
+        }
+
+        // Move the vertices of the triangle to the front of the cache
+        newCache.clear();
+        for (unsigned int k = 0; k < 3; k++) {
+            const unsigned int v = local[3*t+k];
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+                newCache.push_back(v);
+        }
+        const auto triangleEnd = newCache.size();
+        for (unsigned int v : cache) {
+            const auto end = newCache.begin() + triangleEnd;
+            if (std::find(newCache.begin(), end, v) == end)
+                newCache.push_back(v);
+        }
+
+        // Update the scores of the vertices of the cache, including the ones
+        // which have just been evicted
+        for (unsigned int i = 0; i < newCache.size(); i++) {
+            const unsigned int v = newCache[i];
+            cachePosition[v] =
+                i < SCORING_CACHE_SIZE ? static_cast<int>(i) : -1;
+            vertexScores[v] = vertexScore(cachePosition[v], liveTriangles[v]);
+        }
+
+        // Update the scores of their triangles and find the best one
+        best = -1;
+        float bestScore = -std::numeric_limits<float>::max();
+        for (unsigned int v : newCache) {
+            const unsigned int begin = adjacencyOffset[v];
+            for (unsigned int j = begin; j < begin + liveTriangles[v]; j++) {
+                const unsigned int tt = adjacency[j];
+                triangleScores[tt] = vertexScores[local[3*tt]] +
+                    vertexScores[local[3*tt+1]] + vertexScores[local[3*tt+2]];
+                if (triangleScores[tt] > bestScore) {
+                    bestScore = triangleScores[tt];
+                    best = static_cast<int>(tt);
+                }
+            }
+        }
+        if (newCache.size() > SCORING_CACHE_SIZE)
+            newCache.resize(SCORING_CACHE_SIZE);
+        std::swap(cache, newCache);
+    }
+    std::copy(result.begin(), result.end(), indices);
+}
+
+
+void MeshOptimizer::optimizeOverdraw(
+    unsigned int * indices, unsigned int count,
+    const QVector<float> & vertices, float threshold
+) {
+    const unsigned int numTriangles = count / 3;
+    if (numTriangles < 2)
+        return;
+
+    // Split the mesh where the vertex cache is flushed, i.e. where the three
+    // vertices of a triangle are cache misses
+    std::vector<unsigned int> hardClusters;
+    FifoCache cache(FIFO_CACHE_SIZE);
+    for (unsigned int t = 0; t < numTriangles; t++) {
+        unsigned int misses = cache.access(indices[3*t]) +
+            cache.access(indices[3*t+1]) + cache.access(indices[3*t+2]);
+        if (t == 0 || misses == 3)
+            hardClusters.push_back(t);
+    }
+    hardClusters.push_back(numTriangles);
+
+    // Split these clusters further as soon as their ACMR is close to the one
+    // of the mesh
+    const float maxAcmr = threshold * computeAcmr(indices, 3 * numTriangles);
+    std::vector<unsigned int> clusters;
+    for (unsigned int c = 0; c + 1 < hardClusters.size(); c++) {
+        unsigned int start = hardClusters[c];
+        unsigned int misses = 0;
+        cache.reset();
+        clusters.push_back(start);
+        for (unsigned int t = hardClusters[c]; t < hardClusters[c+1]; t++) {
+            misses += cache.access(indices[3*t]) +
+                cache.access(indices[3*t+1]) + cache.access(indices[3*t+2]);
+            const float acmr = static_cast<float>(misses) / (t - start + 1);
+            if (t + 1 < hardClusters[c+1] && acmr <= maxAcmr) {
+                start = t + 1;
+                misses = 0;
+                cache.reset();
+                clusters.push_back(start);
+            }
+        }
+    }
+    clusters.push_back(numTriangles);
+
+    // Compute the centroid and the normal of the clusters
+    const unsigned int numClusters =
+        static_cast<unsigned int>(clusters.size()) - 1;
+    std::vector<double> centroids(3 * numClusters, 0.0);
+    std::vector<double> normals(3 * numClusters, 0.0);
+    std::vector<double> areas(numClusters, 0.0);
+    double meshCentroid[3] = {0.0, 0.0, 0.0};
+    double meshArea = 0.0;
+    for (unsigned int c = 0; c < numClusters; c++) {
+        for (unsigned int t = clusters[c]; t < clusters[c+1]; t++) {
+            double p[3][3];
+            for (unsigned int k = 0; k < 3; k++) {
+                const int v = 3 * static_cast<int>(indices[3*t+k]);
+                for (int j = 0; j < 3; j++)
+                    p[k][j] = vertices.at(v+j);
+            }
+            const double e1[3] = {
+                p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]
+            };
+            const double e2[3] = {
+                p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]
+            };
+            const double n[3] = {
+                e1[1] * e2[2] - e1[2] * e2[1],
+                e1[2] * e2[0] - e1[0] * e2[2],
+                e1[0] * e2[1] - e1[1] * e2[0]
+            };
+            const double area = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+            for (int j = 0; j < 3; j++) {
+                const double center = (p[0][j] + p[1][j] + p[2][j]) / 3.0;
+                centroids[3*c+j] += center * area;
+                normals[3*c+j] += n[j];
+            }
+            areas[c] += area;
+        }
+        for (int j = 0; j < 3; j++)
+            meshCentroid[j] += centroids[3*c+j];
+        meshArea += areas[c];
+    }
+    if (meshArea == 0.0)
+        return;
+    for (int j = 0; j < 3; j++)
+        meshCentroid[j] /= meshArea;
+
+    // Draw first the clusters facing outward, they are likely to occlude the
+    // other ones
+    std::vector<double> keys(numClusters, 0.0);
+    std::vector<unsigned int> order(numClusters);
+    for (unsigned int c = 0; c < numClusters; c++) {
+        order[c] = c;
+        const double length = std::sqrt(
+            normals[3*c] * normals[3*c] + normals[3*c+1] * normals[3*c+1] +
+            normals[3*c+2] * normals[3*c+2]
+        );
+        if (areas[c] == 0.0 || length == 0.0)
+            continue;
+        for (int j = 0; j < 3; j++) {
+            keys[c] += (centroids[3*c+j] / areas[c] - meshCentroid[j]) *
+                normals[3*c+j] / length;
+        }
+    }
+    std::stable_sort(order.begin(), order.end(),
+        [&](unsigned int a, unsigned int b) {return keys[a] > keys[b];}
+    );
+
+    std::vector<unsigned int> result;
+    result.reserve(3 * numTriangles);
+    for (unsigned int c : order) {
+        result.insert(
+            result.end(), indices + 3 * clusters[c],
+            indices + 3 * clusters[c+1]
+        );
+    }
+    std::copy(result.begin(), result.end(), indices);
+}
+
+
+std::vector<unsigned int> MeshOptimizer::optimizeVertexFetch(
+    QVector<unsigned int> & indices, unsigned int numVertices
+) {
+    const unsigned int unused = std::numeric_limits<unsigned int>::max();
+    std::vector<unsigned int> remap(numVertices, unused);
+    unsigned int next = 0;
+    for (int i = 0; i < indices.size(); i++) {
+        const unsigned int v = indices[i];
+        if (v >= numVertices)
+            continue;
+        if (remap[v] == unused)
+            remap[v] = next++;
+        indices[i] = remap[v];
+    }
+    for (unsigned int v = 0; v < numVertices; v++) {
+        if (remap[v] == unused)
+            remap[v] = next++;
+    }
+    return remap;
+}
+
+
+void MeshOptimizer::remapVertexStream(
+    QVector<float> & stream, const std::vector<unsigned int> & remap
+) {
+    const int numVertices = static_cast<int>(remap.size());
+    if (numVertices == 0 || stream.size() % numVertices != 0)
+        return;
+    const int components = stream.size() / numVertices;
+    QVector<float> remapped(stream.size());
+    for (int v = 0; v < numVertices; v++) {
+        const int to = components * static_cast<int>(remap[v]);
+        for (int j = 0; j < components; j++)
+            remapped[to + j] = stream.at(components * v + j);
+    }
+    stream = remapped;
+}
+
+
+float MeshOptimizer::computeAcmr(
+    const unsigned int * indices, unsigned int count, unsigned int cacheSize
+) {
+    const unsigned int numTriangles = count / 3;
+    if (numTriangles == 0)
+        return 0.0f;
+    FifoCache cache(cacheSize);
+    unsigned int misses = 0;
+    for (unsigned int i = 0; i < 3 * numTriangles; i++)
+        misses += cache.access(indices[i]);
+    return static_cast<float>(misses) / numTriangles;
+}
@@ -0,0 +1,290 @@
+#include "../include/meshsimplifier.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <queue>
+#include <vector>
+
+namespace {
+
+typedef std::array<double,3> Vec3;
+
+/**
+ * @brief Symmetric 4x4 matrix measuring the squared distance of a point to a
+ * set of planes.
+ */
+struct Quadric {
+    // Upper triangle: a00 a01 a02 a03 a11 a12 a13 a22 a23 a33
+    double a[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+    void addPlane(const Vec3 & n, double d) {
+        a[0] += n[0]*n[0]; a[1] += n[0]*n[1]; a[2] += n[0]*n[2]; a[3] += n[0]*d;
+        a[4] += n[1]*n[1]; a[5] += n[1]*n[2]; a[6] += n[1]*d;
+        a[7] += n[2]*n[2]; a[8] += n[2]*d;
+        a[9] += d*d;
+    }
+
+    void operator+=(const Quadric & q) {
+        for (int i = 0; i < 10; i++)
+            a[i] += q.a[i];
+    }
+
+    double evaluate(const Vec3 & p) const {
+        const double x = p[0], y = p[1], z = p[2];
+        return a[0]*x*x + 2*a[1]*x*y + 2*a[2]*x*z + 2*a[3]*x
+             + a[4]*y*y + 2*a[5]*y*z + 2*a[6]*y
+             + a[7]*z*z + 2*a[8]*z
+             + a[9];
+    }
+};
+
+/**
+ * @brief Candidate collapse of the vertex 'from' onto the vertex 'to'.
+ * @details The versions are used to discard the candidates which became
+ * outdated after a collapse modified one of the two vertices.
+ */
+struct Collapse {
+    double cost;
+    unsigned int from;
+    unsigned int to;
+    unsigned int fromVersion;
+    unsigned int toVersion;
+
+    bool operator>(const Collapse & c) const {return cost > c.cost;}
+};
+
+Vec3 triangleNormal(const Vec3 & p0, const Vec3 & p1, const Vec3 & p2) {
+    const Vec3 e1 = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    const Vec3 e2 = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    return {
+        e1[1] * e2[2] - e1[2] * e2[1],
+        e1[2] * e2[0] - e1[0] * e2[2],
+        e1[0] * e2[1] - e1[1] * e2[0]
+    };
+}
+
+double dot(const Vec3 & u, const Vec3 & v) {
+    return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+}
+
+}
+
+
+QVector<unsigned int> MeshSimplifier::simplify(
+    const QVector<float> & vertices, const unsigned int * indices,
+    unsigned int count, float ratio, float maxError
+) {
+    const unsigned int numTriangles = count / 3;
+    QVector<unsigned int> result;
+    if (numTriangles == 0)
+        return result;
+
+    // Compact the vertices referenced by the mesh
+    std::vector<unsigned int> globalIds(indices, indices + 3 * numTriangles);
+    std::sort(globalIds.begin(), globalIds.end());
+    globalIds.erase(
+        std::unique(globalIds.begin(), globalIds.end()), globalIds.end()
+    );
+    const unsigned int numVertices = static_cast<unsigned int>(
+        globalIds.size()
+    );
+
+    std::vector<Vec3> positions(numVertices);
+    for (unsigned int i = 0; i < numVertices; i++) {
+        const int id = static_cast<int>(3 * globalIds[i]);
+        positions[i] = {vertices[id], vertices[id+1], vertices[id+2]};
+    }
+
+    std::vector<std::array<unsigned int,3>> triangles(numTriangles);
+    for (unsigned int t = 0; t < numTriangles; t++) {
+        for (unsigned int k = 0; k < 3; k++) {
+            triangles[t][k] = static_cast<unsigned int>(
+                std::lower_bound(
+                    globalIds.begin(), globalIds.end(), indices[3*t+k]
+                ) - globalIds.begin()
+            );
+        }
+    }
+
+    // Weld the vertices sharing the same position (attribute seams)
+    std::map<std::array<float,3>, unsigned int> positionIds;
+    std::vector<unsigned int> welded(numVertices);
+    std::vector<unsigned int> weldCount(numVertices, 0);
+    for (unsigned int i = 0; i < numVertices; i++) {
+        const int id = static_cast<int>(3 * globalIds[i]);
+        std::array<float,3> key = {
+            vertices[id], vertices[id+1], vertices[id+2]
+        };
+        welded[i] = positionIds.emplace(key, i).first->second;
+        weldCount[welded[i]]++;
+    }
+
+    // Lock the vertices on attribute seams and on open borders
+    std::vector<bool> locked(numVertices, false);
+    for (unsigned int i = 0; i < numVertices; i++) {
+        if (weldCount[welded[i]] > 1)
+            locked[i] = true;
+    }
+    std::map<std::pair<unsigned int, unsigned int>, unsigned int> edgeCount;
+    for (const std::array<unsigned int,3> & tri : triangles) {
+        for (unsigned int k = 0; k < 3; k++) {
+            unsigned int a = welded[tri[k]];
+            unsigned int b = welded[tri[(k+1)%3]];
+            edgeCount[std::make_pair(std::min(a, b), std::max(a, b))]++;
+        }
+    }
+    for (const std::array<unsigned int,3> & tri : triangles) {
+        for (unsigned int k = 0; k < 3; k++) {
+            unsigned int a = welded[tri[k]];
+            unsigned int b = welded[tri[(k+1)%3]];
+            if (edgeCount[std::make_pair(std::min(a, b), std::max(a, b))] == 1) {
+                locked[tri[k]] = true;
+                locked[tri[(k+1)%3]] = true;
+            }
+        }
+    }
+
+    // Compute the size of the mesh to scale the maximum error
+    Vec3 lower = positions[0];
+    Vec3 upper = positions[0];
+    for (const Vec3 & p : positions) {
+        for (unsigned int k = 0; k < 3; k++) {
+            lower[k] = std::min(lower[k], p[k]);
+            upper[k] = std::max(upper[k], p[k]);
+        }
+    }
+    const Vec3 diagonal = {
+        upper[0] - lower[0], upper[1] - lower[1], upper[2] - lower[2]
+    };
+    const double maxCost = dot(diagonal, diagonal) * maxError * maxError;
+
+    // Compute the quadric of each vertex from the plane of its triangles
+    std::vector<Quadric> quadrics(numVertices);
+    std::vector<std::vector<unsigned int>> adjacency(numVertices);
+    for (unsigned int t = 0; t < numTriangles; t++) {
+        const std::array<unsigned int,3> & tri = triangles[t];
+        Vec3 n = triangleNormal(
+            positions[tri[0]], positions[tri[1]], positions[tri[2]]
+        );
+        const double length = std::sqrt(dot(n, n));
+        for (unsigned int k = 0; k < 3; k++)
+            adjacency[tri[k]].push_back(t);
+        if (length == 0.0)
+            continue;
+        n = {n[0] / length, n[1] / length, n[2] / length};
+        const double d = -dot(n, positions[tri[0]]);
+        for (unsigned int k = 0; k < 3; k++)
+            quadrics[tri[k]].addPlane(n, d);
+    }
+
+    // Fill the queue of candidate collapses
+    std::vector<unsigned int> version(numVertices, 0);
+    std::vector<bool> removed(numTriangles, false);
+    std::priority_queue<
+        Collapse, std::vector<Collapse>, std::greater<Collapse>
+    > queue;
+    auto pushCollapse = [&](unsigned int from, unsigned int to) {
+        if (locked[from] || from == to)
+            return;
+        Quadric q = quadrics[from];
+        q += quadrics[to];
+        queue.push({
+            q.evaluate(positions[to]), from, to, version[from], version[to]
+        });
+    };
+    for (const std::array<unsigned int,3> & tri : triangles) {
+        for (unsigned int k = 0; k < 3; k++) {
+            pushCollapse(tri[k], tri[(k+1)%3]);
+            pushCollapse(tri[(k+1)%3], tri[k]);
+        }
+    }
+
+    // Check if moving 'from' onto 'to' flips one of the triangles
+    auto isFlipping = [&](unsigned int from, unsigned int to) {
+        for (unsigned int t : adjacency[from]) {
+            const std::array<unsigned int,3> & tri = triangles[t];
+            if (removed[t] || tri[0] == to || tri[1] == to || tri[2] == to)
+                continue;
+            std::array<Vec3,3> p;
+            for (unsigned int k = 0; k < 3; k++)
+                p[k] = positions[tri[k]];
+            const Vec3 before = triangleNormal(p[0], p[1], p[2]);
+            for (unsigned int k = 0; k < 3; k++) {
+                if (tri[k] == from)
+                    p[k] = positions[to];
+            }
+            const Vec3 after = triangleNormal(p[0], p[1], p[2]);
+            if (dot(before, after) <= 0.0)
+                return true;
+        }
+        return false;
+    };
+
+    // Collapse the edges with the lowest error first
+    const unsigned int target = std::max(
+        1u, static_cast<unsigned int>(ratio * numTriangles)
+    );
+    unsigned int remaining = numTriangles;
+    while (remaining > target && !queue.empty()) {
+        const Collapse c = queue.top();
+        queue.pop();
+        if (c.fromVersion != version[c.from] || c.toVersion != version[c.to])
+            continue;
+        if (c.cost > maxCost)
+            break;
+        if (isFlipping(c.from, c.to))
+            continue;
+
+        // Remove the triangles sharing the edge and move the others
+        for (unsigned int t : adjacency[c.from]) {
+            if (removed[t])
+                continue;
+            std::array<unsigned int,3> & tri = triangles[t];
+            if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+                removed[t] = true;
+                remaining--;
+                continue;
+            }
+            for (unsigned int k = 0; k < 3; k++) {
+                if (tri[k] == c.from)
+                    tri[k] = c.to;
+            }
+            adjacency[c.to].push_back(t);
+        }
+        adjacency[c.from].clear();
+        adjacency[c.to].erase(
+            std::remove_if(
+                adjacency[c.to].begin(), adjacency[c.to].end(),
+                [&](unsigned int t) {return removed[t];}
+            ),
+            adjacency[c.to].end()
+        );
+        quadrics[c.to] += quadrics[c.from];
+        locked[c.from] = true;
+        version[c.from]++;
+        version[c.to]++;
+
+        // Update the candidates around the remaining vertex
+        for (unsigned int t : adjacency[c.to]) {
+            for (unsigned int w : triangles[t]) {
+                pushCollapse(c.to, w);
+                pushCollapse(w, c.to);
+            }
+        }
+    }
+
+    // Write the remaining triangles
+    result.reserve(static_cast<int>(3 * remaining));
+    for (unsigned int t = 0; t < numTriangles; t++) {
+        const std::array<unsigned int,3> & tri = triangles[t];
+        if (removed[t] || welded[tri[0]] == welded[tri[1]] ||
+            welded[tri[1]] == welded[tri[2]] || welded[tri[2]] == welded[tri[0]])
+            continue;
+        for (unsigned int k = 0; k < 3; k++)
+            result.push_back(globalIds[tri[k]]);
+    }
+    return result;
+}
@@ -1,4 +1,24 @@
 #include "../include/object.h"
+#include "../include/gltfloader.h"
+#include "../include/materialtable.h"
+#include "../include/meshoptimizer.h"
+#include "../include/meshsimplifier.h"
+#include "../include/objloader.h"
+#include "../include/renderqueue.h"
+#include "../include/shaderregistry.h"
+#include "../include/tangentgenerator.h"
+#include "../include/vertexformat.h"
+
+#include <cmath>
+#include <limits>
+#include <set>
+
+// Ratio of triangles kept from one LOD to the next one
+static constexpr float LOD_REDUCTION = 0.5f;
+// Stop generating LODs when less than 20% of the triangles can be removed
+static constexpr float LOD_MIN_REDUCTION = 0.8f;
+
+Object::OptimizationStatistics Object::m_statistics;
 
 /***
  *       ____   _      _              _   
@@ -19,233 +39,390 @@ void Object::initialize() {
         return;
     }
     
+    // Get pointer to OpenGL functions
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (!context) {
+        qCritical() << __FILE__ << __LINE__ <<
+            "Requires a valid current OpenGL context. \n" <<
+            "Unable to draw the object.";
+        exit(1);
+    }
+    p_glFunctions = context->versionFunctions<QOpenGLFunctions_4_5_Core>();
+    if (!p_glFunctions) {
+        qCritical() << __FILE__ << __LINE__ <<
+            "Could not obtain required OpenGL context version";
+        exit(1);
+    }
+    p_glFunctions->initializeOpenGLFunctions();
+    
     createShaderPrograms();
+    // The data prepared by the loader is already optimized
+    if (!m_isPrepared)
+        optimizeMeshes();
+    computeBoundingSphere();
+    computeTextureRepeat();
     createBuffers();
-    createAttributes();
     
     m_isInitialized = true;
 }
 
 
-void Object::createShaderPrograms() {
-    p_objectShader = std::make_unique<ObjectShader>(
-        ":/shaders/object.vert", ":/shaders/object.frag"
+void Object::computeBoundingSphere() {
+    const float inf = std::numeric_limits<float>::max();
+    QVector3D lower( inf, inf, inf);
+    QVector3D upper(-inf,-inf,-inf);
+    p_rootNode->expandBoundingBox(
+        QMatrix4x4(), *p_vertices, *p_indices, lower, upper
     );
-    p_shadowShader = std::make_unique<ObjectShadowShader>(
-        ":/shaders/object_shadow.vert", ":/shaders/object_shadow.frag"
+    if (lower.x() > upper.x()) {
+        // Empty object
+        m_boundingCenter = QVector3D();
+        m_boundingRadius = 0.0f;
+        return;
+    }
+    m_boundingCenter = (lower + upper) / 2;
+    m_boundingRadius = (upper - lower).length() / 2;
+}
+
+
+void Object::computeTextureRepeat() {
+    // Range of the texture coordinates, which repeat the textures across the
+    // object when it is larger than 1 (e.g. the roads), the loader computes
+    // it with the prepared data
+    if (!m_isPrepared) {
+        m_textureRepeat = 1.0f;
+        if (p_textureUV != nullptr && !p_textureUV->isEmpty())
+            m_textureRepeat = computeTextureRepeat(p_textureUV->at(0));
+    }
+    
+    // Materials of the meshes, whose textures are requested when drawn
+    std::vector<std::pair<QMatrix4x4, const Mesh *>> meshes;
+    p_rootNode->collectMeshes(QMatrix4x4(), meshes);
+    std::set<const Material *> materials;
+    for (const auto & item : meshes)
+        materials.insert(item.second->getMaterial().get());
+    m_materials.assign(materials.begin(), materials.end());
+}
+
+
+float Object::computeTextureRepeat(const QVector<float> & textureUV) {
+    const float inf = std::numeric_limits<float>::max();
+    float lower[2] = { inf, inf};
+    float upper[2] = {-inf,-inf};
+    for (int i = 0; i + 1 < textureUV.size(); i += 2) {
+        for (int j = 0; j < 2; j++) {
+            lower[j] = std::min(lower[j], textureUV.at(i+j));
+            upper[j] = std::max(upper[j], textureUV.at(i+j));
+        }
+    }
+    if (lower[0] > upper[0])
+        return 1.0f;
+    return std::max(1.0f, std::max(upper[0] - lower[0], upper[1] - lower[1]));
+}
+
+
+float Object::getScreenSize(
+    const QMatrix4x4 & viewProjection, const QMatrix4x4 & model
+) const {
+    // Largest scale factor of the model matrix
+    float scale = std::max(
+        model.column(0).toVector3D().length(), std::max(
+        model.column(1).toVector3D().length(),
+        model.column(2).toVector3D().length())
     );
+    
+    // Radius of the bounding sphere projected in normalized device coordinates.
+    // The norm of the second row gives the vertical scale of the projection 
+    // for both perspective and orthographic projections.
+    QVector4D center = viewProjection * model * 
+        QVector4D(m_boundingCenter, 1.0f);
+    return m_boundingRadius * scale * 
+        viewProjection.row(1).toVector3D().length() / 
+        std::max(std::abs(center.w()), 1e-4f);
 }
 
 
-void Object::createBuffers() {
-    // Create a vertex array object
-    m_vao.create();
-    m_vao.bind();
-
-    // Create a buffer and copy the vertex data to it
-    m_vertexBuffer.create();
-    m_vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    m_vertexBuffer.bind();
-    m_vertexBuffer.allocate(
-        &(*p_vertices)[0],
-        p_vertices->size() * sizeof(float)
+void Object::requestTextures(
+    const QMatrix4x4 & viewProjection, const QMatrix4x4 & model
+) const {
+    // Each repetition of the textures covers a part of the diameter of the
+    // object on the screen
+    const float size = 
+        2.0f * getScreenSize(viewProjection, model) / m_textureRepeat;
+    for (const Material * material : m_materials) {
+        TextureManager::requestResolution(material->getDiffuseTexture(), size);
+        TextureManager::requestResolution(material->getNormalTexture(), size);
+        TextureManager::requestResolution(material->getBumpTexture(), size);
+    }
+}
+
+
+unsigned int Object::selectLod(
+    const QMatrix4x4 & viewProjection, const QMatrix4x4 & model
+) const {
+    const float size = getScreenSize(viewProjection, model);
+    unsigned int lod = 0;
+    while (lod < NUM_LODS - 1 && size < LOD_SCREEN_SIZE[lod])
+        lod++;
+    return lod;
+}
+
+
+bool Object::isVisible(
+    const QMatrix4x4 & viewProjection, const QMatrix4x4 & model
+) const {
+    // Extract the planes of the frustum in the model coordinates from the 
+    // rows of the model-view-projection matrix
+    const QMatrix4x4 mvp = viewProjection * model;
+    const QVector4D center(m_boundingCenter, 1.0f);
+    for (int i = 0; i < 3; i++) {
+        for (float sign : {-1.0f, 1.0f}) {
+            QVector4D plane = mvp.row(3) + sign * mvp.row(i);
+            float length = plane.toVector3D().length();
+            if (QVector4D::dotProduct(plane, center) < -m_boundingRadius * length)
+                return false;
+        }
+    }
+    return true;
+}
+
+
+void Object::optimizeMeshes() {
+    std::vector<std::pair<QMatrix4x4, const Mesh *>> meshes;
+    p_rootNode->collectMeshes(QMatrix4x4(), meshes);
+    
+    // Levels of detail of each mesh, once
+    std::set<const Mesh *> optimized;
+    std::vector<std::vector<unsigned int>> lods;
+    for (const auto & item : meshes) {
+        const Mesh * mesh = item.second;
+        if (!optimized.insert(mesh).second)
+            continue;
+        lods.emplace_back();
+        for (const Mesh::Lod & lod : mesh->getLods()) {
+            lods.back().push_back(lod.count);
+            lods.back().push_back(lod.offset);
+        }
+    }
+    optimizeMeshes(lods, *p_vertices, *p_normals, *p_textureUV, *p_indices, 
+                   *p_tangents, *p_bitangents);
+}
+
+
+Object::OptimizationStatistics Object::optimizeMeshes(
+    const std::vector<std::vector<unsigned int>> & lods, 
+    QVector<float> & vertices, QVector<float> & normals, 
+    QVector<QVector<float>> & textureUV, QVector<unsigned int> & indices, 
+    QVector<float> & tangents, QVector<float> & bitangents
+) {
+    // Reorder the triangles of each level of detail in place, the ACMR is
+    // measured on the full detail of the meshes
+    OptimizationStatistics statistics;
+    for (const std::vector<unsigned int> & meshLods : lods) {
+        for (size_t i = 0; i + 1 < meshLods.size(); i += 2) {
+            const unsigned int count = meshLods[i];
+            const unsigned int offset = meshLods[i+1];
+            if (offset + count > static_cast<unsigned int>(indices.size()))
+                continue;
+            const bool isFullDetail = (i == 0);
+            if (isFullDetail) {
+                statistics.acmrBefore += (count / 3) * static_cast<double>(
+                    MeshOptimizer::computeAcmr(indices.data() + offset, count)
+                );
+            }
+            MeshOptimizer::optimizeVertexCache(indices.data() + offset, count);
+            MeshOptimizer::optimizeOverdraw(indices.data() + offset, count, 
+                                            vertices);
+            if (isFullDetail) {
+                statistics.acmrAfter += (count / 3) * static_cast<double>(
+                    MeshOptimizer::computeAcmr(indices.data() + offset, count)
+                );
+                statistics.numTriangles += count / 3;
+            }
+        }
+    }
+    if (statistics.numTriangles > 0) {
+        statistics.acmrBefore /= statistics.numTriangles;
+        statistics.acmrAfter /= statistics.numTriangles;
+    }
+    statistics.numModels = 1;
+    
+    // Renumber the vertices in their order of use and reorder all the vertex
+    // attributes accordingly
+    const std::vector<unsigned int> remap = MeshOptimizer::optimizeVertexFetch(
+        indices, static_cast<unsigned int>(vertices.size() / 3)
     );
+    MeshOptimizer::remapVertexStream(vertices, remap);
+    MeshOptimizer::remapVertexStream(normals, remap);
+    for (int i = 0; i < textureUV.size(); i++)
+        MeshOptimizer::remapVertexStream(textureUV[i], remap);
+    MeshOptimizer::remapVertexStream(tangents, remap);
+    MeshOptimizer::remapVertexStream(bitangents, remap);
+    
+    return statistics;
+}
+
+
+void Object::addStatistics(const OptimizationStatistics & statistics) {
+    const double total = m_statistics.numTriangles + statistics.numTriangles;
+    if (total > 0) {
+        m_statistics.acmrBefore = 
+            (m_statistics.acmrBefore * m_statistics.numTriangles + 
+             statistics.acmrBefore * statistics.numTriangles) / total;
+        m_statistics.acmrAfter = 
+            (m_statistics.acmrAfter * m_statistics.numTriangles + 
+             statistics.acmrAfter * statistics.numTriangles) / total;
+    }
+    m_statistics.numTriangles += statistics.numTriangles;
+    m_statistics.numModels += statistics.numModels;
+}
+
+
+void Object::reportOptimization() {
+    if (m_statistics.numTriangles > 0) {
+        qDebug() << "Mesh optimization: ACMR" << m_statistics.acmrBefore 
+            << "->" << m_statistics.acmrAfter << "over" 
+            << m_statistics.numTriangles << "triangles of" 
+            << m_statistics.numModels << "models";
+    }
+    m_statistics = OptimizationStatistics();
+}
 
-    // Create a buffer and copy the vertex data to it
-    m_normalBuffer.create();
-    m_normalBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    m_normalBuffer.bind();
-    m_normalBuffer.allocate(
-        &(*p_normals)[0], 
-        p_normals->size() * sizeof(float)
+
+void Object::createShaderPrograms() {
+    // The programs are shared by all the objects
+    p_objectShader = ShaderRegistry::getShader<ObjectShader>(
+        ":/shaders/object.vert", ":/shaders/object.frag"
     );
+    p_shadowShader = ShaderRegistry::getShader<ObjectShadowShader>(
+        ":/shaders/object_shadow.vert", ":/shaders/object_shadow.frag",
+        QStringList(ObjectShadowShader::getLayerDefine())
+    );
+}
 
-    // Create a buffer and copy the vertex data to it
-    if (p_textureUV != nullptr && p_textureUV->size() != 0) {
-        m_textureUVBuffer.create();
-        m_textureUVBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-        m_textureUVBuffer.bind();
-        int texSize = 0;
-        for (int i = 0; i < p_textureUV->size(); i++)
-            texSize += p_textureUV->at(i).size();
-        m_textureUVBuffer.allocate(
-            &(*p_textureUV)[0][0], 
-            texSize * sizeof(float)
+
+void Object::createBuffers() {
+    // Interleave and compress the vertex data and pack the indices of each
+    // mesh, unless the loader has prepared them
+    if (!m_isPrepared) {
+        QVector<float> textureUV;
+        if (p_textureUV != nullptr && p_textureUV->size() != 0)
+            textureUV = p_textureUV->at(0);
+        m_halfTextureUV = VertexFormat::isHalfTextureUV(textureUV);
+        m_vertexData = VertexFormat::interleave(
+            *p_vertices, *p_normals, textureUV, *p_tangents, *p_bitangents, 
+            m_halfTextureUV
         );
+        
+        std::vector<std::pair<QMatrix4x4, const Mesh *>> meshes;
+        p_rootNode->collectMeshes(QMatrix4x4(), meshes);
+        std::set<const Mesh *> packed;
+        for (const auto & item : meshes) {
+            const Mesh * mesh = item.second;
+            if (!packed.insert(mesh).second)
+                continue;
+            std::vector<unsigned int> lods;
+            for (const Mesh::Lod & lod : mesh->getLods()) {
+                lods.push_back(lod.count);
+                lods.push_back(lod.offset);
+            }
+            IndexLayout layout;
+            layout.mesh = mesh;
+            packIndices(*p_indices, lods, m_indexData, layout);
+            m_layouts.push_back(std::move(layout));
+        }
     }
 
-    // Create a buffer and copy the index data to it
-    m_indexBuffer.create();
-    m_indexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    m_indexBuffer.bind();
-    m_indexBuffer.allocate(
-        &(*p_indices)[0], 
-        p_indices->size() * sizeof(unsigned int)
-    );
-    
-    // Create a buffer and copy the tangent data to it
-    m_tangentBuffer.create();
-    m_tangentBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    m_tangentBuffer.bind();
-    m_tangentBuffer.allocate(
-        &(*p_tangents)[0],
-        p_tangents->size() * sizeof(float)
+    // Copy the vertex and index data to the geometry heap, the meshes draw 
+    // their indices relative to the range of the object
+    p_allocation = GeometryHeap::allocate(
+        m_halfTextureUV, m_vertexData, m_indexData
     );
+    for (const IndexLayout & layout : m_layouts) {
+        layout.mesh->setIndexLayout(
+            p_allocation, layout.type, layout.baseVertex, layout.byteOffsets
+        );
+    }
     
-    // Create a buffer and copy the bitangent data to it
-    m_bitangentBuffer.create();
-    m_bitangentBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    m_bitangentBuffer.bind();
-    m_bitangentBuffer.allocate(
-        &(*p_bitangents)[0],
-        p_bitangents->size() * sizeof(float)
-    );
+    // Add the materials to the table read by the shaders, the draws only
+    // give the index of their material
+    for (const IndexLayout & layout : m_layouts) {
+        layout.mesh->setMaterialIndex(
+            MaterialTable::add(*layout.mesh->getMaterial())
+        );
+    }
     
-    // Free the buffer data
+    // Free the buffer data and unmap the cache entry
     p_vertices.reset();
     p_normals.reset();
     p_textureUV.reset();
     p_indices.reset();
     p_tangents.reset();
     p_bitangents.reset();
+    m_vertexData = QByteArray();
+    m_indexData = QByteArray();
+    m_layouts.clear();
+    p_entryFile.reset();
 }
 
 
-void Object::createAttributes() {
-    m_vao.bind();
-    
-    // Set up attribute for the shader used for shadow mapping
-    p_shadowShader->bind();
-    
-    // Map vertex data to the vertex shader layout location '0'
-    m_vertexBuffer.bind();
-    p_shadowShader->enableAttributeArray(0);       // layout location
-    p_shadowShader->setAttributeBuffer(0,          // layout location
-                                       GL_FLOAT,   // data type
-                                       0,          // Offset to data in buffer
-                                       3);         // number of components
-    
-    // Set up the vertex array state
-    p_objectShader->bind();
-
-    // Map vertex data to the vertex shader layout location '0'
-    m_vertexBuffer.bind();
-    p_objectShader->enableAttributeArray(0);       // layout location
-    p_objectShader->setAttributeBuffer(0,          // layout location
-                                       GL_FLOAT,   // data type
-                                       0,          // Offset to data in buffer
-                                       3);         // number of components
-
-    // Map normal data to the vertex shader layout location '1'
-    m_normalBuffer.bind();
-    p_objectShader->enableAttributeArray(1);       // layout location
-    p_objectShader->setAttributeBuffer(1,          // layout location
-                                       GL_FLOAT,   // data type
-                                       0,          // Offset to data in buffer
-                                       3);         // number of components
-
-    // Map texture data to the vertex shader layout location '2'
-    if(m_textureUVBuffer.isCreated()) {
-        m_textureUVBuffer.bind();
-        p_objectShader->enableAttributeArray(2);    // layout location
-        p_objectShader->setAttributeBuffer(2,       // layout location
-                                        GL_FLOAT,   // data type
-                                        0,          // Offset to data in buffer
-                                        2);         // number of components
-    }
-    
-    // Map tangent data to the vertex shader layout location '3'
-    m_tangentBuffer.bind();
-    p_objectShader->enableAttributeArray(3);       // layout location
-    p_objectShader->setAttributeBuffer(3,          // layout location
-                                       GL_FLOAT,   // data type
-                                       0,          // Offset to data in buffer
-                                       3);         // number of components
-    
-    // Map bitangent data to the vertex shader layout location '4'
-    m_bitangentBuffer.bind();
-    p_objectShader->enableAttributeArray(4);       // layout location
-    p_objectShader->setAttributeBuffer(4,          // layout location
-                                       GL_FLOAT,   // data type
-                                       0,          // Offset to data in buffer
-                                       3);         // number of components
-}
-
-
-void Object::getTangentsAndBitangents(
-    const QVector<float> & vertices, 
-    const QVector<QVector<float>> & textureUV,
+void Object::packIndices(
     const QVector<unsigned int> & indices, 
-    QVector<float> & tangents,
-    QVector<float> & bitangents
+    const std::vector<unsigned int> & lods, QByteArray & indexData, 
+    IndexLayout & layout
 ) {
-    const unsigned int numTriangles = indices.size() / 3;
-    const unsigned int numVertices = vertices.size() / 3;
-    tangents   = QVector<float>(3 * numVertices);
-    bitangents = QVector<float>(3 * numVertices);
-    for (unsigned int i = 0; i < numTriangles; i++) {
-        // Indices of the triangle vertices
-        unsigned int i0 = indices.at(3*i);
-        unsigned int i1 = indices.at(3*i+1);
-        unsigned int i2 = indices.at(3*i+2);
-        // Position of the triangle vertices
-        QVector<float> pos0 = vertices.mid(3*i0,3);
-        QVector<float> pos1 = vertices.mid(3*i1,3);
-        QVector<float> pos2 = vertices.mid(3*i2,3);
-        // Texture coordinates of the triangle vertices
-        QVector<float> tex0 = textureUV.at(0).mid(2*i0,2);
-        QVector<float> tex1 = textureUV.at(0).mid(2*i1,2);
-        QVector<float> tex2 = textureUV.at(0).mid(2*i2,2);
-        // Compute edges
-        QVector3D edge1 = QVector3D(
-            pos1[0] - pos0[0], pos1[1] - pos0[1], pos1[2] - pos0[2]
-        );
-        QVector3D edge2 = QVector3D(
-            pos2[0] - pos0[0], pos2[1] - pos0[1], pos2[2] - pos0[2]
-        );
-        QVector2D uv1 = QVector2D(tex1[0] - tex0[0], tex1[1] - tex0[1]);
-        QVector2D uv2 = QVector2D(tex2[0] - tex0[0], tex2[1] - tex0[1]);
-        // Compute the tangent and bitangent of the triangle
-        float r = 1.0f / (uv1.x() * uv2.y() - uv2.x() * uv1.y());
-        QVector3D tangent = r * QVector3D(
-            edge1.x() * uv2.y() - edge2.x() * uv1.y(),
-            edge1.y() * uv2.y() - edge2.y() * uv1.y(),
-            edge1.z() * uv2.y() - edge2.z() * uv1.y()
-        );
-        tangent.normalize();
-        QVector3D bitangent = r * QVector3D(
-            -edge1.x() * uv2.x() + edge2.x() * uv1.x(),
-            -edge1.y() * uv2.x() + edge2.y() * uv1.x(),
-            -edge1.z() * uv2.x() + edge2.z() * uv1.x()
-        );
-        bitangent.normalize();
-        // Add tangent and bitangent to the buffer data
-        tangents[3*i0  ] = tangent.x();
-        tangents[3*i0+1] = tangent.y();
-        tangents[3*i0+2] = tangent.z();
-        tangents[3*i1  ] = tangent.x();
-        tangents[3*i1+1] = tangent.y();
-        tangents[3*i1+2] = tangent.z();
-        tangents[3*i2  ] = tangent.x();
-        tangents[3*i2+1] = tangent.y();
-        tangents[3*i2+2] = tangent.z();
-        bitangents[3*i0  ] = bitangent.x();
-        bitangents[3*i0+1] = bitangent.y();
-        bitangents[3*i0+2] = bitangent.z();
-        bitangents[3*i1  ] = bitangent.x();
-        bitangents[3*i1+1] = bitangent.y();
-        bitangents[3*i1+2] = bitangent.z();
-        bitangents[3*i2  ] = bitangent.x();
-        bitangents[3*i2+1] = bitangent.y();
-        bitangents[3*i2+2] = bitangent.z();
+    unsigned int lower = std::numeric_limits<unsigned int>::max();
+    unsigned int upper = 0;
+    for (size_t k = 0; k + 1 < lods.size(); k += 2) {
+        for (unsigned int i = lods[k+1]; i < lods[k+1] + lods[k]; i++) {
+            lower = std::min(lower, indices.at(static_cast<int>(i)));
+            upper = std::max(upper, indices.at(static_cast<int>(i)));
+        }
     }
+    if (lower > upper)
+        lower = upper = 0;
+    const bool isShort = 
+        upper - lower <= std::numeric_limits<unsigned short>::max();
+    const int size = isShort ? sizeof(unsigned short) : sizeof(unsigned int);
+    
+    // Align the indices of the mesh on their size
+    indexData.append(
+        QByteArray((size - indexData.size() % size) % size, '\0')
+    );
+    layout.byteOffsets.clear();
+    for (size_t k = 0; k + 1 < lods.size(); k += 2) {
+        layout.byteOffsets.push_back(static_cast<size_t>(indexData.size()));
+        for (unsigned int i = lods[k+1]; i < lods[k+1] + lods[k]; i++) {
+            const unsigned int index = indices.at(static_cast<int>(i));
+            if (isShort) {
+                const unsigned short local = 
+                    static_cast<unsigned short>(index - lower);
+                indexData.append(reinterpret_cast<const char *>(&local), size);
+            }
+            else {
+                indexData.append(reinterpret_cast<const char *>(&index), size);
+            }
+        }
+    }
+    layout.type = isShort ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    layout.baseVertex = isShort ? static_cast<GLint>(lower) : 0;
+}
+
+
+void Object::setPreparedData(MeshCache::Entry & entry, 
+                             std::vector<IndexLayout> layouts) {
+    m_isPrepared = true;
+    m_halfTextureUV = entry.halfTextureUV;
+    m_textureRepeat = entry.textureRepeat;
+    m_vertexData = std::move(entry.vertexData);
+    m_indexData = std::move(entry.indexData);
+    m_layouts = std::move(layouts);
+    p_entryFile = std::move(entry.file);
 }
 
 
 void Object::render(
-    const CasterLight & light, const QMatrix4x4 & view, 
-    const QMatrix4x4 & projection, const QMatrix4x4 lightSpace[], 
-    const std::array<float,NUM_CASCADES+1> * cascades, ObjectShader * shader
+    const QMatrix4x4 & view, ObjectShader * shader, unsigned int lod
 )  {
     // If the model is not correctly loaded, do nothing
     if (m_error)
@@ -258,58 +435,54 @@ void Object::render(
         exit(1);
     }
     
-    // Bind shader program
-    shader->bind();
-
-    // Set light shader uniform
-    shader->setLightUniforms(light, view);
-    
-    // Set cascade uniform
-    if (cascades != nullptr)
-        shader->setCascadeUniforms(*cascades);
-
-    // Bind VAO and draw everything
-    m_vao.bind();
-    
-    // Draw opaque node
-    MeshesToDrawLater tMeshes;
-    p_rootNode->drawNode(
-        m_model, view, projection, lightSpace, tMeshes, shader
-    );
-    
-    // Draw transparent nodes from farthest to closest
-    for (
-        MeshesToDrawLater::reverse_iterator it = tMeshes.rbegin(); 
-        it != tMeshes.rend(); it++
-    ) {
-        if (it->second.second != nullptr) {
-            shader->setMatrixUniforms(
-                it->second.first, view, projection, lightSpace
-            );
-            it->second.second->drawMesh(shader);
-        }
-    }
-    m_vao.release();
+    // Queue the meshes, the camera and the light are given by the uniform
+    // buffer of the pass. The object is drawn on its own if the queue is not
+    // collecting the meshes of a pass.
+    const bool drawNow = !RenderQueue::isOpen();
+    if (drawNow)
+        RenderQueue::open();
+    QVector3D cameraPosition(view.inverted().column(3));
+    p_rootNode->queueNode(m_model, cameraPosition, shader, m_halfTextureUV, 
+                          lod);
+    if (drawNow)
+        RenderQueue::flush();
 }
 
 
 void Object::render(
-    const CasterLight & light, const QMatrix4x4 & view, 
+    const CasterLight & /*light*/, const QMatrix4x4 & view, 
     const QMatrix4x4 & projection, 
-    const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace, 
-    const std::array<float,NUM_CASCADES+1> & cascades
+    const std::array<QMatrix4x4,NUM_CASCADES> & /*lightSpace*/, 
+    const std::array<float,NUM_CASCADES+1> & /*cascades*/
 ) {
-    render(
-        light, view, projection, lightSpace.data(), &cascades, 
-        p_objectShader.get()
-    );
+    // Skip the objects outside of the view frustum
+    if (m_isInitialized && !isVisible(projection * view, m_model))
+        return;
+    
+    if (m_isInitialized)
+        requestTextures(projection * view, m_model);
+    render(view, p_objectShader.get(), selectLod(projection * view, m_model));
 }
 
 
-void Object::renderShadow(const QMatrix4x4 & lightSpace) {
+void Object::renderShadow(
+    const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace
+) {
+    // Skip the objects outside of the frustum of all the cascades, the LOD 
+    // is selected in the finest cascade containing the object
+    unsigned int cascade = 0;
+    if (m_isInitialized) {
+        while (cascade < NUM_CASCADES && 
+               !isVisible(lightSpace[cascade], m_model))
+            cascade++;
+        if (cascade == NUM_CASCADES)
+            return;
+    }
+    
+    // The meshes are instanced once per cascade by the shadow shader
     render(
-        CasterLight(), QMatrix4x4(), QMatrix4x4(), &lightSpace, nullptr, 
-        p_shadowShader.get()
+        QMatrix4x4(), p_shadowShader.get(), 
+        selectLod(lightSpace[cascade], m_model) + m_shadowLodBias
     );
 }
 
@@ -318,6 +491,20 @@ void Object::cleanUp() {
     // If the model is not correctly loaded, do nothing
     if(m_error)
         return;
+    
+    // Release the range of the geometry heap
+    if (m_isInitialized) {
+        std::vector<std::pair<QMatrix4x4, const Mesh *>> meshes;
+        p_rootNode->collectMeshes(QMatrix4x4(), meshes);
+        for (const auto & item : meshes) {
+            item.second->setIndexLayout(
+                nullptr, GL_UNSIGNED_INT, 0, std::vector<size_t>()
+            );
+        }
+        GeometryHeap::release(p_allocation);
+        p_allocation = nullptr;
+        m_isInitialized = false;
+    }
 }
 
 
@@ -333,10 +520,9 @@ void Object::cleanUp() {
  *                                
  */
 
-void Object::Node::drawNode(
-    const QMatrix4x4 & model, const QMatrix4x4 & view, 
-    const QMatrix4x4 & projection, const QMatrix4x4 lightSpace[],
-    Object::MeshesToDrawLater& drawLaterMeshes, ObjectShader* objectShader
+void Object::Node::queueNode(
+    const QMatrix4x4 & model, const QVector3D & cameraPosition, 
+    ObjectShader * objectShader, bool halfTextureUV, unsigned int lod
 ) const {
     if (!objectShader) {
         qWarning() << __FILE__ << __LINE__ <<
@@ -344,44 +530,84 @@ void Object::Node::drawNode(
         return;
     }
     
-    // Compute model matrix of the node and set uniforms
+    // Compute model matrix of the node
+    QMatrix4x4 object = model * m_transformation;
+    
+    // Queue the meshes of the node, the queue draws the opaque meshes sorted
+    // by state and the transparent ones from farthest to closest
+    QVector3D nodePosition(object * QVector3D(0.0f, 0.0f, 0.0f));
+    float distance(cameraPosition.distanceToPoint(nodePosition));
+    for (unsigned int i = 0; i < m_meshes.size(); i++) {
+        RenderQueue::add(
+            objectShader, m_meshes[i].get(), object, halfTextureUV, lod, 
+            distance
+        );
+    }
+    
+    // Queue the children recursively
+    for (unsigned int i = 0; i < m_children.size(); i++) {
+        m_children[i]->queueNode(
+            object, cameraPosition, objectShader, halfTextureUV, lod
+        );
+    }
+}
+
+
+void Object::Node::expandBoundingBox(
+    const QMatrix4x4 & model, const QVector<float> & vertices, 
+    const QVector<unsigned int> & indices, QVector3D & lower, QVector3D & upper
+) const {
     QMatrix4x4 object = model * m_transformation;
-    objectShader->setMatrixUniforms(object, view, projection, lightSpace);
     
-    // Draw the meshes of the node
     for (unsigned int i = 0; i < m_meshes.size(); i++) {
-        // Check if the mesh is opaque or transparent
-        if (m_meshes[i]->isOpaque()) {
-            // Draw now
-            m_meshes[i]->drawMesh(objectShader);
+        // Bounding box of the mesh in the node coordinates
+        const Mesh::Lod & range = m_meshes[i]->getFullDetail();
+        if (range.count == 0)
+            continue;
+        const float inf = std::numeric_limits<float>::max();
+        QVector3D meshLower( inf, inf, inf);
+        QVector3D meshUpper(-inf,-inf,-inf);
+        for (unsigned int k = range.offset; k < range.offset + range.count; k++) {
+            const int v = 3 * static_cast<int>(indices.at(k));
+            for (int j = 0; j < 3; j++) {
+                meshLower[j] = std::min(meshLower[j], vertices.at(v+j));
+                meshUpper[j] = std::max(meshUpper[j], vertices.at(v+j));
+            }
         }
-        else {
-            // Store the mesh in the container to draw it later
-            QVector3D objectPosition(object * QVector3D(0.0f, 0.0f, 0.0f));
-            QVector3D cameraPosition(view.inverted().column(3));
-            float distance(cameraPosition.distanceToPoint(objectPosition));
-            
-            // Add the info on the mesh to the map to draw it later
-            drawLaterMeshes.insert(
-                std::make_pair(
-                    distance,                   // Key of the map
-                    std::make_pair(             // Mesh and model matrix
-                        object, m_meshes[i].get()
-                    )
-                )
+        
+        // Transform the corners of the box in the object coordinates
+        for (int c = 0; c < 8; c++) {
+            QVector3D corner(
+                (c & 1) ? meshUpper.x() : meshLower.x(),
+                (c & 2) ? meshUpper.y() : meshLower.y(),
+                (c & 4) ? meshUpper.z() : meshLower.z()
             );
+            corner = object * corner;
+            for (int j = 0; j < 3; j++) {
+                lower[j] = std::min(lower[j], corner[j]);
+                upper[j] = std::max(upper[j], corner[j]);
+            }
         }
     }
     
-    // Draw the children recursively
     for (unsigned int i = 0; i < m_children.size(); i++) {
-        m_children[i]->drawNode(
-            object, view, projection, lightSpace, drawLaterMeshes, objectShader
-        );
+        m_children[i]->expandBoundingBox(object, vertices, indices, lower, upper);
     }
 }
 
 
+void Object::Node::collectMeshes(
+    const QMatrix4x4 & model, 
+    std::vector<std::pair<QMatrix4x4, const Mesh *>> & meshes
+) const {
+    QMatrix4x4 object = model * m_transformation;
+    for (unsigned int i = 0; i < m_meshes.size(); i++)
+        meshes.push_back(std::make_pair(object, m_meshes[i].get()));
+    for (unsigned int i = 0; i < m_children.size(); i++)
+        m_children[i]->collectMeshes(object, meshes);
+}
+
+
 
 /***
  *      __  __             _     
@@ -394,33 +620,32 @@ void Object::Node::drawNode(
  *                               
  */
 
-#include <QOpenGLFunctions>
+bool Object::Mesh::getDrawRange(
+    unsigned int lod, GLenum & type, GLsizei & count, size_t & byteOffset,
+    GLint & baseVertex
+) const {
+    if (p_allocation == nullptr)
+        return false;
+    const size_t level = std::min<size_t>(lod, m_lods.size() - 1);
+    const Lod & range = m_lods.at(level);
+    type = m_indexType;
+    count = static_cast<GLsizei>(range.count);
+    byteOffset = p_allocation->indexOffset + 
+        (level < m_byteOffsets.size() ? 
+         m_byteOffsets[level] : range.offset * sizeof(unsigned int));
+    baseVertex = p_allocation->firstVertex + m_baseVertex;
+    return true;
+}
 
-void Object::Mesh::drawMesh(ObjectShader * objectShader) const {
-    if (!objectShader) {
-        qWarning() << __FILE__ << __LINE__ <<
-             "The pointer to the shader is null.";
-        return;
-    }
-    QOpenGLContext * context = QOpenGLContext::currentContext();
-    if (!context) {
-        qWarning() << __FILE__ << __LINE__ <<
-                      "Requires a valid current OpenGL context. \n" <<
-                      "Unable to draw the object.";
-        return;
-    }
-    QOpenGLFunctions * glFunctions = context->functions();
-    
-    // Set material uniforms in OpenGL
-    objectShader->setMaterialUniforms(*m_material);
-    
-    // Draw the mesh
-    glFunctions->glDrawElements(
-        GL_TRIANGLES,
-        static_cast<GLsizei>(m_indexCount),
-        GL_UNSIGNED_INT,
-        reinterpret_cast<const void*>(m_indexOffset * sizeof(unsigned int))
-    );
+
+void Object::Mesh::setIndexLayout(
+    const GeometryHeap::Allocation * allocation, GLenum type, GLint baseVertex,
+    std::vector<size_t> byteOffsets
+) const {
+    p_allocation = allocation;
+    m_indexType = type;
+    m_baseVertex = baseVertex;
+    m_byteOffsets = std::move(byteOffsets);
 }
 
 
@@ -449,6 +674,7 @@ void Object::Mesh::drawMesh(ObjectShader * objectShader) const {
  */
 
 #include <QFile>
+#include <QFileInfo>
 #include <QDir>
 
 std::unique_ptr<Object> Object::Loader::getObject() {
@@ -468,14 +694,49 @@ bool Object::Loader::build() {
             << "The directory" << m_textureDir << "does not exist.";
     }
     
+    // Read the processed model from the cache, or import it with Assimp and
+    // store it in the cache for the next runs
+    const unsigned int flags = 
+        aiProcess_GenSmoothNormals |
+        aiProcess_CalcTangentSpace |
+        aiProcess_Triangulate |
+        aiProcess_JoinIdenticalVertices |
+        aiProcess_SortByPType;
+    const QString key = MeshCache::computeKey(m_filePath, m_textureDir, flags);
+    MeshCache::Entry entry;
+    if (!MeshCache::load(key, entry)) {
+        // The Wavefront OBJ and glTF files are parsed natively, Assimp is used
+        // for the other formats and as a fallback
+        const QString suffix = QFileInfo(m_filePath).suffix().toLower();
+        bool isLoaded = false;
+        if (suffix == "obj")
+            isLoaded = ObjLoader::load(m_filePath, m_textureDir, entry);
+        else if (suffix == "glb" || suffix == "gltf")
+            isLoaded = GltfLoader::load(m_filePath, entry);
+        if (!isLoaded) {
+            entry = MeshCache::Entry();
+            if (!import(flags, entry))
+                return false;
+        }
+        generateLods(entry);
+        prepareBuffers(entry);
+        MeshCache::save(key, entry);
+    }
+    OptimizationStatistics statistics;
+    statistics.acmrBefore = entry.acmrBefore;
+    statistics.acmrAfter = entry.acmrAfter;
+    statistics.numTriangles = entry.numTriangles;
+    statistics.numModels = 1;
+    addStatistics(statistics);
+    
+    return buildObject(entry);
+}
+
+
+bool Object::Loader::import(unsigned int flags, MeshCache::Entry & entry) {
     // Load the model with Assimp
     Assimp::Importer importer;
-    const aiScene * scene = importer.ReadFile(m_filePath.toStdString(),
-            aiProcess_GenSmoothNormals |
-            aiProcess_CalcTangentSpace |
-            aiProcess_Triangulate |
-            aiProcess_JoinIdenticalVertices |
-            aiProcess_SortByPType);
+    const aiScene * scene = importer.ReadFile(m_filePath.toStdString(), flags);
     
     if (!scene) {
         qDebug() << __FILE__ << __LINE__ <<"Error loading file: (assimp:) " <<
@@ -484,32 +745,18 @@ bool Object::Loader::build() {
     }
     
     // Process the materials of the model
-    std::vector<std::shared_ptr<const Material>> materials;
     if (scene->HasMaterials()) {
         for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
-            materials.push_back(
+            entry.materials.push_back(
                 processMaterial(scene->mMaterials[i], m_textureDir)
             );
         }
     }
     
     // Process the meshes
-    std::vector<std::shared_ptr<const Mesh>> meshes;
-    std::unique_ptr<QVector<float>> vertices;
-    std::unique_ptr<QVector<float>> normals;
-    std::unique_ptr<QVector<QVector<float>>> textureUV;
-    std::unique_ptr<QVector<unsigned int>> indices;
-    std::unique_ptr<QVector<float>> tangents;
-    std::unique_ptr<QVector<float>> bitangents;
     if (scene->HasMeshes()) {
-        for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
-            meshes.push_back(
-                processMesh(
-                    scene->mMeshes[i], materials,
-                    vertices, normals, textureUV, indices, tangents, bitangents
-                )
-            );
-        }
+        for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+            processMesh(scene->mMeshes[i], entry);
     }
     else {
         qDebug() << "Error while loading the model: no meshes found.";
@@ -522,36 +769,157 @@ bool Object::Loader::build() {
     }
     
     // Process the nodes
-    std::unique_ptr<const Node> rootNode;
     if (scene->mRootNode != nullptr) {
-        rootNode = processNode(scene->mRootNode, scene, meshes);
+        processNode(scene->mRootNode, entry);
     }
     else {
         qDebug() << "Error while loading the model.";
         return false;
     }
-    // Build the object
+    
+    return true;
+}
+
+
+bool Object::Loader::buildObject(MeshCache::Entry & entry) {
+    // Create the materials
+    std::vector<std::shared_ptr<const Material>> materials;
+    for (const MeshCache::MaterialRecord & material : entry.materials)
+        materials.push_back(createMaterial(material));
+    
+    // Create the meshes
+    std::vector<std::shared_ptr<const Mesh>> meshes;
+    for (const MeshCache::MeshRecord & mesh : entry.meshes) {
+        std::vector<Mesh::Lod> lods;
+        for (size_t i = 0; i + 1 < mesh.lods.size(); i += 2)
+            lods.push_back({mesh.lods[i], mesh.lods[i+1]});
+        meshes.push_back(std::make_shared<Mesh>(
+            mesh.name, lods, materials.at(mesh.material)
+        ));
+    }
+    
+    // Create the node tree
+    if (entry.nodes.empty()) {
+        qDebug() << "Error while loading the model.";
+        return false;
+    }
+    size_t index = 0;
+    std::unique_ptr<const Node> rootNode = createNode(entry, meshes, index);
+    
+    // Layout of the indices of the meshes of the tree
+    std::vector<std::pair<QMatrix4x4, const Mesh *>> nodeMeshes;
+    rootNode->collectMeshes(QMatrix4x4(), nodeMeshes);
+    std::set<const Mesh *> used;
+    for (const auto & item : nodeMeshes)
+        used.insert(item.second);
+    std::vector<IndexLayout> layouts;
+    for (size_t i = 0; i < entry.meshes.size(); i++) {
+        const MeshCache::MeshRecord & mesh = entry.meshes[i];
+        if (used.count(meshes[i].get()) == 0)
+            continue;
+        layouts.push_back({
+            meshes[i].get(), mesh.indexType, 
+            static_cast<GLint>(mesh.baseVertex), 
+            std::vector<size_t>(mesh.byteOffsets.begin(), 
+                                mesh.byteOffsets.end())
+        });
+    }
+    
+    // Build the object: the other vertex streams are in the prepared data
     p_object = std::make_unique<Object>(
-        std::move(rootNode), std::move(vertices), std::move(normals), 
-        std::move(textureUV), std::move(indices), std::move(tangents), 
-        std::move(bitangents)
+        std::move(rootNode), 
+        std::make_unique<QVector<float>>(std::move(entry.vertices)), 
+        std::make_unique<QVector<float>>(), 
+        std::make_unique<QVector<QVector<float>>>(),
+        std::make_unique<QVector<unsigned int>>(std::move(entry.indices)),
+        std::make_unique<QVector<float>>(), 
+        std::make_unique<QVector<float>>()
     );
+    p_object->setPreparedData(entry, std::move(layouts));
     
     return true;
 }
 
 
-std::shared_ptr<const Material> Object::Loader::processMaterial(
+void Object::Loader::prepareBuffers(MeshCache::Entry & entry) {
+    // Optimize the levels of detail of all the meshes, the statistics are 
+    // stored in the cache to be reported when the entry is loaded
+    std::vector<std::vector<unsigned int>> lods;
+    for (const MeshCache::MeshRecord & mesh : entry.meshes)
+        lods.push_back(mesh.lods);
+    const OptimizationStatistics statistics = optimizeMeshes(
+        lods, entry.vertices, entry.normals, entry.textureUV, entry.indices,
+        entry.tangents, entry.bitangents
+    );
+    entry.acmrBefore = static_cast<float>(statistics.acmrBefore);
+    entry.acmrAfter = static_cast<float>(statistics.acmrAfter);
+    entry.numTriangles = statistics.numTriangles;
+    
+    // Interleave and compress the vertex data
+    QVector<float> textureUV;
+    if (!entry.textureUV.isEmpty())
+        textureUV = entry.textureUV.at(0);
+    entry.halfTextureUV = VertexFormat::isHalfTextureUV(textureUV);
+    entry.textureRepeat = computeTextureRepeat(textureUV);
+    entry.vertexData = VertexFormat::interleave(
+        entry.vertices, entry.normals, textureUV, entry.tangents, 
+        entry.bitangents, entry.halfTextureUV
+    );
+    
+    // Pack the indices of each mesh
+    entry.indexData.clear();
+    for (MeshCache::MeshRecord & mesh : entry.meshes) {
+        IndexLayout layout;
+        packIndices(entry.indices, mesh.lods, entry.indexData, layout);
+        mesh.indexType = layout.type;
+        mesh.baseVertex = static_cast<unsigned int>(layout.baseVertex);
+        mesh.byteOffsets.assign(layout.byteOffsets.begin(), 
+                                layout.byteOffsets.end());
+    }
+    
+    // The other streams are only kept in the vertex data
+    entry.normals.clear();
+    entry.textureUV.clear();
+    entry.tangents.clear();
+    entry.bitangents.clear();
+}
+
+
+void Object::Loader::generateLods(MeshCache::Entry & entry) {
+    for (MeshCache::MeshRecord & mesh : entry.meshes) {
+        // Each LOD is simplified from the previous one and appended to the 
+        // index buffer
+        while (mesh.lods.size() < 2 * NUM_LODS) {
+            const unsigned int previousCount = mesh.lods[mesh.lods.size()-2];
+            const unsigned int previousOffset = mesh.lods.back();
+            QVector<unsigned int> lodIndices = MeshSimplifier::simplify(
+                entry.vertices, entry.indices.constData() + previousOffset, 
+                previousCount, LOD_REDUCTION
+            );
+            if (lodIndices.isEmpty() || 
+                lodIndices.size() > LOD_MIN_REDUCTION * previousCount)
+                break;
+            mesh.lods.push_back(static_cast<unsigned int>(lodIndices.size()));
+            mesh.lods.push_back(static_cast<unsigned int>(entry.indices.size()));
+            entry.indices.append(lodIndices);
+        }
+    }
+}
+
+
+MeshCache::MaterialRecord Object::Loader::processMaterial(
     const aiMaterial* material, const QString textureDir
 ) {
-    std::shared_ptr<Material> mater(nullptr);
+    MeshCache::MaterialRecord mater = {
+        QString(), false, QVector3D(), QVector3D(), QVector3D(), 0.0f, 1.0f,
+        QString(), QString()
+    };
 
     // Get material name
     aiString mname;
     material->Get(AI_MATKEY_NAME, mname);
-    QString name;
     if(mname.length > 0)
-        name = QString(mname.C_Str());
+        mater.name = QString(mname.C_Str());
     
     // Check if the model is using a supported shading model (Phong or Gouraud)
     int shadingModel;
@@ -559,12 +927,9 @@ std::shared_ptr<const Material> Object::Loader::processMaterial(
     if(shadingModel != aiShadingMode_Phong 
         && shadingModel != aiShadingMode_Gouraud) {
         qDebug() << __FILE__ << __LINE__ <<
-            "The shading model of the mesh" << name << 
+            "The shading model of the mesh" << mater.name << 
             "is not implemented in this object loader." <<
             "Use default material.";
-        
-        mater = std::make_shared<Material>(name);
-        mater->setAlpha(1.0f);
     }
     // The shading model is supported
     else {
@@ -581,31 +946,30 @@ std::shared_ptr<const Material> Object::Loader::processMaterial(
         material->Get(AI_MATKEY_SHININESS, shine);
         material->Get(AI_MATKEY_OPACITY, alpha);
         
-        // Load the texture of the material
-        std::vector<Texture *> diffuseTextures = loadMaterialTextures(
+        // Find the textures of the material
+        std::vector<QString> diffuseTextures = getTexturePaths(
             material, Texture::Type::Diffuse, textureDir
         );
-        if (diffuseTextures.size() == 0)
-            diffuseTextures.push_back(nullptr);
-        std::vector<Texture *> normalTextures = loadMaterialTextures(
+        std::vector<QString> normalTextures = getTexturePaths(
             material, Texture::Type::Normal, textureDir
         );
-        if (normalTextures.size() == 0)
-            normalTextures.push_back(nullptr);
-        mater = std::make_shared<Material>(
-            name, diffuseTextures.at(0), normalTextures.at(0));
-        mater->setAmbientColor(QVector3D(amb.r, amb.g, amb.b));
-        mater->setDiffuseColor(QVector3D(dif.r, dif.g, dif.b));
-        mater->setSpecularColor(QVector3D(spec.r, spec.g, spec.b));
-        mater->setShininess(shine);
-        mater->setAlpha(alpha);
+        mater.isShaded = true;
+        mater.ambient = QVector3D(amb.r, amb.g, amb.b);
+        mater.diffuse = QVector3D(dif.r, dif.g, dif.b);
+        mater.specular = QVector3D(spec.r, spec.g, spec.b);
+        mater.shininess = shine;
+        mater.alpha = alpha;
+        if (diffuseTextures.size() != 0)
+            mater.diffuseTexture = diffuseTextures.at(0);
+        if (normalTextures.size() != 0)
+            mater.normalTexture = normalTextures.at(0);
     }
     
     return mater;
 }
 
 
-std::vector<Texture *> Object::Loader::loadMaterialTextures(
+std::vector<QString> Object::Loader::getTexturePaths(
     const aiMaterial* material, const Texture::Type type, 
     const QString textureDir
 ) {
@@ -627,58 +991,79 @@ std::vector<Texture *> Object::Loader::loadMaterialTextures(
         default:
             qCritical() << __FILE__ << __LINE__ <<
             "No corresponding Assimp type for type" << type;
-            return std::vector<Texture *>();
+            return std::vector<QString>();
     }
     
-    // Load all the textures used by the model
-    std::vector<Texture *> textures;
+    // Get the paths of all the textures used by the model
+    std::vector<QString> paths;
     for (unsigned int i = 0; i < material->GetTextureCount(aiType); i++) {
-        // Get the texture path from Assimp
         aiString pathString;
         material->GetTexture(aiType, i, &pathString);
         QString path = QString(pathString.C_Str());
         path.prepend(textureDir);
-        
-        // Check the texture file exists
-        if (!QFile::exists(path))
-            qCritical() << __FILE__ << __LINE__ << 
-                "The path" << path 
-                << "to the texture file is not valid";
-        QImage image(path);
+        paths.push_back(path);
+    }
+    return paths;
+}
+
+
+std::shared_ptr<const Material> Object::Loader::createMaterial(
+    const MeshCache::MaterialRecord & material
+) {
+    std::shared_ptr<Material> mater(nullptr);
+    if (!material.isShaded) {
+        mater = std::make_shared<Material>(material.name);
+        mater->setAlpha(1.0f);
+        return mater;
+    }
+    
+    mater = std::make_shared<Material>(
+        material.name, 
+        loadTexture(material.diffuseTexture, Texture::Type::Diffuse),
+        loadTexture(material.normalTexture, Texture::Type::Normal)
+    );
+    mater->setAmbientColor(material.ambient);
+    mater->setDiffuseColor(material.diffuse);
+    mater->setSpecularColor(material.specular);
+    mater->setShininess(material.shininess);
+    mater->setAlpha(material.alpha);
+    return mater;
+}
+
+
+Texture * Object::Loader::loadTexture(
+    const QString & path, const Texture::Type type
+) {
+    if (path.isEmpty())
+        return nullptr;
+    
+    // Images embedded in a glTF file are decoded from the file
+    if (GltfLoader::isEmbeddedImage(path)) {
+        QImage image = GltfLoader::loadEmbeddedImage(path);
         if (image.isNull())
-            qCritical() << __FILE__ << __LINE__ << 
-                "The image file does not exist.";
-        
-        // Load the texture
-        Texture * thisTexture = TextureManager::loadTexture(path, type, image);
-        textures.push_back(thisTexture);
+            qCritical() << __FILE__ << __LINE__ <<
+                "The embedded image" << path << "cannot be decoded.";
+        return TextureManager::loadTexture(path, type, image);
     }
-    return textures;
+    
+    // Check the texture file exists
+    if (!QFile::exists(path))
+        qCritical() << __FILE__ << __LINE__ << 
+            "The path" << path 
+            << "to the texture file is not valid";
+    
+    // Load the texture in the background
+    return TextureManager::loadTextureAsync(path, type);
 }
 
 
-std::shared_ptr<const Object::Mesh> Object::Loader::processMesh(
-    const aiMesh* mesh, 
-    const std::vector<std::shared_ptr<const Material>> & materials, 
-    std::unique_ptr<QVector<float>> & vertices, 
-    std::unique_ptr<QVector<float>> & normals,
-    std::unique_ptr<QVector<QVector<float>>> & textureUV,
-    std::unique_ptr<QVector<unsigned int>> & indices,
-    std::unique_ptr<QVector<float>> & tangents, 
-    std::unique_ptr<QVector<float>> & bitangents
+void Object::Loader::processMesh(
+    const aiMesh* mesh, MeshCache::Entry & entry
 ) {
-    if (!vertices)
-        vertices = std::make_unique<QVector<float>>();
-    if (!normals)
-        normals = std::make_unique<QVector<float>>();
-    if (!textureUV)
-        textureUV = std::make_unique<QVector<QVector<float>>>();
-    if (!indices)
-        indices = std::make_unique<QVector<unsigned int>>();
-    if (!tangents)
-        tangents = std::make_unique<QVector<float>>();
-    if (!bitangents)
-        bitangents = std::make_unique<QVector<float>>();
+    QVector<float> & vertices = entry.vertices;
+    QVector<float> & normals = entry.normals;
+    QVector<QVector<float>> & textureUV = entry.textureUV;
+    QVector<unsigned int> & indices = entry.indices;
     
     // Get the mesh name
     QString name;
@@ -688,16 +1073,16 @@ std::shared_ptr<const Object::Mesh> Object::Loader::processMesh(
         name = QString("");
     
     // Get the mesh offset index in the index buffer
-    unsigned int offset = static_cast<unsigned int>(indices->size());
-    unsigned int vertexOffset = static_cast<unsigned int>(vertices->size()/3);
+    unsigned int offset = static_cast<unsigned int>(indices.size());
+    unsigned int vertexOffset = static_cast<unsigned int>(vertices.size()/3);
     
     // Retrieve the vertices of the mesh
     if (mesh->mNumVertices > 0) {
         for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
             aiVector3D & vec = mesh->mVertices[i];
-            vertices->push_back(vec.x);
-            vertices->push_back(vec.y);
-            vertices->push_back(vec.z);
+            vertices.push_back(vec.x);
+            vertices.push_back(vec.y);
+            vertices.push_back(vec.z);
         }
     }
     
@@ -705,32 +1090,32 @@ std::shared_ptr<const Object::Mesh> Object::Loader::processMesh(
     if (mesh->HasNormals()) {
         for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
             aiVector3D & vec = mesh->mNormals[i];
-            normals->push_back(vec.x);
-            normals->push_back(vec.y);
-            normals->push_back(vec.z);
+            normals.push_back(vec.x);
+            normals.push_back(vec.y);
+            normals.push_back(vec.z);
         }
     }
     
     // Retrieve the texture coordinates
     unsigned int numUV = mesh->GetNumUVChannels();
     if (numUV > 0) {
-        if (textureUV->size() < static_cast<int>(numUV)) {
+        if (textureUV.size() < static_cast<int>(numUV)) {
             // It is assumed that all the meshes have the same number of UV 
             // channels (number of texture coordinates). Resize the textureUV
             // if the number of UV channel is not the same.
-            textureUV->resize(numUV);
+            textureUV.resize(numUV);
         }
         for (unsigned int iChannel = 0; iChannel < numUV; iChannel++) {
             for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-                (*textureUV)[iChannel].push_back(
+                textureUV[iChannel].push_back(
                     mesh->mTextureCoords[iChannel][i].x
                 );
                 if (mesh->mNumUVComponents[iChannel]> 1) {
-                    (*textureUV)[iChannel].push_back(
+                    textureUV[iChannel].push_back(
                         mesh->mTextureCoords[iChannel][i].y
                     );
                     if (mesh->mNumUVComponents[iChannel] > 2) {
-                        (*textureUV)[iChannel].push_back(
+                        textureUV[iChannel].push_back(
                             mesh->mTextureCoords[iChannel][i].z
                         );
                     }
@@ -747,11 +1132,11 @@ std::shared_ptr<const Object::Mesh> Object::Loader::processMesh(
                 << "ignore the primitive" << face->mNumIndices;
             continue;
         }
-        indices->push_back(face->mIndices[0] + vertexOffset);
-        indices->push_back(face->mIndices[1] + vertexOffset);
-        indices->push_back(face->mIndices[2] + vertexOffset);
+        indices.push_back(face->mIndices[0] + vertexOffset);
+        indices.push_back(face->mIndices[1] + vertexOffset);
+        indices.push_back(face->mIndices[2] + vertexOffset);
     }
-    unsigned int count = static_cast<unsigned int>(indices->size()) - offset;
+    unsigned int count = static_cast<unsigned int>(indices.size()) - offset;
     
     // Retrieve tangents and bitangents
     if (mesh->HasTangentsAndBitangents()) {
@@ -759,29 +1144,22 @@ std::shared_ptr<const Object::Mesh> Object::Loader::processMesh(
             // Check orientation
             aiVector3D & tan   = mesh->mTangents[i];
             aiVector3D & bitan = mesh->mBitangents[i];
-            tangents->push_back(tan.x);
-            tangents->push_back(tan.y);
-            tangents->push_back(tan.z);
-            bitangents->push_back(bitan.x);
-            bitangents->push_back(bitan.y);
-            bitangents->push_back(bitan.z);
+            entry.tangents.push_back(tan.x);
+            entry.tangents.push_back(tan.y);
+            entry.tangents.push_back(tan.z);
+            entry.bitangents.push_back(bitan.x);
+            entry.bitangents.push_back(bitan.y);
+            entry.bitangents.push_back(bitan.z);
         }
     }
     
-    // Find the material of the mesh
-    std::shared_ptr<const Material> material = materials.at(mesh->mMaterialIndex);
-    
     // Create the mesh
-    std::shared_ptr<const Mesh> newMesh = std::make_shared<Mesh>(
-        name, count, offset, material
-    );
-    return newMesh;
+    entry.meshes.push_back({name, mesh->mMaterialIndex, {count, offset}});
 }
 
 
-std::unique_ptr<const Object::Node> Object::Loader::processNode(
-    const aiNode * node, const aiScene * scene, 
-    const std::vector<std::shared_ptr<const Mesh>> & sceneMeshes
+void Object::Loader::processNode(
+    const aiNode * node, MeshCache::Entry & entry
 ) {    
     // Get the node name
     QString name;
@@ -793,27 +1171,41 @@ std::unique_ptr<const Object::Node> Object::Loader::processNode(
     // Define the transformation
     QMatrix4x4 transformation(node->mTransformation[0]);
     
+    // Get the node meshes
+    std::vector<unsigned int> nodeMeshes(
+        node->mMeshes, node->mMeshes + node->mNumMeshes
+    );
+    
+    // Add the node, then its children
+    entry.nodes.push_back({
+        name, transformation, nodeMeshes, node->mNumChildren
+    });
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+        processNode(node->mChildren[i], entry);
+}
+
+
+std::unique_ptr<const Object::Node> Object::Loader::createNode(
+    const MeshCache::Entry & entry, 
+    const std::vector<std::shared_ptr<const Mesh>> & meshes, size_t & index
+) {
+    const MeshCache::NodeRecord & node = entry.nodes.at(index++);
+    
     // Get the node meshes
     std::vector<std::shared_ptr<const Mesh>> nodeMeshes;
-    nodeMeshes.resize(node->mNumMeshes);
-    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-        std::shared_ptr<const Mesh> mesh = sceneMeshes[node->mMeshes[i]];
-        nodeMeshes[i] = mesh;
-    }
+    for (unsigned int mesh : node.meshes)
+        nodeMeshes.push_back(meshes.at(mesh));
     
-    // Create the children of the node
+    // Create the children of the node, stored after it in depth-first order
     std::vector<std::unique_ptr<const Node>> children;
-    children.resize(node->mNumChildren);
-    for (unsigned int i = 0; i < node->mNumChildren; i++) {
-        std::unique_ptr<const Node> child = processNode(
-            node->mChildren[i], scene, sceneMeshes
-        );
-        children[i] = std::move(child);
+    for (unsigned int i = 0; i < node.numChildren && index < entry.nodes.size(); 
+         i++) {
+        children.push_back(createNode(entry, meshes, index));
     }
     
     // Create the node
     return std::make_unique<Node>(
-        name, transformation, nodeMeshes, std::move(children)
+        node.name, node.transformation, nodeMeshes, std::move(children)
     );
 }
 
@@ -975,13 +1367,9 @@ std::shared_ptr<const Material> Object::XmlLoader::processMaterial(
         if (!QFile::exists(path))
             qCritical() << __FILE__ << __LINE__ << 
                 "The path" << path << "to the texture file is not valid";
-        QImage image(path);
-        if (image.isNull())
-            qCritical() << __FILE__ << __LINE__ << 
-            "The image file does not exist.";
         
-        // Load the texture
-        Texture * tex = TextureManager::loadTexture(path, type, image);
+        // Load the texture in the background
+        Texture * tex = TextureManager::loadTextureAsync(path, type);
         if (type == Texture::Type::Diffuse)
             material.setDiffuseTexture(tex);
         else if (type == Texture::Type::Normal)
@@ -1159,8 +1547,9 @@ std::unique_ptr<const Object::Node> Object::XmlLoader::processNode(
     }
     // Compute the tangents and bitangents once the vertices, textures, and 
     // indices buffers are filed
-    getTangentsAndBitangents(
-        *p_vertices, *p_textureUV, *p_indices, *p_tangents, *p_bitangents
+    TangentGenerator::generate(
+        *p_vertices, *p_normals, p_textureUV->at(0), *p_indices, 
+        *p_tangents, *p_bitangents
     );
     
     // Create the children of the node
@@ -1178,17 +1567,213 @@ std::unique_ptr<const Object::Node> Object::XmlLoader::processNode(
 
 
 
+/***
+ *      ____          _          _                 
+ *     |  _ \        | |        | |                
+ *     | |_) |  __ _ | |_   ___ | |__    ___  _ __ 
+ *     |  _ <  / _` || __| / __|| '_ \  / _ \| '__|
+ *     | |_) || (_| || |_ | (__ | | | ||  __/| |   
+ *     |____/  \__,_| \__| \___||_| |_| \___||_|   
+ *                                                 
+ *                                                 
+ */
 
+bool Object::Batcher::addInstance(
+    const Object * object, const QMatrix4x4 & model
+) {
+    // The vertex data must still be available
+    if (object == nullptr || object->m_error || object->m_isInitialized || 
+        !object->p_vertices || !object->p_indices)
+        return false;
+    
+    // Transparent meshes are sorted when drawing, they cannot be merged
+    std::vector<std::pair<QMatrix4x4, const Mesh *>> meshes;
+    object->p_rootNode->collectMeshes(model, meshes);
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        if (!meshes[i].second->isOpaque())
+            return false;
+    }
+    
+    // Find the cell containing the center of the bounding box
+    const float inf = std::numeric_limits<float>::max();
+    QVector3D lower( inf, inf, inf);
+    QVector3D upper(-inf,-inf,-inf);
+    object->p_rootNode->expandBoundingBox(
+        model, *object->p_vertices, *object->p_indices, lower, upper
+    );
+    if (lower.x() > upper.x())
+        return false;
+    const QVector3D center = (lower + upper) / 2;
+    std::array<int,3> cell;
+    for (int i = 0; i < 3; i++)
+        cell[i] = static_cast<int>(std::floor(center[i] / m_cellSize));
+    
+    m_cells[cell].push_back({object, model});
+    return true;
+}
 
 
+std::vector<std::unique_ptr<Object>> Object::Batcher::build() {
+    std::vector<std::unique_ptr<Object>> objects;
+    for (auto cell = m_cells.begin(); cell != m_cells.end(); cell++) {
+        // Group the meshes of the cell by material
+        std::vector<std::shared_ptr<const Material>> materials;
+        std::vector<std::vector<std::pair<const Instance *, 
+            std::pair<QMatrix4x4, const Mesh *>>>> groups;
+        for (const Instance & instance : cell->second) {
+            std::vector<std::pair<QMatrix4x4, const Mesh *>> meshes;
+            instance.object->p_rootNode->collectMeshes(instance.model, meshes);
+            for (unsigned int i = 0; i < meshes.size(); i++) {
+                std::shared_ptr<const Material> material = 
+                    meshes[i].second->getMaterial();
+                unsigned int k = 0;
+                while (k < materials.size() && 
+                       !materials[k]->isEquivalent(*material))
+                    k++;
+                if (k == materials.size()) {
+                    materials.push_back(material);
+                    groups.emplace_back();
+                }
+                groups[k].push_back(std::make_pair(&instance, meshes[i]));
+            }
+        }
+        
+        // Merge the meshes of each group into a single mesh
+        Buffers buffers;
+        std::unique_ptr<QVector<unsigned int>> indices = 
+            std::make_unique<QVector<unsigned int>>();
+        std::vector<std::shared_ptr<const Mesh>> meshes;
+        for (unsigned int k = 0; k < materials.size(); k++) {
+            size_t numLods = 1;
+            for (unsigned int i = 0; i < groups[k].size(); i++) {
+                numLods = std::max(
+                    numLods, groups[k][i].second.second->getLods().size()
+                );
+            }
+            std::vector<QVector<unsigned int>> lodIndices(numLods);
+            for (unsigned int i = 0; i < groups[k].size(); i++) {
+                appendMesh(
+                    *groups[k][i].first->object, groups[k][i].second.first,
+                    *groups[k][i].second.second, buffers, lodIndices
+                );
+            }
+            std::vector<Mesh::Lod> lods;
+            for (unsigned int lod = 0; lod < numLods; lod++) {
+                lods.push_back({
+                    static_cast<unsigned int>(lodIndices[lod].size()),
+                    static_cast<unsigned int>(indices->size())
+                });
+                indices->append(lodIndices[lod]);
+            }
+            meshes.push_back(std::make_shared<const Mesh>(
+                materials[k]->getName(), lods, materials[k]
+            ));
+        }
+        
+        // Create the object of the cell: the vertices are already in world 
+        // coordinates
+        std::unique_ptr<const Node> rootNode = std::make_unique<const Node>(
+            "batch", QMatrix4x4(), meshes, 
+            std::vector<std::unique_ptr<const Node>>()
+        );
+        std::unique_ptr<QVector<QVector<float>>> textureUV = 
+            std::make_unique<QVector<QVector<float>>>();
+        textureUV->push_back(buffers.textureUV);
+        objects.push_back(std::make_unique<Object>(
+            std::move(rootNode),
+            std::make_unique<QVector<float>>(buffers.vertices),
+            std::make_unique<QVector<float>>(buffers.normals),
+            std::move(textureUV),
+            std::move(indices),
+            std::make_unique<QVector<float>>(buffers.tangents),
+            std::make_unique<QVector<float>>(buffers.bitangents)
+        ));
+    }
+    m_cells.clear();
+    return objects;
+}
 
 
-
-
-
-
-
-
-
-
-
+void Object::Batcher::appendMesh(
+    const Object & object, const QMatrix4x4 & model, const Mesh & mesh, 
+    Buffers & buffers, std::vector<QVector<unsigned int>> & lodIndices
+) {
+    const QVector<float> & vertices = *object.p_vertices;
+    const QVector<float> & normals = *object.p_normals;
+    const QVector<float> & tangents = *object.p_tangents;
+    const QVector<float> & bitangents = *object.p_bitangents;
+    const QVector<unsigned int> & indices = *object.p_indices;
+    const QVector<float> * textureUV = object.p_textureUV->isEmpty() ? 
+        nullptr : &object.p_textureUV->at(0);
+    const int stride = VertexFormat::stride(object.m_halfTextureUV);
+    const QMatrix4x4 normalMatrix = model.inverted().transposed();
+    
+    // Copy the vertices of the full mesh, the other LODs reuse them
+    std::map<unsigned int, unsigned int> remap;
+    const Mesh::Lod & full = mesh.getFullDetail();
+    for (unsigned int k = full.offset; k < full.offset + full.count; k++) {
+        const unsigned int index = indices.at(static_cast<int>(k));
+        if (remap.count(index) != 0)
+            continue;
+        remap[index] = static_cast<unsigned int>(buffers.vertices.size() / 3);
+        
+        // The attributes of the prepared objects are decoded from their
+        // interleaved vertex data
+        const int i = 3 * static_cast<int>(index);
+        const int uv = 2 * static_cast<int>(index);
+        QVector3D normal, tangent, bitangent;
+        float texture[2] = {0.0f, 0.0f};
+        if (object.m_isPrepared) {
+            VertexFormat::decode(
+                object.m_vertexData.constData() + index * stride,
+                object.m_halfTextureUV, normal, tangent, bitangent, texture
+            );
+        }
+        else {
+            normal = QVector3D(normals.at(i), normals.at(i+1), normals.at(i+2));
+            tangent = QVector3D(
+                tangents.at(i), tangents.at(i+1), tangents.at(i+2)
+            );
+            bitangent = QVector3D(
+                bitangents.at(i), bitangents.at(i+1), bitangents.at(i+2)
+            );
+            if (textureUV != nullptr && uv + 1 < textureUV->size()) {
+                texture[0] = textureUV->at(uv);
+                texture[1] = textureUV->at(uv+1);
+            }
+        }
+        
+        QVector3D position = model.map(
+            QVector3D(vertices.at(i), vertices.at(i+1), vertices.at(i+2))
+        );
+        normal = normalMatrix.mapVector(normal).normalized();
+        tangent = model.mapVector(tangent).normalized();
+        bitangent = model.mapVector(bitangent).normalized();
+        for (int j = 0; j < 3; j++) {
+            buffers.vertices.push_back(position[j]);
+            buffers.normals.push_back(normal[j]);
+            buffers.tangents.push_back(tangent[j]);
+            buffers.bitangents.push_back(bitangent[j]);
+        }
+        buffers.textureUV.push_back(texture[0]);
+        buffers.textureUV.push_back(texture[1]);
+    }
+    
+    // Append the indices of each LOD, the least detailed LOD of the mesh is
+    // repeated if the mesh has less LODs than the merged mesh
+    const std::vector<Mesh::Lod> & lods = mesh.getLods();
+    for (unsigned int lod = 0; lod < lodIndices.size(); lod++) {
+        const Mesh::Lod & range = lods.at(std::min<size_t>(lod, lods.size() - 1));
+        for (unsigned int k = range.offset; k + 2 < range.offset + range.count; 
+             k += 3) {
+            auto it0 = remap.find(indices.at(static_cast<int>(k)));
+            auto it1 = remap.find(indices.at(static_cast<int>(k+1)));
+            auto it2 = remap.find(indices.at(static_cast<int>(k+2)));
+            if (it0 == remap.end() || it1 == remap.end() || it2 == remap.end())
+                continue;
+            lodIndices[lod].push_back(it0->second);
+            lodIndices[lod].push_back(it1->second);
+            lodIndices[lod].push_back(it2->second);
+        }
+    }
+}
@@ -0,0 +1,680 @@
+#include "../include/objloader.h"
+#include "../include/tangentgenerator.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+// Minimum size of the chunks parsed in parallel (bytes)
+static constexpr qint64 MIN_CHUNK_SIZE = 1 << 20;
+// Marks a missing reference of a face corner
+static constexpr int MISSING = INT_MIN;
+
+namespace {
+
+bool isSpace(char c) {return c == ' ' || c == '\t' || c == '\r';}
+
+bool isDigit(char c) {return c >= '0' && c <= '9';}
+
+const char * skipSpaces(const char * s, const char * end) {
+    while (s < end && isSpace(*s))
+        s++;
+    return s;
+}
+
+/**
+ * @brief Parse a floating point number independently of the locale.
+ * @return The position after the number, or 's' if there is no number.
+ */
+const char * parseFloat(const char * s, const char * end, float & value) {
+    static const double POWERS[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+        1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char * start = s;
+    s = skipSpaces(s, end);
+    bool isNegative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+        isNegative = (*s++ == '-');
+
+    // Digits of the mantissa, the decimal point moves the exponent
+    double mantissa = 0.0;
+    int exponent = 0;
+    bool hasDigits = false;
+    for (; s < end && isDigit(*s); s++, hasDigits = true)
+        mantissa = 10.0 * mantissa + (*s - '0');
+    if (s < end && *s == '.') {
+        for (s++; s < end && isDigit(*s); s++, hasDigits = true) {
+            mantissa = 10.0 * mantissa + (*s - '0');
+            exponent--;
+        }
+    }
+    if (!hasDigits)
+        return start;
+
+    // Exponent
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char * e = s + 1;
+        bool isNegativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            isNegativeExponent = (*e++ == '-');
+        int value = 0;
+        bool hasExponent = false;
+        for (; e < end && isDigit(*e); e++, hasExponent = true)
+            value = std::min(10 * value + (*e - '0'), 1000);
+        if (hasExponent) {
+            exponent += isNegativeExponent ? -value : value;
+            s = e;
+        }
+    }
+
+    const int power = std::abs(exponent);
+    const double scale = power <= 22 ? POWERS[power] : std::pow(10.0, power);
+    const double result = exponent < 0 ? mantissa / scale : mantissa * scale;
+    value = static_cast<float>(isNegative ? -result : result);
+    return s;
+}
+
+/**
+ * @brief Parse an integer.
+ * @return The position after the integer, or 's' if there is no integer.
+ */
+const char * parseInt(const char * s, const char * end, int & value) {
+    const char * start = s;
+    bool isNegative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+        isNegative = (*s++ == '-');
+    long long result = 0;
+    bool hasDigits = false;
+    for (; s < end && isDigit(*s); s++, hasDigits = true)
+        result = std::min(10 * result + (*s - '0'), 1LL << 40);
+    if (!hasDigits)
+        return start;
+    result = isNegative ? -result : result;
+    value = static_cast<int>(std::max<long long>(
+        std::min<long long>(result, INT_MAX), INT_MIN + 1
+    ));
+    return s;
+}
+
+/**
+ * @brief Return the rest of the line without the surrounding spaces.
+ */
+QByteArray parseName(const char * s, const char * end) {
+    s = skipSpaces(s, end);
+    while (end > s && isSpace(end[-1]))
+        end--;
+    return QByteArray(s, static_cast<int>(end - s));
+}
+
+/**
+ * @brief Check if the line starts with a keyword followed by a space.
+ * @param[out] next The position after the keyword.
+ */
+bool isKeyword(const char * s, const char * end, const char * keyword,
+               const char * & next) {
+    const size_t length = std::strlen(keyword);
+    if (end - s <= static_cast<ptrdiff_t>(length) ||
+        std::strncmp(s, keyword, length) != 0 || !isSpace(s[length]))
+        return false;
+    next = s + length;
+    return true;
+}
+
+/**
+ * @brief Hash of the vertex keys of ObjLoader, which are private.
+ */
+struct VertexKeyHash {
+    template<typename Key> size_t operator()(const Key & key) const {
+        return static_cast<size_t>(key.position) * 73856093u ^
+            static_cast<size_t>(key.textureUV) * 19349663u ^
+            static_cast<size_t>(key.normal) * 83492791u;
+    };
+};
+
+/**
+ * @brief Call a function with the index of each chunk, one thread per chunk.
+ */
+template<typename Function>
+void forEachChunk(unsigned int numChunks, Function function) {
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < numChunks; i++)
+        threads.emplace_back(function, i);
+    function(0u);
+    for (std::thread & thread : threads)
+        thread.join();
+}
+
+}
+
+
+bool ObjLoader::load(
+    const QString & filePath, const QString & textureDir,
+    MeshCache::Entry & entry
+) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const qint64 size = file.size();
+    uchar * map = size > 0 ? file.map(0, size) : nullptr;
+    if (map == nullptr)
+        return false;
+    const char * data = reinterpret_cast<const char *>(map);
+
+    // Split the file into chunks starting at the beginning of a line
+    const unsigned int numChunks = static_cast<unsigned int>(std::max<qint64>(
+        1, std::min<qint64>(
+            size / MIN_CHUNK_SIZE, std::thread::hardware_concurrency()
+        )
+    ));
+    std::vector<const char *> bounds(numChunks + 1);
+    bounds[0] = data;
+    bounds[numChunks] = data + size;
+    for (unsigned int i = 1; i < numChunks; i++) {
+        const char * start = std::max(data + size * i / numChunks, bounds[i-1]);
+        const void * newLine = std::memchr(
+            start, '\n', static_cast<size_t>(data + size - start)
+        );
+        bounds[i] = newLine ? static_cast<const char *>(newLine) + 1 :
+            data + size;
+    }
+
+    // Parse the chunks in parallel
+    std::vector<Chunk> chunks(numChunks);
+    forEachChunk(numChunks, [&](unsigned int i) {
+        parseChunk(bounds[i], bounds[i+1], chunks[i]);
+    });
+    file.unmap(map);
+
+    // Gather the attributes of all the chunks, the relative references of a
+    // chunk are offset by the attributes of the previous chunks
+    Attributes attributes;
+    std::vector<int> bases(3 * numChunks);
+    for (unsigned int i = 0; i < numChunks; i++) {
+        bases[3*i  ] = static_cast<int>(attributes.positions.size() / 3);
+        bases[3*i+1] = static_cast<int>(attributes.textureUV.size() / 2);
+        bases[3*i+2] = static_cast<int>(attributes.normals.size() / 3);
+        attributes.positions.insert(attributes.positions.end(),
+            chunks[i].positions.begin(), chunks[i].positions.end());
+        attributes.textureUV.insert(attributes.textureUV.end(),
+            chunks[i].textureUV.begin(), chunks[i].textureUV.end());
+        attributes.normals.insert(attributes.normals.end(),
+            chunks[i].normals.begin(), chunks[i].normals.end());
+    }
+    attributes.counts[0] = static_cast<int>(attributes.positions.size() / 3);
+    attributes.counts[1] = static_cast<int>(attributes.textureUV.size() / 2);
+    attributes.counts[2] = static_cast<int>(attributes.normals.size() / 3);
+    const bool hasTextureUV = attributes.counts[1] > 0;
+
+    // Merge the identical vertices and triangulate the faces of each chunk
+    // in parallel
+    forEachChunk(numChunks, [&](unsigned int i) {
+        mergeChunk(chunks[i], &bases[3*i], attributes);
+    });
+
+    // Sum the normals of the faces sharing a position for the smooth normals
+    for (const Chunk & chunk : chunks) {
+        if (!chunk.smoothCorners.empty() && attributes.smoothNormals.empty())
+            attributes.smoothNormals.resize(attributes.positions.size(), 0.0f);
+        for (const auto & corner : chunk.smoothCorners) {
+            for (int j = 0; j < 3; j++) {
+                attributes.smoothNormals[3 * corner.first + j] +=
+                    chunk.faceNormals[3 * corner.second + j];
+            }
+        }
+    }
+
+    // Offsets of the vertices and of the indices of each chunk in the final
+    // vertex streams
+    std::vector<unsigned int> firstVertices(numChunks + 1, 0);
+    std::vector<unsigned int> firstIndices(numChunks + 1, 0);
+    for (unsigned int i = 0; i < numChunks; i++) {
+        firstVertices[i+1] = firstVertices[i] +
+            static_cast<unsigned int>(chunks[i].vertices.size());
+        firstIndices[i+1] = firstIndices[i] +
+            static_cast<unsigned int>(chunks[i].indices.size());
+    }
+
+    // State of the faces
+    const QDir directory = QFileInfo(filePath).absoluteDir();
+    std::map<QByteArray, unsigned int> materialNames;
+    std::vector<std::pair<QString, std::vector<unsigned int>>> objects;
+    unsigned int material = UINT_MAX;
+    unsigned int meshOffset = 0;
+    auto useMaterial = [&](const QByteArray & name) {
+        auto it = materialNames.find(name);
+        if (it == materialNames.end()) {
+            // Unknown material, use the default one
+            it = materialNames.find(QByteArray());
+            if (it == materialNames.end()) {
+                it = materialNames.emplace(
+                    QByteArray(),
+                    static_cast<unsigned int>(entry.materials.size())
+                ).first;
+                entry.materials.push_back(defaultMaterial("DefaultMaterial"));
+            }
+        }
+        material = it->second;
+    };
+    auto closeMesh = [&](unsigned int offset) {
+        if (offset > meshOffset) {
+            if (objects.empty())
+                objects.push_back({QString("defaultobject"), {}});
+            if (material == UINT_MAX)
+                useMaterial(QByteArray());
+            objects.back().second.push_back(
+                static_cast<unsigned int>(entry.meshes.size())
+            );
+            entry.meshes.push_back(
+                {objects.back().first, material, {offset - meshOffset, meshOffset}}
+            );
+        }
+        meshOffset = offset;
+    };
+    auto processEvent = [&](const Event & event, unsigned int offset) {
+        switch (event.type) {
+            case Event::Object:
+                closeMesh(offset);
+                objects.push_back({QString::fromUtf8(event.name), {}});
+                break;
+            case Event::Material:
+                closeMesh(offset);
+                useMaterial(event.name);
+                break;
+            case Event::Library:
+                loadMaterials(
+                    directory.filePath(QString::fromUtf8(event.name)),
+                    textureDir, entry.materials, materialNames
+                );
+                break;
+        }
+    };
+
+    // Split the indices into meshes at the statements of the chunks
+    for (unsigned int i = 0; i < numChunks; i++) {
+        for (size_t e = 0; e < chunks[i].events.size(); e++) {
+            processEvent(chunks[i].events[e],
+                         firstIndices[i] + chunks[i].eventIndices[e]);
+        }
+    }
+    closeMesh(firstIndices[numChunks]);
+    if (entry.meshes.empty()) {
+        qDebug() << __FILE__ << __LINE__ <<
+            "No faces found in the file" << filePath;
+        return false;
+    }
+
+    // Write the vertices and the indices of each chunk in parallel
+    const int numVertices = static_cast<int>(firstVertices[numChunks]);
+    entry.vertices.resize(3 * numVertices);
+    entry.normals.resize(3 * numVertices);
+    entry.indices.resize(static_cast<int>(firstIndices[numChunks]));
+    float * vertices = entry.vertices.data();
+    float * normals = entry.normals.data();
+    float * textureUV = nullptr;
+    if (hasTextureUV) {
+        entry.textureUV.resize(1);
+        entry.textureUV[0].resize(2 * numVertices);
+        textureUV = entry.textureUV[0].data();
+    }
+    unsigned int * indices = entry.indices.data();
+    forEachChunk(numChunks, [&](unsigned int i) {
+        writeChunk(
+            chunks[i], attributes, firstVertices[i],
+            vertices + 3 * firstVertices[i], normals + 3 * firstVertices[i],
+            textureUV ? textureUV + 2 * firstVertices[i] : nullptr,
+            indices + firstIndices[i]
+        );
+    });
+
+    // Compute the tangent space
+    TangentGenerator::generate(
+        entry.vertices, entry.normals,
+        hasTextureUV ? entry.textureUV.at(0) : QVector<float>(),
+        entry.indices, entry.tangents, entry.bitangents
+    );
+
+    // A root node with a child per object
+    unsigned int numObjects = 0;
+    for (const auto & object : objects)
+        numObjects += object.second.empty() ? 0 : 1;
+    entry.nodes.push_back(
+        {QFileInfo(filePath).fileName(), QMatrix4x4(), {}, numObjects}
+    );
+    for (const auto & object : objects) {
+        if (!object.second.empty())
+            entry.nodes.push_back({object.first, QMatrix4x4(), object.second, 0});
+    }
+    return true;
+}
+
+
+void ObjLoader::parseChunk(
+    const char * begin, const char * end, Chunk & chunk
+) {
+    const char * line = begin;
+    while (line < end) {
+        const void * newLine = std::memchr(
+            line, '\n', static_cast<size_t>(end - line)
+        );
+        const char * lineEnd = newLine ? static_cast<const char *>(newLine) : end;
+        const char * s = skipSpaces(line, lineEnd);
+        const char * next = nullptr;
+        line = lineEnd + 1;
+
+        if (isKeyword(s, lineEnd, "v", next)) {
+            float position[3] = {0.0f, 0.0f, 0.0f};
+            for (int i = 0; i < 3; i++)
+                next = parseFloat(next, lineEnd, position[i]);
+            chunk.positions.insert(chunk.positions.end(), position, position + 3);
+        }
+        else if (isKeyword(s, lineEnd, "vt", next)) {
+            float uv[2] = {0.0f, 0.0f};
+            for (int i = 0; i < 2; i++)
+                next = parseFloat(next, lineEnd, uv[i]);
+            chunk.textureUV.insert(chunk.textureUV.end(), uv, uv + 2);
+        }
+        else if (isKeyword(s, lineEnd, "vn", next)) {
+            float normal[3] = {0.0f, 0.0f, 0.0f};
+            for (int i = 0; i < 3; i++)
+                next = parseFloat(next, lineEnd, normal[i]);
+            chunk.normals.insert(chunk.normals.end(), normal, normal + 3);
+        }
+        else if (isKeyword(s, lineEnd, "f", next)) {
+            // Number of attributes defined so far in the chunk, used by the
+            // relative references
+            const int counts[3] = {
+                static_cast<int>(chunk.positions.size() / 3),
+                static_cast<int>(chunk.textureUV.size() / 2),
+                static_cast<int>(chunk.normals.size() / 3)
+            };
+            unsigned int numVertices = 0;
+            while (true) {
+                next = skipSpaces(next, lineEnd);
+                if (next >= lineEnd || *next == '#')
+                    break;
+
+                // Parse the 'p', 'p/t', 'p//n' or 'p/t/n' references
+                Corner corner = {MISSING, MISSING, MISSING, 0};
+                int * references[3] = {
+                    &corner.position, &corner.textureUV, &corner.normal
+                };
+                const char * token = next;
+                for (int i = 0; i < 3; i++) {
+                    int value = 0;
+                    const char * after = parseInt(next, lineEnd, value);
+                    if (after != next) {
+                        if (value < 0) {
+                            *references[i] = counts[i] + value;
+                            corner.relative |= static_cast<unsigned char>(1 << i);
+                        }
+                        else if (value > 0) {
+                            *references[i] = value - 1;
+                        }
+                        next = after;
+                    }
+                    if (next >= lineEnd || *next != '/')
+                        break;
+                    next++;
+                }
+
+                // Skip an invalid token
+                if (next == token || (next < lineEnd && !isSpace(*next))) {
+                    while (next < lineEnd && !isSpace(*next))
+                        next++;
+                    corner.position = MISSING;
+                }
+                chunk.corners.push_back(corner);
+                numVertices++;
+            }
+            chunk.faceSizes.push_back(numVertices);
+        }
+        else if (isKeyword(s, lineEnd, "o", next) ||
+                 isKeyword(s, lineEnd, "g", next)) {
+            chunk.events.push_back({
+                Event::Object, chunk.faceSizes.size(), parseName(next, lineEnd)
+            });
+        }
+        else if (isKeyword(s, lineEnd, "usemtl", next)) {
+            chunk.events.push_back({
+                Event::Material, chunk.faceSizes.size(), parseName(next, lineEnd)
+            });
+        }
+        else if (isKeyword(s, lineEnd, "mtllib", next)) {
+            chunk.events.push_back({
+                Event::Library, chunk.faceSizes.size(), parseName(next, lineEnd)
+            });
+        }
+    }
+}
+
+
+void ObjLoader::mergeChunk(
+    Chunk & chunk, const int * bases, const Attributes & attributes
+) {
+    const std::vector<float> & positions = attributes.positions;
+    std::unordered_map<VertexKey, unsigned int, VertexKeyHash> vertices;
+    vertices.reserve(chunk.corners.size());
+    std::vector<VertexKey> face;
+    std::vector<unsigned int> faceVertices;
+    size_t corner = 0;
+    size_t event = 0;
+    for (size_t f = 0; f < chunk.faceSizes.size(); f++) {
+        for (; event < chunk.events.size() && chunk.events[event].face == f;
+             event++) {
+            chunk.eventIndices.push_back(
+                static_cast<unsigned int>(chunk.indices.size())
+            );
+        }
+        const unsigned int numVertices = chunk.faceSizes[f];
+
+        // Resolve the references of the corners
+        face.clear();
+        bool isValid = numVertices >= 3;
+        bool hasNormals = true;
+        for (unsigned int k = 0; k < numVertices && isValid; k++) {
+            const Corner & ref = chunk.corners[corner + k];
+            const int values[3] = {ref.position, ref.textureUV, ref.normal};
+            int resolved[3];
+            for (int i = 0; i < 3; i++) {
+                resolved[i] = values[i];
+                if (values[i] != MISSING && (ref.relative & (1 << i)))
+                    resolved[i] += bases[i];
+                if (values[i] == MISSING || resolved[i] < 0 ||
+                    resolved[i] >= attributes.counts[i])
+                    resolved[i] = -1;
+            }
+            isValid = resolved[0] >= 0;
+            hasNormals = hasNormals && resolved[2] >= 0;
+            face.push_back({resolved[0], resolved[1], resolved[2]});
+        }
+        corner += numVertices;
+        if (!isValid)
+            continue;
+
+        // The corners without normals share a smooth normal per position,
+        // summed once all the chunks are merged
+        if (!hasNormals) {
+            const float * p0 = &positions[3 * face[0].position];
+            float normal[3] = {0.0f, 0.0f, 0.0f};
+            for (unsigned int k = 1; k + 1 < numVertices; k++) {
+                const float * p1 = &positions[3 * face[k].position];
+                const float * p2 = &positions[3 * face[k+1].position];
+                const float e1[3] = {
+                    p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]
+                };
+                const float e2[3] = {
+                    p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]
+                };
+                normal[0] += e1[1] * e2[2] - e1[2] * e2[1];
+                normal[1] += e1[2] * e2[0] - e1[0] * e2[2];
+                normal[2] += e1[0] * e2[1] - e1[1] * e2[0];
+            }
+            const unsigned int index =
+                static_cast<unsigned int>(chunk.faceNormals.size() / 3);
+            chunk.faceNormals.insert(chunk.faceNormals.end(), normal, 
+                                     normal + 3);
+            for (const VertexKey & key : face)
+                chunk.smoothCorners.push_back({key.position, index});
+        }
+
+        // Find or create the vertices of the face
+        faceVertices.clear();
+        for (const VertexKey & key : face) {
+            auto inserted = vertices.emplace(
+                key, static_cast<unsigned int>(chunk.vertices.size())
+            );
+            faceVertices.push_back(inserted.first->second);
+            if (inserted.second)
+                chunk.vertices.push_back(key);
+        }
+
+        // Triangulate the face as a fan
+        for (unsigned int k = 1; k + 1 < numVertices; k++) {
+            chunk.indices.push_back(faceVertices[0]);
+            chunk.indices.push_back(faceVertices[k]);
+            chunk.indices.push_back(faceVertices[k+1]);
+        }
+    }
+    for (; event < chunk.events.size(); event++) {
+        chunk.eventIndices.push_back(
+            static_cast<unsigned int>(chunk.indices.size())
+        );
+    }
+}
+
+
+void ObjLoader::writeChunk(
+    const Chunk & chunk, const Attributes & attributes,
+    unsigned int firstVertex, float * vertices, float * normals,
+    float * textureUV, unsigned int * indices
+) {
+    for (size_t i = 0; i < chunk.vertices.size(); i++) {
+        const VertexKey & key = chunk.vertices[i];
+        for (int j = 0; j < 3; j++)
+            vertices[3*i+j] = attributes.positions[3 * key.position + j];
+
+        // The missing normals are the normalized sum of the face normals
+        if (key.normal >= 0) {
+            for (int j = 0; j < 3; j++)
+                normals[3*i+j] = attributes.normals[3 * key.normal + j];
+        }
+        else {
+            const float * normal = 
+                &attributes.smoothNormals[3 * key.position];
+            const float length = std::sqrt(
+                normal[0] * normal[0] + normal[1] * normal[1] + 
+                normal[2] * normal[2]
+            );
+            for (int j = 0; j < 3; j++)
+                normals[3*i+j] = length == 0.0f ? 0.0f : normal[j] / length;
+        }
+
+        if (textureUV != nullptr) {
+            for (int j = 0; j < 2; j++) {
+                textureUV[2*i+j] = key.textureUV >= 0 ?
+                    attributes.textureUV[2 * key.textureUV + j] : 0.0f;
+            }
+        }
+    }
+    for (size_t i = 0; i < chunk.indices.size(); i++)
+        indices[i] = firstVertex + chunk.indices[i];
+}
+
+
+void ObjLoader::loadMaterials(
+    const QString & path, const QString & textureDir,
+    std::vector<MeshCache::MaterialRecord> & materials,
+    std::map<QByteArray, unsigned int> & names
+) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Unable to open the material library" << path;
+        return;
+    }
+    const QByteArray content = file.readAll();
+    const char * line = content.constData();
+    const char * end = line + content.size();
+    MeshCache::MaterialRecord * material = nullptr;
+    while (line < end) {
+        const void * newLine = std::memchr(
+            line, '\n', static_cast<size_t>(end - line)
+        );
+        const char * lineEnd = newLine ? static_cast<const char *>(newLine) : end;
+        const char * s = skipSpaces(line, lineEnd);
+        const char * next = nullptr;
+        line = lineEnd + 1;
+
+        if (isKeyword(s, lineEnd, "newmtl", next)) {
+            const QByteArray name = parseName(next, lineEnd);
+            names[name] = static_cast<unsigned int>(materials.size());
+            materials.push_back(defaultMaterial(QString::fromUtf8(name)));
+            material = &materials.back();
+            continue;
+        }
+        if (material == nullptr)
+            continue;
+
+        float values[3] = {0.0f, 0.0f, 0.0f};
+        if (isKeyword(s, lineEnd, "Ka", next) ||
+            isKeyword(s, lineEnd, "Kd", next) ||
+            isKeyword(s, lineEnd, "Ks", next)) {
+            for (int i = 0; i < 3; i++)
+                next = parseFloat(next, lineEnd, values[i]);
+            const QVector3D color(values[0], values[1], values[2]);
+            if (s[1] == 'a')
+                material->ambient = color;
+            else if (s[1] == 'd')
+                material->diffuse = color;
+            else
+                material->specular = color;
+        }
+        else if (isKeyword(s, lineEnd, "Ns", next)) {
+            parseFloat(next, lineEnd, material->shininess);
+        }
+        else if (isKeyword(s, lineEnd, "d", next)) {
+            parseFloat(next, lineEnd, material->alpha);
+        }
+        else if (isKeyword(s, lineEnd, "Tr", next)) {
+            if (parseFloat(next, lineEnd, values[0]) != next)
+                material->alpha = 1.0f - values[0];
+        }
+        else if (isKeyword(s, lineEnd, "illum", next)) {
+            int model = 1;
+            parseInt(skipSpaces(next, lineEnd), lineEnd, model);
+            // Illumination model 0 is not shaded (color only)
+            material->isShaded = (model != 0);
+        }
+        else if (isKeyword(s, lineEnd, "map_Kd", next) ||
+                 isKeyword(s, lineEnd, "norm", next) ||
+                 isKeyword(s, lineEnd, "map_Kn", next)) {
+            // The file name is the last token, after the options
+            QByteArray name = parseName(next, lineEnd);
+            const int space = std::max(name.lastIndexOf(' '),
+                                       name.lastIndexOf('\t'));
+            if (space >= 0)
+                name = name.mid(space + 1);
+            const QString texture = textureDir + QString::fromUtf8(name);
+            if (s[0] == 'm' && s[5] == 'd')
+                material->diffuseTexture = texture;
+            else
+                material->normalTexture = texture;
+        }
+    }
+}
+
+
+MeshCache::MaterialRecord ObjLoader::defaultMaterial(const QString & name) {
+    return {
+        name, true, QVector3D(0.0f, 0.0f, 0.0f), QVector3D(0.6f, 0.6f, 0.6f),
+        QVector3D(0.0f, 0.0f, 0.0f), 0.0f, 1.0f, QString(), QString()
+    };
+}
@@ -0,0 +1,21 @@
+#include "../include/openglfunctions.h"
+
+#include <QDebug>
+#include <QOpenGLContext>
+
+QOpenGLFunctions_4_5_Core * OpenGLFunctions::get() {
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (!context) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Requires a valid current OpenGL context.";
+        return nullptr;
+    }
+    QOpenGLFunctions_4_5_Core * gl =
+        context->versionFunctions<QOpenGLFunctions_4_5_Core>();
+    if (!gl || !gl->initializeOpenGLFunctions()) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Could not obtain required OpenGL context version";
+        return nullptr;
+    }
+    return gl;
+}
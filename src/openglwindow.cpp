@@ -115,16 +115,14 @@ void OpenGLWindow::renderGL() {
     // Draw the scene
     p_context->makeCurrent(this);
     p_scene->update();
-    // Generate the shadow map
-    for (unsigned int i = 0; i < NUM_CASCADES; i++) {
-        if (p_depthMap != nullptr)
-            p_depthMap->bind(i);
-        p_scene->renderShadow(i);
-    }
+    // Generate the shadow map, all the cascades in one pass
+    if (p_depthMap != nullptr)
+        p_depthMap->bind();
+    p_scene->renderShadow();
     // Render the scene
     if (p_depthMap != nullptr) {
         p_depthMap->release();
-        p_depthMap->bindTexture(SHADOW_TEXTURE_UNITS);
+        p_depthMap->bindTexture(SHADOW_TEXTURE_UNIT);
     }
     p_glFunctions->glViewport(0, 0, width(), height());
     p_scene->render();
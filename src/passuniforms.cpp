@@ -0,0 +1,105 @@
+#include "../include/passuniforms.h"
+
+#include <QDebug>
+#include <QOpenGLContext>
+#include <algorithm>
+
+GLuint PassUniforms::m_buffer = 0;
+
+/***
+ *      _____                   
+ *     |  __ \                  
+ *     | |__) |  __ _  ___  ___ 
+ *     |  ___/  / _` |/ __|/ __|
+ *     | |     | (_| |\__ \\__ \
+ *     |_|      \__,_||___/|___/
+ *                              
+ *                              
+ *      _    _         _   __                              
+ *     | |  | |       (_) / _|                             
+ *     | |  | | _ __   _ | |_   ___   _ __  _ __ ___   ___ 
+ *     | |  | || '_ \ | ||  _| / _ \ | '__|| '_ ` _ \ / __|
+ *     | |__| || | | || || |  | (_) || |   | | | | | |\__ \
+ *      \____/ |_| |_||_||_|   \___/ |_|   |_| |_| |_||___/
+ *                                                         
+ *                                                         
+ */
+
+void PassUniforms::update(
+    const CasterLight & light, const QMatrix4x4 & view, 
+    const QMatrix4x4 & projection, 
+    const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace,
+    const std::array<float,NUM_CASCADES+1> & cascades
+) {
+    Data data = {};
+    std::copy(view.constData(), view.constData() + 16, data.view);
+    std::copy(projection.constData(), projection.constData() + 16, 
+              data.projection);
+    for (unsigned int i = 0; i < NUM_CASCADES; i++) {
+        std::copy(lightSpace[i].constData(), lightSpace[i].constData() + 16,
+                  data.lightSpace[i]);
+        data.endCascade[i] = cascades[i+1];
+    }
+    
+    // The light direction is given in view coordinates
+    const QVector4D direction = view * light.getDirection();
+    const QVector3D intensity = light.getIntensity();
+    for (int i = 0; i < 4; i++)
+        data.lightDirection[i] = direction[i];
+    for (int i = 0; i < 3; i++)
+        data.lightIntensity[i] = intensity[i];
+    
+    upload(data);
+}
+
+
+void PassUniforms::updateShadow(
+    const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace
+) {
+    Data data = {};
+    const QMatrix4x4 identity;
+    std::copy(identity.constData(), identity.constData() + 16, data.view);
+    std::copy(identity.constData(), identity.constData() + 16, 
+              data.projection);
+    for (unsigned int i = 0; i < NUM_CASCADES; i++) {
+        std::copy(lightSpace[i].constData(), lightSpace[i].constData() + 16,
+                  data.lightSpace[i]);
+    }
+    upload(data);
+}
+
+
+void PassUniforms::cleanUp() {
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (m_buffer != 0 && context) {
+        QOpenGLFunctions_4_5_Core * gl = 
+            context->versionFunctions<QOpenGLFunctions_4_5_Core>();
+        if (gl && gl->initializeOpenGLFunctions())
+            gl->glDeleteBuffers(1, &m_buffer);
+    }
+    m_buffer = 0;
+}
+
+
+void PassUniforms::upload(const Data & data) {
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (!context) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Requires a valid current OpenGL context.";
+        return;
+    }
+    QOpenGLFunctions_4_5_Core * gl =
+        context->versionFunctions<QOpenGLFunctions_4_5_Core>();
+    if (!gl || !gl->initializeOpenGLFunctions()) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Could not obtain required OpenGL context version";
+        return;
+    }
+    
+    // The previous content is orphaned since it may still be read by the 
+    // draws of the previous pass
+    if (m_buffer == 0)
+        gl->glCreateBuffers(1, &m_buffer);
+    gl->glNamedBufferData(m_buffer, sizeof(Data), &data, GL_STREAM_DRAW);
+    gl->glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, m_buffer);
+}
@@ -0,0 +1,207 @@
+#include "../include/renderqueue.h"
+#include "../include/geometryheap.h"
+#include "../include/materialtable.h"
+
+#include <QDebug>
+#include <QOpenGLContext>
+#include <algorithm>
+#include <cstring>
+
+bool Object::RenderQueue::m_isOpen = false;
+std::vector<Object::RenderQueue::Item> Object::RenderQueue::m_items;
+std::map<const ObjectShader *, unsigned int> Object::RenderQueue::m_programIds;
+std::map<Object::RenderQueue::TextureSet, unsigned int> 
+    Object::RenderQueue::m_textureIds;
+Object::RenderQueue::Statistics Object::RenderQueue::m_statistics;
+
+/***
+ *      _____                    _             
+ *     |  __ \                  | |            
+ *     | |__) |  ___  _ __    __| |  ___  _ __ 
+ *     |  _  /  / _ \| '_ \  / _` | / _ \| '__|
+ *     | | \ \ |  __/| | | || (_| ||  __/| |   
+ *     |_|  \_\ \___||_| |_| \__,_| \___||_|   
+ *                                             
+ *                                             
+ *       ____                            
+ *      / __ \                           
+ *     | |  | | _   _   ___  _   _   ___ 
+ *     | |  | || | | | / _ \| | | | / _ \
+ *     | |__| || |_| ||  __/| |_| ||  __/
+ *      \___\_\ \__,_| \___| \__,_| \___|
+ *                                       
+ *                                       
+ */
+
+void Object::RenderQueue::open() {
+    m_items.clear();
+    m_isOpen = true;
+}
+
+
+void Object::RenderQueue::add(
+    ObjectShader * shader, const Mesh * mesh, const QMatrix4x4 & model, 
+    bool halfTextureUV, unsigned int lod, float distance
+) {
+    if (!shader || !mesh)
+        return;
+    
+    // The identifiers of the states, the shadow shaders ignore the materials
+    const std::uint64_t program = getId(
+        m_programIds, static_cast<const ObjectShader *>(shader)
+    ) & 0xFFF;
+    std::uint64_t textures = 0;
+    std::uint64_t material = 0;
+    if (shader->usesMaterials()) {
+        const Material * meshMaterial = mesh->getMaterial().get();
+        textures = getId(m_textureIds, TextureSet(
+            getArray(meshMaterial->getDiffuseTexture()), 
+            getArray(meshMaterial->getNormalTexture()), 
+            getArray(meshMaterial->getBumpTexture())
+        )) & 0x7FFF;
+        material = mesh->getMaterialIndex() & 0xFFFF;
+    }
+    
+    // The upper bits of a positive float sort like the float itself
+    const float positive = std::max(distance, 0.0f);
+    std::uint32_t bits;
+    std::memcpy(&bits, &positive, sizeof(bits));
+    const std::uint64_t depth = bits >> 16;
+    
+    // Opaque meshes are sorted by state, transparent ones by distance
+    std::uint64_t key;
+    if (mesh->isOpaque()) {
+        key = program << 48 | std::uint64_t(halfTextureUV) << 47 | 
+              textures << 32 | material << 16 | depth;
+    }
+    else {
+        key = std::uint64_t(1) << 60 | (0xFFFF - depth) << 44 | 
+              program << 32 | std::uint64_t(halfTextureUV) << 31 | 
+              textures << 16 | material;
+    }
+    m_items.push_back(Item{key, shader, mesh, model, halfTextureUV, lod});
+}
+
+
+void Object::RenderQueue::flush() {
+    m_isOpen = false;
+    if (m_items.empty())
+        return;
+    
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (!context) {
+        qWarning() << __FILE__ << __LINE__ <<
+                      "Requires a valid current OpenGL context. \n" <<
+                      "Unable to draw the objects.";
+        m_items.clear();
+        return;
+    }
+    QOpenGLFunctions_4_5_Core * gl = 
+        context->versionFunctions<QOpenGLFunctions_4_5_Core>();
+    if (gl && gl->initializeOpenGLFunctions())
+        draw(gl);
+    else
+        qWarning() << __FILE__ << __LINE__ <<
+            "Could not obtain required OpenGL context version";
+    m_items.clear();
+}
+
+
+void Object::RenderQueue::cleanUp() {
+    m_items.clear();
+    m_isOpen = false;
+    m_programIds.clear();
+    m_textureIds.clear();
+}
+
+
+void Object::RenderQueue::draw(QOpenGLFunctions_4_5_Core * gl) {
+    std::stable_sort(
+        m_items.begin(), m_items.end(), 
+        [](const Item & a, const Item & b) {return a.key < b.key;}
+    );
+    
+    // The state bound when the queue is flushed is unknown
+    ObjectShader * shader = nullptr;
+    int halfTextureUV = -1;
+    GLuint material = 0;
+    bool hasMaterial = false;
+    MaterialTable::bind();
+    const TextureArrays::Array * textures[3] = {nullptr, nullptr, nullptr};
+    static constexpr unsigned int UNITS[3] = {
+        COLOR_TEXTURE_UNIT, NORMAL_TEXTURE_UNIT, BUMP_TEXTURE_UNIT
+    };
+    
+    for (const Item & item : m_items) {
+        GLenum type;
+        GLsizei count;
+        size_t offset;
+        GLint baseVertex;
+        if (!item.mesh->getDrawRange(item.lod, type, count, offset, 
+                                     baseVertex))
+            continue;
+        
+        // Program, the uniforms of the material belong to the program
+        if (item.shader != shader) {
+            shader = item.shader;
+            shader->bind();
+            hasMaterial = false;
+            m_statistics.programBinds++;
+        }
+        else {
+            m_statistics.programBindsAvoided++;
+        }
+        
+        // VAO of the vertex format
+        if (static_cast<int>(item.halfTextureUV) != halfTextureUV) {
+            halfTextureUV = item.halfTextureUV;
+            GeometryHeap::bind(gl, item.halfTextureUV);
+            m_statistics.vaoBinds++;
+        }
+        else {
+            m_statistics.vaoBindsAvoided++;
+        }
+        
+        // Material and textures
+        if (shader->usesMaterials()) {
+            const GLuint index = item.mesh->getMaterialIndex();
+            if (!hasMaterial || index != material) {
+                material = index;
+                hasMaterial = true;
+                shader->setMaterialIndex(index);
+                m_statistics.materialUpdates++;
+            }
+            else {
+                m_statistics.materialUpdatesAvoided++;
+            }
+            
+            const Material * meshMaterial = item.mesh->getMaterial().get();
+            const TextureArrays::Array * meshTextures[3] = {
+                getArray(meshMaterial->getDiffuseTexture()), 
+                getArray(meshMaterial->getNormalTexture()),
+                getArray(meshMaterial->getBumpTexture())
+            };
+            for (unsigned int i = 0; i < 3; i++) {
+                if (meshTextures[i] == nullptr)
+                    continue;
+                if (meshTextures[i] != textures[i]) {
+                    textures[i] = meshTextures[i];
+                    TextureArrays::bind(gl, textures[i], UNITS[i]);
+                    m_statistics.textureBinds++;
+                }
+                else {
+                    m_statistics.textureBindsAvoided++;
+                }
+            }
+        }
+        
+        // The shadow shader draws the mesh once per cascade
+        shader->setModelMatrix(item.model);
+        gl->glDrawElementsInstancedBaseVertex(
+            GL_TRIANGLES, count, type, reinterpret_cast<const void*>(offset),
+            shader->getInstanceCount(), baseVertex
+        );
+        m_statistics.draws++;
+    }
+    GeometryHeap::unbind(gl);
+}
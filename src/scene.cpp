@@ -1,5 +1,8 @@
 #include "../include/scene.h"
 
+// Size of the spatial cells used to batch the static objects (m)
+static constexpr float BATCH_CELL_SIZE = 50.0f;
+
 
 /***
  *       _____                     
@@ -15,6 +18,7 @@
 Scene::Scene(unsigned int refreshRate, QString envFile, std::vector<QString> vehList) : 
     m_camera(0.0f, 0.0f,QVector3D(0.0f, 0.0f, 0.0f)),
     m_frame(QVector3D(0.0f, 0.0f, 1.0f)),
+    m_impostorPlaceholders(false),
     m_timestep(0.0f),
     m_refreshRate(refreshRate),
     m_timeRate(1.0f),
@@ -37,12 +41,43 @@ void Scene::initialize() {
     QVector3D lightIntensity(1.0f, 1.0f, 1.0f);
     m_light = CasterLight(lightIntensity, lightDirection);
 
+    // Compile the programs of the scene together, so the driver can compile
+    // them in parallel, the programs below load their cached binary
+    const QStringList indirect("INDIRECT");
+    const QStringList layer(ObjectShadowShader::getLayerDefine());
+    const QStringList indirectLayer({"INDIRECT", layer.first()});
+    ShaderRegistry::precompile({
+        {{{QOpenGLShader::Vertex, ":/shaders/object.vert"},
+          {QOpenGLShader::Fragment, ":/shaders/object.frag"}}, {}},
+        {{{QOpenGLShader::Vertex, ":/shaders/object.vert"},
+          {QOpenGLShader::Fragment, ":/shaders/object.frag"}}, indirect},
+        {ObjectShadowShader::getStages(":/shaders/object_shadow.vert",
+                                       ":/shaders/object_shadow.frag", layer),
+         layer},
+        {ObjectShadowShader::getStages(":/shaders/object_shadow.vert",
+                                       ":/shaders/object_shadow.frag", 
+                                       indirectLayer),
+         indirectLayer},
+        {{{QOpenGLShader::Compute, ":/shaders/object_cull.comp"}},
+         QStringList(QString("NUM_LODS %1").arg(NUM_LODS))},
+        {{{QOpenGLShader::Vertex, ":/shaders/skybox.vert"},
+          {QOpenGLShader::Fragment, ":/shaders/skybox.frag"}}, {}},
+        {{{QOpenGLShader::Vertex, ":/shaders/line.vert"},
+          {QOpenGLShader::Fragment, ":/shaders/line.frag"}}, {}},
+        {{{QOpenGLShader::Vertex, ":/shaders/line_batch.vert"},
+          {QOpenGLShader::Fragment, ":/shaders/line_batch.frag"}}, {}},
+        {{{QOpenGLShader::Vertex, ":/shaders/impostor.vert"},
+          {QOpenGLShader::Fragment, ":/shaders/impostor.frag"}}, {}}
+    });
+
     // Set up the skybox
     m_skybox.initialize();
-    m_frame.initialize();
+    m_lines.initialize();
+    m_impostors.initialize();
+    m_indirect.initialize();
     
     // Load the objects of the environment
-    Loader loader;
+    Loader loader(m_impostors);
     loader.parse(m_envFile);
     p_graph = loader.getSceneGraph();
     
@@ -55,8 +90,15 @@ void Scene::initialize() {
         }
     }
 
-    // Initialize all the loaded objects
+    // Initialize all the loaded objects, then release the unused capacity of
+    // the geometry heap grown while they were allocated
     ObjectManager::initialize();
+    GeometryHeap::defragment();
+    Object::reportOptimization();
+    
+    // Render the impostors of the distant models
+    m_impostors.bake(m_light);
+    m_impostorPlaceholders = TextureManager::isLoading();
     
     // Get the simulation duration from the vehicle trajectory
     m_firstTimestep = 0.0f;
@@ -109,6 +151,14 @@ void Scene::update() {
 //     m_view = m_light.getViewMatrix();
 //     m_projection = m_light.getProjectionMatrix(m_camera, m_cascades).at(2);
     m_lightSpace = m_light.getLightSpaceMatrix(m_camera, m_cascades);
+    
+    // Upload the textures decoded in the background, the impostors are
+    // baked again once all of them have replaced their placeholder
+    TextureManager::update();
+    if (m_impostorPlaceholders && !TextureManager::isLoading()) {
+        m_impostors.bake(m_light);
+        m_impostorPlaceholders = false;
+    }
 }
 
 
@@ -122,9 +172,22 @@ void Scene::render() {
     }
     
     // Call the render method of object in the scene
+    m_lines.clear();
+    m_impostors.clear(m_view);
+    m_indirect.clear(m_view, m_projection);
+    PassUniforms::update(
+        m_light, m_view, m_projection, m_lightSpace, m_cascades
+    );
     m_skybox.render(m_view, m_projection);
-    if (p_graph != nullptr)
-        p_graph->render(m_light, m_view, m_projection, m_lightSpace, m_cascades);
+    Object::RenderQueue::open();
+    if (p_graph != nullptr) {
+        p_graph->render(
+            m_light, m_view, m_projection, m_lightSpace, m_cascades, 
+            m_impostors, m_indirect
+        );
+    }
+    m_indirect.render();
+    m_impostors.render(m_view, m_projection);
     for (unsigned int i = 0; i < m_vehicles.size(); i++) {
         if (m_vehicles.at(i) != nullptr) {
             if (m_snapshotMode) {
@@ -135,25 +198,37 @@ void Scene::render() {
                     m_vehicles.at(i)->render(
                         m_light, m_view, m_projection, m_lightSpace, m_cascades
                     );
+                    m_vehicles.at(i)->renderTireForces(m_lines);
                 }
             } else {
                 m_vehicles.at(i)->render(
                     m_light, m_view, m_projection, m_lightSpace, m_cascades
                 );
+                m_vehicles.at(i)->renderTireForces(m_lines);
             }
         }
     }
+    
+    // Draw the meshes queued by the objects, sorted by state
+    Object::RenderQueue::flush();
     if (m_showGlobalFrame) {
         m_frame.setModelMatrix(QMatrix4x4());
-        m_frame.render(m_light, m_view, m_projection, m_lightSpace, m_cascades);
+        m_frame.render(m_lines);
     }
+    
+    // Draw all the lines at once
+    m_lines.render(m_view, m_projection);
 }
 
 
-void Scene::renderShadow(unsigned int cascadeIdx) {
-    // Render the shadow map
+void Scene::renderShadow() {
+    // Render the shadow map of all the cascades
+    PassUniforms::updateShadow(m_lightSpace);
+    Object::RenderQueue::open();
+    m_indirect.clearShadow(m_lightSpace);
     if (p_graph != nullptr)
-        p_graph->renderShadow(m_lightSpace.at(cascadeIdx));
+        p_graph->renderShadow(m_lightSpace, m_indirect);
+    m_indirect.renderShadow();
     for (unsigned int i = 0; i < m_vehicles.size(); i++) {
         if (m_vehicles.at(i) != nullptr) {
             if (m_snapshotMode) {
@@ -161,21 +236,31 @@ void Scene::renderShadow(unsigned int cascadeIdx) {
                     float timestep = m_firstTimestep + static_cast<float>(k)/m_numSnapshot * 
                         (m_finalTimestep - m_firstTimestep);
                     m_vehicles.at(i)->updatePosition(timestep);
-                    m_vehicles.at(i)->renderShadow(m_lightSpace.at(cascadeIdx));
+                    m_vehicles.at(i)->renderShadow(m_lightSpace);
                 }
             } else {
-                m_vehicles.at(i)->renderShadow(m_lightSpace.at(cascadeIdx));
+                m_vehicles.at(i)->renderShadow(m_lightSpace);
             }
         }
     }
+    Object::RenderQueue::flush();
 }
 
 
 void Scene::cleanUp() {
     m_skybox.cleanUp();
-    m_frame.cleanup();
+    m_lines.cleanUp();
+    m_impostors.cleanUp();
+    m_indirect.cleanUp();
+    Object::RenderQueue::cleanUp();
     ObjectManager::cleanUp();
+    GeometryHeap::cleanUp();
+    MaterialTable::cleanUp();
+    PassUniforms::cleanUp();
+    ShaderRegistry::cleanUp();
     TextureManager::cleanUp();
+    TextureAtlas::cleanUp();
+    TextureArrays::cleanUp();
 }
 
 
@@ -217,7 +302,8 @@ void Scene::updateTimestep() {
 #include <QXmlSchema>
 #include <QXmlSchemaValidator>
 
-Scene::Loader::Loader() {}
+Scene::Loader::Loader(ImpostorRenderer & impostors) : 
+    m_impostors(impostors) {}
 
 Scene::Loader::~Loader() {}
 
@@ -281,6 +367,9 @@ void Scene::Loader::parse(QString const fileNameIn) {
     QDomElement group = world.firstChildElement();
     p_rootNode = std::make_unique<Node>();
     processGroup(group, p_rootNode);
+    
+    // Reduce the number of draw calls of the static environment
+    batchStaticObjects();
 }
 
 bool Scene::Loader::qStringToQVector3D(const QString & string, QVector3D & vec) {
@@ -419,6 +508,12 @@ ABCObject *  Scene::Loader::processModel(const QDomElement & elmt) {
     Object::Loader modelLoader(fileName, textureDir);
     if (modelLoader.build()) {
         model = ObjectManager::loadObject(name, modelLoader.getObject());
+        
+        // Render the distant instances of the model as impostors
+        bool ok;
+        float distance = elmt.attribute("impostorDistance", "").toFloat(&ok);
+        if (ok && model != nullptr)
+            m_impostors.addModel(static_cast<Object *>(model), distance);
         return model;
     }
     return nullptr;
@@ -467,6 +562,32 @@ ABCObject * Scene::Loader::processReference(const QDomElement& elmt) {
 }
 
 
+void Scene::Loader::batchStaticObjects() {
+    // The objects drawn several times are kept as they are
+    std::map<const ABCObject *, unsigned int> counts;
+    p_rootNode->countObjects(counts);
+    
+    // Remove the batched objects from the scene graph
+    Object::Batcher batcher(BATCH_CELL_SIZE);
+    std::vector<const ABCObject *> batched;
+    p_rootNode->batchObjects(counts, m_impostors, batcher, batched);
+    if (batched.empty())
+        return;
+    
+    // Add the merged objects to the root node (world coordinates)
+    std::vector<std::unique_ptr<Object>> batches = batcher.build();
+    for (unsigned int i = 0; i < batches.size(); i++) {
+        // The name cannot conflict with an XML ID which cannot contain '#'
+        QString name = QString("#batch%1").arg(i);
+        p_rootNode->addObject(
+            ObjectManager::loadObject(name, std::move(batches[i]))
+        );
+    }
+    for (unsigned int i = 0; i < batched.size(); i++)
+        ObjectManager::unloadObject(batched[i]);
+}
+
+
 
 
 /***
@@ -489,14 +610,23 @@ void Scene::Node::render(
     const CasterLight & light, const QMatrix4x4 & view, 
     const QMatrix4x4 & projection, 
     const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace,
-    const std::array<float,NUM_CASCADES+1> & cascades
+    const std::array<float,NUM_CASCADES+1> & cascades,
+    ImpostorRenderer & impostors, Object::IndirectRenderer & indirect
 ) {
     // Draw the node
     for (auto it = m_objects.begin(); it != m_objects.end(); it++) {
         if (*it != nullptr) {
+            // Queue the distant objects to draw them as impostors
+            if (impostors.addInstance(*it, m_worldMatrix))
+                continue;
+            
             // Set model matrix
             (*it)->setModelMatrix(m_worldMatrix);
             
+            // Queue the objects drawn with the multi-draw indirect calls
+            if (indirect.addInstance(*it, m_worldMatrix))
+                continue;
+            
             // Draw
             (*it)->render(
                 light, view, projection, lightSpace, cascades
@@ -506,18 +636,28 @@ void Scene::Node::render(
     
     // Draw its descendant
     for (auto it = m_children.begin(); it != m_children.end(); it++) {
-        (*it)->render(light, view, projection, lightSpace, cascades);
+        (*it)->render(
+            light, view, projection, lightSpace, cascades, impostors, 
+            indirect
+        );
     }
 }
 
 
-void Scene::Node::renderShadow(const QMatrix4x4& lightSpace) {
+void Scene::Node::renderShadow(
+    const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace, 
+    Object::IndirectRenderer & indirect
+) {
     // Draw the node
     for (auto it = m_objects.begin(); it != m_objects.end(); it++) {
         if (*it != nullptr) {
             // Set model matrix
             (*it)->setModelMatrix(m_worldMatrix);
             
+            // Queue the objects drawn with the multi-draw indirect calls
+            if (indirect.addInstance(*it, m_worldMatrix))
+                continue;
+            
             // Draw
             (*it)->renderShadow(lightSpace);
         }
@@ -525,7 +665,43 @@ void Scene::Node::renderShadow(const QMatrix4x4& lightSpace) {
     
     // Draw its descendant
     for (auto it = m_children.begin(); it != m_children.end(); it++) {
-        (*it)->renderShadow(lightSpace);
+        (*it)->renderShadow(lightSpace, indirect);
+    }
+}
+
+
+void Scene::Node::countObjects(
+    std::map<const ABCObject *, unsigned int> & counts
+) const {
+    for (auto it = m_objects.begin(); it != m_objects.end(); it++) {
+        if (*it != nullptr)
+            counts[*it]++;
+    }
+    for (auto it = m_children.begin(); it != m_children.end(); it++) {
+        (*it)->countObjects(counts);
+    }
+}
+
+
+void Scene::Node::batchObjects(
+    const std::map<const ABCObject *, unsigned int> & counts,
+    const ImpostorRenderer & impostors, Object::Batcher & batcher,
+    std::vector<const ABCObject *> & batched
+) {
+    for (auto it = m_objects.begin(); it != m_objects.end();) {
+        const Object * object = dynamic_cast<const Object *>(*it);
+        if (object != nullptr && counts.at(*it) == 1 && 
+            !impostors.hasModel(*it) && 
+            batcher.addInstance(object, m_worldMatrix)) {
+            batched.push_back(*it);
+            it = m_objects.erase(it);
+        }
+        else {
+            it++;
+        }
+    }
+    for (auto it = m_children.begin(); it != m_children.end(); it++) {
+        (*it)->batchObjects(counts, impostors, batcher, batched);
     }
 }
 
@@ -1,6 +1,10 @@
 #include "../include/shaderprogram.h"
+#include "../include/passuniforms.h"
+#include "../include/shaderregistry.h"
 
-#include <QOpenGLFunctions>
+#include <QFile>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
 
 
 /***
@@ -14,18 +18,61 @@
  *                                              
  */
 
-Shader::Shader(QString vShader, QString fShader) {
-    // Compile vertex shader
-    if (!addShaderFromSourceFile(QOpenGLShader::Vertex, vShader.toUtf8()))
-        qCritical() << "Unable to compile vertex shader. Log:" << log();
+Shader::Shader(QString vShader, QString fShader, const QStringList & defines) {
+    build({{QOpenGLShader::Vertex, vShader}, 
+           {QOpenGLShader::Fragment, fShader}}, defines);
+}
+
 
-    // Compile fragment shader
-    if (!addShaderFromSourceFile(QOpenGLShader::Fragment,fShader.toUtf8()))
-        qCritical() << "Unable to compile fragment shader. Log:" << log();
+void Shader::build(const Stages & stages, const QStringList & defines) {
+    std::vector<QByteArray> sources;
+    for (const auto & stage : stages)
+        sources.push_back(readSource(stage.second, defines));
+    
+    // Skip the compilation if the driver accepts the cached binary
+    const QByteArray key = ShaderRegistry::programKey(stages, sources);
+    if (ShaderRegistry::loadProgram(*this, key))
+        return;
+    
+    // Compile the shaders
+    for (size_t i = 0; i < stages.size(); i++) {
+        if (!addShaderFromSourceCode(stages[i].first, sources[i]))
+            qCritical() << "Unable to compile shader" << stages[i].second << 
+                           ". Log:" << log();
+    }
 
     // Link the shaders together into a program
+    ShaderRegistry::setRetrievable(*this);
     if (!link())
         qCritical() << "Unable to link shader program. Log:" << log();
+    else
+        ShaderRegistry::saveProgram(programId(), key);
+}
+
+
+QByteArray Shader::readSource(
+    const QString & path, const QStringList & defines
+) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical() << __FILE__ << __LINE__ << 
+            "Unable to read the shader" << path;
+        return QByteArray();
+    }
+    QByteArray source = file.readAll();
+    if (defines.isEmpty())
+        return source;
+    
+    // The version directive must stay the first statement of the shader
+    int position = 0;
+    if (source.startsWith("#version")) {
+        position = source.indexOf('\n');
+        position = position < 0 ? source.size() : position + 1;
+    }
+    QByteArray definitions;
+    for (const QString & define : defines)
+        definitions += QByteArray("#define ") + define.toUtf8() + "\n";
+    return source.insert(position, definitions);
 }
 
 
@@ -47,159 +94,133 @@ Shader::Shader(QString vShader, QString fShader) {
  *                                              
  */
 
-void ObjectShader::setMaterialUniforms(const Material & material) {
-    // Set material properties
-    setUniformValue("Ka", material.getAmbientColor());
-    setUniformValue("Kd", material.getDiffuseColor());
-    setUniformValue("Ks", material.getSpecularColor());
-    setUniformValue("shininess", material.getShininess());
-    setUniformValue("alpha", material.getAlpha());
-    setUniformValue("heightScale", material.getHeightScale());
+ObjectShader::ObjectShader(
+    QString vShader, QString fShader, const QStringList & defines
+) : ObjectShader(Stages({{QOpenGLShader::Vertex, vShader}, 
+                         {QOpenGLShader::Fragment, fShader}}), defines) {}
+
+
+ObjectShader::ObjectShader(const Stages & stages, const QStringList & defines) {
+    build(stages, defines);
     
-    // Apply the texture
-    if (material.getDiffuseTexture() != nullptr)
-        material.getDiffuseTexture()->bind(COLOR_TEXTURE_UNIT);
-    if (material.getNormalTexture() != nullptr)
-        material.getNormalTexture()->bind(NORMAL_TEXTURE_UNIT);
-    if (material.getBumpTexture() != nullptr)
-        material.getBumpTexture()->bind(BUMP_TEXTURE_UNIT);
+    // Cache the locations of the uniforms set per draw
+    m_locations.model      = uniformLocation("M");
+    m_locations.drawOffset = uniformLocation("drawOffset");
+    m_locations.material   = uniformLocation("materialIndex");
+    
+    // The texture units of the samplers never change
+    bind();
     setUniformValue("diffuseSampler", COLOR_TEXTURE_UNIT);
     setUniformValue("normalSampler",  NORMAL_TEXTURE_UNIT);
     setUniformValue("depthSampler",   BUMP_TEXTURE_UNIT);
-    for (unsigned int i = 0; i < NUM_CASCADES; i++) {
-        char name[128] = {0};
-        snprintf(name, sizeof(name), "shadowMap[%d]", i);
-        setUniformValue(name, SHADOW_TEXTURE_UNITS[i]);
-    }
-}
-
-
-void ObjectShader::setMatrixUniforms(
-    const QMatrix4x4 & M, const QMatrix4x4 & V, const QMatrix4x4 & P, 
-    const QMatrix4x4 lVP[]
-) {
-    QMatrix4x4 MV = V*M;
-    QMatrix4x4 MVP = P * MV;
-    QMatrix3x3 N = MV.normalMatrix();
-
-    // Set matrices uniform
-    setUniformValue("M", M);
-    setUniformValue("MV", MV);
-    setUniformValue("MVP", MVP);
-    setUniformValue("N", N);
+    setUniformValue("shadowMap",      SHADOW_TEXTURE_UNIT);
+    release();
     
-    // Set camera position uniform
-    QVector3D cameraPosition(V.inverted().column(3));
-    setUniformValue("cameraPosition", 
-        QVector3D(V*QVector4D(cameraPosition))
-    );
-    
-    // Set light transform uniform for shadow mapping for all cascades
+    // Check the layout of the uniform block of the pass
     QOpenGLContext * context = QOpenGLContext::currentContext();
     if (!context) {
         qWarning() << __FILE__ << __LINE__ <<
-                      "Requires a valid current OpenGL context. \n" <<
-                      "Unable to draw the object.";
+                      "Requires a valid current OpenGL context.";
         return;
     }
-    QOpenGLFunctions * glFunctions = context->functions();
-    for(unsigned int i = 0; i < NUM_CASCADES; i++) {
-        // Find the location of the uniform
-        char name[128] = {0};
-        snprintf(name, sizeof(name), "lMVP[%d]", i);
-        GLuint location = glFunctions->glGetUniformLocation(
-            programId(), name
+    QOpenGLExtraFunctions * glFunctions = context->extraFunctions();
+    GLuint index = glFunctions->glGetUniformBlockIndex(
+        programId(), "PassUniforms"
+    );
+    if (index != GL_INVALID_INDEX) {
+        GLint size = 0;
+        glFunctions->glGetActiveUniformBlockiv(
+            programId(), index, GL_UNIFORM_BLOCK_DATA_SIZE, &size
         );
-        // Set uniform
-        QMatrix4x4 lMVP = lVP[i] * M;
-        glFunctions->glUniformMatrix4fv(location, 1, GL_FALSE, lMVP.constData());
+        if (size != PassUniforms::getDataSize()) {
+            qWarning() << __FILE__ << __LINE__ <<
+                "The uniform block PassUniforms of the shader does not match "
+                "PassUniforms::Data:" << size << "bytes instead of" << 
+                PassUniforms::getDataSize();
+        }
     }
 }
 
 
-void ObjectShader::setLightUniforms(
-    const CasterLight & light, const QMatrix4x4 & V
-) {
-    setUniformValue("lightIntensity", light.getIntensity());
-    setUniformValue("lightDirection", V * light.getDirection());
-}
-
-
-void ObjectShader::setCascadeUniforms(
-    const std::array<float,NUM_CASCADES+1> & cascades
-) {
-    QOpenGLContext * context = QOpenGLContext::currentContext();
-    if (!context) {
-        qWarning() << __FILE__ << __LINE__ <<
-                      "Requires a valid current OpenGL context. \n" <<
-                      "Unable to draw the object.";
-        return;
-    }
-    QOpenGLFunctions * glFunctions = context->functions();
-    
-    GLuint location = glFunctions->glGetUniformLocation(
-        programId(), "endCascade"
-    );
-    glFunctions->glUniform1fv(location, NUM_CASCADES, cascades.data()+1);
+void ObjectShader::bindTextures(QOpenGLFunctions_4_5_Core * gl, 
+                                const Material & material) {
+    if (material.getDiffuseTexture() != nullptr)
+        TextureArrays::bind(gl, material.getDiffuseTexture()->getArray(), 
+                            COLOR_TEXTURE_UNIT);
+    if (material.getNormalTexture() != nullptr)
+        TextureArrays::bind(gl, material.getNormalTexture()->getArray(), 
+                            NORMAL_TEXTURE_UNIT);
+    if (material.getBumpTexture() != nullptr)
+        TextureArrays::bind(gl, material.getBumpTexture()->getArray(), 
+                            BUMP_TEXTURE_UNIT);
 }
 
 
 
 
 /***
- *          ____   _      _              _            
- *         / __ \ | |    (_)            | |           
- *        | |  | || |__   _   ___   ___ | |_          
- *        | |  | || '_ \ | | / _ \ / __|| __|         
- *        | |__| || |_) || ||  __/| (__ | |_          
- *         \____/ |_.__/ | | \___| \___| \__|         
- *       _____  _       _/ |      _                   
- *      / ____|| |     |__/      | |                  
- *     | (___  | |__    __ _   __| |  ___ __      __  
- *      \___ \ | '_ \  / _` | / _` | / _ \\ \ /\ / /  
- *      ____) || | | || (_| || (_| || (_) |\ V  V /   
- *     |_____/ |_| |_| \__,_| \__,_| \___/  \_/\_/    
- *             _____  _                 _             
- *            / ____|| |               | |            
- *           | (___  | |__    __ _   __| |  ___  _ __ 
- *            \___ \ | '_ \  / _` | / _` | / _ \| '__|
- *            ____) || | | || (_| || (_| ||  __/| |   
- *           |_____/ |_| |_| \__,_| \__,_| \___||_|   
- *                                                    
- *                                                    
+ *       _____  _                 _                  
+ *      / ____|| |               | |                 
+ *     | (___  | |__    __ _   __| |  ___  __      __
+ *      \___ \ | '_ \  / _` | / _` | / _ \ \ \ /\ / /
+ *      ____) || | | || (_| || (_| || (_) | \ V  V / 
+ *     |_____/ |_| |_| \__,_| \__,_| \___/   \_/\_/  
+ *                                                   
+ *                                                   
+ *       _____  _                 _             
+ *      / ____|| |               | |            
+ *     | (___  | |__    __ _   __| |  ___  _ __ 
+ *      \___ \ | '_ \  / _` | / _` | / _ \| '__|
+ *      ____) || | | || (_| || (_| ||  __/| |   
+ *     |_____/ |_| |_| \__,_| \__,_| \___||_|   
+ *                                              
+ *                                              
  */
 
-void ObjectShadowShader::setMaterialUniforms(const Material & /*material*/) {
-    // Nothing to do: no need to apply material to render the shadow 
-    // frame buffer.
-}
-
-
-void ObjectShadowShader::setMatrixUniforms(
-    const QMatrix4x4 & M, const QMatrix4x4 & /*V*/, const QMatrix4x4 & /*P*/, 
-    const QMatrix4x4 lVP[]
-) {
-    QMatrix4x4 lMVP = lVP[0] * M;
-    
-    setUniformValue("lMVP", lMVP);
+QString ObjectShadowShader::getLayerDefine() {
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (context && 
+        context->hasExtension("GL_ARB_shader_viewport_layer_array"))
+        return QString("VERTEX_LAYER");
+    return QString("GEOMETRY_LAYER");
 }
 
 
-void ObjectShadowShader::setLightUniforms(
-    const CasterLight & /*light*/, const QMatrix4x4 & /*V*/
+Shader::Stages ObjectShadowShader::getStages(
+    const QString & vShader, const QString & fShader, 
+    const QStringList & defines
 ) {
-    // Nothing to do
-}
-
-void ObjectShadowShader::setCascadeUniforms(
-    const std::array<float,NUM_CASCADES+1> & cascades
-) {
-    // Nothing to do
-    (void)cascades;
+    Stages stages = {{QOpenGLShader::Vertex, vShader}};
+    if (defines.contains("GEOMETRY_LAYER")) {
+        stages.push_back(std::make_pair(
+            QOpenGLShader::Geometry, QString(":/shaders/object_shadow.geom")
+        ));
+    }
+    stages.push_back(std::make_pair(QOpenGLShader::Fragment, fShader));
+    return stages;
 }
 
 
 
+/***
+ *       _____                                  _         
+ *      / ____|                                | |        
+ *     | |       ___   _ __ ___   _ __   _   _ | |_   ___ 
+ *     | |      / _ \ | '_ ` _ \ | '_ \ | | | || __| / _ \
+ *     | |____ | (_) || | | | | || |_) || |_| || |_ |  __/
+ *      \_____| \___/ |_| |_| |_|| .__/  \__,_| \__| \___|
+ *                               | |                      
+ *                               |_|                      
+ *       _____  _                 _             
+ *      / ____|| |               | |            
+ *     | (___  | |__    __ _   __| |  ___  _ __ 
+ *      \___ \ | '_ \  / _` | / _` | / _ \| '__|
+ *      ____) || | | || (_| || (_| ||  __/| |   
+ *     |_____/ |_| |_| \__,_| \__,_| \___||_|   
+ *                                              
+ *                                              
+ */
 
-
-
+ComputeShader::ComputeShader(QString cShader, const QStringList & defines) {
+    build({{QOpenGLShader::Compute, cShader}}, defines);
+}
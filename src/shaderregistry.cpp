@@ -0,0 +1,258 @@
+#include "../include/shaderregistry.h"
+#include "../include/openglfunctions.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QOpenGLContext>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+// Version of the cache, changing it invalidates the cached binaries
+static constexpr int CACHE_VERSION = 1;
+
+std::map<QString, std::shared_ptr<Shader>> ShaderRegistry::m_shaders;
+std::map<QByteArray, std::pair<GLenum, QByteArray>> ShaderRegistry::m_binaries;
+
+/***
+ *       _____  _                 _             
+ *      / ____|| |               | |            
+ *     | (___  | |__    __ _   __| |  ___  _ __ 
+ *      \___ \ | '_ \  / _` | / _` | / _ \| '__|
+ *      ____) || | | || (_| || (_| ||  __/| |   
+ *     |_____/ |_| |_| \__,_| \__,_| \___||_|   
+ *                                              
+ *                                              
+ *      _____                _       _                
+ *     |  __ \              (_)     | |               
+ *     | |__) |  ___   __ _  _  ___ | |_  _ __  _   _ 
+ *     |  _  /  / _ \ / _` || |/ __|| __|| '__|| | | |
+ *     | | \ \ |  __/| (_| || |\__ \| |_ | |   | |_| |
+ *     |_|  \_\ \___| \__, ||_||___/ \__||_|    \__, |
+ *                     __/ |                     __/ |
+ *                    |___/                     |___/ 
+ */
+
+std::shared_ptr<ComputeShader> ShaderRegistry::getComputeShader(
+    const QString & cShader, const QStringList & defines
+) {
+    const QString key = QString(typeid(ComputeShader).name()) + "|" + 
+                        cShader + "|" + defines.join("|");
+    auto it = m_shaders.find(key);
+    if (it == m_shaders.end()) {
+        it = m_shaders.emplace(
+            key, std::make_shared<ComputeShader>(cShader, defines)
+        ).first;
+    }
+    return std::static_pointer_cast<ComputeShader>(it->second);
+}
+
+
+void ShaderRegistry::precompile(const std::vector<Program> & programs) {
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (!gl)
+        return;
+    
+    // Let the driver compile the shaders on as many threads as it wants
+    typedef void (QOPENGLF_APIENTRYP MaxShaderCompilerThreads)(GLuint count);
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    MaxShaderCompilerThreads maxThreads = nullptr;
+    if (context->hasExtension("GL_KHR_parallel_shader_compile")) {
+        maxThreads = reinterpret_cast<MaxShaderCompilerThreads>(
+            context->getProcAddress("glMaxShaderCompilerThreadsKHR")
+        );
+    }
+    else if (context->hasExtension("GL_ARB_parallel_shader_compile")) {
+        maxThreads = reinterpret_cast<MaxShaderCompilerThreads>(
+            context->getProcAddress("glMaxShaderCompilerThreadsARB")
+        );
+    }
+    if (maxThreads)
+        maxThreads(0xFFFFFFFF);
+    
+    // Start the compilation and the link of the programs that are not cached,
+    // without reading any result
+    struct Pending {
+        QByteArray key;
+        GLuint program;
+        std::vector<GLuint> shaders;
+    };
+    std::vector<Pending> pending;
+    for (const Program & program : programs) {
+        std::vector<QByteArray> sources;
+        for (const auto & stage : program.stages)
+            sources.push_back(Shader::readSource(stage.second, 
+                                                 program.defines));
+        const QByteArray key = programKey(program.stages, sources);
+        if (m_binaries.count(key) || QFile::exists(binaryPath(key)))
+            continue;
+        
+        Pending compiled = {key, gl->glCreateProgram(), {}};
+        for (size_t i = 0; i < program.stages.size(); i++) {
+            const GLenum type = shaderType(program.stages[i].first);
+            const GLchar * source = sources[i].constData();
+            const GLint length = sources[i].size();
+            GLuint shader = gl->glCreateShader(type);
+            gl->glShaderSource(shader, 1, &source, &length);
+            gl->glCompileShader(shader);
+            gl->glAttachShader(compiled.program, shader);
+            compiled.shaders.push_back(shader);
+        }
+        gl->glProgramParameteri(compiled.program, 
+                                GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        gl->glLinkProgram(compiled.program);
+        pending.push_back(compiled);
+    }
+    
+    // Cache the binaries, reading the status waits for the link to complete.
+    // The errors are reported when the program is created from its sources.
+    for (const Pending & compiled : pending) {
+        GLint status = GL_FALSE;
+        gl->glGetProgramiv(compiled.program, GL_LINK_STATUS, &status);
+        if (status == GL_TRUE)
+            saveProgram(compiled.program, compiled.key);
+        for (GLuint shader : compiled.shaders) {
+            gl->glDetachShader(compiled.program, shader);
+            gl->glDeleteShader(shader);
+        }
+        gl->glDeleteProgram(compiled.program);
+    }
+}
+
+
+GLenum ShaderRegistry::shaderType(QOpenGLShader::ShaderType type) {
+    switch (type) {
+        case QOpenGLShader::Vertex:
+            return GL_VERTEX_SHADER;
+        case QOpenGLShader::Fragment:
+            return GL_FRAGMENT_SHADER;
+        case QOpenGLShader::Geometry:
+            return GL_GEOMETRY_SHADER;
+        case QOpenGLShader::TessellationControl:
+            return GL_TESS_CONTROL_SHADER;
+        case QOpenGLShader::TessellationEvaluation:
+            return GL_TESS_EVALUATION_SHADER;
+        case QOpenGLShader::Compute:
+            return GL_COMPUTE_SHADER;
+    }
+    return GL_VERTEX_SHADER;
+}
+
+
+void ShaderRegistry::cleanUp() {
+    m_shaders.clear();
+    m_binaries.clear();
+}
+
+
+QByteArray ShaderRegistry::programKey(
+    const Shader::Stages & stages, const std::vector<QByteArray> & sources
+) {
+    // A binary is only valid for the driver that produced it
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray::number(CACHE_VERSION));
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (gl) {
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            const GLubyte * string = gl->glGetString(name);
+            if (string)
+                hash.addData(reinterpret_cast<const char *>(string));
+            hash.addData("\n", 1);
+        }
+    }
+    for (size_t i = 0; i < stages.size() && i < sources.size(); i++) {
+        hash.addData(QByteArray::number(static_cast<int>(stages[i].first)));
+        hash.addData(sources[i]);
+    }
+    return hash.result().toHex();
+}
+
+
+bool ShaderRegistry::loadProgram(
+    QOpenGLShaderProgram & program, const QByteArray & key
+) {
+    // Read the binary from the memory or the disk
+    std::pair<GLenum, QByteArray> binary;
+    auto it = m_binaries.find(key);
+    if (it != m_binaries.end()) {
+        binary = it->second;
+    }
+    else {
+        QFile file(binaryPath(key));
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+        QDataStream stream(&file);
+        quint32 format = 0;
+        stream >> format >> binary.second;
+        if (stream.status() != QDataStream::Ok || binary.second.isEmpty())
+            return false;
+        binary.first = format;
+    }
+    
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (!gl || !program.create())
+        return false;
+    gl->glProgramBinary(program.programId(), binary.first, 
+                        binary.second.constData(), binary.second.size());
+    GLint status = GL_FALSE;
+    gl->glGetProgramiv(program.programId(), GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        qDebug() << __FILE__ << __LINE__ << 
+            "The cached shader binary" << key << "has been rejected.";
+        m_binaries.erase(key);
+        QFile::remove(binaryPath(key));
+        return false;
+    }
+    
+    // The program has no shader, link() only reads the status of the binary
+    return program.link();
+}
+
+
+void ShaderRegistry::setRetrievable(QOpenGLShaderProgram & program) {
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (gl && program.programId() != 0)
+        gl->glProgramParameteri(program.programId(), 
+                                GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+
+void ShaderRegistry::saveProgram(GLuint program, const QByteArray & key) {
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (!gl)
+        return;
+    GLint length = 0;
+    gl->glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    GLenum format = 0;
+    QByteArray binary(length, Qt::Uninitialized);
+    gl->glGetProgramBinary(program, length, &length, &format, binary.data());
+    binary.resize(length);
+    m_binaries[key] = std::make_pair(format, binary);
+    
+    // Write the binary to the disk, the program is still cached in memory if
+    // it fails
+    const QString path = binaryPath(key);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Unable to write the shader cache" << path;
+        return;
+    }
+    QDataStream stream(&file);
+    stream << static_cast<quint32>(format) << binary;
+    if (stream.status() != QDataStream::Ok || !file.commit())
+        qWarning() << __FILE__ << __LINE__ <<
+            "Unable to write the shader cache" << path;
+}
+
+
+QString ShaderRegistry::binaryPath(const QByteArray & key) {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + 
+           "/shaders/" + QString::fromLatin1(key) + ".bin";
+}
@@ -1,4 +1,6 @@
 #include "../include/skybox.h"
+#include "../include/shaderregistry.h"
+#include <QOpenGLPixelTransferOptions>
 #include <memory>
 
 
@@ -24,72 +26,87 @@ void Skybox::initialize() {
 
 
 void Skybox::createShaderProgram() {
-    m_shader = std::make_unique<Shader>(":/shaders/skybox.vert", 
-                                        ":/shaders/skybox.frag");
+    m_shader = ShaderRegistry::getShader<Shader>(":/shaders/skybox.vert", 
+                                                 ":/shaders/skybox.frag");
 }
 
 
 void Skybox::loadCubeMapTextures() {
-    QTransform posRotation;
-    posRotation.rotate(90);
-    QTransform negRotation;
-    negRotation.rotate(-90);
+    static constexpr QOpenGLTexture::CubeMapFace FACES[6] = {
+        QOpenGLTexture::CubeMapPositiveX, QOpenGLTexture::CubeMapPositiveY,
+        QOpenGLTexture::CubeMapPositiveZ, QOpenGLTexture::CubeMapNegativeX,
+        QOpenGLTexture::CubeMapNegativeY, QOpenGLTexture::CubeMapNegativeZ
+    };
     
-    // Load the texture of the skybox
-    const QImage posX = QImage(
-        "asset/Texture/Skybox/front.jpg"
-    ).mirrored().transformed(posRotation);
-    const QImage posY = QImage(
-        "asset/Texture/Skybox/left.jpg"
-    ).mirrored();
-    const QImage posZ = QImage(
-        "asset/Texture/Skybox/top.jpg"
-    ).mirrored(true, false).transformed(negRotation);
-    const QImage negX = QImage(
-        "asset/Texture/Skybox/back.jpg"
-    ).mirrored(true,false).transformed(posRotation);
-    const QImage negY = QImage(
-        "asset/Texture/Skybox/right.jpg"
-    ).mirrored(true, false);
-    const QImage negZ = QImage(
-        "asset/Texture/Skybox/bottom.jpg"
-    ).mirrored(true, false).transformed(negRotation);
-    
-    if (posX.isNull() || posY.isNull() || posZ.isNull() ||
-        negX.isNull() || negY.isNull() || negZ.isNull())
-        qCritical() << __FILE__ << __LINE__ << "The image file does not exist.";
-
+    // Load the texture of the skybox, the faces must share their format
+    const std::vector<TextureBaker::Job> jobs = getFaces();
+    std::vector<CompressedTextureLoader::Image> faces(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (!TextureBaker::load(jobs[i], faces[i])) {
+            qCritical() << __FILE__ << __LINE__ << 
+                "The image file does not exist.";
+            return;
+        }
+    }
+    for (const CompressedTextureLoader::Image & face : faces) {
+        if (face.format != faces[0].format || face.width != faces[0].width ||
+            face.height != faces[0].height || 
+            face.levels.size() != faces[0].levels.size()) {
+            qCritical() << __FILE__ << __LINE__ << 
+                "The faces of the skybox do not have the same format.";
+            return;
+        }
+    }
+    const bool isCompressed = faces[0].format != GL_RGBA8;
+    const int numLevels = static_cast<int>(faces[0].levels.size());
     
     m_textures = std::make_unique<Texture>(
         Texture::Type::Cubemap, QOpenGLTexture::TargetCubeMap
     );
     
     m_textures->create();
-    m_textures->setSize(posX.width(), posX.height(), posX.depth());
-    m_textures->setFormat(QOpenGLTexture::RGBA8_UNorm);
+    m_textures->setSize(faces[0].width, faces[0].height);
+    m_textures->setFormat(
+        static_cast<QOpenGLTexture::TextureFormat>(faces[0].format)
+    );
+    m_textures->setMipLevels(numLevels);
     m_textures->allocateStorage();
-    m_textures->setData(0, 0, QOpenGLTexture::CubeMapPositiveX,
-                        QOpenGLTexture::BGRA, QOpenGLTexture::UInt8,
-                        (const void*)posX.constBits(), 0);
-    m_textures->setData(0, 0, QOpenGLTexture::CubeMapPositiveY,
-                        QOpenGLTexture::BGRA, QOpenGLTexture::UInt8,
-                        (const void*)posY.constBits(), 0);
-    m_textures->setData(0, 0, QOpenGLTexture::CubeMapPositiveZ,
-                        QOpenGLTexture::BGRA, QOpenGLTexture::UInt8,
-                        (const void*)posZ.constBits(), 0);
-    m_textures->setData(0, 0, QOpenGLTexture::CubeMapNegativeX,
-                        QOpenGLTexture::BGRA, QOpenGLTexture::UInt8,
-                        (const void*)negX.constBits(), 0);
-    m_textures->setData(0, 0, QOpenGLTexture::CubeMapNegativeY,
-                        QOpenGLTexture::BGRA, QOpenGLTexture::UInt8,
-                        (const void*)negY.constBits(), 0);
-    m_textures->setData(0, 0, QOpenGLTexture::CubeMapNegativeZ,
-                        QOpenGLTexture::BGRA, QOpenGLTexture::UInt8,
-                        (const void*)negZ.constBits(), 0);
+    QOpenGLPixelTransferOptions options;
+    options.setAlignment(1);
+    for (size_t i = 0; i < faces.size(); i++) {
+        for (int level = 0; level < numLevels; level++) {
+            const QByteArray & data = faces[i].levels[level];
+            if (isCompressed) {
+                m_textures->setCompressedData(
+                    level, 0, FACES[i], data.size(), data.constData()
+                );
+            }
+            else {
+                m_textures->setData(
+                    level, 0, FACES[i], QOpenGLTexture::RGBA, 
+                    QOpenGLTexture::UInt8, data.constData(), &options
+                );
+            }
+        }
+    }
     m_textures->setWrapMode(QOpenGLTexture::ClampToEdge);
-    m_textures->setMinificationFilter(QOpenGLTexture::Linear);
+    m_textures->setMinificationFilter(
+        numLevels > 1 ? QOpenGLTexture::LinearMipMapLinear : 
+                        QOpenGLTexture::Linear
+    );
     m_textures->setMagnificationFilter(QOpenGLTexture::Linear);
-    m_textures->generateMipMaps();
+}
+
+
+std::vector<TextureBaker::Job> Skybox::getFaces() {
+    return {
+        {"asset/Texture/Skybox/front.jpg", false, true, 90},
+        {"asset/Texture/Skybox/left.jpg", false, true, 0},
+        {"asset/Texture/Skybox/top.jpg", true, false, -90},
+        {"asset/Texture/Skybox/back.jpg", true, false, 90},
+        {"asset/Texture/Skybox/right.jpg", true, false, 0},
+        {"asset/Texture/Skybox/bottom.jpg", true, false, -90}
+    };
 }
 
 void Skybox::createBuffers() {
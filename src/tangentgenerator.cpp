@@ -0,0 +1,348 @@
+#include "../include/tangentgenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// SSE2 is part of the x86-64 baseline, no compiler flag is needed
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TANGENT_GENERATOR_SSE2
+#endif
+
+// Number of vertices below which the orthonormalization is not parallelized
+static constexpr unsigned int PARALLEL_MIN_VERTICES = 1 << 16;
+
+#ifdef TANGENT_GENERATOR_SSE2
+namespace {
+
+/**
+ * @brief Return {u[i], u[i], w[j], w[j]}.
+ */
+template <int i, int j>
+inline __m128 pair(__m128 u, __m128 w) {
+    return _mm_shuffle_ps(u, w, _MM_SHUFFLE(j, j, i, i));
+}
+
+/**
+ * @brief Return {p[0], p[2], q[0], q[2]}.
+ */
+inline __m128 combine(__m128 p, __m128 q) {
+    return _mm_shuffle_ps(p, q, _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+/**
+ * @brief Vectors of 4 vertices, one component per register.
+ */
+struct Vector4 {
+    __m128 x;
+    __m128 y;
+    __m128 z;
+};
+
+/**
+ * @brief Load the vectors of 4 consecutive vertices (12 floats).
+ */
+inline Vector4 load(const float * data) {
+    const __m128 a = _mm_loadu_ps(data);     // x0 y0 z0 x1
+    const __m128 b = _mm_loadu_ps(data + 4); // y1 z1 x2 y2
+    const __m128 c = _mm_loadu_ps(data + 8); // z2 x3 y3 z3
+    return Vector4{
+        combine(pair<0,3>(a, a), pair<2,1>(b, c)),
+        combine(pair<1,0>(a, b), pair<3,2>(b, c)),
+        combine(pair<2,1>(a, b), pair<0,3>(c, c))
+    };
+}
+
+/**
+ * @brief Store the vectors of 4 consecutive vertices (12 floats).
+ */
+inline void store(float * data, const Vector4 & v) {
+    _mm_storeu_ps(data,     combine(pair<0,0>(v.x, v.y), pair<0,1>(v.z, v.x)));
+    _mm_storeu_ps(data + 4, combine(pair<1,1>(v.y, v.z), pair<2,2>(v.x, v.y)));
+    _mm_storeu_ps(data + 8, combine(pair<2,3>(v.z, v.x), pair<3,3>(v.y, v.z)));
+}
+
+inline __m128 dot(const Vector4 & u, const Vector4 & v) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(u.x, v.x), _mm_mul_ps(u.y, v.y)),
+                      _mm_mul_ps(u.z, v.z));
+}
+
+inline Vector4 cross(const Vector4 & u, const Vector4 & v) {
+    return Vector4{
+        _mm_sub_ps(_mm_mul_ps(u.y, v.z), _mm_mul_ps(u.z, v.y)),
+        _mm_sub_ps(_mm_mul_ps(u.z, v.x), _mm_mul_ps(u.x, v.z)),
+        _mm_sub_ps(_mm_mul_ps(u.x, v.y), _mm_mul_ps(u.y, v.x))
+    };
+}
+
+/**
+ * @brief Return a where the mask is set, b elsewhere.
+ */
+inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline Vector4 select(__m128 mask, const Vector4 & a, const Vector4 & b) {
+    return Vector4{
+        select(mask, a.x, b.x), select(mask, a.y, b.y), select(mask, a.z, b.z)
+    };
+}
+
+}
+#endif
+
+void TangentGenerator::generate(
+    const QVector<float> & vertices,
+    const QVector<float> & normals,
+    const QVector<float> & textureUV,
+    const QVector<unsigned int> & indices,
+    QVector<float> & tangents,
+    QVector<float> & bitangents,
+    bool parallel
+) {
+    const unsigned int numVertices = 
+        static_cast<unsigned int>(vertices.size()) / 3;
+    tangents.fill(0.0f, static_cast<int>(3 * numVertices));
+    bitangents.fill(0.0f, static_cast<int>(3 * numVertices));
+    if (numVertices == 0)
+        return;
+
+    // Without texture coordinates, the tangents are only built from the
+    // normals
+    if (textureUV.size() >= static_cast<int>(2 * numVertices)) {
+        accumulate(
+            vertices.constData(), textureUV.constData(), indices.constData(),
+            static_cast<unsigned int>(indices.size()) / 3, numVertices,
+            tangents.data(), bitangents.data()
+        );
+    }
+    const float * normalData =
+        normals.size() >= static_cast<int>(3 * numVertices) ?
+        normals.constData() : nullptr;
+
+    // Split the vertices over the available threads
+    unsigned int numThreads = 1;
+    if (parallel && numVertices >= PARALLEL_MIN_VERTICES) {
+        numThreads = std::max(1u, std::min(
+            std::thread::hardware_concurrency(),
+            numVertices / PARALLEL_MIN_VERTICES
+        ));
+    }
+    float * tangentData = tangents.data();
+    float * bitangentData = bitangents.data();
+    if (numThreads == 1) {
+        orthonormalize(normalData, tangentData, bitangentData, 0, numVertices);
+        return;
+    }
+    std::vector<std::thread> threads;
+    const unsigned int chunk = (numVertices + numThreads - 1) / numThreads;
+    for (unsigned int i = 1; i < numThreads; i++) {
+        const unsigned int begin = std::min(i * chunk, numVertices);
+        const unsigned int end = std::min(begin + chunk, numVertices);
+        threads.emplace_back(
+            orthonormalize, normalData, tangentData, bitangentData, begin, end
+        );
+    }
+    orthonormalize(normalData, tangentData, bitangentData, 0, chunk);
+    for (std::thread & thread : threads)
+        thread.join();
+}
+
+
+void TangentGenerator::accumulate(
+    const float * vertices, const float * textureUV,
+    const unsigned int * indices, unsigned int numTriangles,
+    unsigned int numVertices, float * tangents, float * bitangents
+) {
+    for (unsigned int i = 0; i < numTriangles; i++) {
+        const unsigned int i0 = indices[3*i];
+        const unsigned int i1 = indices[3*i+1];
+        const unsigned int i2 = indices[3*i+2];
+        if (i0 >= numVertices || i1 >= numVertices || i2 >= numVertices)
+            continue;
+
+        // Edges of the triangle in the object and texture spaces
+        const float * p0 = vertices + 3*i0;
+        const float * p1 = vertices + 3*i1;
+        const float * p2 = vertices + 3*i2;
+        const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        const float u1 = textureUV[2*i1  ] - textureUV[2*i0  ];
+        const float v1 = textureUV[2*i1+1] - textureUV[2*i0+1];
+        const float u2 = textureUV[2*i2  ] - textureUV[2*i0  ];
+        const float v2 = textureUV[2*i2+1] - textureUV[2*i0+1];
+
+        // The tangent space of the triangle is divided by the determinant of
+        // the texture edges: only its sign is kept so that the triangles are
+        // weighted by their area in the object space, and the triangles with
+        // degenerate texture coordinates are ignored
+        const float det = u1 * v2 - u2 * v1;
+        if (det == 0.0f || !std::isfinite(det))
+            continue;
+        const float sign = det > 0.0f ? 1.0f : -1.0f;
+        float t[3];
+        float b[3];
+        for (int j = 0; j < 3; j++) {
+            t[j] = sign * (e1[j] * v2 - e2[j] * v1);
+            b[j] = sign * (e2[j] * u1 - e1[j] * u2);
+        }
+
+        // Add it to the vertices of the triangle
+        for (const unsigned int v : {i0, i1, i2}) {
+            for (int j = 0; j < 3; j++) {
+                tangents[3*v+j] += t[j];
+                bitangents[3*v+j] += b[j];
+            }
+        }
+    }
+}
+
+
+void TangentGenerator::orthonormalize(
+    const float * normals, float * tangents, float * bitangents,
+    unsigned int begin, unsigned int end
+) {
+    unsigned int v = begin;
+#ifdef TANGENT_GENERATOR_SSE2
+    // Same computation as orthonormalizeVertex() on 4 vertices at once, the
+    // branches being replaced by selections
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    for (; v + 4 <= end; v += 4) {
+        float * t = tangents + 3*v;
+        float * b = bitangents + 3*v;
+        const Vector4 accumulatedT = load(t);
+        const Vector4 accumulatedB = load(b);
+
+        // Normal of the vertex, or of the accumulated tangent space
+        Vector4 n = normals ? load(normals + 3*v) : 
+            cross(accumulatedT, accumulatedB);
+        __m128 length = _mm_sqrt_ps(dot(n, n));
+        const __m128 hasNormal = _mm_cmpgt_ps(length, zero);
+        n = select(hasNormal, Vector4{
+            _mm_div_ps(n.x, length), _mm_div_ps(n.y, length), 
+            _mm_div_ps(n.z, length)
+        }, Vector4{zero, zero, one});
+
+        // Gram-Schmidt: remove the normal component of the tangent
+        const __m128 d = dot(n, accumulatedT);
+        Vector4 tangent = {
+            _mm_sub_ps(accumulatedT.x, _mm_mul_ps(d, n.x)),
+            _mm_sub_ps(accumulatedT.y, _mm_mul_ps(d, n.y)),
+            _mm_sub_ps(accumulatedT.z, _mm_mul_ps(d, n.z))
+        };
+        length = _mm_sqrt_ps(dot(tangent, tangent));
+
+        // No valid tangent: use any direction orthogonal to the normal
+        const __m128 isDegenerate = _mm_cmplt_ps(length, _mm_set1_ps(1e-12f));
+        if (_mm_movemask_ps(isDegenerate) != 0) {
+            const __m128 useX = _mm_cmplt_ps(_mm_andnot_ps(signBit, n.x), 
+                                             _mm_set1_ps(0.9f));
+            const Vector4 fallback = {
+                select(useX, _mm_sub_ps(one, _mm_mul_ps(n.x, n.x)),
+                       _mm_xor_ps(signBit, _mm_mul_ps(n.y, n.x))),
+                select(useX, _mm_xor_ps(signBit, _mm_mul_ps(n.x, n.y)),
+                       _mm_sub_ps(one, _mm_mul_ps(n.y, n.y))),
+                _mm_xor_ps(signBit, _mm_mul_ps(select(useX, n.x, n.y), n.z))
+            };
+            tangent = select(isDegenerate, fallback, tangent);
+            length = select(isDegenerate, 
+                            _mm_sqrt_ps(dot(fallback, fallback)), length);
+        }
+        tangent.x = _mm_div_ps(tangent.x, length);
+        tangent.y = _mm_div_ps(tangent.y, length);
+        tangent.z = _mm_div_ps(tangent.z, length);
+
+        // Handedness of the accumulated tangent space, applied by flipping
+        // the sign bits
+        Vector4 bitangent = cross(n, tangent);
+        const __m128 flip = _mm_and_ps(
+            _mm_cmplt_ps(dot(bitangent, accumulatedB), zero), signBit
+        );
+        bitangent.x = _mm_xor_ps(bitangent.x, flip);
+        bitangent.y = _mm_xor_ps(bitangent.y, flip);
+        bitangent.z = _mm_xor_ps(bitangent.z, flip);
+
+        store(t, tangent);
+        store(b, bitangent);
+    }
+#endif
+    for (; v < end; v++)
+        orthonormalizeVertex(normals, tangents, bitangents, v);
+}
+
+
+void TangentGenerator::orthonormalizeVertex(
+    const float * normals, float * tangents, float * bitangents,
+    unsigned int v
+) {
+    float * t = tangents + 3*v;
+    float * b = bitangents + 3*v;
+
+    // Normal of the vertex, or of the accumulated tangent space
+    float n[3];
+    if (normals) {
+        n[0] = normals[3*v];
+        n[1] = normals[3*v+1];
+        n[2] = normals[3*v+2];
+    }
+    else {
+        n[0] = t[1] * b[2] - t[2] * b[1];
+        n[1] = t[2] * b[0] - t[0] * b[2];
+        n[2] = t[0] * b[1] - t[1] * b[0];
+    }
+    float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length > 0.0f) {
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+    }
+    else {
+        n[0] = 0.0f;
+        n[1] = 0.0f;
+        n[2] = 1.0f;
+    }
+
+    // Gram-Schmidt: remove the normal component of the tangent
+    const float dot = n[0] * t[0] + n[1] * t[1] + n[2] * t[2];
+    float tangent[3] = {
+        t[0] - dot * n[0], t[1] - dot * n[1], t[2] - dot * n[2]
+    };
+    length = std::sqrt(
+        tangent[0] * tangent[0] + tangent[1] * tangent[1] +
+        tangent[2] * tangent[2]
+    );
+    if (length < 1e-12f) {
+        // No valid tangent: use any direction orthogonal to the normal
+        const bool useX = std::abs(n[0]) < 0.9f;
+        tangent[0] = useX ? 1.0f - n[0] * n[0] : -n[1] * n[0];
+        tangent[1] = useX ? -n[0] * n[1] : 1.0f - n[1] * n[1];
+        tangent[2] = useX ? -n[0] * n[2] : -n[1] * n[2];
+        length = std::sqrt(
+            tangent[0] * tangent[0] + tangent[1] * tangent[1] +
+            tangent[2] * tangent[2]
+        );
+    }
+    tangent[0] /= length;
+    tangent[1] /= length;
+    tangent[2] /= length;
+
+    // Handedness of the accumulated tangent space
+    const float cross[3] = {
+        n[1] * tangent[2] - n[2] * tangent[1],
+        n[2] * tangent[0] - n[0] * tangent[2],
+        n[0] * tangent[1] - n[1] * tangent[0]
+    };
+    const float handedness =
+        cross[0] * b[0] + cross[1] * b[1] + cross[2] * b[2] < 0.0f ?
+        -1.0f : 1.0f;
+
+    for (int j = 0; j < 3; j++) {
+        t[j] = tangent[j];
+        b[j] = handedness * cross[j];
+    }
+}
@@ -1,4 +1,12 @@
 #include "../include/texture.h"
+#include "../include/materialtable.h"
+#include "../include/openglfunctions.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 
 /***
@@ -18,6 +26,24 @@
 
 // Instantiate static member variables
 TextureManager::TexturesMapsContainer TextureManager::m_textures;
+std::deque<TextureManager::Upload> TextureManager::m_pending;
+std::deque<TextureManager::Upload> TextureManager::m_decoded;
+std::deque<TextureManager::Upload> TextureManager::m_uploads;
+std::mutex TextureManager::m_mutex;
+std::condition_variable TextureManager::m_condition;
+std::vector<std::thread> TextureManager::m_workers;
+bool TextureManager::m_stop = false;
+std::array<TextureManager::Staging, 2> TextureManager::m_staging;
+std::vector<TextureManager::Stream> TextureManager::m_streams;
+GLsizeiptr TextureManager::m_budget = TextureManager::DEFAULT_BUDGET;
+GLsizeiptr TextureManager::m_charged = 0;
+unsigned int TextureManager::m_loads = 0;
+std::map<QByteArray, size_t> TextureManager::m_contents;
+unsigned int TextureManager::m_duplicates = 0;
+qint64 TextureManager::m_duplicateSize = 0;
+bool TextureManager::m_isReported = false;
+unsigned int TextureManager::m_frame = 0;
+unsigned int TextureManager::m_generation = 0;
 
 
 Texture * TextureManager::loadTexture(
@@ -33,12 +59,252 @@ Texture * TextureManager::loadTexture(
             return searchTexture->second.get();
         }
     }
-    // The texture has not been loaded yet
-    m_textures[type][name] = std::make_unique<Texture>(type, image);
+    // The texture has not been loaded yet, copy it to a texture array
+    const TextureArrays::Layer layer = TextureArrays::allocate(image);
+    if (layer.array == nullptr) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "Could not copy the texture" << name << "to a texture array.";
+    }
+    m_textures[type][name] = std::make_unique<Texture>(type, layer);
     return m_textures[type][name].get();
 }
 
 
+Texture * TextureManager::loadTexture(
+    const QString & path, Texture::Type type
+) {
+    Texture * texture = getTexture(path, type);
+    if (texture != nullptr)
+        return texture;
+    
+    // Upload the block-compressed files and the baked files as they are
+    CompressedTextureLoader::Image image;
+    if (read(path, image)) {
+        const TextureArrays::Layer layer = TextureArrays::allocate(image);
+        if (layer.array != nullptr) {
+            m_textures[type][path] = std::make_unique<Texture>(type, layer);
+            m_textures[type][path]->m_isTopDown = image.isTopDown;
+            return m_textures[type][path].get();
+        }
+    }
+    
+    // Decode the other files and the formats not supported by the driver
+    QImage decoded(path);
+    if (decoded.isNull())
+        qCritical() << __FILE__ << __LINE__ << 
+            "The image file does not exist.";
+    return loadTexture(path, type, decoded);
+}
+
+
+Texture * TextureManager::loadTextureAsync(
+    const QString & path, Texture::Type type
+) {
+    Texture * texture = getTexture(path, type);
+    if (texture != nullptr)
+        return texture;
+    
+    // The texture is sampled at the layer of its placeholder until update()
+    // has uploaded it
+    const Texture * placeholder = getDefaultTexture(type);
+    m_textures[type][path] = 
+        std::make_unique<Texture>(type, placeholder->m_layer);
+    texture = m_textures[type][path].get();
+    texture->m_stream = static_cast<int>(m_streams.size());
+    m_streams.push_back(Stream());
+    m_streams.back().textures.push_back(texture);
+    m_streams.back().path = path;
+    
+    Upload upload;
+    upload.texture = texture;
+    upload.path = path;
+    queue(std::move(upload));
+    return texture;
+}
+
+
+Texture * TextureManager::getDefaultTexture(Texture::Type type) {
+    switch (type) {
+        case Texture::Type::Normal:
+            return loadTexture(QString("asset/Texture/Default/normal.png"),
+                               Texture::Type::Normal);
+        case Texture::Type::Bump:
+            return loadTexture(QString("asset/Texture/Default/depth.png"), 
+                               Texture::Type::Bump);
+        default:
+            return loadTexture(QString("asset/Texture/Default/diffuse.png"),
+                               Texture::Type::Diffuse);
+    }
+}
+
+
+void TextureManager::update() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::move(m_decoded.begin(), m_decoded.end(), 
+                  std::back_inserter(m_uploads));
+        m_decoded.clear();
+    }
+    if (m_streams.empty())
+        return;
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (!gl)
+        return;
+    
+    // Apply the requests of the last frame before starting the next one
+    if (stream(gl)) {
+        m_generation++;
+        MaterialTable::updateTextures();
+    }
+    m_frame++;
+    if (m_uploads.empty())
+        return;
+    
+    // The staging buffer of this frame may still be read by the GPU: the
+    // uploads wait for the next frame rather than for the GPU
+    Staging & staging = m_staging[m_frame % m_staging.size()];
+    if (staging.fence != nullptr) {
+        if (gl->glClientWaitSync(staging.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            return;
+        gl->glDeleteSync(staging.fence);
+        staging.fence = nullptr;
+    }
+    if (staging.buffer == 0) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | 
+                                 GL_MAP_COHERENT_BIT;
+        gl->glCreateBuffers(1, &staging.buffer);
+        gl->glNamedBufferStorage(staging.buffer, STAGING_SIZE, nullptr, flags);
+        staging.data = static_cast<uchar *>(gl->glMapNamedBufferRange(
+            staging.buffer, 0, STAGING_SIZE, flags
+        ));
+        if (staging.data == nullptr) {
+            qWarning() << __FILE__ << __LINE__ << 
+                "Could not map the staging buffer of the textures.";
+            gl->glDeleteBuffers(1, &staging.buffer);
+            staging.buffer = 0;
+            return;
+        }
+    }
+    
+    // Upload the textures in order until the staging buffer is full
+    bool isUpdated = false;
+    GLsizeiptr offset = 0;
+    gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+    while (!m_uploads.empty()) {
+        Upload & upload = m_uploads.front();
+        Stream & stream = m_streams[upload.texture->m_stream];
+        
+        // An image identical to a texture already read shares its layer
+        if (!stream.isResident && share(upload)) {
+            isUpdated = true;
+            m_uploads.pop_front();
+            continue;
+        }
+        
+        // The small images are packed in an atlas, from the client memory
+        if (!stream.isResident && TextureAtlas::isPackable(upload.image)) {
+            gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            const TextureArrays::Layer layer = 
+                TextureAtlas::allocate(upload.image);
+            gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+            if (layer.array != nullptr) {
+                setLayer(stream, layer);
+                stream.levels = 0;
+                stream.isResident = true;
+                isUpdated = true;
+                m_uploads.pop_front();
+                continue;
+            }
+        }
+        
+        if (upload.layer.array == nullptr && !reserve(upload)) {
+            if (stream.isResident) {
+                // The finer levels could not be read, the texture keeps its
+                // resolution
+                m_charged -= upload.charge;
+                stream.target = stream.resident;
+                m_loads--;
+            }
+            else {
+                // Decode the formats not supported by the driver, which are
+                // not streamed, the missing files keep their placeholder
+                gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                QImage decoded(upload.path);
+                const TextureArrays::Layer layer = 
+                    TextureArrays::allocate(decoded);
+                if (layer.array != nullptr) {
+                    setLayer(stream, layer);
+                    isUpdated = true;
+                } else {
+                    qWarning() << __FILE__ << __LINE__ << 
+                        "Could not load the texture" << upload.path;
+                }
+                gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+                stream.levels = 0;
+                stream.isResident = true;
+            }
+            m_uploads.pop_front();
+            continue;
+        }
+        if (!uploadLevels(gl, upload, staging, offset))
+            break;
+        
+        // The new layer replaces the placeholder or the coarser levels
+        const TextureArrays::Layer previous = stream.layer;
+        setLayer(stream, upload.layer);
+        if (stream.isResident) {
+            releaseLayer(previous);
+            m_loads--;
+        }
+        stream.resident = stream.target = upload.first;
+        stream.isResident = true;
+        isUpdated = true;
+        m_uploads.pop_front();
+    }
+    gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (offset > 0)
+        staging.fence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    
+    if (isUpdated) {
+        m_generation++;
+        MaterialTable::updateTextures();
+    }
+    
+    // Report the duplicates once the textures of the scene are loaded
+    if (!m_isReported && !isLoading()) {
+        m_isReported = true;
+        if (m_duplicates > 0) {
+            qDebug() << "Texture deduplication:" << m_duplicates 
+                << "duplicate images," << (m_duplicateSize >> 20) 
+                << "MB not uploaded";
+        }
+    }
+}
+
+
+void TextureManager::requestResolution(const Texture * texture, float size) {
+    if (texture == nullptr || texture->m_stream < 0)
+        return;
+    Stream & stream = m_streams[texture->m_stream];
+    if (stream.lastUsed != m_frame) {
+        stream.lastUsed = m_frame;
+        stream.size = size;
+    }
+    else {
+        stream.size = std::max(stream.size, size);
+    }
+}
+
+
+bool TextureManager::isLoading() {
+    for (const Stream & stream : m_streams) {
+        if (!stream.isResident)
+            return true;
+    }
+    return false;
+}
+
+
 Texture * TextureManager::getTexture(QString name, Texture::Type type) {
     TexturesMap::iterator it(m_textures[type].find(name));
     if (it != m_textures.at(type).end())
@@ -49,6 +315,42 @@ Texture * TextureManager::getTexture(QString name, Texture::Type type) {
 
 
 void TextureManager::cleanUp() {
+    // Stop the worker threads
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_pending.clear();
+    }
+    m_condition.notify_all();
+    for (std::thread & worker : m_workers)
+        worker.join();
+    m_workers.clear();
+    m_decoded.clear();
+    m_uploads.clear();
+    
+    // Delete the staging buffers, created by the first frame uploading
+    QOpenGLFunctions_4_5_Core * gl = m_staging.front().buffer != 0 ? 
+        OpenGLFunctions::get() : nullptr;
+    for (Staging & staging : m_staging) {
+        if (gl) {
+            if (staging.fence != nullptr)
+                gl->glDeleteSync(staging.fence);
+            if (staging.buffer != 0) {
+                gl->glUnmapNamedBuffer(staging.buffer);
+                gl->glDeleteBuffers(1, &staging.buffer);
+            }
+        }
+        staging = Staging();
+    }
+    m_streams.clear();
+    m_contents.clear();
+    m_duplicates = 0;
+    m_duplicateSize = 0;
+    m_isReported = false;
+    m_charged = 0;
+    m_loads = 0;
+    m_frame = 0;
+    
     // Delete all textures
     for (
         TexturesMapsContainer::iterator itType = m_textures.begin();
@@ -63,3 +365,361 @@ void TextureManager::cleanUp() {
         }
     }
 }
+
+
+bool TextureManager::read(
+    const QString & path, CompressedTextureLoader::Image & image
+) {
+    const QString file = TextureBaker::isBaked(path) ? 
+        TextureBaker::bakedPath(path) : path;
+    if (CompressedTextureLoader::isCompressedFile(file))
+        return CompressedTextureLoader::load(file, image);
+    // Flip the image like QImage::mirrored() in loadTexture()
+    return TextureBaker::load(TextureBaker::Job{path, false, true, 0}, image,
+                              true);
+}
+
+
+void TextureManager::queue(Upload && upload) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_workers.empty()) {
+            // Keep a core for the thread rendering the frames
+            const unsigned int cores = std::thread::hardware_concurrency();
+            const unsigned int numWorkers = cores > 1 ? cores - 1 : 1;
+            m_stop = false;
+            for (unsigned int i = 0; i < numWorkers; i++)
+                m_workers.emplace_back(decode);
+        }
+        m_pending.push_back(std::move(upload));
+    }
+    m_condition.notify_one();
+}
+
+
+void TextureManager::decode() {
+    while (true) {
+        Upload upload;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [] {return m_stop || !m_pending.empty();});
+            if (m_stop)
+                return;
+            upload = std::move(m_pending.front());
+            m_pending.pop_front();
+        }
+        read(upload.path, upload.image);
+        if (upload.isFirstLoad && !upload.image.isNull())
+            upload.hash = hash(upload.image);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_stop)
+            m_decoded.push_back(std::move(upload));
+    }
+}
+
+
+bool TextureManager::uploadLevels(
+    QOpenGLFunctions_4_5_Core * gl, Upload & upload, Staging & staging,
+    GLsizeiptr & offset
+) {
+    const std::vector<QByteArray> & levels = upload.image.levels;
+    for (; upload.level < static_cast<GLsizei>(levels.size()); 
+         upload.level++) {
+        const QByteArray & level = levels[upload.level];
+        if (level.size() > STAGING_SIZE) {
+            // A level larger than the staging buffer is copied by the driver
+            // from the image, alone in its frame
+            if (offset > 0)
+                return false;
+            gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            TextureArrays::upload(upload.layer, upload.level - upload.first,
+                                  level.constData(), level.size());
+            gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+            offset = STAGING_SIZE;
+            continue;
+        }
+        if (offset + level.size() > STAGING_SIZE)
+            return false;
+        std::memcpy(staging.data + offset, level.constData(), level.size());
+        TextureArrays::upload(upload.layer, upload.level - upload.first, 
+                              reinterpret_cast<const void *>(offset),
+                              level.size());
+        // Keep the offsets aligned for the compressed blocks
+        offset += (level.size() + 15) / 16 * 16;
+    }
+    // The image is not needed anymore
+    upload.image = CompressedTextureLoader::Image();
+    return true;
+}
+
+
+bool TextureManager::reserve(Upload & upload) {
+    Stream & stream = m_streams[upload.texture->m_stream];
+    const CompressedTextureLoader::Image & image = upload.image;
+    if (image.isNull() || !TextureArrays::isSupported(image.format))
+        return false;
+    
+    // The first upload stops at the coarsest level kept by the texture, the
+    // next ones must read the same image
+    const GLsizei levels = static_cast<GLsizei>(image.levels.size());
+    if (!stream.isResident) {
+        stream.format = image.format;
+        stream.width = image.width;
+        stream.height = image.height;
+        stream.levels = levels;
+        stream.isTopDown = image.isTopDown;
+        upload.first = coarsestLevel(stream);
+    }
+    else if (image.format != stream.format || image.width != stream.width ||
+             image.height != stream.height || levels != stream.levels) {
+        qWarning() << __FILE__ << __LINE__ << 
+            "The texture" << upload.path << "has changed since it was loaded.";
+        return false;
+    }
+    
+    upload.level = upload.first;
+    upload.layer = TextureArrays::reserve(
+        stream.format, std::max(1, stream.width >> upload.first),
+        std::max(1, stream.height >> upload.first), 
+        stream.levels - upload.first, true
+    );
+    if (upload.layer.array == nullptr)
+        return false;
+    if (!stream.isResident)
+        stream.target = upload.first;
+    
+    // The layer is now counted in the storage of its array
+    m_charged -= upload.charge;
+    upload.charge = 0;
+    return true;
+}
+
+
+bool TextureManager::stream(QOpenGLFunctions_4_5_Core * gl) {
+    // Number of pixels of a unit of the normalized device coordinates, for
+    // the viewport of the last frame
+    GLint viewport[4] = {0, 0, 0, 0};
+    gl->glGetIntegerv(GL_VIEWPORT, viewport);
+    const float scale = 0.5f * static_cast<float>(viewport[3]);
+    
+    // Level requested by each texture, the textures not used by the last
+    // frame only need their coarsest level
+    std::vector<std::pair<GLsizei, size_t>> loads;
+    for (size_t i = 0; i < m_streams.size(); i++) {
+        Stream & stream = m_streams[i];
+        if (!stream.isResident || stream.levels == 0 || 
+            stream.target != stream.resident)
+            continue;
+        const GLsizei coarsest = coarsestLevel(stream);
+        const float size = stream.size * scale;
+        stream.wanted = coarsest;
+        if (stream.lastUsed == m_frame && size > 0.0f) {
+            const float ratio = 
+                std::max(stream.width, stream.height) / size;
+            stream.wanted = ratio > 1.0f ? std::min(
+                coarsest, static_cast<GLsizei>(std::floor(std::log2(ratio)))
+            ) : 0;
+        }
+        if (stream.wanted < stream.resident)
+            loads.push_back(std::make_pair(stream.resident - stream.wanted, i));
+    }
+    
+    // Load the largest gains first, at the finest level that fits in the
+    // budget once the textures least recently used have dropped levels
+    bool isEvicted = false;
+    std::stable_sort(
+        loads.begin(), loads.end(), 
+        [](const std::pair<GLsizei, size_t> & a, 
+           const std::pair<GLsizei, size_t> & b) {return a.first > b.first;}
+    );
+    for (const auto & load : loads) {
+        if (m_loads >= MAX_LOADS)
+            break;
+        Stream & stream = m_streams[load.second];
+        GLsizei level = stream.wanted;
+        GLsizeiptr size = 0;
+        for (; level < stream.resident; level++) {
+            // The new layer is charged with the memory its array grows by,
+            // at least its own size as the loads queued in this frame may
+            // take the same free layer
+            size = std::max(residentSize(stream, level), 
+                TextureArrays::getReserveSize(
+                    stream.format, std::max(1, stream.width >> level),
+                    std::max(1, stream.height >> level), stream.levels - level
+                )
+            );
+            if (getMemoryUsage() + size > m_budget)
+                isEvicted = evict(size, load.second) || isEvicted;
+            if (getMemoryUsage() + size <= m_budget)
+                break;
+        }
+        if (level == stream.resident)
+            continue;
+        
+        stream.target = level;
+        m_loads++;
+        m_charged += size;
+        Upload upload;
+        upload.texture = stream.textures.front();
+        upload.path = stream.path;
+        upload.first = level;
+        upload.isFirstLoad = false;
+        upload.charge = size;
+        queue(std::move(upload));
+    }
+    return isEvicted;
+}
+
+
+bool TextureManager::evict(GLsizeiptr size, size_t loading) {
+    // Levels that can be dropped: all the levels but the coarsest ones for
+    // the textures not used by the last frame, the levels finer than needed
+    // for the others
+    std::vector<std::pair<size_t, GLsizei>> candidates;
+    GLsizeiptr available = 0;
+    for (size_t i = 0; i < m_streams.size(); i++) {
+        const Stream & stream = m_streams[i];
+        if (i == loading || !stream.isResident || stream.levels == 0 ||
+            stream.target != stream.resident)
+            continue;
+        const GLsizei level = stream.lastUsed == m_frame ? 
+            stream.wanted : coarsestLevel(stream);
+        if (level <= stream.resident)
+            continue;
+        candidates.push_back(std::make_pair(i, level));
+        available += residentSize(stream, stream.resident) - 
+            residentSize(stream, level);
+    }
+    if (getMemoryUsage() + size - available > m_budget)
+        return false;
+    
+    // Drop the levels of the textures least recently used first
+    std::stable_sort(
+        candidates.begin(), candidates.end(),
+        [](const std::pair<size_t, GLsizei> & a, 
+           const std::pair<size_t, GLsizei> & b) {
+            return m_streams[a.first].lastUsed < m_streams[b.first].lastUsed;
+        }
+    );
+    bool isDropped = false;
+    for (const auto & candidate : candidates) {
+        if (getMemoryUsage() + size <= m_budget)
+            break;
+        dropLevels(m_streams[candidate.first], candidate.second);
+        isDropped = true;
+    }
+    return isDropped;
+}
+
+
+void TextureManager::dropLevels(Stream & stream, GLsizei level) {
+    const TextureArrays::Layer layer = TextureArrays::reserve(
+        stream.format, std::max(1, stream.width >> level),
+        std::max(1, stream.height >> level), stream.levels - level, true
+    );
+    if (layer.array == nullptr)
+        return;
+    TextureArrays::copy(stream.layer, level - stream.resident, layer);
+    const TextureArrays::Layer previous = stream.layer;
+    setLayer(stream, layer);
+    releaseLayer(previous);
+    stream.resident = stream.target = level;
+}
+
+
+void TextureManager::releaseLayer(const TextureArrays::Layer & layer) {
+    TextureArrays::release(layer);
+    const std::vector<GLint> layers = TextureArrays::compact(layer.array);
+    if (layers.empty())
+        return;
+    
+    // The layers still used have moved to the first layers of the array
+    for (Stream & stream : m_streams) {
+        if (stream.layer.array != layer.array)
+            continue;
+        TextureArrays::Layer moved = stream.layer;
+        moved.layer = layers[static_cast<size_t>(moved.layer)];
+        setLayer(stream, moved);
+    }
+    for (Upload & upload : m_uploads) {
+        if (upload.layer.array == layer.array)
+            upload.layer.layer = layers[static_cast<size_t>(upload.layer.layer)];
+    }
+}
+
+
+bool TextureManager::share(const Upload & upload) {
+    if (upload.hash.isEmpty())
+        return false;
+    const size_t index = static_cast<size_t>(upload.texture->m_stream);
+    const size_t original = m_contents.emplace(upload.hash, index).first->second;
+    if (original == index)
+        return false;
+    
+    // The textures of the duplicate are streamed with the original, they
+    // keep their placeholder until the original is uploaded
+    Stream & source = m_streams[original];
+    Stream & duplicate = m_streams[index];
+    for (Texture * texture : duplicate.textures) {
+        texture->m_stream = static_cast<int>(original);
+        if (source.isResident) {
+            texture->m_layer = source.layer;
+            texture->m_isTopDown = source.isTopDown;
+        }
+        source.textures.push_back(texture);
+    }
+    duplicate.textures.clear();
+    duplicate.levels = 0;
+    duplicate.isResident = true;
+    
+    m_duplicates++;
+    for (const QByteArray & level : upload.image.levels)
+        m_duplicateSize += level.size();
+    return true;
+}
+
+
+void TextureManager::setLayer(Stream & stream, 
+                              const TextureArrays::Layer & layer) {
+    stream.layer = layer;
+    for (Texture * texture : stream.textures) {
+        texture->m_layer = layer;
+        texture->m_isTopDown = stream.isTopDown;
+    }
+}
+
+
+QByteArray TextureManager::hash(const CompressedTextureLoader::Image & image) {
+    QCryptographicHash sha1(QCryptographicHash::Sha1);
+    const quint32 header[4] = {
+        image.format, static_cast<quint32>(image.width), 
+        static_cast<quint32>(image.height), 
+        static_cast<quint32>(image.isTopDown)
+    };
+    sha1.addData(reinterpret_cast<const char *>(header), sizeof(header));
+    for (const QByteArray & level : image.levels)
+        sha1.addData(level);
+    return sha1.result();
+}
+
+
+GLsizeiptr TextureManager::residentSize(const Stream & stream, 
+                                        GLsizei level) {
+    GLsizeiptr size = 0;
+    for (; level < stream.levels; level++) {
+        size += CompressedTextureLoader::levelSize(
+            stream.format, std::max(1, stream.width >> level), 
+            std::max(1, stream.height >> level)
+        );
+    }
+    return size;
+}
+
+
+GLsizei TextureManager::coarsestLevel(const Stream & stream) {
+    GLsizei level = 0;
+    while (level + 1 < stream.levels &&
+           std::max(stream.width, stream.height) >> (level + 1) >= MIN_SIZE)
+        level++;
+    return level;
+}
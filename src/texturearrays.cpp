@@ -0,0 +1,397 @@
+#include "../include/texturearrays.h"
+#include "../include/openglfunctions.h"
+
+#include <QDebug>
+#include <QOpenGLContext>
+#include <algorithm>
+#include <cmath>
+
+// Number of layers of a new array
+static constexpr GLsizei INITIAL_CAPACITY = 4;
+
+std::list<std::unique_ptr<TextureArrays::Array>> TextureArrays::m_arrays;
+
+/***
+ *      _______               _                      
+ *     |__   __|             | |                     
+ *        | |     ___ __  __ | |_  _   _  _ __   ___ 
+ *        | |    / _ \\ \/ / | __|| | | || '__| / _ \
+ *        | |   |  __/ >  <  | |_ | |_| || |   |  __/
+ *        |_|    \___|/_/\_\  \__| \__,_||_|    \___|
+ *                                                   
+ *                                                   
+ *                                              
+ *         /\                                   
+ *        /  \    _ __  _ __   __ _  _   _  ___ 
+ *       / /\ \  | '__|| '__| / _` || | | |/ __|
+ *      / ____ \ | |   | |   | (_| || |_| |\__ \
+ *     /_/    \_\|_|   |_|    \__,_| \__, ||___/
+ *                                    __/ |     
+ *                                   |___/      
+ */
+
+TextureArrays::Layer TextureArrays::allocate(const QImage & image) {
+    if (image.isNull())
+        return Layer();
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (!gl)
+        return Layer();
+    
+    // The grayscale images only need one channel, OpenGL expects the first
+    // row at the bottom
+    const bool isGrayscale = image.isGrayscale() && !image.hasAlphaChannel();
+    const QImage data = image.mirrored().convertToFormat(
+        isGrayscale ? QImage::Format_Grayscale8 : QImage::Format_RGBA8888
+    );
+    const GLenum format = isGrayscale ? GL_R8 : GL_RGBA8;
+    const GLsizei levels = 1 + static_cast<GLsizei>(
+        std::floor(std::log2(std::max(data.width(), data.height())))
+    );
+    Array * array = findArray(gl, format, data.width(), data.height(), levels,
+                              false);
+    const GLint layer = takeLayer(*array);
+    
+    // Copy the image and its mipmaps, the rows of QImage are aligned on 4
+    // bytes like the default unpack alignment
+    const GLenum pixelFormat = isGrayscale ? GL_RED : GL_RGBA;
+    for (GLsizei level = 0; level < array->levels; level++) {
+        const int width = std::max(1, data.width() >> level);
+        const int height = std::max(1, data.height() >> level);
+        const QImage mipmap = level == 0 ? data : data.scaled(
+            width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation
+        );
+        gl->glTextureSubImage3D(
+            array->texture, level, 0, 0, layer, width, height, 1, 
+            pixelFormat, GL_UNSIGNED_BYTE, mipmap.constBits()
+        );
+    }
+    
+    Layer result;
+    result.array = array;
+    result.layer = layer;
+    return result;
+}
+
+
+TextureArrays::Layer TextureArrays::allocate(
+    const CompressedTextureLoader::Image & image
+) {
+    if (image.isNull() || !isSupported(image.format))
+        return Layer();
+    const Layer layer = reserve(
+        image.format, image.width, image.height, 
+        static_cast<GLsizei>(image.levels.size())
+    );
+    for (size_t level = 0; level < image.levels.size(); level++) {
+        upload(layer, static_cast<GLsizei>(level), 
+               image.levels[level].constData(), image.levels[level].size());
+    }
+    return layer;
+}
+
+
+bool TextureArrays::isSupported(GLenum format) {
+    // S3TC is not part of the core profile
+    const bool isS3tc = 
+        format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ||
+        format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT ||
+        format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT ||
+        format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    return context && (!isS3tc || 
+        context->hasExtension("GL_EXT_texture_compression_s3tc"));
+}
+
+
+TextureArrays::Layer TextureArrays::reserve(
+    GLenum format, GLsizei width, GLsizei height, GLsizei levels, 
+    bool isStreamed
+) {
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (!gl)
+        return Layer();
+    Array * array = findArray(gl, format, width, height, levels, isStreamed);
+    
+    Layer result;
+    result.array = array;
+    result.layer = takeLayer(*array);
+    return result;
+}
+
+
+GLsizeiptr TextureArrays::getReserveSize(
+    GLenum format, GLsizei width, GLsizei height, GLsizei levels
+) {
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (!gl)
+        return 0;
+    GLint maxLayers = 0;
+    gl->glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    GLsizeiptr layerSize = 0;
+    for (GLsizei level = 0; level < levels; level++) {
+        layerSize += CompressedTextureLoader::levelSize(
+            format, std::max(1, width >> level), std::max(1, height >> level)
+        );
+    }
+    
+    // Same choice as findArray()
+    for (const auto & array : m_arrays) {
+        if (!array->isStreamed || array->format != format || 
+            array->width != width || array->height != height || 
+            array->levels != levels)
+            continue;
+        if (!array->freeLayers.empty() || array->size < array->capacity)
+            return 0;
+        if (array->capacity < maxLayers) {
+            return (std::min(2 * array->capacity, 
+                             static_cast<GLsizei>(maxLayers)) - 
+                    array->capacity) * layerSize;
+        }
+    }
+    return std::min(INITIAL_CAPACITY, static_cast<GLsizei>(maxLayers)) * 
+        layerSize;
+}
+
+
+GLsizeiptr TextureArrays::getStreamedSize() {
+    GLsizeiptr size = 0;
+    for (const auto & array : m_arrays) {
+        if (array->isStreamed)
+            size += array->capacity * array->layerSize;
+    }
+    return size;
+}
+
+
+void TextureArrays::copy(const Layer & source, GLsizei firstLevel,
+                         const Layer & destination) {
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (!gl || !source.array || !destination.array)
+        return;
+    const Array & array = *destination.array;
+    for (GLsizei level = 0; level < array.levels; level++) {
+        gl->glCopyImageSubData(
+            source.array->texture, GL_TEXTURE_2D_ARRAY, firstLevel + level, 
+            0, 0, source.layer,
+            array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, destination.layer,
+            std::max(1, array.width >> level), 
+            std::max(1, array.height >> level), 1
+        );
+    }
+}
+
+
+void TextureArrays::release(const Layer & layer) {
+    auto it = std::find_if(
+        m_arrays.begin(), m_arrays.end(), 
+        [&layer](const std::unique_ptr<Array> & array) {
+            return array.get() == layer.array;
+        }
+    );
+    if (it == m_arrays.end())
+        return;
+    Array & array = **it;
+    array.freeLayers.push_back(layer.layer);
+    
+    // The memory of an array is given back once all its layers are free
+    if (static_cast<GLsizei>(array.freeLayers.size()) == array.size) {
+        QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+        if (gl)
+            gl->glDeleteTextures(1, &array.texture);
+        m_arrays.erase(it);
+    }
+}
+
+
+std::vector<GLint> TextureArrays::compact(const Array * array) {
+    auto it = std::find_if(
+        m_arrays.begin(), m_arrays.end(), 
+        [array](const std::unique_ptr<Array> & other) {
+            return other.get() == array;
+        }
+    );
+    if (it == m_arrays.end() || !(*it)->isStreamed)
+        return std::vector<GLint>();
+    Array & compacted = **it;
+    
+    // Halve the capacity while the used layers fill at most a quarter of it,
+    // so the array is half full afterwards and does not grow back at once
+    const GLsizei used = compacted.size - 
+        static_cast<GLsizei>(compacted.freeLayers.size());
+    GLsizei capacity = compacted.capacity;
+    while (capacity > INITIAL_CAPACITY && 4 * used <= capacity)
+        capacity /= 2;
+    if (capacity == compacted.capacity)
+        return std::vector<GLint>();
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (!gl)
+        return std::vector<GLint>();
+    
+    // Copy the used layers in order to the first layers of the new storage
+    std::vector<GLint> layers(static_cast<size_t>(compacted.size), 0);
+    for (GLint layer : compacted.freeLayers)
+        layers[static_cast<size_t>(layer)] = -1;
+    const GLuint texture = createStorage(gl, compacted, capacity);
+    GLint next = 0;
+    for (GLint layer = 0; layer < compacted.size; layer++) {
+        if (layers[static_cast<size_t>(layer)] < 0)
+            continue;
+        for (GLsizei level = 0; level < compacted.levels; level++) {
+            gl->glCopyImageSubData(
+                compacted.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+                texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, next,
+                std::max(1, compacted.width >> level), 
+                std::max(1, compacted.height >> level), 1
+            );
+        }
+        layers[static_cast<size_t>(layer)] = next++;
+    }
+    gl->glDeleteTextures(1, &compacted.texture);
+    compacted.texture = texture;
+    compacted.capacity = capacity;
+    compacted.size = used;
+    compacted.freeLayers.clear();
+    return layers;
+}
+
+
+void TextureArrays::upload(const Layer & layer, GLsizei level, 
+                           const void * data, GLsizei size) {
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (!gl || !layer.array)
+        return;
+    const Array & array = *layer.array;
+    const GLsizei width = std::max(1, array.width >> level);
+    const GLsizei height = std::max(1, array.height >> level);
+    
+    // The rows of the uncompressed levels (baked files) are not padded
+    if (array.format == GL_RGBA8 || array.format == GL_R8) {
+        gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        gl->glTextureSubImage3D(
+            array.texture, level, 0, 0, layer.layer, width, height, 1, 
+            array.format == GL_R8 ? GL_RED : GL_RGBA, GL_UNSIGNED_BYTE, data
+        );
+        gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    else {
+        gl->glCompressedTextureSubImage3D(
+            array.texture, level, 0, 0, layer.layer, width, height, 1, 
+            array.format, size, data
+        );
+    }
+}
+
+
+void TextureArrays::bind(QOpenGLFunctions_4_5_Core * gl, const Array * array,
+                         GLuint unit) {
+    if (array)
+        gl->glBindTextureUnit(unit, array->texture);
+}
+
+
+void TextureArrays::cleanUp() {
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (context) {
+        QOpenGLFunctions_4_5_Core * gl = 
+            context->versionFunctions<QOpenGLFunctions_4_5_Core>();
+        if (gl && gl->initializeOpenGLFunctions()) {
+            for (const auto & array : m_arrays)
+                gl->glDeleteTextures(1, &array->texture);
+        }
+    }
+    m_arrays.clear();
+}
+
+
+TextureArrays::Array * TextureArrays::findArray(
+    QOpenGLFunctions_4_5_Core * gl, GLenum format, GLsizei width, 
+    GLsizei height, GLsizei levels, bool isStreamed
+) {
+    GLint maxLayers = 0;
+    gl->glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    
+    // Use an array of the same size and format with a free or unused layer, or
+    // one that can still grow
+    for (const auto & array : m_arrays) {
+        if (array->isStreamed != isStreamed || array->format != format || 
+            array->width != width || array->height != height || 
+            array->levels != levels)
+            continue;
+        if (!array->freeLayers.empty() || array->size < array->capacity)
+            return array.get();
+        if (array->capacity < maxLayers) {
+            resize(gl, *array, std::min(2 * array->capacity, 
+                                        static_cast<GLsizei>(maxLayers)));
+            return array.get();
+        }
+    }
+    
+    // Create a new array
+    m_arrays.push_back(std::make_unique<Array>());
+    Array & array = *m_arrays.back();
+    array.format = format;
+    array.width = width;
+    array.height = height;
+    array.levels = levels;
+    array.isStreamed = isStreamed;
+    for (GLsizei level = 0; level < levels; level++) {
+        array.layerSize += CompressedTextureLoader::levelSize(
+            format, std::max(1, width >> level), std::max(1, height >> level)
+        );
+    }
+    resize(gl, array, std::min(INITIAL_CAPACITY, 
+                               static_cast<GLsizei>(maxLayers)));
+    return &array;
+}
+
+
+GLint TextureArrays::takeLayer(Array & array) {
+    if (array.freeLayers.empty())
+        return array.size++;
+    const GLint layer = array.freeLayers.back();
+    array.freeLayers.pop_back();
+    return layer;
+}
+
+
+void TextureArrays::resize(
+    QOpenGLFunctions_4_5_Core * gl, Array & array, GLsizei capacity
+) {
+    const GLuint texture = createStorage(gl, array, capacity);
+    
+    // Copy the used layers of every level
+    if (array.texture != 0) {
+        for (GLsizei level = 0; level < array.levels && array.size > 0; 
+             level++) {
+            gl->glCopyImageSubData(
+                array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                std::max(1, array.width >> level), 
+                std::max(1, array.height >> level), array.size
+            );
+        }
+        gl->glDeleteTextures(1, &array.texture);
+    }
+    array.texture = texture;
+    array.capacity = capacity;
+}
+
+
+GLuint TextureArrays::createStorage(
+    QOpenGLFunctions_4_5_Core * gl, const Array & array, GLsizei capacity
+) {
+    GLuint texture = 0;
+    gl->glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+    gl->glTextureStorage3D(texture, array.levels, array.format, array.width,
+                           array.height, capacity);
+    gl->glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, 
+                            GL_LINEAR_MIPMAP_LINEAR);
+    gl->glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl->glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    gl->glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    if (array.format == GL_R8 || array.format == GL_COMPRESSED_RED_RGTC1) {
+        const GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        gl->glTextureParameteriv(texture, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+    return texture;
+}
@@ -0,0 +1,148 @@
+#include "../include/textureatlas.h"
+#include "../include/openglfunctions.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+std::vector<TextureAtlas::Atlas> TextureAtlas::m_atlases;
+
+/***
+ *      _______               _                      
+ *     |__   __|             | |                     
+ *        | |     ___ __  __ | |_  _   _  _ __   ___ 
+ *        | |    / _ \\ \/ / | __|| | | || '__| / _ \
+ *        | |   |  __/ >  <  | |_ | |_| || |   |  __/
+ *        |_|    \___|/_/\_\  \__| \__,_||_|    \___|
+ *                                                   
+ *                                                   
+ *                _    _             
+ *         /\    | |  | |            
+ *        /  \   | |_ | |  __ _  ___ 
+ *       / /\ \  | __|| | / _` |/ __|
+ *      / ____ \ | |_ | || (_| |\__ \
+ *     /_/    \_\ \__||_| \__,_||___/
+ *                                   
+ *                                   
+ */
+
+bool TextureAtlas::isPackable(const CompressedTextureLoader::Image & image) {
+    const GLsizei alignment = 1 << (LEVELS - 1);
+    return (image.format == GL_RGBA8 || image.format == GL_R8) &&
+        image.width <= MAX_TILE_SIZE && image.height <= MAX_TILE_SIZE &&
+        image.width % alignment == 0 && image.height % alignment == 0 &&
+        static_cast<GLsizei>(image.levels.size()) >= LEVELS;
+}
+
+
+TextureArrays::Layer TextureAtlas::allocate(
+    const CompressedTextureLoader::Image & image
+) {
+    if (!isPackable(image))
+        return TextureArrays::Layer();
+    QOpenGLFunctions_4_5_Core * gl = OpenGLFunctions::get();
+    if (!gl)
+        return TextureArrays::Layer();
+    
+    GLsizei x = 0;
+    GLsizei y = 0;
+    Atlas * atlas = findRoom(image.format, image.width + 2 * GUTTER, 
+                             image.height + 2 * GUTTER, x, y);
+    if (atlas == nullptr)
+        return TextureArrays::Layer();
+    
+    // Copy each level with its gutter, the positions and the sizes of the
+    // tile are divided exactly by two at each level
+    const GLsizei pixelSize = image.format == GL_R8 ? 1 : 4;
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (GLsizei level = 0; level < LEVELS; level++) {
+        const GLsizei width = image.width >> level;
+        const GLsizei height = image.height >> level;
+        const GLsizei gutter = GUTTER >> level;
+        const QByteArray tile = addGutter(
+            image.levels[level], width, height, pixelSize, gutter
+        );
+        gl->glTextureSubImage3D(
+            atlas->layer.array->texture, level, x >> level, y >> level, 
+            atlas->layer.layer, width + 2 * gutter, height + 2 * gutter, 1,
+            image.format == GL_R8 ? GL_RED : GL_RGBA, GL_UNSIGNED_BYTE, 
+            tile.constData()
+        );
+    }
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    
+    TextureArrays::Layer result = atlas->layer;
+    result.rect[0] = static_cast<GLfloat>(x + GUTTER) / SIZE;
+    result.rect[1] = static_cast<GLfloat>(y + GUTTER) / SIZE;
+    result.rect[2] = static_cast<GLfloat>(image.width) / SIZE;
+    result.rect[3] = static_cast<GLfloat>(image.height) / SIZE;
+    return result;
+}
+
+
+void TextureAtlas::cleanUp() {
+    m_atlases.clear();
+}
+
+
+TextureAtlas::Atlas * TextureAtlas::findRoom(
+    GLenum format, GLsizei width, GLsizei height, GLsizei & x, GLsizei & y
+) {
+    for (Atlas & atlas : m_atlases) {
+        if (atlas.layer.array->format != format)
+            continue;
+        
+        // Use a shelf of the same height with room left, or a new shelf
+        for (Shelf & shelf : atlas.shelves) {
+            if (shelf.height == height && shelf.width + width <= SIZE) {
+                x = shelf.width;
+                y = shelf.y;
+                shelf.width += width;
+                return &atlas;
+            }
+        }
+        if (atlas.height + height <= SIZE) {
+            atlas.shelves.push_back(Shelf{atlas.height, height, width});
+            x = 0;
+            y = atlas.height;
+            atlas.height += height;
+            return &atlas;
+        }
+    }
+    
+    // Create a new atlas, i.e. a layer of an array of the atlas size
+    Atlas atlas;
+    atlas.layer = TextureArrays::reserve(format, SIZE, SIZE, LEVELS);
+    if (atlas.layer.array == nullptr)
+        return nullptr;
+    atlas.shelves.push_back(Shelf{0, height, width});
+    atlas.height = height;
+    m_atlases.push_back(atlas);
+    x = 0;
+    y = 0;
+    return &m_atlases.back();
+}
+
+
+QByteArray TextureAtlas::addGutter(
+    const QByteArray & level, GLsizei width, GLsizei height, 
+    GLsizei pixelSize, GLsizei gutter
+) {
+    const GLsizei tileWidth = width + 2 * gutter;
+    const GLsizei tileHeight = height + 2 * gutter;
+    QByteArray tile(tileWidth * tileHeight * pixelSize, 0);
+    const char * source = level.constData();
+    char * destination = tile.data();
+    for (GLsizei j = 0; j < tileHeight; j++) {
+        // Row of the level wrapped around the tile
+        const GLsizei row = ((j - gutter) % height + height) % height;
+        for (GLsizei i = 0; i < tileWidth; i++) {
+            const GLsizei column = ((i - gutter) % width + width) % width;
+            std::memcpy(
+                destination + (j * tileWidth + i) * pixelSize,
+                source + (row * width + column) * pixelSize, pixelSize
+            );
+        }
+    }
+    return tile;
+}
@@ -0,0 +1,517 @@
+#include "../include/texturebaker.h"
+
+#include <QDebug>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTransform>
+#include <QtEndian>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+// Suffixes of the images baked by findImages()
+static const QStringList IMAGE_SUFFIXES = {"jpg", "jpeg", "png", "bmp", "tga"};
+
+// Identifier of the KTX2 files
+static const char KTX2_IDENTIFIER[12] = {
+    '\xAB', 'K', 'T', 'X', ' ', '2', '0', '\xBB', '\r', '\n', '\x1A', '\n'
+};
+
+/**
+ * @brief Append a little-endian integer to an array.
+ */
+template <class T>
+static void append(QByteArray & data, T value) {
+    char bytes[sizeof(T)];
+    qToLittleEndian<T>(value, bytes);
+    data.append(bytes, sizeof(T));
+}
+
+/**
+ * @brief Convert a color to RGB 5:6:5.
+ */
+static quint16 toRgb565(const int color[3]) {
+    return static_cast<quint16>(
+        (color[0] * 31 + 127) / 255 << 11 | 
+        (color[1] * 63 + 127) / 255 << 5 | 
+        (color[2] * 31 + 127) / 255
+    );
+}
+
+/**
+ * @brief Convert a color from RGB 5:6:5.
+ */
+static void fromRgb565(quint16 value, int color[3]) {
+    const int r = value >> 11 & 31;
+    const int g = value >> 5 & 63;
+    const int b = value & 31;
+    color[0] = r << 3 | r >> 2;
+    color[1] = g << 2 | g >> 4;
+    color[2] = b << 3 | b >> 2;
+}
+
+/***
+ *      _______               _                      
+ *     |__   __|             | |                     
+ *        | |     ___ __  __ | |_  _   _  _ __   ___ 
+ *        | |    / _ \\ \/ / | __|| | | || '__| / _ \
+ *        | |   |  __/ >  <  | |_ | |_| || |   |  __/
+ *        |_|    \___|/_/\_\  \__| \__,_||_|    \___|
+ *                                                   
+ *                                                   
+ *      ____          _                 
+ *     |  _ \        | |                
+ *     | |_) |  __ _ | | __   ___  _ __ 
+ *     |  _ <  / _` || |/ /  / _ \| '__|
+ *     | |_) || (_| ||   <  |  __/| |   
+ *     |____/  \__,_||_|\_\  \___||_|   
+ *                                      
+ *                                      
+ */
+
+std::vector<TextureBaker::Job> TextureBaker::findImages(
+    const QString & directory
+) {
+    std::vector<Job> jobs;
+    QDirIterator it(directory, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        if (IMAGE_SUFFIXES.contains(QFileInfo(path).suffix().toLower()))
+            jobs.push_back(Job{path, false, true, 0});
+    }
+    return jobs;
+}
+
+
+bool TextureBaker::bake(const std::vector<Job> & jobs, bool compress) {
+    // The threads take the next image until all the images are baked
+    std::atomic<size_t> next(0);
+    std::atomic<bool> success(true);
+    auto worker = [&]() {
+        for (size_t i = next++; i < jobs.size(); i = next++) {
+            if (!bakeImage(jobs[i], compress))
+                success = false;
+        }
+    };
+    
+    const size_t numThreads = std::max<size_t>(1, std::min<size_t>(
+        std::thread::hardware_concurrency(), jobs.size()
+    ));
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numThreads; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread & thread : threads)
+        thread.join();
+    return success;
+}
+
+
+QString TextureBaker::bakedPath(const QString & source) {
+    return source + ".ktx2";
+}
+
+
+bool TextureBaker::isBaked(const QString & source) {
+    const QFileInfo baked(bakedPath(source));
+    return baked.exists() && 
+           baked.lastModified() >= QFileInfo(source).lastModified();
+}
+
+
+bool TextureBaker::load(const Job & job, 
+                        CompressedTextureLoader::Image & image,
+                        bool generateMipmaps) {
+    if (isBaked(job.source) && 
+        CompressedTextureLoader::load(bakedPath(job.source), image))
+        return true;
+    
+    QImage level = decode(job);
+    image = CompressedTextureLoader::Image();
+    if (level.isNull())
+        return false;
+    image.format = level.format() == QImage::Format_Grayscale8 ? 
+        GL_R8 : GL_RGBA8;
+    image.width = level.width();
+    image.height = level.height();
+    image.levels.push_back(packPixels(level));
+    while (generateMipmaps && (level.width() > 1 || level.height() > 1)) {
+        level = downsample(level);
+        image.levels.push_back(packPixels(level));
+    }
+    return true;
+}
+
+
+QImage TextureBaker::decode(const Job & job) {
+    QImage image(job.source);
+    if (image.isNull())
+        return image;
+    image = image.mirrored(job.mirrorHorizontally, job.mirrorVertically);
+    if (job.rotation != 0) {
+        QTransform rotation;
+        rotation.rotate(job.rotation);
+        image = image.transformed(rotation);
+    }
+    
+    // The grayscale images only need one channel
+    if (image.isGrayscale() && !image.hasAlphaChannel())
+        return image.convertToFormat(QImage::Format_Grayscale8);
+    return image.convertToFormat(QImage::Format_RGBA8888);
+}
+
+
+bool TextureBaker::bakeImage(const Job & job, bool compress) {
+    QImage level = decode(job);
+    if (level.isNull()) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "The image" << job.source << "cannot be decoded.";
+        return false;
+    }
+    
+    // Format of the baked file, BC1 does not store the alpha channel
+    CompressedTextureLoader::Image image;
+    const bool isGrayscale = level.format() == QImage::Format_Grayscale8;
+    if (!compress)
+        image.format = isGrayscale ? GL_R8 : GL_RGBA8;
+    else if (isGrayscale)
+        image.format = GL_COMPRESSED_RED_RGTC1;
+    else if (hasTransparency(level))
+        image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    else
+        image.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    image.width = level.width();
+    image.height = level.height();
+    
+    // Mipmaps down to 1x1
+    while (true) {
+        image.levels.push_back(
+            compress ? TextureBaker::compress(image.format, level) : 
+                       packPixels(level)
+        );
+        if (level.width() == 1 && level.height() == 1)
+            break;
+        level = downsample(level);
+    }
+    
+    if (!write(bakedPath(job.source), image)) {
+        qWarning() << __FILE__ << __LINE__ <<
+            "The baked file of" << job.source << "cannot be written.";
+        return false;
+    }
+    return true;
+}
+
+
+QImage TextureBaker::downsample(const QImage & image) {
+    const int width = std::max(1, image.width() / 2);
+    const int height = std::max(1, image.height() / 2);
+    const int channels = image.format() == QImage::Format_Grayscale8 ? 1 : 4;
+    QImage result(width, height, image.format());
+    
+    // Average the 2x2 pixels of the image covered by a pixel of the result,
+    // the last row or column is repeated if the size is odd
+    for (int y = 0; y < height; y++) {
+        const uchar * row0 = image.constScanLine(std::min(2 * y, 
+                                                          image.height() - 1));
+        const uchar * row1 = image.constScanLine(std::min(2 * y + 1, 
+                                                          image.height() - 1));
+        uchar * target = result.scanLine(y);
+        for (int x = 0; x < width; x++) {
+            const int x0 = std::min(2 * x, image.width() - 1) * channels;
+            const int x1 = std::min(2 * x + 1, image.width() - 1) * channels;
+            for (int c = 0; c < channels; c++) {
+                target[x * channels + c] = static_cast<uchar>(
+                    (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + 
+                     row1[x1 + c] + 2) / 4
+                );
+            }
+        }
+    }
+    return result;
+}
+
+
+bool TextureBaker::hasTransparency(const QImage & image) {
+    if (!image.hasAlphaChannel())
+        return false;
+    for (int y = 0; y < image.height(); y++) {
+        const uchar * row = image.constScanLine(y);
+        for (int x = 0; x < image.width(); x++) {
+            if (row[4 * x + 3] != 255)
+                return true;
+        }
+    }
+    return false;
+}
+
+
+QByteArray TextureBaker::packPixels(const QImage & image) {
+    const int rowSize = image.width() * 
+        (image.format() == QImage::Format_Grayscale8 ? 1 : 4);
+    QByteArray data;
+    data.reserve(rowSize * image.height());
+    for (int y = 0; y < image.height(); y++) {
+        data.append(reinterpret_cast<const char *>(image.constScanLine(y)), 
+                    rowSize);
+    }
+    return data;
+}
+
+
+QByteArray TextureBaker::compress(GLenum format, const QImage & image) {
+    const int blocksX = (image.width() + 3) / 4;
+    const int blocksY = (image.height() + 3) / 4;
+    const bool isGrayscale = format == GL_COMPRESSED_RED_RGTC1;
+    const int blockSize = format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 16 : 8;
+    QByteArray data(blocksX * blocksY * blockSize, '\0');
+    uchar * block = reinterpret_cast<uchar *>(data.data());
+    
+    for (int by = 0; by < blocksY; by++) {
+        for (int bx = 0; bx < blocksX; bx++, block += blockSize) {
+            // Pixels of the block, the last row or column of the image is
+            // repeated if the block is outside the image
+            uchar rgba[64];
+            uchar alpha[16];
+            for (int i = 0; i < 16; i++) {
+                const int x = std::min(4 * bx + i % 4, image.width() - 1);
+                const int y = std::min(4 * by + i / 4, image.height() - 1);
+                const uchar * pixel = image.constScanLine(y) + 
+                                      x * (isGrayscale ? 1 : 4);
+                if (isGrayscale) {
+                    alpha[i] = pixel[0];
+                }
+                else {
+                    std::memcpy(rgba + 4 * i, pixel, 4);
+                    alpha[i] = pixel[3];
+                }
+            }
+            
+            if (isGrayscale) {
+                encodeChannelBlock(alpha, block);
+            }
+            else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+                encodeChannelBlock(alpha, block);
+                encodeColorBlock(rgba, block + 8);
+            }
+            else {
+                encodeColorBlock(rgba, block);
+            }
+        }
+    }
+    return data;
+}
+
+
+void TextureBaker::encodeColorBlock(const uchar rgba[64], uchar * block) {
+    // Endpoints: the bounding box of the colors, inset by 1/16 to reduce the
+    // error of the interpolated colors
+    int minColor[3] = {255, 255, 255};
+    int maxColor[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            minColor[c] = std::min<int>(minColor[c], rgba[4 * i + c]);
+            maxColor[c] = std::max<int>(maxColor[c], rgba[4 * i + c]);
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        const int inset = (maxColor[c] - minColor[c]) / 16;
+        minColor[c] += inset;
+        maxColor[c] -= inset;
+    }
+    quint16 color0 = toRgb565(maxColor);
+    quint16 color1 = toRgb565(minColor);
+    
+    // The four color mode requires color0 > color1
+    quint32 indices = 0;
+    if (color0 < color1)
+        std::swap(color0, color1);
+    if (color0 != color1) {
+        int palette[4][3];
+        fromRgb565(color0, palette[0]);
+        fromRgb565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            int bestError = -1;
+            for (int j = 0; j < 4; j++) {
+                int error = 0;
+                for (int c = 0; c < 3; c++) {
+                    const int d = rgba[4 * i + c] - palette[j][c];
+                    error += d * d;
+                }
+                if (bestError < 0 || error < bestError) {
+                    best = j;
+                    bestError = error;
+                }
+            }
+            indices |= static_cast<quint32>(best) << (2 * i);
+        }
+    }
+    
+    qToLittleEndian<quint16>(color0, block);
+    qToLittleEndian<quint16>(color1, block + 2);
+    qToLittleEndian<quint32>(indices, block + 4);
+}
+
+
+void TextureBaker::encodeChannelBlock(const uchar values[16], uchar * block) {
+    const uchar value0 = *std::max_element(values, values + 16);
+    const uchar value1 = *std::min_element(values, values + 16);
+    
+    // Eight value mode (value0 > value1): the endpoints and six interpolated
+    // values
+    quint64 indices = 0;
+    if (value0 != value1) {
+        int palette[8] = {value0, value1};
+        for (int j = 1; j < 7; j++)
+            palette[j + 1] = ((7 - j) * value0 + j * value1) / 7;
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            for (int j = 1; j < 8; j++) {
+                if (std::abs(values[i] - palette[j]) < 
+                    std::abs(values[i] - palette[best]))
+                    best = j;
+            }
+            indices |= static_cast<quint64>(best) << (3 * i);
+        }
+    }
+    
+    block[0] = value0;
+    block[1] = value1;
+    for (int i = 0; i < 6; i++)
+        block[2 + i] = static_cast<uchar>(indices >> (8 * i));
+}
+
+
+bool TextureBaker::write(const QString & path,
+                         const CompressedTextureLoader::Image & image) {
+    // Vulkan format, color model, size of a block, alignment of the levels
+    // and samples (bit offset, bit length - 1, channel) of the format
+    struct Sample {quint16 offset; quint8 length; quint8 channel;};
+    quint32 vkFormat = 0;
+    quint8 model = 1;  // KHR_DF_MODEL_RGBSDA
+    quint8 blockSize = 0;
+    int alignment = 4;
+    bool isCompressed = true;
+    std::vector<Sample> samples;
+    switch (image.format) {
+        case GL_RGBA8:
+            vkFormat = 37;
+            blockSize = 4;
+            isCompressed = false;
+            samples = {{0, 7, 0}, {8, 7, 1}, {16, 7, 2}, {24, 7, 15}};
+            break;
+        case GL_R8:
+            vkFormat = 9;
+            blockSize = 1;
+            isCompressed = false;
+            samples = {{0, 7, 0}};
+            break;
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+            vkFormat = 131;
+            model = 128;   // KHR_DF_MODEL_BC1A
+            blockSize = 8;
+            alignment = 8;
+            samples = {{0, 63, 0}};
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            vkFormat = 137;
+            model = 130;   // KHR_DF_MODEL_BC3
+            blockSize = 16;
+            alignment = 16;
+            samples = {{0, 63, 15}, {64, 63, 0}};
+            break;
+        case GL_COMPRESSED_RED_RGTC1:
+            vkFormat = 139;
+            model = 131;   // KHR_DF_MODEL_BC4
+            blockSize = 8;
+            alignment = 8;
+            samples = {{0, 63, 0}};
+            break;
+        default:
+            return false;
+    }
+    const quint32 numLevels = static_cast<quint32>(image.levels.size());
+    
+    // Data format descriptor: a basic descriptor block
+    QByteArray dfd;
+    const quint16 blockLength = static_cast<quint16>(24 + 16 * samples.size());
+    append<quint32>(dfd, 4 + blockLength);
+    append<quint32>(dfd, 0);            // Vendor, descriptor type
+    append<quint16>(dfd, 2);            // Version
+    append<quint16>(dfd, blockLength);
+    dfd.append(static_cast<char>(model));
+    dfd.append(char(1));                // BT.709 primaries
+    dfd.append(char(1));                // Linear transfer function
+    dfd.append(char(0));                // Straight alpha
+    const char blockDimension = isCompressed ? 3 : 0;
+    dfd.append(QByteArray(2, blockDimension)).append(QByteArray(2, '\0'));
+    dfd.append(static_cast<char>(blockSize)).append(QByteArray(7, '\0'));
+    for (const Sample & sample : samples) {
+        append<quint16>(dfd, sample.offset);
+        dfd.append(static_cast<char>(sample.length));
+        dfd.append(static_cast<char>(sample.channel));
+        append<quint32>(dfd, 0);        // Sample position
+        append<quint32>(dfd, 0);        // Lower value
+        append<quint32>(dfd, isCompressed ? 0xFFFFFFFF : 0xFF);
+    }
+    
+    // Key/value data: the rows are stored from the bottom
+    QByteArray kvd;
+    const QByteArray orientation("KTXorientation\0ru", 18);
+    append<quint32>(kvd, orientation.size());
+    kvd.append(orientation);
+    kvd.append(QByteArray((4 - kvd.size() % 4) % 4, '\0'));
+    
+    // Levels, stored from the smallest
+    const quint32 dfdOffset = 80 + 24 * numLevels;
+    const quint32 kvdOffset = dfdOffset + dfd.size();
+    std::vector<quint64> offsets(numLevels);
+    quint64 offset = kvdOffset + kvd.size();
+    for (quint32 i = numLevels; i-- > 0;) {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        offsets[i] = offset;
+        offset += image.levels[i].size();
+    }
+    
+    QByteArray data(KTX2_IDENTIFIER, 12);
+    append<quint32>(data, vkFormat);
+    append<quint32>(data, 1);           // Type size
+    append<quint32>(data, image.width);
+    append<quint32>(data, image.height);
+    append<quint32>(data, 0);           // Depth
+    append<quint32>(data, 0);           // Layers
+    append<quint32>(data, 1);           // Faces
+    append<quint32>(data, numLevels);
+    append<quint32>(data, 0);           // Supercompression
+    append<quint32>(data, dfdOffset);
+    append<quint32>(data, dfd.size());
+    append<quint32>(data, kvdOffset);
+    append<quint32>(data, kvd.size());
+    append<quint64>(data, 0);           // Supercompression global data
+    append<quint64>(data, 0);
+    for (quint32 i = 0; i < numLevels; i++) {
+        append<quint64>(data, offsets[i]);
+        append<quint64>(data, image.levels[i].size());
+        append<quint64>(data, image.levels[i].size());
+    }
+    data.append(dfd).append(kvd);
+    for (quint32 i = numLevels; i-- > 0;) {
+        data.append(QByteArray(static_cast<int>(offsets[i]) - data.size(), 
+                               '\0'));
+        data.append(image.levels[i]);
+    }
+    
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || 
+        file.write(data) != data.size())
+        return false;
+    return file.commit();
+}
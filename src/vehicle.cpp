@@ -231,33 +231,14 @@ void VehicleGraphics::updateMatrices(const VehiclePosition vehiclePosition) {
     m_wheelRLMatrix.rotate(wheelRLSpin*180/PI, 0,-1, 0);
     m_wheelRRMatrix.rotate(wheelRRSpin*180/PI, 0, 1, 0);
     
-    // Compute model matrices to draw the force arrows
-    m_forceFLMatrix = getForceModelMatrix(
-        forceFL, wheelFL, chassis, QVector3D( 1, 0.5,0)
-    );
-    m_forceFRMatrix = getForceModelMatrix(
-        forceFR, wheelFR, chassis, QVector3D( 1,-0.5,0)
-    );
-    m_forceRLMatrix = getForceModelMatrix(
-        forceRL, wheelRL, chassis, QVector3D(-1.2, 0.5,0)
-                       );
-    m_forceRRMatrix = getForceModelMatrix(
-        forceRR, wheelRR, chassis, QVector3D(-1.2,-0.5,0)
-    );
-}
-
-
-QMatrix4x4 VehicleGraphics::getForceModelMatrix(const QVector3D & force,
-                                                const Position & wheelPos,
-                                                const Position & chassisPos,
-                                                const QVector3D & offset) {
-    QMatrix4x4 modelMatrix;
-    modelMatrix.setToIdentity();
-    modelMatrix.translate(wheelPos.x, wheelPos.y, wheelPos.z);
-    modelMatrix.rotate(chassisPos.yaw *180/PI,0,0,1);
-    modelMatrix.translate(offset);
-    modelMatrix.scale(force / FORCE_SCALE);
-    return modelMatrix;
+    // Save the raw tire forces, the arrows are computed on the GPU
+    m_chassisYaw = chassis.yaw;
+    m_tireForces = {{
+        {wheelFL.getPoint(), QVector3D( 1.0f, 0.5f, 0.0f), forceFL},
+        {wheelFR.getPoint(), QVector3D( 1.0f,-0.5f, 0.0f), forceFR},
+        {wheelRL.getPoint(), QVector3D(-1.2f, 0.5f, 0.0f), forceRL},
+        {wheelRR.getPoint(), QVector3D(-1.2f,-0.5f, 0.0f), forceRR}
+    }};
 }
 
 
@@ -281,20 +262,12 @@ void VehicleGraphics::render(
         p_chassisModel->setModelMatrix(m_chassisMatrix);
         p_chassisModel->render(light, view, projection, lightSpace, cascades);
     }
-    if (p_forceLine != nullptr && m_showTireForce) {
-        p_forceLine->setModelMatrix(m_forceFLMatrix);
-        p_forceLine->render(light, view, projection, lightSpace, cascades);
-        p_forceLine->setModelMatrix(m_forceFRMatrix);
-        p_forceLine->render(light, view, projection, lightSpace, cascades);
-        p_forceLine->setModelMatrix(m_forceRLMatrix);
-        p_forceLine->render(light, view, projection, lightSpace, cascades);
-        p_forceLine->setModelMatrix(m_forceRRMatrix);
-        p_forceLine->render(light, view, projection, lightSpace, cascades);
-    }
 }
 
 
-void VehicleGraphics::renderShadow(const QMatrix4x4 & lightSpace) {
+void VehicleGraphics::renderShadow(
+    const std::array<QMatrix4x4,NUM_CASCADES> & lightSpace
+) {
     if (p_wheelModel != nullptr) {
         p_wheelModel->setModelMatrix(m_wheelFLMatrix);
         p_wheelModel->renderShadow(lightSpace);
@@ -312,6 +285,18 @@ void VehicleGraphics::renderShadow(const QMatrix4x4 & lightSpace) {
 }
 
 
+void VehicleGraphics::renderTireForces(LineBatch & lines) const {
+    if (!m_showTireForce)
+        return;
+    for (const TireForce & tire : m_tireForces) {
+        lines.addVector(
+            tire.wheel, m_chassisYaw, tire.offset, tire.force, 
+            1.0f / FORCE_SCALE, QVector3D(0.0f, 0.0f, 1.0f)
+        );
+    }
+}
+
+
 
 /***
  *     __      __  _     _      _       
@@ -333,7 +318,6 @@ void VehicleGraphics::renderShadow(const QMatrix4x4 & lightSpace) {
 #include <QXmlSchema>
 #include <QXmlSchemaValidator>
 #include "../include/object.h"
-#include "../include/line.h"
 
 bool VehicleBuilder::build() {
     // Get data
@@ -412,25 +396,8 @@ bool VehicleBuilder::build() {
         );
     }
     
-    // Load line
-    ABCObject * line = nullptr;
-    line = ObjectManager::loadObject(
-        "line", 
-        std::make_unique<Line>(
-            // Vertices
-            QVector<QVector3D>({
-                QVector3D(0, 0, 0), QVector3D(1, 0, 0), 
-                QVector3D(0, 1, 0), QVector3D(0, 0, 1)}
-            ),
-            // Indices
-            QVector<unsigned int>({0, 1, 0, 2, 0, 3}), 
-            // Color
-            QVector3D(0.0f, 0.0f, 1.0f)
-        )
-    );
-    
     // Create the vehicle
-    p_vehicle = std::make_unique<Vehicle>(chassis, wheel, line, trajectory);
+    p_vehicle = std::make_unique<Vehicle>(chassis, wheel, trajectory);
     
     return true;
 }
@@ -0,0 +1,204 @@
+#include "../include/vertexformat.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+// Largest texture coordinate stored as a half float: the precision of half 
+// floats in [1,2) is 1/1024, i.e. one texel of a 1024x1024 texture
+static constexpr float HALF_TEXTURE_UV_RANGE = 2.0f;
+
+bool VertexFormat::isHalfTextureUV(const QVector<float> & textureUV) {
+    for (int i = 0; i < textureUV.size(); i++) {
+        if (std::abs(textureUV.at(i)) > HALF_TEXTURE_UV_RANGE)
+            return false;
+    }
+    return true;
+}
+
+
+QByteArray VertexFormat::interleave(
+    const QVector<float> & vertices, const QVector<float> & normals,
+    const QVector<float> & textureUV, const QVector<float> & tangents,
+    const QVector<float> & bitangents, bool halfTextureUV
+) {
+    const int numVertices = vertices.size() / 3;
+    const int size = stride(halfTextureUV);
+    QByteArray data(numVertices * size, '\0');
+    for (int v = 0; v < numVertices; v++) {
+        char * vertex = data.data() + v * size;
+        
+        // Position
+        std::memcpy(
+            vertex + POSITION_OFFSET, vertices.constData() + 3 * v, 
+            3 * sizeof(float)
+        );
+        
+        // Normal
+        QVector3D normal(normals.at(3*v), normals.at(3*v+1), normals.at(3*v+2));
+        qint16 encoded[4] = {0, 0, 0, 0};
+        octEncode(normal, encoded);
+        std::memcpy(vertex + NORMAL_OFFSET, encoded, 2 * sizeof(qint16));
+        
+        // Tangent and handedness of the tangent space
+        QVector3D tangent(
+            tangents.at(3*v), tangents.at(3*v+1), tangents.at(3*v+2)
+        );
+        QVector3D bitangent(
+            bitangents.at(3*v), bitangents.at(3*v+1), bitangents.at(3*v+2)
+        );
+        octEncode(tangent, encoded);
+        encoded[2] = QVector3D::dotProduct(
+            QVector3D::crossProduct(normal, tangent), bitangent
+        ) < 0.0f ? -32767 : 32767;
+        std::memcpy(vertex + TANGENT_OFFSET, encoded, 4 * sizeof(qint16));
+        
+        // Texture coordinates
+        float uv[2] = {0.0f, 0.0f};
+        if (2 * v + 1 < textureUV.size()) {
+            uv[0] = textureUV.at(2*v);
+            uv[1] = textureUV.at(2*v+1);
+        }
+        if (halfTextureUV) {
+            quint16 half[2] = {toHalf(uv[0]), toHalf(uv[1])};
+            std::memcpy(vertex + TEXTURE_UV_OFFSET, half, sizeof(half));
+        }
+        else {
+            std::memcpy(vertex + TEXTURE_UV_OFFSET, uv, sizeof(uv));
+        }
+    }
+    return data;
+}
+
+
+void VertexFormat::decode(
+    const char * vertex, bool halfTextureUV, QVector3D & normal, 
+    QVector3D & tangent, QVector3D & bitangent, float textureUV[2]
+) {
+    qint16 encoded[4];
+    std::memcpy(encoded, vertex + NORMAL_OFFSET, 2 * sizeof(qint16));
+    normal = octDecode(encoded);
+    std::memcpy(encoded, vertex + TANGENT_OFFSET, 4 * sizeof(qint16));
+    tangent = octDecode(encoded);
+    bitangent = QVector3D::crossProduct(normal, tangent) * 
+        (encoded[2] < 0 ? -1.0f : 1.0f);
+    
+    if (halfTextureUV) {
+        quint16 half[2];
+        std::memcpy(half, vertex + TEXTURE_UV_OFFSET, sizeof(half));
+        textureUV[0] = fromHalf(half[0]);
+        textureUV[1] = fromHalf(half[1]);
+    }
+    else {
+        std::memcpy(textureUV, vertex + TEXTURE_UV_OFFSET, 2 * sizeof(float));
+    }
+}
+
+
+void VertexFormat::octEncode(const QVector3D & vector, qint16 encoded[2]) {
+    // Project on the octahedron |x| + |y| + |z| = 1
+    const float norm = 
+        std::abs(vector.x()) + std::abs(vector.y()) + std::abs(vector.z());
+    if (norm == 0.0f) {
+        encoded[0] = 0;
+        encoded[1] = 0;
+        return;
+    }
+    float x = vector.x() / norm;
+    float y = vector.y() / norm;
+    
+    // Fold the lower hemisphere over the diagonals
+    if (vector.z() < 0.0f) {
+        const float u = x;
+        x = (1.0f - std::abs(y)) * (u >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - std::abs(u)) * (y >= 0.0f ? 1.0f : -1.0f);
+    }
+    encoded[0] = static_cast<qint16>(
+        std::round(std::max(-1.0f, std::min(x, 1.0f)) * 32767.0f)
+    );
+    encoded[1] = static_cast<qint16>(
+        std::round(std::max(-1.0f, std::min(y, 1.0f)) * 32767.0f)
+    );
+}
+
+
+quint16 VertexFormat::toHalf(float value) {
+    quint32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const quint16 sign = static_cast<quint16>((bits >> 16) & 0x8000);
+    const int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+    quint32 mantissa = bits & 0x7fffff;
+    
+    // Too large: infinity
+    if (exponent >= 31)
+        return sign | 0x7c00;
+    
+    // Too small: subnormal half float or zero
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        const int shift = 14 - exponent;
+        quint32 half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1)
+            half++;
+        return sign | static_cast<quint16>(half);
+    }
+    
+    // Normal half float, rounded to the nearest (a carry increments the 
+    // exponent as expected)
+    quint32 half = (static_cast<quint32>(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000)
+        half++;
+    return sign | static_cast<quint16>(half);
+}
+
+
+QVector3D VertexFormat::octDecode(const qint16 encoded[2]) {
+    float x = std::max(-1.0f, encoded[0] / 32767.0f);
+    float y = std::max(-1.0f, encoded[1] / 32767.0f);
+    const float z = 1.0f - std::abs(x) - std::abs(y);
+    
+    // Unfold the lower hemisphere
+    if (z < 0.0f) {
+        const float u = x;
+        x = (1.0f - std::abs(y)) * (u >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - std::abs(u)) * (y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return QVector3D(x, y, z).normalized();
+}
+
+
+float VertexFormat::fromHalf(quint16 half) {
+    const quint32 sign = static_cast<quint32>(half & 0x8000) << 16;
+    const int exponent = (half >> 10) & 0x1f;
+    quint32 mantissa = half & 0x3ff;
+    quint32 bits;
+    
+    // Infinity or NaN
+    if (exponent == 31) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    // Zero or subnormal half float, normalized as a float
+    else if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        }
+        else {
+            int shift = 0;
+            while ((mantissa & 0x400) == 0) {
+                mantissa <<= 1;
+                shift++;
+            }
+            bits = sign | (static_cast<quint32>(113 - shift) << 23) | 
+                ((mantissa & 0x3ff) << 13);
+        }
+    }
+    else {
+        bits = sign | (static_cast<quint32>(exponent + 112) << 23) | 
+            (mantissa << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}